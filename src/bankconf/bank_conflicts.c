@@ -43,6 +43,11 @@
 #define LWS_Y 16
 /** Default stride. */
 #define STRIDE 1
+/** Seed for input data. */
+#define DATA_SEED 0
+/** Range of input data values. */
+#define DATA_MIN -100
+#define DATA_MAX 100
 
 /** A description of the program. */
 #define PROG_DESCRIPTION "Program for testing bank conflicts on the GPU"
@@ -52,8 +57,9 @@ static size_t gws[] = {GWS_X, GWS_Y};
 static size_t lws[] = {LWS_X, LWS_Y};
 static gchar* compiler_opts = NULL;
 static gboolean dev_list = FALSE;
-static int dev_idx = -1;
+static gchar* device = NULL;
 static int stride = STRIDE;
+static gboolean fill_dev = FALSE;
 static gboolean version;
 
 /* Callback functions to parse gws and lws. */
@@ -82,13 +88,18 @@ static GOptionEntry entries[] = {
 	{"stride",     's', 0, G_OPTION_ARG_INT,      &stride,
 		"Stride (default is " G_STRINGIFY(STRIDE) ")",
 		"STRIDE"},
+	{"fill",       'f', 0, G_OPTION_ARG_NONE,     &fill_dev,
+		"Generate input data on the device (otherwise it is generated " \
+		"on the host and copied to the device)",
+		NULL},
 	{"list",      'i', 0, G_OPTION_ARG_NONE,      &dev_list,
 		"List available devices (selectable with -d) and exit",
 		NULL},
-	{"device",     'd', 0, G_OPTION_ARG_INT,      &dev_idx,
-		"Device index (if not given and more than one device is "\
-		"available, chose device from menu)",
-		"INDEX"},
+	{"device",     'd', 0, G_OPTION_ARG_STRING,   &device,
+		"Device index, or one of menu, first, gpu, cpu, accel or "\
+		"fastest (if not given, use $CCL_EX_DEVICE or chose device "\
+		"from menu)",
+		"INDEX|SELECTOR"},
 	{"version",     0,  0, G_OPTION_ARG_NONE,     &version,
 		"Output version information and exit",
 		NULL},
@@ -125,8 +136,15 @@ int main(int argc, char *argv[]) {
 	CCLProf* prof = NULL;
 	/* Context wrapper. */
 	CCLContext* ctx = NULL;
+	/* Device requirements. */
+	CCLExDevReqs dev_reqs = { FALSE, FALSE, 0, CCL_EX_WORKLOAD_MEMORY,
+		NULL };
+	/* Device wrapper. */
+	CCLDevice* dev = NULL;
 	/* Program wrapper. */
 	CCLProgram* prg = NULL;
+	/* Kernel wrapper. */
+	CCLKernel* krnl = NULL;
 	/* Command queue wrapper. */
 	CCLQueue* cq = NULL;
 	/* Data in device. */
@@ -139,10 +157,14 @@ int main(int argc, char *argv[]) {
 	size_t size_data_in_bytes;
 	/* Size of local memory required. */
 	size_t local_mem_size_in_bytes;
+	/* OpenCL compiler options. */
+	gchar* build_opts = NULL;
 	/* Command line options context. */
 	GOptionContext* opt_ctx = NULL;
 	/* Random number generator. */
 	GRand* rng = NULL;
+	/* Device input generator. */
+	CCLExFill* fill = NULL;
 
 	/* ************************** */
 	/* Parse command line options */
@@ -175,14 +197,20 @@ int main(int argc, char *argv[]) {
 	/* Initialize profiler, OpenCL variables and build program */
 	/* ******************************************************* */
 
+	/* Report memory footprint at exit, for this problem size. */
+	ccl_ex_footprint_report_at_exit(argv[0], stdout);
+	ccl_ex_footprint_param("gws_x", gws[0]);
+	ccl_ex_footprint_param("gws_y", gws[1]);
+
 	/* Initialize RNG. */
 	rng = g_rand_new_with_seed(0);
 
 	/* Initialize profiling object. */
 	prof = ccl_prof_new();
 
-	/* Create a GPU context. */
-	ctx = ccl_context_new_from_menu_full(&dev_idx, &err);
+	/* Create a context with a device which has enough local memory. */
+	dev_reqs.local_mem = lws[1] * lws[0] * sizeof(cl_int);
+	ctx = ccl_ex_context_new(device, &dev_reqs, &err);
 	if_err_goto(err, error_handler);
 
 	/* Get location of kernel file, which should be in the same location
@@ -193,44 +221,69 @@ int main(int argc, char *argv[]) {
 	prg = ccl_program_new_from_source_file(ctx, kernel_path, &err);
 	if_err_goto(err, error_handler);
 
-	/* Build program. */
-	status = ccl_program_build(prg, compiler_opts, &err);
+	/* Build program, with 64-bit indexes if required by data size. */
+	size_data_in_bytes = gws[0] * gws[1] * sizeof(cl_int);
+	build_opts = ccl_ex_compiler_opts_get(compiler_opts, size_data_in_bytes);
+	status = ccl_program_build(prg, build_opts, &err);
+	if_err_goto(err, error_handler);
+
+	/* Get kernel. */
+	krnl = ccl_program_get_kernel(prg, "bankconf", &err);
+	if_err_goto(err, error_handler);
+
+	/* Get device in context. */
+	dev = ccl_context_get_device(ctx, 0, &err);
 	if_err_goto(err, error_handler);
 
 	/* Create a command queue. */
-	cq = ccl_queue_new(ctx, NULL, CL_QUEUE_PROFILING_ENABLE, &err);
+	cq = ccl_queue_new(ctx, dev, CL_QUEUE_PROFILING_ENABLE, &err);
 	if_err_goto(err, error_handler);
 
 	/* Start basic timming / profiling. */
 	ccl_prof_start(prof);
 
-	/* Allocate data in host */
-	size_data_in_bytes = gws[0] * gws[1] * sizeof(cl_int);
-	data_host = (cl_int*) g_malloc(size_data_in_bytes);
-
 	/* Allocate data in device */
-	buf_data_dev = ccl_buffer_new(ctx, CL_MEM_READ_WRITE,
+	buf_data_dev = ccl_ex_footprint_buffer_new(ctx, CL_MEM_READ_WRITE,
 		size_data_in_bytes, NULL, &err);
 	if_err_goto(err, error_handler);
 
-	/* Copy data from host to device. */
-	ccl_buffer_enqueue_write(buf_data_dev, cq, CL_TRUE, 0, size_data_in_bytes,
-		data_host, NULL, &err);
-	if_err_goto(err, error_handler);
+	if (fill_dev) {
+
+		/* Generate data on the device. */
+		fill = ccl_ex_fill_new(ctx, argv[0], &err);
+		if_err_goto(err, error_handler);
+		ccl_ex_fill_int(fill, cq, buf_data_dev, gws[0] * gws[1],
+			DATA_SEED, DATA_MIN, DATA_MAX, &err);
+		if_err_goto(err, error_handler);
+
+	} else {
+
+		/* Generate data in host, with the same values. */
+		data_host = (cl_int*) ccl_ex_hugemem_alloc(size_data_in_bytes);
+		ccl_ex_fill_int_host(data_host, gws[0] * gws[1],
+			DATA_SEED, DATA_MIN, DATA_MAX);
+
+		/* Copy data from host to device. */
+		ccl_buffer_enqueue_write(buf_data_dev, cq, CL_TRUE, 0,
+			size_data_in_bytes, data_host, NULL, &err);
+		if_err_goto(err, error_handler);
+	}
 
 	/* ************************************************** */
 	/* Determine and print required memory and work sizes */
 	/* ************************************************** */
 
 	local_mem_size_in_bytes = lws[1] * lws[0] * sizeof(cl_int);
-	ccl_ex_reqs_print(gws, lws, size_data_in_bytes, local_mem_size_in_bytes);
+	ccl_ex_reqs_analyze(krnl, dev, 2, gws, lws, size_data_in_bytes,
+		local_mem_size_in_bytes, &err);
+	if_err_goto(err, error_handler);
 
 	/* ************************************ */
 	/*  Set kernel arguments and run kernel */
 	/* ************************************ */
 
-	ccl_program_enqueue_kernel(
-		prg, "bankconf", cq, 2, NULL, gws, lws, NULL, &err,
+	ccl_kernel_set_args_and_enqueue_ndrange(
+		krnl, cq, 2, NULL, gws, lws, NULL, &err,
 		buf_data_dev, ccl_arg_local(lws[1] * lws[0], cl_int),
 		ccl_arg_priv(stride, cl_uint), NULL);
 	if_err_goto(err, error_handler);
@@ -278,6 +331,8 @@ cleanup:
 	/* Free command line variables. */
 	if (opt_ctx) g_option_context_free(opt_ctx);
 	if (compiler_opts) g_free(compiler_opts);
+	if (build_opts) g_free(build_opts);
+	if (device) g_free(device);
 
 	/* Free RNG */
 	if (rng != NULL) g_rand_free(rng);
@@ -286,13 +341,14 @@ cleanup:
 	if (prof) ccl_prof_destroy(prof);
 
 	/* Free wrappers. */
-	if (buf_data_dev) ccl_buffer_destroy(buf_data_dev);
+	if (fill) ccl_ex_fill_destroy(fill);
+	if (buf_data_dev) ccl_ex_footprint_buffer_destroy(buf_data_dev);
 	if (cq) ccl_queue_destroy(cq);
 	if (prg) ccl_program_destroy(prg);
 	if (ctx) ccl_context_destroy(ctx);
 
 	/* Free host resources */
-	if (data_host) g_free(data_host);
+	if (data_host) ccl_ex_hugemem_free(data_host);
 
 	/* Free kernel path. */
 	if (kernel_path) g_free(kernel_path);
@@ -25,6 +25,14 @@
  * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
  * */
 
+/* Type of global indexes. The host defines IDX64 when the buffer is
+ * larger than 4 GiB. */
+#ifdef IDX64
+typedef ulong idx_t;
+#else
+typedef uint idx_t;
+#endif
+
 /**
  * Kernel for testing bank conflicts.
  *
@@ -36,14 +44,14 @@ __kernel void bankconf(__global int* globalData, __local int* localData,
 	__private uint stride) {
 
 	/* Data position for this work-item */
-	uint gRow = get_global_id(1);
-	uint gCol = get_global_id(0);
+	idx_t gRow = get_global_id(1);
+	idx_t gCol = get_global_id(0);
 	uint lRow = get_local_id(1);
 	uint lCol = get_local_id(0);
-	uint gTotCols = get_global_size(0);
+	idx_t gTotCols = get_global_size(0);
 	uint lTotCols = get_local_size(0);
 	uint lTotElems = get_local_size(0) * get_local_size(1);
-	uint gIndex = gRow * gTotCols + gCol;
+	idx_t gIndex = gRow * gTotCols + gCol;
 	uint lIndex = lRow * lTotCols + lCol;
 
 	/* Copy to local memory */
@@ -29,5 +29,8 @@
 #define _CCL_EXAMPLES_BANKCONFLICTS_H_
 
 #include "examples_common.h"
+#include "examples_fill.h"
+#include "examples_hugemem.h"
+#include "examples_footprint.h"
 
 #endif
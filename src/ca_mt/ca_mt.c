@@ -26,10 +26,41 @@
  * A series of images will be saved in the folder where this program
  * runs.
  *
- * The program accepts two command-line arguments:
+ * The program accepts ten command-line arguments:
  *
- * 1. Device index
+ * 1. Device index, or one of `menu`, `first`, `gpu`, `cpu`, `accel` or
+ *    `fastest` (default is `$CCL_EX_DEVICE` or `menu`); only devices
+ *    with image support are considered
  * 2. RNG seed
+ * 3. Auto-tune local work size (0 - no, 1 - use cached result if
+ *    available, 2 - tune again)
+ * 4. Generate initial state on the device (0 - no, 1 - yes); the state
+ *    is the same as the one generated on the host for a given seed
+ * 5. CPU sets of the communications and execution threads, as
+ *    `COMM:EXEC`, e.g. `0-1:2-3` (empty sets mean no pinning)
+ * 6. Place simulation results on the NUMA node of the communications
+ *    thread (0 - no, 1 - yes)
+ * 7. File where to save work-group records of the last iteration, which
+ *    enables in-kernel instrumentation (see `instr_view`; empty for no
+ *    instrumentation)
+ * 8. Profiling sample period (1 - profile all iterations, N - profile
+ *    every Nth iteration, -N - profile a random sample of one in N
+ *    iterations); unsampled iterations run on queues without profiling,
+ *    and their events are released immediately
+ * 9. File where to capture the OpenCL command stream, for replaying with
+ *    `cmd_replay` (the stream is captured without instrumentation, and
+ *    an initial state generated on the device is not part of it; empty
+ *    for no capture)
+ * 10. Soak run, as `DURATION[:WINDOW]` (e.g. `12h:5m`; a duration of 0
+ *    runs until `Ctrl+C`): instead of CA_ITERS iterations, the CA runs
+ *    for the given duration, logging throughput, latency percentiles,
+ *    RSS and events held by the queues every window, and flagging
+ *    windows which degrade with respect to the first one; only the last
+ *    CA_ITERS + 1 states are kept, and no images are saved
+ *
+ * If the `CCL_EX_PERFCTR` environment variable is set, hardware counters
+ * of PNG encoding (IPC, cache, branch and dTLB miss rates) are shown
+ * after the profiling summary.
  *
  * @author Nuno Fachada
  * @date 2019
@@ -40,6 +71,20 @@
 #include <stdio.h>
 #include <cf4ocl2.h>
 #include "examples_common.h"
+#include "examples_bufpool.h"
+#include "examples_tuner.h"
+#include "examples_fill.h"
+#include "examples_hugemem.h"
+#include "examples_footprint.h"
+#include "examples_instr.h"
+#include "examples_sampprof.h"
+#include "examples_capture.h"
+#include "examples_soak.h"
+#include "examples_perfctr.h"
+#include "cp_affinity.h"
+#ifdef WITH_SPSC_RING
+#include "spsc_ring.h"
+#endif
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
@@ -59,8 +104,17 @@ struct thread_data {
 	size_t* gws;
 	size_t* lws;
 	cl_uchar4** output_images;
+	size_t output_size;
+	int numa_touch;
+	CCLExInstr* instr;
+	CCLExSampProf* sp;
+	CCLExCapture* cap;
 };
 
+/* CPU sets of communications and execution threads. */
+static cp_cpuset_t cpus_comm;
+static cp_cpuset_t cpus_exec;
+
 /* Origin of sim space. */
 static size_t origin[3] = { 0, 0, 0 };
 /* Region of sim space. */
@@ -72,17 +126,106 @@ static size_t real_ws[] = { CA_WIDTH, CA_HEIGHT };
 static int go_msg = 1;
 static int stop_msg = 0;
 
-/* Threads communication queues. */
-static GAsyncQueue* comm_thread_queue;
-static GAsyncQueue* exec_thread_queue;
-static GAsyncQueue* host_thread_queue;
-
-/* OpenCL queues. */
+/* Threads communication queues. The host thread gets events from the
+ * comms and exec threads through separate queues, so that each queue has
+ * a single producer and a single consumer. */
+#ifdef WITH_SPSC_RING
+typedef spsc_ring_t* msg_queue_t;
+#define msg_queue_push(q, m) spsc_ring_push((q), (m))
+#define msg_queue_pop(q) spsc_ring_pop(q)
+static spsc_ring_t rings[4];
+#else
+typedef GAsyncQueue* msg_queue_t;
+#define msg_queue_push(q, m) g_async_queue_push((q), (m))
+#define msg_queue_pop(q) g_async_queue_pop(q)
+#endif
+static msg_queue_t comm_thread_queue;
+static msg_queue_t exec_thread_queue;
+static msg_queue_t host_comm_queue;
+static msg_queue_t host_exec_queue;
+
+/* OpenCL queues, and queues without profiling for unsampled iterations
+ * (only with sampled profiling). */
 static CCLQueue* queue_exec;
 static CCLQueue* queue_comm;
+static CCLQueue* queue_exec_noprof = NULL;
+static CCLQueue* queue_comm_noprof = NULL;
+
+/* Queue where the given iteration runs. */
+static CCLQueue* iter_queue(CCLExSampProf* sp, guint iter,
+	CCLQueue* cq, CCLQueue* cq_noprof) {
+
+	return (sp && !ccl_ex_sampprof_is_sampled(sp, iter)) ? cq_noprof : cq;
+}
+
+/* Kernel files, instrumentation macros first. */
+static char* kernel_files[] = { CCL_EX_INSTR_KERNEL_FILE, "ca_mt.cl" };
+
+/* Names of the per-group counters of the instrumented kernel. */
+static const char* const instr_counters[] = { "cells", "alive", NULL };
 
-/* Kernel file. */
-static char* kernel_files[] = { "ca_mt.cl" };
+/* Number of timed kernel runs for each auto-tuner configuration. */
+#define TUNE_REPS 3
+
+/* Data passed to the auto-tuner timing callback. */
+struct tune_data {
+	CCLKernel* krnl;
+	CCLQueue* cq;
+	CCLImage* img1;
+	CCLImage* img2;
+	size_t krnl_wg_max;
+};
+
+/* Auto-tuner timing callback: time the CA kernel with the local work
+ * size given in `config`. */
+static double tune_timer(const int* config, void* data, GError** err) {
+
+	struct tune_data* td = (struct tune_data*) data;
+	size_t lws[2] = { config[0], config[1] }, gws[2];
+	CCLEvent* evt;
+	CCLEventWaitList ewl = NULL;
+	GError* err_internal = NULL;
+	cl_ulong tstart, tend;
+	double t_best = -1;
+
+	/* Skip configurations which don't fit the kernel. */
+	if (lws[0] * lws[1] > td->krnl_wg_max) return -1;
+
+	/* Global work size must be a multiple of local work size. */
+	for (int i = 0; i < 2; ++i)
+		gws[i] = ((real_ws[i] + lws[i] - 1) / lws[i]) * lws[i];
+
+	for (int r = 0; r < TUNE_REPS; ++r) {
+
+		evt = ccl_kernel_set_args_and_enqueue_ndrange(
+			td->krnl, td->cq, 2, NULL, gws, lws, NULL, &err_internal,
+			td->img1, td->img2, NULL);
+		if (err_internal != NULL) {
+			/* Runtime rejected configuration, consider it invalid. */
+			g_clear_error(&err_internal);
+			return -1;
+		}
+		ccl_event_wait_list_add(&ewl, evt, NULL);
+		ccl_event_wait(&ewl, &err_internal);
+		if (err_internal) break;
+
+		tstart = ccl_event_get_profiling_info_scalar(
+			evt, CL_PROFILING_COMMAND_START, cl_ulong, &err_internal);
+		if (err_internal) break;
+		tend = ccl_event_get_profiling_info_scalar(
+			evt, CL_PROFILING_COMMAND_END, cl_ulong, &err_internal);
+		if (err_internal) break;
+
+		if ((t_best < 0) || ((tend - tstart) * 1e-9 < t_best))
+			t_best = (tend - tstart) * 1e-9;
+	}
+
+	if (err_internal) {
+		g_propagate_error(err, err_internal);
+		return -1;
+	}
+	return t_best;
+}
 
 /* Communications function thread. */
 static gpointer comm_func(gpointer data) {
@@ -93,8 +236,8 @@ static gpointer comm_func(gpointer data) {
 	CCLImage* img2 = td->img2;
 	CCLImage* img_aux;
 
-	/* Initialize output images index. */
-	int i = 0;
+	/* Initialize iteration, which is unbounded in a soak run. */
+	guint i = 0;
 
 	/* Comms event. */
 	CCLEvent* evt_comm;
@@ -102,17 +245,33 @@ static gpointer comm_func(gpointer data) {
 	/* Error reporting. */
 	GError* err = NULL;
 
+	/* Pin thread to its CPU set, if any. */
+	cp_affinity_set(&cpus_comm);
+
+	/* If simulation results could not be placed on a specific node,
+	 * place them on the node of this thread by touching them first. */
+	if (td->numa_touch)
+		cp_numa_touch(td->output_images[0], td->output_size);
+
 	/* Keep thread alive until host thread says otherwise. */
-	while(*((int*) g_async_queue_pop(comm_thread_queue)) == go_msg) {
+	while(*((int*) msg_queue_pop(comm_thread_queue)) == go_msg) {
 
 		/* Read result of last iteration. On first run it is the initial
-		 * state. */
-		evt_comm = ccl_image_enqueue_read(img1, queue_comm, CL_FALSE,
-			origin, region, 0, 0, td->output_images[i], NULL, &err);
+		 * state. Soak runs keep only the last CA_ITERS + 1 states. */
+		evt_comm = ccl_image_enqueue_read(img1,
+			iter_queue(td->sp, i, queue_comm, queue_comm_noprof),
+			CL_FALSE, origin, region, 0, 0,
+			td->output_images[i % (CA_ITERS + 1)], NULL, &err);
 		HANDLE_ERROR(err);
 
+		/* Capture read before the host thread waits for it. */
+		if (td->cap)
+			ccl_ex_capture_read(td->cap, evt_comm,
+				iter_queue(td->sp, i, queue_comm, queue_comm_noprof),
+				img1, CL_FALSE, origin, region, NULL);
+
 		/* Send event to host thread. */
-		g_async_queue_push(host_thread_queue, evt_comm);
+		msg_queue_push(host_comm_queue, evt_comm);
 
 		/* Swap buffers. */
 		img_aux = img1;
@@ -140,20 +299,47 @@ static gpointer exec_func(gpointer data) {
 	/* Execution event. */
 	CCLEvent* evt_exec;
 
+	/* Iteration and its queue. */
+	guint i = 0;
+	CCLQueue* cq;
+
 	/* Error reporting. */
 	GError* err = NULL;
 
+	/* Pin thread to its CPU set, if any. */
+	cp_affinity_set(&cpus_exec);
+
 	/* Keep thread alive until host thread says otherwise. */
-	while(*((int*) g_async_queue_pop(exec_thread_queue)) == go_msg) {
+	while(*((int*) msg_queue_pop(exec_thread_queue)) == go_msg) {
+
+		/* Only profile sampled iterations. */
+		cq = iter_queue(td->sp, i, queue_exec, queue_exec_noprof);
+
+		/* Only keep work-group records of this iteration. The buffer
+		 * reset waits for the previous iteration. */
+		if (td->instr) {
+			ccl_ex_instr_prepare(td->instr, td->krnl, cq, 2,
+				td->gws, td->lws, &err);
+			HANDLE_ERROR(err);
+		}
 
 		/* Execute kernel. */
 		evt_exec = ccl_kernel_set_args_and_enqueue_ndrange(
-			td->krnl, queue_exec, 2, NULL, td->gws, td->lws, NULL, &err,
+			td->krnl, cq, 2, NULL, td->gws, td->lws, NULL, &err,
 			img1, img2, NULL);
 		HANDLE_ERROR(err);
+		i++;
+
+		/* Capture launch before the host thread waits for it. */
+		if (td->cap) {
+			ccl_ex_capture_arg_mem(td->cap, td->krnl, 0, img1);
+			ccl_ex_capture_arg_mem(td->cap, td->krnl, 1, img2);
+			ccl_ex_capture_kernel(td->cap, evt_exec, cq, td->krnl, 2,
+				td->gws, td->lws, NULL);
+		}
 
 		/* Send event to host thread. */
-		g_async_queue_push(host_thread_queue, evt_exec);
+		msg_queue_push(host_exec_queue, evt_exec);
 
 		/* Swap buffers. */
 		img_aux = img1;
@@ -187,7 +373,10 @@ int main(int argc, char* argv[]) {
 	/* Output images filename. */
 	char* filename;
 	/* Selected device, may be given in command line. */
-	int dev_idx = -1;
+	const char* device = NULL;
+	/* Device requirements. */
+	CCLExDevReqs dev_reqs = { TRUE, FALSE, 0, CCL_EX_WORKLOAD_MEMORY,
+		NULL };
 	/* Error handling object (must be NULL). */
 	GError* err = NULL;
 	/* Does selected device support images? */
@@ -196,16 +385,52 @@ int main(int argc, char* argv[]) {
 	cl_uchar4* input_image;
 	/* Simulation states. */
 	cl_uchar4** output_images;
+	/* Size of simulation states, which are contiguous in memory. */
+	size_t output_size;
+	/* Place simulation states on the node of the comms thread? May be
+	 * given in command line. */
+	int numa_place = 0, numa_touch;
 	/* RNG seed, may be given in command line. */
 	unsigned int seed;
+	/* Auto-tune mode, may be given in command line. */
+	int tune = 0;
+	/* Generate initial state on device? May be given in command line. */
+	int gen_dev = 0;
+	/* Device input generator. */
+	CCLExFill* fill = NULL;
 	/* Image file write status. */
 	int file_write_status;
 	/* Image format. */
 	cl_image_format image_format = { CL_RGBA, CL_UNSIGNED_INT8 };
 	/* Thread data. */
 	struct thread_data td;
-	/* Full kernel path. */
-	gchar* kernel_path = NULL;
+	/* Full paths of kernel files. */
+	gchar* kernel_paths[G_N_ELEMENTS(kernel_files)] = { NULL };
+	/* File where to save work-group records, may be given in command
+	 * line, enabling in-kernel instrumentation. */
+	char* instr_file = NULL;
+	/* In-kernel instrumentation. */
+	CCLExInstr* instr = NULL;
+	/* Device memory pool. */
+	CCLExBufPool* pool;
+	/* Profiling sample period, may be given in command line. */
+	int sample = 1;
+	/* Sampled profiling, if requested. */
+	CCLExSampProf* sp = NULL;
+	/* Command-stream capture, if requested. */
+	CCLExCapture* cap = NULL;
+	/* Soak run, if requested. */
+	CCLExSoak* soak = NULL;
+	/* Should the soak run go on? */
+	gboolean more;
+	/* Hardware counters of PNG encoding, if requested. */
+	CCLExPerfCtr* pc = NULL;
+	/* Number of iterations run. */
+	guint iters;
+	/* Initial state write event. */
+	CCLEvent* evt_write;
+	/* Start of current iteration. */
+	gint64 t_iter;
 
 	/* Global and local worksizes. */
 	size_t gws[2];
@@ -217,7 +442,7 @@ int main(int argc, char* argv[]) {
 	/* Check arguments. */
 	if (argc >= 2) {
 		/* Check if a device was specified in the command line. */
-		dev_idx = atoi(argv[1]);
+		device = argv[1];
 	}
 	if (argc >= 3) {
 		/* Check if a RNG seed was specified. */
@@ -225,27 +450,75 @@ int main(int argc, char* argv[]) {
 	} else {
 		seed = (unsigned int) time(NULL);
 	}
+	if (argc >= 4) {
+		/* Check if auto-tuning was requested. */
+		tune = atoi(argv[3]);
+	}
+	if (argc >= 5) {
+		/* Check if initial state should be generated on the device. */
+		gen_dev = atoi(argv[4]);
+	}
+	if (argc >= 6) {
+		/* Check if CPU sets for the threads were specified. */
+		if (cp_affinity_parse_pair(argv[5], &cpus_comm, &cpus_exec) != 0)
+			ERROR_MSG_AND_EXIT("Invalid CPU sets.");
+	}
+	if (argc >= 7) {
+		/* Check if NUMA placement of simulation states was requested. */
+		numa_place = atoi(argv[6]);
+	}
+	if ((argc >= 8) && (*argv[7] != '\0')) {
+		/* Check if in-kernel instrumentation was requested. */
+		instr_file = argv[7];
+	}
+	if (argc >= 9) {
+		/* Check if only a sample of the iterations should be
+		 * profiled. */
+		sample = atoi(argv[8]);
+		if (sample == 0)
+			ERROR_MSG_AND_EXIT("Invalid profiling sample period.");
+	}
+	if ((argc >= 10) && (*argv[9] != '\0')) {
+		/* Check if the command stream should be captured. */
+		cap = ccl_ex_capture_new(argv[9], &err);
+		HANDLE_ERROR(err);
+	}
+	if (argc >= 11) {
+		/* Check if a soak run was requested. */
+		soak = ccl_ex_soak_new(argv[10], "cells", stdout, &err);
+		HANDLE_ERROR(err);
+	}
 
-	/* Initialize RNG. */
-	srand(seed);
-
-	/* Create random initial state. */
-	input_image = (cl_uchar4*)
-		malloc(CA_WIDTH * CA_HEIGHT * sizeof(cl_uchar4));
-	for (cl_uint i = 0; i < CA_WIDTH * CA_HEIGHT; ++i) {
-		cl_uchar state = (rand() & 0x3) ? 0xFF : 0x00;
-		input_image[i] = (cl_uchar4) {{ state, state, state, 0xFF }};
+	/* Report memory footprint at exit, for this problem size. */
+	ccl_ex_footprint_report_at_exit(argv[0], stdout);
+	ccl_ex_footprint_param("width", CA_WIDTH);
+	ccl_ex_footprint_param("height", CA_HEIGHT);
+	ccl_ex_footprint_param("iters", CA_ITERS);
+
+	/* Create random initial state, unless it's generated on the
+	 * device. */
+	input_image = NULL;
+	if (!gen_dev) {
+		input_image = (cl_uchar4*) ccl_ex_hugemem_alloc(
+			CA_WIDTH * CA_HEIGHT * sizeof(cl_uchar4));
+		ccl_ex_fill_ca_host(input_image, CA_WIDTH, CA_HEIGHT, seed);
 	}
 
-	/* Allocate space for simulation results. */
+	/* Allocate space for simulation results, which are written by the
+	 * comms thread, in a single block. If requested, place it on the node
+	 * of the comms thread (if the node is unknown or the block can't be
+	 * placed, the comms thread touches the block first). */
+	output_size = (CA_ITERS + 1) * CA_WIDTH * CA_HEIGHT * sizeof(cl_uchar4);
 	output_images = (cl_uchar4**)
 		malloc((CA_ITERS + 1) * sizeof(cl_uchar4*));
-	for (cl_uint i = 0; i < CA_ITERS + 1; ++i)
-		output_images[i] = (cl_uchar4*)
-			malloc(CA_WIDTH * CA_HEIGHT * sizeof(cl_uchar4));
-
-	/* Create context using device selected from menu. */
-	ctx = ccl_context_new_from_menu_full(&dev_idx, &err);
+	output_images[0] = (cl_uchar4*) ccl_ex_hugemem_alloc(output_size);
+	numa_touch = numa_place && !cp_numa_bind(output_images[0],
+		output_size, cp_affinity_node(&cpus_comm));
+	for (cl_uint i = 1; i < CA_ITERS + 1; ++i)
+		output_images[i] = output_images[i - 1] + CA_WIDTH * CA_HEIGHT;
+
+	/* Create context using a device with image support. */
+	ctx = ccl_ex_context_new(device, &dev_reqs, &err);
 	HANDLE_ERROR(err);
 
 	/* Get first device in context. */
@@ -265,50 +538,122 @@ int main(int argc, char* argv[]) {
 	queue_comm = ccl_queue_new(ctx, dev, CL_QUEUE_PROFILING_ENABLE, &err);
 	HANDLE_ERROR(err);
 
-	/* Create 2D image for initial state. */
-	img1 = ccl_image_new(ctx, CL_MEM_READ_WRITE,
-		&image_format, NULL, &err,
-		"image_type", (cl_mem_object_type) CL_MEM_OBJECT_IMAGE2D,
-		"image_width", (size_t) CA_WIDTH,
-		"image_height", (size_t) CA_HEIGHT,
-		NULL);
+	/* With sampled profiling, unsampled iterations run on queues without
+	 * profiling. */
+	if (sample != 1) {
+		sp = ccl_ex_sampprof_new(sample, seed);
+		queue_exec_noprof = ccl_queue_new(ctx, dev, 0, &err);
+		HANDLE_ERROR(err);
+		queue_comm_noprof = ccl_queue_new(ctx, dev, 0, &err);
+		HANDLE_ERROR(err);
+	}
+
+	/* Create device memory pool. */
+	pool = ccl_ex_bufpool_new(0);
+
+	/* Get 2D image for initial state. */
+	img1 = ccl_ex_bufpool_get_image2d(pool, ctx, CL_MEM_READ_WRITE,
+		&image_format, CA_WIDTH, CA_HEIGHT, &err);
 	HANDLE_ERROR(err);
 
-	/* Create another 2D image for double buffering. */
-	img2 = ccl_image_new(ctx, CL_MEM_READ_WRITE,
-		&image_format, NULL, &err,
-		"image_type", (cl_mem_object_type) CL_MEM_OBJECT_IMAGE2D,
-		"image_width", (size_t) CA_WIDTH,
-		"image_height", (size_t) CA_HEIGHT,
-		NULL);
+	/* Get another 2D image for double buffering. */
+	img2 = ccl_ex_bufpool_get_image2d(pool, ctx, CL_MEM_READ_WRITE,
+		&image_format, CA_WIDTH, CA_HEIGHT, &err);
 	HANDLE_ERROR(err);
 
-	/* Get location of kernel file, which should be in the same location
-	 * of the bankconf executable. */
-	kernel_path = ccl_ex_kernelpath_get(kernel_files[0], argv[0]);
+	/* Get location of kernel files, which should be in the same location
+	 * of the ca_mt executable. */
+	for (guint i = 0; i < G_N_ELEMENTS(kernel_files); ++i)
+		kernel_paths[i] = ccl_ex_kernelpath_get(kernel_files[i], argv[0]);
 
-	/* Create program from kernel source and compile it. */
-	prg = ccl_program_new_from_source_file(ctx, kernel_path, &err);
+	/* Create program from kernel sources and compile it. */
+	prg = ccl_program_new_from_source_files(ctx,
+		G_N_ELEMENTS(kernel_paths), (const char**) kernel_paths, &err);
 	HANDLE_ERROR(err);
 
-	ccl_program_build(prg, NULL, &err);
+	ccl_program_build(prg, instr_file ? CCL_EX_INSTR_BUILD_OPT : NULL, &err);
 	HANDLE_ERROR(err);
 
+	/* Capture program sources. The instrumentation buffer is not
+	 * captured, so the program is replayed without instrumentation. */
+	if (cap)
+		ccl_ex_capture_program(cap, G_N_ELEMENTS(kernel_paths),
+			(const char* const*) kernel_paths, NULL);
+
 	/* Get kernel wrapper. */
 	krnl = ccl_program_get_kernel(prg, "ca", &err);
 	HANDLE_ERROR(err);
 
+	/* The instrumented kernel takes the instrumentation buffer as its
+	 * last argument. */
+	if (instr_file) {
+		instr = ccl_ex_instr_new(ctx, "ca", instr_counters);
+		ccl_ex_instr_prepare(instr, krnl, queue_exec, 0, NULL, NULL, &err);
+		HANDLE_ERROR(err);
+	}
+
+	/* Create device input generator, if required. */
+	if (gen_dev) {
+		fill = ccl_ex_fill_new(ctx, argv[0], &err);
+		HANDLE_ERROR(err);
+	}
+
 	/* Determine nice local and global worksizes. */
 	ccl_kernel_suggest_worksizes(krnl, dev, 2, real_ws, gws, lws, &err);
 	HANDLE_ERROR(err);
 
-	printf("\n * Global work-size: (%d, %d)\n", (int) gws[0], (int) gws[1]);
-	printf(" * Local work-size: (%d, %d)\n", (int) lws[0], (int) lws[1]);
+	/* Auto-tune local work size if requested. */
+	if (tune) {
+
+		struct tune_data tdata = { krnl, NULL, img1, img2, 0 };
+		CCLExTuner* tuner;
+		int best[2];
+
+		/* Use a separate queue, so that tuning runs are not profiled. */
+		tdata.cq = ccl_queue_new(ctx, dev, CL_QUEUE_PROFILING_ENABLE, &err);
+		HANDLE_ERROR(err);
+		tdata.krnl_wg_max = ccl_kernel_get_workgroup_info_scalar(
+			krnl, dev, CL_KERNEL_WORK_GROUP_SIZE, size_t, &err);
+		HANDLE_ERROR(err);
+
+		/* Search local work sizes which are powers of two. */
+		tuner = ccl_ex_tuner_new(dev, "ca", CA_WIDTH * CA_HEIGHT, &err);
+		HANDLE_ERROR(err);
+		ccl_ex_tuner_add_param_pow2(tuner, "lws0", 1,
+			MIN((int) tdata.krnl_wg_max, CA_WIDTH));
+		ccl_ex_tuner_add_param_pow2(tuner, "lws1", 1,
+			MIN((int) tdata.krnl_wg_max, CA_HEIGHT));
+		ccl_ex_tuner_run(tuner, tune_timer, &tdata, tune > 1, best, &err);
+		HANDLE_ERROR(err);
+
+		/* Use best local work size. */
+		for (int i = 0; i < 2; ++i) {
+			lws[i] = best[i];
+			gws[i] = ((real_ws[i] + lws[i] - 1) / lws[i]) * lws[i];
+		}
+
+		ccl_ex_tuner_destroy(tuner);
+		ccl_queue_destroy(tdata.cq);
+	}
+
+	/* Print work sizes and analyze resource usage. */
+	ccl_ex_reqs_analyze(krnl, dev, 2, gws, lws,
+		2 * CA_WIDTH * CA_HEIGHT * sizeof(cl_uchar4), 0, &err);
+	HANDLE_ERROR(err);
 
 	/* Create thread communication queues. */
+#ifdef WITH_SPSC_RING
+	for (int i = 0; i < 4; ++i) spsc_ring_init(&rings[i]);
+	comm_thread_queue = &rings[0];
+	exec_thread_queue = &rings[1];
+	host_comm_queue = &rings[2];
+	host_exec_queue = &rings[3];
+#else
 	comm_thread_queue = g_async_queue_new();
 	exec_thread_queue = g_async_queue_new();
-	host_thread_queue = g_async_queue_new();
+	host_comm_queue = g_async_queue_new();
+	host_exec_queue = g_async_queue_new();
+#endif
 
 	/* Setup thread data. */
 	td.krnl = krnl;
@@ -317,6 +662,27 @@ int main(int argc, char* argv[]) {
 	td.gws = gws;
 	td.lws = lws;
 	td.output_images = output_images;
+	td.output_size = output_size;
+	td.numa_touch = numa_touch;
+	td.instr = instr;
+	td.sp = sp;
+	td.cap = cap;
+
+	/* Show thread placement. */
+	cp_affinity_print(stdout, " * Comms thread CPUs : ", &cpus_comm);
+	cp_affinity_print(stdout, " * Exec thread CPUs  : ", &cpus_exec);
+	printf(" * Results placement : %s\n",
+		numa_place ? "comms thread node" : "default");
+
+	/* In soak mode, track events held by all queues. */
+	if (soak) {
+		ccl_ex_soak_add_queue(soak, queue_comm);
+		ccl_ex_soak_add_queue(soak, queue_exec);
+		if (sp) {
+			ccl_ex_soak_add_queue(soak, queue_comm_noprof);
+			ccl_ex_soak_add_queue(soak, queue_exec_noprof);
+		}
+	}
 
 	/* Create threads. */
 	exec_thread = g_thread_new("exec_thread", exec_func, &td);
@@ -326,23 +692,37 @@ int main(int argc, char* argv[]) {
 	prof = ccl_prof_new();
 	ccl_prof_start(prof);
 
-	/* Write initial state. */
-	ccl_image_enqueue_write(img1, queue_comm, CL_TRUE,
-		origin, region, 0, 0, input_image, NULL, &err);
-	HANDLE_ERROR(err);
+	/* Write initial state, or generate it on the device. */
+	if (fill) {
+		ccl_ex_fill_ca(fill, queue_comm, img1, CA_WIDTH, CA_HEIGHT,
+			seed, &err);
+		HANDLE_ERROR(err);
+		ccl_queue_finish(queue_comm, &err);
+		HANDLE_ERROR(err);
+	} else {
+		evt_write = ccl_image_enqueue_write(img1, queue_comm, CL_TRUE,
+			origin, region, 0, 0, input_image, NULL, &err);
+		HANDLE_ERROR(err);
+		if (cap)
+			ccl_ex_capture_write(cap, evt_write, queue_comm, img1, CL_TRUE,
+				origin, region, NULL);
+	}
+
+	/* Run CA_ITERS iterations of the CA, or until the soak run is
+	 * over. */
+	for (guint i = 0; (soak) || (i < CA_ITERS); ++i) {
 
-	/* Run CA_ITERS iterations of the CA. */
-	for (cl_uint i = 0; i < CA_ITERS; ++i) {
+		t_iter = g_get_monotonic_time();
 
 		/* Send message to comms thread. */
-		g_async_queue_push(comm_thread_queue, &go_msg);
+		msg_queue_push(comm_thread_queue, &go_msg);
 
 		/* Send message to exec thread. */
-		g_async_queue_push(exec_thread_queue, &go_msg);
+		msg_queue_push(exec_thread_queue, &go_msg);
 
 		/* Get event wrappers from both threads. */
-		evt1 = (CCLEvent*) g_async_queue_pop(host_thread_queue);
-		evt2 = (CCLEvent*) g_async_queue_pop(host_thread_queue);
+		evt1 = (CCLEvent*) msg_queue_pop(host_comm_queue);
+		evt2 = (CCLEvent*) msg_queue_pop(host_exec_queue);
 
 		/* Can't continue until this iteration is over. */
 		ccl_event_wait_list_add(&ewl, evt1, evt2, NULL);
@@ -350,48 +730,108 @@ int main(int argc, char* argv[]) {
 		/* Wait for events. */
 		ccl_event_wait(&ewl, &err);
 		HANDLE_ERROR(err);
+		if (cap) ccl_ex_capture_wait(cap, evt1, evt2, NULL);
+
+		/* Both threads are waiting for the next message, so events of
+		 * this iteration can be released, keeping their profiling
+		 * information if sampled. */
+		t_iter = g_get_monotonic_time() - t_iter;
+		if (sp) {
+			ccl_ex_sampprof_iter_time(sp, i, t_iter * 1e-6);
+			ccl_ex_sampprof_collect(sp,
+				iter_queue(sp, i, queue_comm, queue_comm_noprof),
+				"Comms", i, &err);
+			HANDLE_ERROR(err);
+			ccl_ex_sampprof_collect(sp,
+				iter_queue(sp, i, queue_exec, queue_exec_noprof),
+				"Exec", i, &err);
+			HANDLE_ERROR(err);
+		}
+
+		/* In soak mode, stop when the run is over (events can be
+		 * counted and released, since both threads are waiting). */
+		iters = i + 1;
+		if (soak) {
+			more = ccl_ex_soak_iter(soak, t_iter * 1e-6,
+				CA_WIDTH * CA_HEIGHT);
+			ccl_ex_soak_gc(soak);
+			if (!more) break;
+		}
 
 	}
 
 	/* Send message to comms thread to read last result. */
-	g_async_queue_push(comm_thread_queue, &go_msg);
+	msg_queue_push(comm_thread_queue, &go_msg);
 
 	/* Send stop messages to both threads. */
-	g_async_queue_push(comm_thread_queue, &stop_msg);
-	g_async_queue_push(exec_thread_queue, &stop_msg);
+	msg_queue_push(comm_thread_queue, &stop_msg);
+	msg_queue_push(exec_thread_queue, &stop_msg);
 
 	/* Get event wrapper from comms thread. */
-	evt1 = (CCLEvent*) g_async_queue_pop(host_thread_queue);
+	evt1 = (CCLEvent*) msg_queue_pop(host_comm_queue);
 
 	/* Can't continue until final read is over. */
 	ccl_event_wait_list_add(&ewl, evt1, NULL);
 	ccl_event_wait(&ewl, &err);
 	HANDLE_ERROR(err);
+	if (cap) ccl_ex_capture_wait(cap, evt1, NULL);
 
-	/* Make sure both queues are finished. */
+	/* Make sure all queues are finished. */
 	ccl_queue_finish(queue_comm, &err);
 	HANDLE_ERROR(err);
 	ccl_queue_finish(queue_exec, &err);
 	HANDLE_ERROR(err);
+	if (sp) {
+		ccl_queue_finish(queue_comm_noprof, &err);
+		HANDLE_ERROR(err);
+		ccl_queue_finish(queue_exec_noprof, &err);
+		HANDLE_ERROR(err);
+	}
 
-	/* Stop profiling timer and add queues for analysis. */
+	/* All commands were captured. */
+	if (cap) {
+		ccl_ex_capture_close(cap, &err);
+		HANDLE_ERROR(err);
+		printf(" * Command stream captured to '%s'\n", argv[9]);
+	}
+
+	/* Stop profiling timer and add queues for analysis, unless events
+	 * were already collected by sampled profiling or released by the
+	 * soak run. */
 	ccl_prof_stop(prof);
-	ccl_prof_add_queue(prof, "Comms", queue_comm);
-	ccl_prof_add_queue(prof, "Exec", queue_exec);
+	if (sp) {
+		ccl_ex_sampprof_collect(sp,
+			iter_queue(sp, iters, queue_comm, queue_comm_noprof),
+			"Comms", iters, &err);
+		HANDLE_ERROR(err);
+	} else if (!soak) {
+		ccl_prof_add_queue(prof, "Comms", queue_comm);
+		ccl_prof_add_queue(prof, "Exec", queue_exec);
+	}
+
+	/* All simulation states were read, sample memory usage. */
+	ccl_ex_footprint_sample();
 
 	/* Allocate space for base filename. */
 	filename = (char*) malloc(
 		(strlen(IMAGE_FILE_PREFIX ".png") + IMAGE_FILE_NUM_DIGITS + 1) * sizeof(char));
 
-	/* Write results to image files. */
-	for (cl_uint i = 0; i < CA_ITERS; ++i) {
+	/* Count hardware events of image encoding in this thread. */
+	if ((!soak) && (g_getenv(CCL_EX_PERFCTR_ENV) != NULL))
+		pc = ccl_ex_perfctr_new(FALSE);
+
+	/* Write results to image files, unless states were overwritten in
+	 * a soak run. */
+	for (cl_uint i = 0; (!soak) && (i < CA_ITERS); ++i) {
 
 		/* Determine next filename. */
 		sprintf(filename, "%s%0" G_STRINGIFY(IMAGE_FILE_NUM_DIGITS) "d.png", IMAGE_FILE_PREFIX, i);
 
 		/* Save next image. */
+		if (pc) ccl_ex_perfctr_start(pc, "PNG encode");
 		file_write_status = stbi_write_png(filename, CA_WIDTH, CA_HEIGHT, 4,
 			output_images[i], CA_WIDTH * sizeof(cl_uchar4));
+		if (pc) ccl_ex_perfctr_stop(pc, "PNG encode");
 
 		/* Give feedback if unable to save image. */
 		if (!file_write_status) {
@@ -399,43 +839,102 @@ int main(int argc, char* argv[]) {
 		}
 	}
 
-	/* Process profiling info. */
-	ccl_prof_calc(prof, &err);
-	HANDLE_ERROR(err);
+	if (sp) {
+
+		/* Print sampled profiling info. */
+		ccl_ex_sampprof_summary_print(sp, stdout);
+
+	} else if (!soak) {
+
+		/* Process profiling info. */
+		ccl_prof_calc(prof, &err);
+		HANDLE_ERROR(err);
+
+		/* Print profiling info. */
+		ccl_prof_print_summary(prof);
+
+	} else {
+
+		printf("\n * Events were released during the soak run, use a "
+			"sample period for profiling info.\n");
 
-	/* Print profiling info. */
-	ccl_prof_print_summary(prof);
+	}
+
+	/* Show throughput, for comparing thread placements. */
+	printf(" * Throughput        : %.2f iterations/s\n",
+		iters / ccl_prof_time_elapsed(prof));
+
+	/* Show why image encoding takes the time it takes. */
+	if (pc) {
+		ccl_ex_perfctr_summary_print(pc, stdout);
+		ccl_ex_perfctr_destroy(pc);
+	}
+
+	/* Show soak run summary. */
+	if (soak) {
+		ccl_ex_soak_summary_print(soak, stdout);
+		ccl_ex_soak_destroy(soak);
+	}
 
 	/* Save profiling info. */
-	ccl_prof_export_info_file(prof, "prof.tsv", &err);
-	HANDLE_ERROR(err);
+	if ((!sp) && (!soak)) {
+		ccl_prof_export_info_file(prof, "prof.tsv", &err);
+		HANDLE_ERROR(err);
+	}
 
 	/* Destroy threads. */
 	g_thread_join(exec_thread);
 	g_thread_join(comm_thread);
 
+	/* Summarize and save work-group records of the last iteration. */
+	if (instr) {
+		ccl_ex_instr_read(instr, queue_exec, &err);
+		HANDLE_ERROR(err);
+		ccl_ex_instr_summary_print(instr, stdout);
+		ccl_ex_instr_save(instr, instr_file, &err);
+		HANDLE_ERROR(err);
+		printf("\n * Work-group records saved to '%s'\n", instr_file);
+	}
+
 	/* Destroy thread communication queues. */
+#ifdef WITH_SPSC_RING
+	for (int i = 0; i < 4; ++i) spsc_ring_destroy(&rings[i]);
+#else
 	g_async_queue_unref(comm_thread_queue);
 	g_async_queue_unref(exec_thread_queue);
-	g_async_queue_unref(host_thread_queue);
+	g_async_queue_unref(host_comm_queue);
+	g_async_queue_unref(host_exec_queue);
+#endif
 
 	/* Release host buffers. */
 	free(filename);
-	free(input_image);
-	for (cl_uint i = 0; i < CA_ITERS + 1; ++i)
-		free(output_images[i]);
+	ccl_ex_hugemem_free(input_image);
+	ccl_ex_hugemem_free(output_images[0]);
 	free(output_images);
+	for (guint i = 0; i < G_N_ELEMENTS(kernel_paths); ++i)
+		g_free(kernel_paths[i]);
+
+	/* Return images to pool, show pool statistics and destroy pool
+	 * (must be done before destroying the context). */
+	ccl_ex_bufpool_put(pool, img1);
+	ccl_ex_bufpool_put(pool, img2);
+	ccl_ex_bufpool_stats_print(pool);
+	ccl_ex_hugemem_stats_print(stdout);
+	ccl_ex_bufpool_destroy(pool);
 
 	/* Release wrappers. */
-	ccl_image_destroy(img1);
-	ccl_image_destroy(img2);
+	if (fill) ccl_ex_fill_destroy(fill);
+	if (instr) ccl_ex_instr_destroy(instr);
 	ccl_program_destroy(prg);
 	ccl_queue_destroy(queue_comm);
 	ccl_queue_destroy(queue_exec);
+	if (queue_comm_noprof) ccl_queue_destroy(queue_comm_noprof);
+	if (queue_exec_noprof) ccl_queue_destroy(queue_exec_noprof);
 	ccl_context_destroy(ctx);
 
-	/* Destroy profiler. */
+	/* Destroy profilers. */
 	ccl_prof_destroy(prof);
+	if (sp) ccl_ex_sampprof_destroy(sp);
 
 	/* Check all wrappers have been destroyed. */
 	g_assert(ccl_wrapper_memcheck());
@@ -21,6 +21,11 @@
  * File containing kernel for cellular automata simulation (Conway's
  * Game of Life).
  *
+ * The kernel is instrumented with the macros of `examples_instr.cl`,
+ * which must precede this file, counting the cells updated by each
+ * work-group (`cells`) and how many of them are alive afterwards
+ * (`alive`).
+ *
  * @author Nuno Fachada
  * @date 2016
  * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
@@ -57,7 +62,10 @@ __constant sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_NONE |
  * @param[in] CA input state.
  * @param[out] CA output state.
  * */
-__kernel void ca(__read_only image2d_t in_img, __write_only image2d_t out_img) {
+__kernel void ca(__read_only image2d_t in_img, __write_only image2d_t out_img
+	INSTR_ARG) {
+
+	INSTR_BEGIN();
 
 	/* Get image dimensions. */
 	int2 imdim = get_image_dim(in_img);
@@ -100,9 +108,13 @@ __kernel void ca(__read_only image2d_t in_img, __write_only image2d_t out_img) {
 		if ((alive && (neighs_alive >= live_rule.s0) && (neighs_alive <= live_rule.s1))
 			|| (!alive && (neighs_alive >= dead_rule.s0) && (neighs_alive <= dead_rule.s1))) {
 			new_state = (uint4) { 0x00, 0x00, 0x00, 0xFF };
+			INSTR_COUNT(1, 1);
 		}
+		INSTR_COUNT(0, 1);
 
 		/* Write current cell's new state. */
 		write_imageui(out_img, coord, new_state);
 	}
+
+	INSTR_END();
 }
@@ -0,0 +1,258 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Header library for pinning threads to CPU sets and for placing host
+ * buffers on NUMA nodes.
+ *
+ * On Linux, buffers are placed with libnuma if `WITH_LIBNUMA` is
+ * defined, or with the `mbind` system call otherwise. Placement only
+ * affects pages not yet touched, so buffers must be freshly mapped and
+ * page-aligned (e.g. large buffers from ccl_ex_hugemem_alloc()). Other
+ * buffers, such as small ones from `malloc()`, which may share pages
+ * with other data, are not placed; their pages may instead be placed on
+ * the node of the thread which first touches them. On other systems,
+ * pinning and placement are no-ops.
+ */
+
+#ifndef _CP_AFFINITY_H_
+#define _CP_AFFINITY_H_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__linux__) && defined(_GNU_SOURCE)
+	#define CP_AFFINITY_LINUX
+	#include <sched.h>
+	#include <pthread.h>
+	#include <unistd.h>
+	#include <dirent.h>
+	#include <sys/syscall.h>
+	#ifdef WITH_LIBNUMA
+		#include <numa.h>
+	#endif
+#endif
+
+/** Memory policy for mbind: prefer the given node. */
+#define CP_AFFINITY_MPOL_PREFERRED 1
+
+/**
+ * A CPU set. An empty set means "don't pin".
+ * */
+typedef struct {
+#ifdef CP_AFFINITY_LINUX
+	cpu_set_t set;
+#endif
+	int count;
+} cp_cpuset_t;
+
+/**
+ * Parse a CPU list such as "0-3,8,10-11" into a CPU set. An empty or
+ * NULL string gives an empty set.
+ *
+ * @return 0 if string is valid, -1 otherwise.
+ * */
+static inline int cp_affinity_parse(const char * str, cp_cpuset_t * cs) {
+
+	const char * p = str;
+
+	cs->count = 0;
+#ifdef CP_AFFINITY_LINUX
+	CPU_ZERO(&cs->set);
+#endif
+	if ((str == NULL) || (*str == '\0')) return 0;
+
+	while (*p) {
+		char * end;
+		long first, last;
+		first = strtol(p, &end, 10);
+		if ((end == p) || (first < 0)) return -1;
+		last = first;
+		p = end;
+		if (*p == '-') {
+			last = strtol(p + 1, &end, 10);
+			if ((end == p + 1) || (last < first)) return -1;
+			p = end;
+		}
+		for (long c = first; c <= last; c++) {
+#ifdef CP_AFFINITY_LINUX
+			if (c >= CPU_SETSIZE) return -1;
+			CPU_SET(c, &cs->set);
+#endif
+			cs->count++;
+		}
+		if (*p == ',') p++;
+		else if (*p != '\0') return -1;
+	}
+	return 0;
+}
+
+/**
+ * Parse two CPU lists separated by a colon, e.g. "0-3:4-7" or ":4",
+ * into two CPU sets.
+ *
+ * @return 0 if string is valid, -1 otherwise.
+ * */
+static inline int cp_affinity_parse_pair(const char * str,
+	cp_cpuset_t * cs1, cp_cpuset_t * cs2) {
+
+	char buf[256];
+	char * sep;
+
+	if ((str == NULL) || (strlen(str) >= sizeof(buf))) return -1;
+	strcpy(buf, str);
+	if ((sep = strchr(buf, ':')) == NULL) return -1;
+	*sep = '\0';
+	if (cp_affinity_parse(buf, cs1) != 0) return -1;
+	return cp_affinity_parse(sep + 1, cs2);
+}
+
+/**
+ * Pin the calling thread to a CPU set. Does nothing if the set is empty.
+ *
+ * @return 0 if successful, an error number otherwise.
+ * */
+static inline int cp_affinity_set(const cp_cpuset_t * cs) {
+#ifdef CP_AFFINITY_LINUX
+	if (cs->count == 0) return 0;
+	return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+		&cs->set);
+#else
+	(void) cs;
+	return 0;
+#endif
+}
+
+/**
+ * NUMA node of the first CPU in a set.
+ *
+ * @return The node, or -1 if the set is empty or the node is unknown.
+ * */
+static inline int cp_affinity_node(const cp_cpuset_t * cs) {
+#ifdef CP_AFFINITY_LINUX
+	int cpu;
+	if (cs->count == 0) return -1;
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		if (CPU_ISSET(cpu, &cs->set)) break;
+#ifdef WITH_LIBNUMA
+	if (numa_available() < 0) return -1;
+	return numa_node_of_cpu(cpu);
+#else
+	{
+		/* Look for a nodeN entry in the CPU's sysfs directory. */
+		char path[64];
+		DIR * dir;
+		struct dirent * ent;
+		int node = -1;
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+		if ((dir = opendir(path)) == NULL) return -1;
+		while ((ent = readdir(dir)) != NULL)
+			if (sscanf(ent->d_name, "node%d", &node) == 1) break;
+		closedir(dir);
+		return node;
+	}
+#endif
+#else
+	(void) cs;
+	return -1;
+#endif
+}
+
+/**
+ * Size of a memory page, in bytes.
+ * */
+static inline size_t cp_numa_page_size(void) {
+#ifdef CP_AFFINITY_LINUX
+	long ps = sysconf(_SC_PAGESIZE);
+	if (ps > 0) return (size_t) ps;
+#endif
+	return 4096;
+}
+
+/**
+ * Place the untouched pages of a buffer on a NUMA node. Best effort:
+ * buffers which are not page-aligned (e.g. small buffers allocated with
+ * `malloc()`) are not placed, nor are buffers when the node is not
+ * valid.
+ *
+ * @param[in] p Buffer.
+ * @param[in] size Buffer size in bytes.
+ * @param[in] node NUMA node, or -1 to leave pages to first touch.
+ * @return 1 if the placement was requested, 0 if the buffer was not
+ * placed, in which case the caller can fall back to cp_numa_touch() from
+ * a thread on the intended node.
+ * */
+static inline int cp_numa_bind(void * p, size_t size, int node) {
+#ifdef CP_AFFINITY_LINUX
+	if ((p == NULL) || (node < 0)
+			|| ((unsigned long) p % cp_numa_page_size()))
+		return 0;
+#ifdef WITH_LIBNUMA
+	if (numa_available() < 0) return 0;
+	numa_tonode_memory(p, size, node);
+	return 1;
+#else
+	{
+		unsigned long mask[4] = { 0, 0, 0, 0 };
+		unsigned long bits = 8 * sizeof(unsigned long);
+		if ((unsigned long) node >= 8 * sizeof(mask)) return 0;
+		mask[node / bits] = 1UL << (node % bits);
+		return syscall(SYS_mbind, p, size, CP_AFFINITY_MPOL_PREFERRED,
+			mask, 8 * sizeof(mask), 0) == 0;
+	}
+#endif
+#else
+	(void) p; (void) size; (void) node;
+	return 0;
+#endif
+}
+
+/**
+ * Touch each page of a buffer, so that pages not yet placed are placed
+ * on the node of the calling thread.
+ * */
+static inline void cp_numa_touch(void * p, size_t size) {
+	volatile char * c = (volatile char *) p;
+	size_t page = cp_numa_page_size();
+	for (size_t i = 0; i < size; i += page) c[i] = 0;
+}
+
+/**
+ * Print a CPU set, for reporting.
+ * */
+static inline void cp_affinity_print(FILE * out, const char * label,
+	const cp_cpuset_t * cs) {
+
+	fprintf(out, "%s", label);
+	if (cs->count == 0) {
+		fprintf(out, "not pinned\n");
+		return;
+	}
+#ifdef CP_AFFINITY_LINUX
+	for (int c = 0, n = 0; c < CPU_SETSIZE; c++)
+		if (CPU_ISSET(c, &cs->set))
+			fprintf(out, "%s%d", n++ ? "," : "", c);
+	fprintf(out, " (node %d)\n", cp_affinity_node(cs));
+#else
+	fprintf(out, "%d CPUs (pinning not supported)\n", cs->count);
+#endif
+}
+
+#endif
@@ -0,0 +1,528 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Device memory pool implementation for cf4ocl-examples.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#include "examples_bufpool.h"
+#include "examples_footprint.h"
+
+/* A memory object managed by the pool. */
+struct ccl_ex_bufpool_entry {
+	/* Buffer or image wrapper. */
+	void* memobj;
+	/* Context where memory object was created. */
+	CCLContext* ctx;
+	/* Is the memory object an image? */
+	gboolean is_image;
+	/* Memory flags. */
+	cl_mem_flags flags;
+	/* Real size in bytes. */
+	size_t size;
+	/* Size class (buffers only). */
+	guint cls;
+	/* Is the buffer of exactly the requested size, instead of the size
+	 * of its class? Such buffers are not kept in free lists. */
+	gboolean exact;
+	/* Image format and dimensions (images only). */
+	cl_image_format image_format;
+	size_t width;
+	size_t height;
+};
+
+/* Free lists of a context. */
+struct ccl_ex_bufpool_ctx {
+	/* One free list for each buffer size class. */
+	GQueue buffers[CCL_EX_BUFPOOL_NUM_CLASSES];
+	/* Free list of images. */
+	GQueue images;
+	/* Maximum size of a buffer in the context's devices. */
+	cl_ulong max_alloc;
+};
+
+/* Device memory pool. */
+struct ccl_ex_bufpool {
+	/* Free lists, one set for each context. */
+	GHashTable* contexts;
+	/* Memory objects handed out to callers. */
+	GHashTable* in_use;
+	/* Maximum number of bytes held in free lists. */
+	size_t high_water;
+	/* Number of memory objects created. */
+	gulong creations;
+	/* Number of memory objects destroyed. */
+	gulong destructions;
+	/* Statistics. */
+	CCLExBufPoolStats stats;
+};
+
+/* Determine size class for the given size in bytes, i.e. the index of
+ * the smallest class whose size, 2^(CCL_EX_BUFPOOL_MIN_CLASS + index)
+ * bytes, is not smaller than `size`. */
+static guint ccl_ex_bufpool_class(size_t size) {
+	guint cls = 0;
+	while ((cls < CCL_EX_BUFPOOL_NUM_CLASSES)
+		&& (CCL_EX_BUFPOOL_CLASS_SIZE(cls) < size)) cls++;
+	return cls;
+}
+
+/* Get the free lists of a context, creating them if necessary. */
+static struct ccl_ex_bufpool_ctx* ccl_ex_bufpool_ctx_get(
+	CCLExBufPool* pool, CCLContext* ctx) {
+
+	struct ccl_ex_bufpool_ctx* pctx;
+
+	pctx = g_hash_table_lookup(pool->contexts, ctx);
+	if (pctx == NULL) {
+		pctx = g_slice_new0(struct ccl_ex_bufpool_ctx);
+		for (guint i = 0; i < CCL_EX_BUFPOOL_NUM_CLASSES; i++)
+			g_queue_init(&pctx->buffers[i]);
+		g_queue_init(&pctx->images);
+		g_hash_table_insert(pool->contexts, ctx, pctx);
+	}
+	return pctx;
+}
+
+/* Get the smallest maximum buffer size of the devices in a context. */
+static gboolean ccl_ex_bufpool_max_alloc_get(
+	struct ccl_ex_bufpool_ctx* pctx, CCLContext* ctx, GError** err) {
+
+	GError* err_internal = NULL;
+	cl_ulong max_alloc = G_MAXUINT64;
+	cl_uint num_devs;
+
+	if (pctx->max_alloc > 0) return TRUE;
+
+	num_devs = ccl_context_get_num_devices(ctx, &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	for (cl_uint i = 0; i < num_devs; ++i) {
+		CCLDevice* dev;
+		cl_ulong dev_max_alloc;
+		dev = ccl_context_get_device(ctx, i, &err_internal);
+		if_err_goto(err_internal, error_handler);
+		dev_max_alloc = ccl_device_get_info_scalar(dev,
+			CL_DEVICE_MAX_MEM_ALLOC_SIZE, cl_ulong, &err_internal);
+		if_err_goto(err_internal, error_handler);
+		max_alloc = MIN(max_alloc, dev_max_alloc);
+	}
+	pctx->max_alloc = max_alloc;
+	return TRUE;
+
+error_handler:
+	g_propagate_error(err, err_internal);
+	return FALSE;
+}
+
+/* Account for a memory object being handed out. */
+static void ccl_ex_bufpool_hand_out(CCLExBufPool* pool,
+	struct ccl_ex_bufpool_entry* entry) {
+
+	g_hash_table_insert(pool->in_use, entry->memobj, entry);
+	pool->stats.bytes_in_use += entry->size;
+	pool->stats.bytes_peak = MAX(pool->stats.bytes_peak,
+		pool->stats.bytes_in_use + pool->stats.bytes_held);
+}
+
+/* Destroy the memory object of an entry and free the entry. */
+static void ccl_ex_bufpool_entry_destroy(CCLExBufPool* pool,
+	struct ccl_ex_bufpool_entry* entry) {
+
+	gint64 t0 = g_get_monotonic_time();
+
+	if (entry->is_image)
+		ccl_ex_footprint_image_destroy((CCLImage*) entry->memobj);
+	else
+		ccl_ex_footprint_buffer_destroy((CCLBuffer*) entry->memobj);
+
+	pool->stats.time_destroy +=
+		(g_get_monotonic_time() - t0) / (double) G_USEC_PER_SEC;
+	pool->destructions++;
+	g_slice_free(struct ccl_ex_bufpool_entry, entry);
+}
+
+/* Destroy all entries in a free list. */
+static void ccl_ex_bufpool_queue_clear(CCLExBufPool* pool, GQueue* q) {
+
+	struct ccl_ex_bufpool_entry* entry;
+
+	while ((entry = g_queue_pop_head(q)) != NULL) {
+		pool->stats.bytes_held -= entry->size;
+		ccl_ex_bufpool_entry_destroy(pool, entry);
+	}
+}
+
+/**
+ * Create a new device memory pool.
+ *
+ * The pool must be destroyed before the contexts of the memory objects
+ * it holds.
+ *
+ * @param[in] high_water Maximum number of bytes to keep in free lists;
+ * memory objects returned to the pool beyond this limit are destroyed.
+ * If 0, #CCL_EX_BUFPOOL_HIGH_WATER_DEFAULT is used.
+ * @return A new device memory pool, to be destroyed with
+ * ccl_ex_bufpool_destroy().
+ * */
+CCLExBufPool* ccl_ex_bufpool_new(size_t high_water) {
+
+	CCLExBufPool* pool = g_slice_new0(CCLExBufPool);
+
+	pool->contexts = g_hash_table_new(g_direct_hash, g_direct_equal);
+	pool->in_use = g_hash_table_new(g_direct_hash, g_direct_equal);
+	pool->high_water = high_water > 0
+		? high_water : CCL_EX_BUFPOOL_HIGH_WATER_DEFAULT;
+
+	return pool;
+}
+
+/**
+ * Get a buffer from the pool, creating it if necessary.
+ *
+ * The returned buffer may be larger than requested, since its size is
+ * rounded up to the next power of two. Buffers are created with the
+ * requested size, and not kept when returned to the pool, if the
+ * rounded size would exceed the high-water limit (e.g. if the pool is
+ * only used for its statistics) or the maximum buffer size of the
+ * context's devices. Buffers with host pointers are not supported.
+ *
+ * @param[in] pool Device memory pool.
+ * @param[in] ctx Context where buffer will be used.
+ * @param[in] flags Memory flags.
+ * @param[in] size Minimum size of buffer in bytes.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return A buffer, to be returned to the pool with ccl_ex_bufpool_put(),
+ * or `NULL` if an error occurs.
+ * */
+CCLBuffer* ccl_ex_bufpool_get(CCLExBufPool* pool, CCLContext* ctx,
+	cl_mem_flags flags, size_t size, GError** err) {
+
+	struct ccl_ex_bufpool_ctx* pctx;
+	struct ccl_ex_bufpool_entry* entry = NULL;
+	guint cls;
+	gboolean exact;
+	GQueue* q;
+	gint64 t0;
+
+	g_return_val_if_fail(pool != NULL, NULL);
+	g_return_val_if_fail(ctx != NULL, NULL);
+
+	cls = ccl_ex_bufpool_class(size);
+	if (cls >= CCL_EX_BUFPOOL_NUM_CLASSES) {
+		g_set_error(err, CCL_EX_ERROR, CCL_EX_FAIL,
+			"Buffer of %lu bytes is larger than the largest size class "
+			"of the device memory pool.", (unsigned long) size);
+		return NULL;
+	}
+
+	pool->stats.requests++;
+	pctx = ccl_ex_bufpool_ctx_get(pool, ctx);
+	if (!ccl_ex_bufpool_max_alloc_get(pctx, ctx, err)) return NULL;
+	q = &pctx->buffers[cls];
+
+	/* Don't round up buffers which can't be kept or which would not fit
+	 * the devices. */
+	exact = (CCL_EX_BUFPOOL_CLASS_SIZE(cls) > pool->high_water)
+		|| (CCL_EX_BUFPOOL_CLASS_SIZE(cls) > pctx->max_alloc);
+
+	/* Look for a free buffer with the same flags in the size class. */
+	for (GList* l = exact ? NULL : q->head; l != NULL; l = l->next) {
+		struct ccl_ex_bufpool_entry* e = l->data;
+		if (e->flags == flags) {
+			entry = e;
+			g_queue_delete_link(q, l);
+			break;
+		}
+	}
+
+	if (entry != NULL) {
+		/* Hit. */
+		pool->stats.hits++;
+		pool->stats.bytes_held -= entry->size;
+	} else {
+		/* Miss, create a new buffer with the size of the class, or with
+		 * the requested size. */
+		CCLBuffer* buf;
+		size_t buf_size = exact ? size : CCL_EX_BUFPOOL_CLASS_SIZE(cls);
+		t0 = g_get_monotonic_time();
+		buf = ccl_ex_footprint_buffer_new(
+			ctx, flags, buf_size, NULL, err);
+		pool->stats.time_create +=
+			(g_get_monotonic_time() - t0) / (double) G_USEC_PER_SEC;
+		if (buf == NULL) return NULL;
+		pool->creations++;
+
+		entry = g_slice_new0(struct ccl_ex_bufpool_entry);
+		entry->memobj = buf;
+		entry->ctx = ctx;
+		entry->is_image = FALSE;
+		entry->flags = flags;
+		entry->size = buf_size;
+		entry->cls = cls;
+		entry->exact = exact;
+	}
+
+	ccl_ex_bufpool_hand_out(pool, entry);
+	return (CCLBuffer*) entry->memobj;
+}
+
+/**
+ * Get a 2D image from the pool, creating it if necessary.
+ *
+ * Images are only reused if flags, format and dimensions match exactly.
+ *
+ * @param[in] pool Device memory pool.
+ * @param[in] ctx Context where image will be used.
+ * @param[in] flags Memory flags.
+ * @param[in] image_format Image format.
+ * @param[in] width Image width in pixels.
+ * @param[in] height Image height in pixels.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return An image, to be returned to the pool with ccl_ex_bufpool_put(),
+ * or `NULL` if an error occurs.
+ * */
+CCLImage* ccl_ex_bufpool_get_image2d(CCLExBufPool* pool,
+	CCLContext* ctx, cl_mem_flags flags,
+	const cl_image_format* image_format, size_t width, size_t height,
+	GError** err) {
+
+	struct ccl_ex_bufpool_ctx* pctx;
+	struct ccl_ex_bufpool_entry* entry = NULL;
+	gint64 t0;
+
+	g_return_val_if_fail(pool != NULL, NULL);
+	g_return_val_if_fail(ctx != NULL, NULL);
+	g_return_val_if_fail(image_format != NULL, NULL);
+
+	pool->stats.requests++;
+	pctx = ccl_ex_bufpool_ctx_get(pool, ctx);
+
+	/* Look for a free image with the same properties. */
+	for (GList* l = pctx->images.head; l != NULL; l = l->next) {
+		struct ccl_ex_bufpool_entry* e = l->data;
+		if ((e->flags == flags) && (e->width == width)
+			&& (e->height == height)
+			&& (e->image_format.image_channel_order
+				== image_format->image_channel_order)
+			&& (e->image_format.image_channel_data_type
+				== image_format->image_channel_data_type)) {
+
+			entry = e;
+			g_queue_delete_link(&pctx->images, l);
+			break;
+		}
+	}
+
+	if (entry != NULL) {
+		/* Hit. */
+		pool->stats.hits++;
+		pool->stats.bytes_held -= entry->size;
+	} else {
+		/* Miss, create a new image. */
+		CCLImage* img;
+		t0 = g_get_monotonic_time();
+		img = ccl_ex_footprint_image2d_new(
+			ctx, flags, image_format, width, height, NULL, err);
+		pool->stats.time_create +=
+			(g_get_monotonic_time() - t0) / (double) G_USEC_PER_SEC;
+		if (img == NULL) return NULL;
+		pool->creations++;
+
+		entry = g_slice_new0(struct ccl_ex_bufpool_entry);
+		entry->memobj = img;
+		entry->ctx = ctx;
+		entry->is_image = TRUE;
+		entry->flags = flags;
+		entry->size =
+			width * height * ccl_ex_footprint_pixel_size(image_format);
+		entry->image_format = *image_format;
+		entry->width = width;
+		entry->height = height;
+	}
+
+	ccl_ex_bufpool_hand_out(pool, entry);
+	return (CCLImage*) entry->memobj;
+}
+
+/**
+ * Return a buffer or image to the pool.
+ *
+ * If keeping the memory object would exceed the high-water limit, it is
+ * destroyed instead.
+ *
+ * @param[in] pool Device memory pool.
+ * @param[in] memobj Buffer or image obtained from this pool.
+ * */
+void ccl_ex_bufpool_put(CCLExBufPool* pool, void* memobj) {
+
+	struct ccl_ex_bufpool_entry* entry;
+	struct ccl_ex_bufpool_ctx* pctx;
+
+	g_return_if_fail(pool != NULL);
+	g_return_if_fail(memobj != NULL);
+
+	entry = g_hash_table_lookup(pool->in_use, memobj);
+	g_return_if_fail(entry != NULL);
+
+	g_hash_table_remove(pool->in_use, memobj);
+	pool->stats.bytes_in_use -= entry->size;
+
+	if (entry->exact) {
+		/* Not of the size of its class, destroy buffer. */
+		ccl_ex_bufpool_entry_destroy(pool, entry);
+	} else if (pool->stats.bytes_held + entry->size > pool->high_water) {
+		/* Over the high-water limit, destroy memory object. */
+		pool->stats.evictions++;
+		ccl_ex_bufpool_entry_destroy(pool, entry);
+	} else {
+		/* Keep memory object, most recently used first. */
+		pctx = ccl_ex_bufpool_ctx_get(pool, entry->ctx);
+		g_queue_push_head(entry->is_image
+			? &pctx->images : &pctx->buffers[entry->cls], entry);
+		pool->stats.bytes_held += entry->size;
+	}
+}
+
+/**
+ * Destroy all free memory objects of the given context. Must be called
+ * before destroying a context if the pool outlives it.
+ *
+ * @param[in] pool Device memory pool.
+ * @param[in] ctx Context whose free memory objects are to be destroyed.
+ * */
+void ccl_ex_bufpool_trim(CCLExBufPool* pool, CCLContext* ctx) {
+
+	struct ccl_ex_bufpool_ctx* pctx;
+
+	g_return_if_fail(pool != NULL);
+
+	pctx = g_hash_table_lookup(pool->contexts, ctx);
+	if (pctx == NULL) return;
+
+	for (guint i = 0; i < CCL_EX_BUFPOOL_NUM_CLASSES; i++)
+		ccl_ex_bufpool_queue_clear(pool, &pctx->buffers[i]);
+	ccl_ex_bufpool_queue_clear(pool, &pctx->images);
+
+	g_hash_table_remove(pool->contexts, ctx);
+	g_slice_free(struct ccl_ex_bufpool_ctx, pctx);
+}
+
+/**
+ * Get pool statistics.
+ *
+ * @param[in] pool Device memory pool.
+ * @param[out] stats Location where to place statistics.
+ * */
+void ccl_ex_bufpool_stats_get(CCLExBufPool* pool,
+	CCLExBufPoolStats* stats) {
+
+	g_return_if_fail(pool != NULL);
+	g_return_if_fail(stats != NULL);
+
+	*stats = pool->stats;
+}
+
+/**
+ * Print pool statistics, including an estimate of the allocation
+ * overhead removed by the pool.
+ *
+ * @param[in] pool Device memory pool.
+ * */
+void ccl_ex_bufpool_stats_print(CCLExBufPool* pool) {
+
+	CCLExBufPoolStats* s;
+	double hit_rate, t_create_avg, t_destroy_avg, t_saved;
+
+	g_return_if_fail(pool != NULL);
+
+	s = &pool->stats;
+	hit_rate = s->requests > 0 ? 100.0 * s->hits / s->requests : 0.0;
+	t_create_avg = pool->creations > 0
+		? s->time_create / pool->creations : 0.0;
+	t_destroy_avg = pool->destructions > 0
+		? s->time_destroy / pool->destructions : 0.0;
+
+	/* Each hit avoids one creation and one destruction. */
+	t_saved = s->hits * (t_create_avg + t_destroy_avg);
+
+	g_printf("\n   ========================= Device memory pool ============================\n\n");
+	g_printf("     Requests / hits        : %lu / %lu (%.1f%% hit rate)\n",
+		s->requests, s->hits, hit_rate);
+	g_printf("     Evictions              : %lu\n", s->evictions);
+	g_printf("     Bytes held / in use    : %lu / %lu bytes\n",
+		(unsigned long) s->bytes_held, (unsigned long) s->bytes_in_use);
+	g_printf("     Peak bytes             : %lu bytes (%lu Kb)\n",
+		(unsigned long) s->bytes_peak,
+		(unsigned long) (s->bytes_peak / 1024));
+	g_printf("     Create time (%5lu)    : %es (%es avg.)\n",
+		pool->creations, s->time_create, t_create_avg);
+	g_printf("     Destroy time (%5lu)   : %es (%es avg.)\n",
+		pool->destructions, s->time_destroy, t_destroy_avg);
+	g_printf("     Allocation time saved  : %es\n", t_saved);
+}
+
+/* Destroy free lists of a context (hash table iteration callback). */
+static void ccl_ex_bufpool_ctx_destroy(gpointer key, gpointer value,
+	gpointer user_data) {
+
+	CCLExBufPool* pool = (CCLExBufPool*) user_data;
+	struct ccl_ex_bufpool_ctx* pctx = (struct ccl_ex_bufpool_ctx*) value;
+
+	(void) key;
+
+	for (guint i = 0; i < CCL_EX_BUFPOOL_NUM_CLASSES; i++)
+		ccl_ex_bufpool_queue_clear(pool, &pctx->buffers[i]);
+	ccl_ex_bufpool_queue_clear(pool, &pctx->images);
+
+	g_slice_free(struct ccl_ex_bufpool_ctx, pctx);
+}
+
+/* Destroy a memory object still in use (hash table iteration
+ * callback). */
+static void ccl_ex_bufpool_in_use_destroy(gpointer key, gpointer value,
+	gpointer user_data) {
+
+	(void) key;
+	ccl_ex_bufpool_entry_destroy((CCLExBufPool*) user_data,
+		(struct ccl_ex_bufpool_entry*) value);
+}
+
+/**
+ * Destroy the pool and all memory objects it holds, including the ones
+ * which were not returned to the pool.
+ *
+ * @param[in] pool Device memory pool to destroy.
+ * */
+void ccl_ex_bufpool_destroy(CCLExBufPool* pool) {
+
+	g_return_if_fail(pool != NULL);
+
+	g_hash_table_foreach(pool->contexts, ccl_ex_bufpool_ctx_destroy, pool);
+	g_hash_table_foreach(pool->in_use, ccl_ex_bufpool_in_use_destroy, pool);
+	g_hash_table_destroy(pool->contexts);
+	g_hash_table_destroy(pool->in_use);
+	g_slice_free(CCLExBufPool, pool);
+}
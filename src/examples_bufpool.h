@@ -0,0 +1,106 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Device memory pool for cf4ocl-examples.
+ *
+ * Buffers are kept in power-of-two size classes, in free lists which
+ * are separate for each context. Images are kept in per-context free
+ * lists and are only reused for an exact match of flags, format and
+ * dimensions.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#ifndef _CCL_EXAMPLES_BUFPOOL_H_
+#define _CCL_EXAMPLES_BUFPOOL_H_
+
+#include "examples_common.h"
+
+/** Exponent of the smallest size class, @f$2^6=64@f$ bytes. */
+#define CCL_EX_BUFPOOL_MIN_CLASS 6
+
+/** Number of buffer size classes, from @f$2^6@f$ up to @f$2^{47}@f$
+ * bytes. */
+#define CCL_EX_BUFPOOL_NUM_CLASSES 42
+
+/** Size in bytes of the size class with the given index. */
+#define CCL_EX_BUFPOOL_CLASS_SIZE(cls) \
+	(((size_t) 1) << (CCL_EX_BUFPOOL_MIN_CLASS + (cls)))
+
+/** Default high-water limit for memory held in free lists (256 Mb). */
+#define CCL_EX_BUFPOOL_HIGH_WATER_DEFAULT (256 * 1024 * 1024)
+
+/** Device memory pool. */
+typedef struct ccl_ex_bufpool CCLExBufPool;
+
+/** Device memory pool statistics. */
+typedef struct ccl_ex_bufpool_stats {
+
+	/** Number of get requests. */
+	gulong requests;
+	/** Number of get requests served from a free list. */
+	gulong hits;
+	/** Number of objects destroyed because of the high-water limit. */
+	gulong evictions;
+	/** Bytes currently held in free lists. */
+	size_t bytes_held;
+	/** Bytes currently handed out to callers. */
+	size_t bytes_in_use;
+	/** Peak of bytes held plus bytes in use. */
+	size_t bytes_peak;
+	/** Seconds spent creating memory objects (misses). */
+	double time_create;
+	/** Seconds spent destroying memory objects. */
+	double time_destroy;
+
+} CCLExBufPoolStats;
+
+/* Create a new device memory pool. */
+CCLExBufPool* ccl_ex_bufpool_new(size_t high_water);
+
+/* Get a buffer from the pool, creating it if necessary. */
+CCLBuffer* ccl_ex_bufpool_get(CCLExBufPool* pool, CCLContext* ctx,
+	cl_mem_flags flags, size_t size, GError** err);
+
+/* Get a 2D image from the pool, creating it if necessary. */
+CCLImage* ccl_ex_bufpool_get_image2d(CCLExBufPool* pool,
+	CCLContext* ctx, cl_mem_flags flags,
+	const cl_image_format* image_format, size_t width, size_t height,
+	GError** err);
+
+/* Return a buffer or image to the pool. */
+void ccl_ex_bufpool_put(CCLExBufPool* pool, void* memobj);
+
+/* Destroy all free memory objects of the given context. */
+void ccl_ex_bufpool_trim(CCLExBufPool* pool, CCLContext* ctx);
+
+/* Get pool statistics. */
+void ccl_ex_bufpool_stats_get(CCLExBufPool* pool,
+	CCLExBufPoolStats* stats);
+
+/* Print pool statistics. */
+void ccl_ex_bufpool_stats_print(CCLExBufPool* pool);
+
+/* Destroy the pool and all memory objects it holds. */
+void ccl_ex_bufpool_destroy(CCLExBufPool* pool);
+
+#endif
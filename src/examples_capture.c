@@ -0,0 +1,578 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Command-stream capture implementation for cf4ocl-examples.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#include "examples_capture.h"
+#include <errno.h>
+
+/* A captured memory object. */
+struct ccl_ex_capture_mem {
+	/* Identifier in the capture file. */
+	guint id;
+	/* Element size for images, 0 for buffers. */
+	size_t elem_size;
+};
+
+/* Command-stream capture. */
+struct ccl_ex_capture {
+	/* Capture file. */
+	FILE* out;
+	/* Capture file name, for error messages. */
+	gchar* filename;
+	/* Queue identifiers (plus one), by queue. */
+	GHashTable* queues;
+	/* Captured memory objects, by memory object. */
+	GHashTable* mems;
+	/* Kernel function names, by kernel. */
+	GHashTable* kernels;
+	/* Command identifiers (plus one), by event. */
+	GHashTable* events;
+	/* Number of queues, memory objects and commands captured. */
+	guint num_queues;
+	guint num_mems;
+	guint num_cmds;
+	/* First error, reported when the capture is closed. */
+	GError* err;
+	/* Commands may be captured from different threads. */
+	GMutex lock;
+};
+
+/* Free a captured memory object (hash table value destroy function). */
+static void ccl_ex_capture_mem_free(gpointer data) {
+	g_slice_free(struct ccl_ex_capture_mem, data);
+}
+
+/* Identifier of a queue, writing a queue record the first time it is
+ * seen. Must be called with the lock held. */
+static guint ccl_ex_capture_queue_id(CCLExCapture* cap, CCLQueue* cq) {
+
+	guint id = GPOINTER_TO_UINT(g_hash_table_lookup(cap->queues, cq));
+	cl_command_queue_properties props;
+
+	if (id == 0) {
+		props = ccl_queue_get_info_scalar(cq, CL_QUEUE_PROPERTIES,
+			cl_command_queue_properties, &cap->err);
+		if (cap->err) return 0;
+		id = ++cap->num_queues;
+		g_hash_table_insert(cap->queues, cq, GUINT_TO_POINTER(id));
+		fprintf(cap->out, "Q\t%u\t%lu\n", id - 1, (unsigned long) props);
+	}
+	return id - 1;
+}
+
+/* Captured memory object, writing a buffer or image record the first
+ * time it is seen. Must be called with the lock held. */
+static struct ccl_ex_capture_mem* ccl_ex_capture_mem_get(
+	CCLExCapture* cap, void* memobj) {
+
+	struct ccl_ex_capture_mem* cm = g_hash_table_lookup(cap->mems, memobj);
+	cl_mem_object_type type;
+	cl_mem_flags flags;
+	cl_image_format fmt;
+	size_t size, width, height;
+
+	if (cm != NULL) return cm;
+
+	type = ccl_memobj_get_info_scalar(
+		memobj, CL_MEM_TYPE, cl_mem_object_type, &cap->err);
+	if (cap->err) return NULL;
+	flags = ccl_memobj_get_info_scalar(
+		memobj, CL_MEM_FLAGS, cl_mem_flags, &cap->err);
+	if (cap->err) return NULL;
+
+	cm = g_slice_new0(struct ccl_ex_capture_mem);
+	cm->id = cap->num_mems++;
+	g_hash_table_insert(cap->mems, memobj, cm);
+
+	if (type == CL_MEM_OBJECT_BUFFER) {
+		size = ccl_memobj_get_info_scalar(
+			memobj, CL_MEM_SIZE, size_t, &cap->err);
+		if (cap->err) return NULL;
+		fprintf(cap->out, "B\t%u\t%lu\t%lu\n", cm->id,
+			(unsigned long) flags, (unsigned long) size);
+	} else {
+		fmt = ccl_image_get_info_scalar((CCLImage*) memobj,
+			CL_IMAGE_FORMAT, cl_image_format, &cap->err);
+		if (cap->err) return NULL;
+		cm->elem_size = ccl_image_get_info_scalar((CCLImage*) memobj,
+			CL_IMAGE_ELEMENT_SIZE, size_t, &cap->err);
+		if (cap->err) return NULL;
+		width = ccl_image_get_info_scalar((CCLImage*) memobj,
+			CL_IMAGE_WIDTH, size_t, &cap->err);
+		if (cap->err) return NULL;
+		height = ccl_image_get_info_scalar((CCLImage*) memobj,
+			CL_IMAGE_HEIGHT, size_t, &cap->err);
+		if (cap->err) return NULL;
+		fprintf(cap->out, "I\t%u\t%lu\t%u\t%u\t%lu\t%lu\n", cm->id,
+			(unsigned long) flags, (unsigned int) fmt.image_channel_order,
+			(unsigned int) fmt.image_channel_data_type,
+			(unsigned long) width, (unsigned long) height);
+	}
+	return cm;
+}
+
+/* Function name of a kernel. Must be called with the lock held. */
+static const char* ccl_ex_capture_kernel_name(CCLExCapture* cap,
+	CCLKernel* krnl) {
+
+	const char* name = g_hash_table_lookup(cap->kernels, krnl);
+
+	if (name == NULL) {
+		name = ccl_kernel_get_info_array(
+			krnl, CL_KERNEL_FUNCTION_NAME, char, &cap->err);
+		if (cap->err) return NULL;
+		g_hash_table_insert(cap->kernels, krnl, g_strdup(name));
+		name = g_hash_table_lookup(cap->kernels, krnl);
+	}
+	return name;
+}
+
+/* Append a comma-separated list of sizes, or `-` if empty. */
+static void ccl_ex_capture_sizes(GString* str, cl_uint n,
+	const size_t* sizes) {
+
+	if ((n == 0) || (sizes == NULL)) {
+		g_string_append(str, "\t-");
+		return;
+	}
+	for (cl_uint i = 0; i < n; ++i)
+		g_string_append_printf(str, "%c%lu", i ? ',' : '\t',
+			(unsigned long) sizes[i]);
+}
+
+/* Append the command identifiers of a NULL-terminated list of events,
+ * ignoring events which were not captured. Must be called with the lock
+ * held. */
+static void ccl_ex_capture_waits(CCLExCapture* cap, GString* str,
+	va_list ap) {
+
+	CCLEvent* evt;
+	guint id, n = 0;
+
+	while ((evt = va_arg(ap, CCLEvent*)) != NULL) {
+		id = GPOINTER_TO_UINT(g_hash_table_lookup(cap->events, evt));
+		if (id > 0)
+			g_string_append_printf(str, "%c%u", n++ ? ',' : '\t', id - 1);
+	}
+	if (n == 0) g_string_append(str, "\t-");
+}
+
+/* Assign the next command identifier to an event. Must be called with
+ * the lock held. */
+static guint ccl_ex_capture_cmd(CCLExCapture* cap, CCLEvent* evt) {
+
+	guint id = cap->num_cmds++;
+
+	if (evt != NULL)
+		g_hash_table_insert(cap->events, evt, GUINT_TO_POINTER(id + 1));
+	return id;
+}
+
+/* Capture a read or write. */
+static void ccl_ex_capture_transfer(CCLExCapture* cap, char kind,
+	CCLEvent* evt, CCLQueue* cq, void* memobj, cl_bool blocking,
+	const size_t* origin, const size_t* region, va_list ap) {
+
+	struct ccl_ex_capture_mem* cm;
+	GString* line;
+	guint qid;
+	size_t bytes;
+
+	g_mutex_lock(&cap->lock);
+
+	if (cap->err) goto finish;
+	qid = ccl_ex_capture_queue_id(cap, cq);
+	if (cap->err) goto finish;
+	cm = ccl_ex_capture_mem_get(cap, memobj);
+	if (cap->err) goto finish;
+
+	/* Buffers have a single offset and size, images have 3D origin and
+	 * region. */
+	bytes = cm->elem_size > 0
+		? region[0] * region[1] * region[2] * cm->elem_size : region[0];
+
+	line = g_string_new(NULL);
+	g_string_printf(line, "%c\t%u\t%u\t%u\t%d", kind,
+		ccl_ex_capture_cmd(cap, evt), qid, cm->id, blocking ? 1 : 0);
+	ccl_ex_capture_sizes(line, cm->elem_size > 0 ? 3 : 1, origin);
+	ccl_ex_capture_sizes(line, cm->elem_size > 0 ? 3 : 1, region);
+	g_string_append_printf(line, "\t%lu", (unsigned long) bytes);
+	ccl_ex_capture_waits(cap, line, ap);
+	fprintf(cap->out, "%s\n", line->str);
+	g_string_free(line, TRUE);
+
+finish:
+	g_mutex_unlock(&cap->lock);
+}
+
+/**
+ * Start capturing commands to a file.
+ *
+ * @param[in] filename File where to write the command stream.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return A new capture object, to be closed with
+ * ccl_ex_capture_close(), or `NULL` if an error occurs.
+ * */
+CCLExCapture* ccl_ex_capture_new(const char* filename, GError** err) {
+
+	CCLExCapture* cap;
+	FILE* out;
+
+	g_return_val_if_fail(filename != NULL, NULL);
+	g_return_val_if_fail(err == NULL || *err == NULL, NULL);
+
+	if ((out = fopen(filename, "w")) == NULL) {
+		g_set_error(err, CCL_EX_ERROR, CCL_EX_FAIL,
+			"Unable to open '%s': %s", filename, g_strerror(errno));
+		return NULL;
+	}
+	fprintf(out, "%s\n", CCL_EX_CAPTURE_MAGIC);
+
+	cap = g_slice_new0(CCLExCapture);
+	cap->out = out;
+	cap->filename = g_strdup(filename);
+	cap->queues = g_hash_table_new(g_direct_hash, g_direct_equal);
+	cap->mems = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+		NULL, ccl_ex_capture_mem_free);
+	cap->kernels = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+		NULL, g_free);
+	cap->events = g_hash_table_new(g_direct_hash, g_direct_equal);
+	g_mutex_init(&cap->lock);
+
+	return cap;
+}
+
+/**
+ * Capture program sources and build options. Kernels captured
+ * afterwards must belong to a program built from these sources.
+ *
+ * @param[in] cap Capture object.
+ * @param[in] count Number of source files.
+ * @param[in] filenames Source files.
+ * @param[in] options Build options, or `NULL`.
+ * */
+void ccl_ex_capture_program(CCLExCapture* cap, cl_uint count,
+	const char* const* filenames, const char* options) {
+
+	gchar* src;
+	gchar* src_esc;
+	gchar* opts_esc;
+
+	g_return_if_fail(cap != NULL);
+
+	g_mutex_lock(&cap->lock);
+
+	opts_esc = options ? g_strescape(options, NULL) : g_strdup("-");
+	for (cl_uint i = 0; (i < count) && (cap->err == NULL); ++i) {
+		if (!g_file_get_contents(filenames[i], &src, NULL, &cap->err))
+			break;
+		src_esc = g_strescape(src, NULL);
+		fprintf(cap->out, "P\t%s\t%s\n", opts_esc, src_esc);
+		g_free(src_esc);
+		g_free(src);
+	}
+	g_free(opts_esc);
+
+	g_mutex_unlock(&cap->lock);
+}
+
+/**
+ * Capture a memory object kernel argument.
+ *
+ * @param[in] cap Capture object.
+ * @param[in] krnl Kernel.
+ * @param[in] index Argument index.
+ * @param[in] memobj Buffer or image.
+ * */
+void ccl_ex_capture_arg_mem(CCLExCapture* cap, CCLKernel* krnl,
+	cl_uint index, void* memobj) {
+
+	const char* name;
+	struct ccl_ex_capture_mem* cm;
+
+	g_return_if_fail(cap != NULL);
+
+	g_mutex_lock(&cap->lock);
+
+	if (cap->err) goto finish;
+	name = ccl_ex_capture_kernel_name(cap, krnl);
+	if (cap->err) goto finish;
+	cm = ccl_ex_capture_mem_get(cap, memobj);
+	if (cap->err) goto finish;
+	fprintf(cap->out, "A\t%s\t%u\tm\t%u\n", name, index, cm->id);
+
+finish:
+	g_mutex_unlock(&cap->lock);
+}
+
+/**
+ * Capture a private kernel argument.
+ *
+ * @param[in] cap Capture object.
+ * @param[in] krnl Kernel.
+ * @param[in] index Argument index.
+ * @param[in] value Argument value.
+ * @param[in] size Size of argument value in bytes.
+ * */
+void ccl_ex_capture_arg_priv(CCLExCapture* cap, CCLKernel* krnl,
+	cl_uint index, const void* value, size_t size) {
+
+	const char* name;
+
+	g_return_if_fail(cap != NULL);
+
+	g_mutex_lock(&cap->lock);
+
+	if (cap->err) goto finish;
+	name = ccl_ex_capture_kernel_name(cap, krnl);
+	if (cap->err) goto finish;
+	fprintf(cap->out, "A\t%s\t%u\tp\t", name, index);
+	for (size_t i = 0; i < size; ++i)
+		fprintf(cap->out, "%02x", ((const guchar*) value)[i]);
+	fprintf(cap->out, "\n");
+
+finish:
+	g_mutex_unlock(&cap->lock);
+}
+
+/**
+ * Capture a local memory kernel argument.
+ *
+ * @param[in] cap Capture object.
+ * @param[in] krnl Kernel.
+ * @param[in] index Argument index.
+ * @param[in] size Size of local memory in bytes.
+ * */
+void ccl_ex_capture_arg_local(CCLExCapture* cap, CCLKernel* krnl,
+	cl_uint index, size_t size) {
+
+	const char* name;
+
+	g_return_if_fail(cap != NULL);
+
+	g_mutex_lock(&cap->lock);
+
+	if (cap->err) goto finish;
+	name = ccl_ex_capture_kernel_name(cap, krnl);
+	if (cap->err) goto finish;
+	fprintf(cap->out, "A\t%s\t%u\tl\t%lu\n", name, index,
+		(unsigned long) size);
+
+finish:
+	g_mutex_unlock(&cap->lock);
+}
+
+/**
+ * Capture a kernel launch (without global work offset).
+ *
+ * @param[in] cap Capture object.
+ * @param[in] evt Event of the kernel launch.
+ * @param[in] cq Queue where the kernel was enqueued.
+ * @param[in] krnl Kernel.
+ * @param[in] dims Number of dimensions.
+ * @param[in] gws Global work size.
+ * @param[in] lws Local work size, or `NULL`.
+ * @param[in] ... `NULL`-terminated list of events the launch waited for.
+ * */
+void ccl_ex_capture_kernel(CCLExCapture* cap, CCLEvent* evt,
+	CCLQueue* cq, CCLKernel* krnl, cl_uint dims, const size_t* gws,
+	const size_t* lws, ...) {
+
+	const char* name;
+	GString* line;
+	guint qid;
+	va_list ap;
+
+	g_return_if_fail(cap != NULL);
+
+	g_mutex_lock(&cap->lock);
+
+	if (cap->err) goto finish;
+	qid = ccl_ex_capture_queue_id(cap, cq);
+	if (cap->err) goto finish;
+	name = ccl_ex_capture_kernel_name(cap, krnl);
+	if (cap->err) goto finish;
+
+	line = g_string_new(NULL);
+	g_string_printf(line, "K\t%u\t%u\t%s",
+		ccl_ex_capture_cmd(cap, evt), qid, name);
+	ccl_ex_capture_sizes(line, dims, gws);
+	ccl_ex_capture_sizes(line, dims, lws);
+	va_start(ap, lws);
+	ccl_ex_capture_waits(cap, line, ap);
+	va_end(ap);
+	fprintf(cap->out, "%s\n", line->str);
+	g_string_free(line, TRUE);
+
+finish:
+	g_mutex_unlock(&cap->lock);
+}
+
+/**
+ * Capture a read from a buffer or image.
+ *
+ * @param[in] cap Capture object.
+ * @param[in] evt Event of the read.
+ * @param[in] cq Queue where the read was enqueued.
+ * @param[in] memobj Buffer or image.
+ * @param[in] blocking Was the read blocking?
+ * @param[in] origin Buffer offset or 3D image origin.
+ * @param[in] region Buffer size or 3D image region.
+ * @param[in] ... `NULL`-terminated list of events the read waited for.
+ * */
+void ccl_ex_capture_read(CCLExCapture* cap, CCLEvent* evt, CCLQueue* cq,
+	void* memobj, cl_bool blocking, const size_t* origin,
+	const size_t* region, ...) {
+
+	va_list ap;
+
+	g_return_if_fail(cap != NULL);
+
+	va_start(ap, region);
+	ccl_ex_capture_transfer(cap, 'R', evt, cq, memobj, blocking,
+		origin, region, ap);
+	va_end(ap);
+}
+
+/**
+ * Capture a write to a buffer or image.
+ *
+ * @param[in] cap Capture object.
+ * @param[in] evt Event of the write.
+ * @param[in] cq Queue where the write was enqueued.
+ * @param[in] memobj Buffer or image.
+ * @param[in] blocking Was the write blocking?
+ * @param[in] origin Buffer offset or 3D image origin.
+ * @param[in] region Buffer size or 3D image region.
+ * @param[in] ... `NULL`-terminated list of events the write waited for.
+ * */
+void ccl_ex_capture_write(CCLExCapture* cap, CCLEvent* evt, CCLQueue* cq,
+	void* memobj, cl_bool blocking, const size_t* origin,
+	const size_t* region, ...) {
+
+	va_list ap;
+
+	g_return_if_fail(cap != NULL);
+
+	va_start(ap, region);
+	ccl_ex_capture_transfer(cap, 'W', evt, cq, memobj, blocking,
+		origin, region, ap);
+	va_end(ap);
+}
+
+/**
+ * Capture host waiting for events, which orders commands enqueued
+ * afterwards in any queue.
+ *
+ * @param[in] cap Capture object.
+ * @param[in] ... `NULL`-terminated list of events.
+ * */
+void ccl_ex_capture_wait(CCLExCapture* cap, ...) {
+
+	GString* line;
+	va_list ap;
+
+	g_return_if_fail(cap != NULL);
+
+	g_mutex_lock(&cap->lock);
+
+	if (cap->err) goto finish;
+	line = g_string_new(NULL);
+	g_string_printf(line, "S\t%u\tE", ccl_ex_capture_cmd(cap, NULL));
+	va_start(ap, cap);
+	ccl_ex_capture_waits(cap, line, ap);
+	va_end(ap);
+	fprintf(cap->out, "%s\n", line->str);
+	g_string_free(line, TRUE);
+
+finish:
+	g_mutex_unlock(&cap->lock);
+}
+
+/**
+ * Capture host finishing a queue.
+ *
+ * @param[in] cap Capture object.
+ * @param[in] cq Finished queue.
+ * */
+void ccl_ex_capture_finish(CCLExCapture* cap, CCLQueue* cq) {
+
+	guint qid;
+
+	g_return_if_fail(cap != NULL);
+
+	g_mutex_lock(&cap->lock);
+
+	if (cap->err) goto finish;
+	qid = ccl_ex_capture_queue_id(cap, cq);
+	if (cap->err) goto finish;
+	fprintf(cap->out, "S\t%u\tQ\t%u\n", ccl_ex_capture_cmd(cap, NULL), qid);
+
+finish:
+	g_mutex_unlock(&cap->lock);
+}
+
+/**
+ * Stop capturing, close the capture file and destroy the capture
+ * object.
+ *
+ * @param[in] cap Capture object.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return `TRUE` if all commands were captured, `FALSE` otherwise.
+ * */
+gboolean ccl_ex_capture_close(CCLExCapture* cap, GError** err) {
+
+	GError* err_internal;
+	int write_err;
+
+	g_return_val_if_fail(cap != NULL, FALSE);
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	write_err = ferror(cap->out);
+	if ((fclose(cap->out) != 0) || write_err)
+		write_err = TRUE;
+
+	err_internal = cap->err;
+	if ((err_internal == NULL) && write_err)
+		g_set_error(&err_internal, CCL_EX_ERROR, CCL_EX_FAIL,
+			"Unable to write '%s'.", cap->filename);
+
+	g_hash_table_destroy(cap->queues);
+	g_hash_table_destroy(cap->mems);
+	g_hash_table_destroy(cap->kernels);
+	g_hash_table_destroy(cap->events);
+	g_mutex_clear(&cap->lock);
+	g_free(cap->filename);
+	g_slice_free(CCLExCapture, cap);
+
+	if (err_internal) {
+		g_propagate_error(err, err_internal);
+		return FALSE;
+	}
+	return TRUE;
+}
@@ -0,0 +1,113 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Command-stream capture for cf4ocl-examples.
+ *
+ * Examples call the capture functions next to their own enqueues, so
+ * that the OpenCL command sequence can be replayed in isolation with the
+ * `cmd_replay` tool, without host threads, image encoding or file output
+ * perturbing the timings. Each command is written to the capture file as
+ * soon as it is captured, one tab-separated line per record:
+ *
+ * | Record                                                   | Meaning                                  |
+ * | -------------------------------------------------------- | ---------------------------------------- |
+ * | `P` _options_ _source_                                   | Program source file and build options    |
+ * | `Q` _queue_ _properties_                                 | Command queue                            |
+ * | `B` _mem_ _flags_ _size_                                 | Buffer                                   |
+ * | `I` _mem_ _flags_ _order_ _type_ _width_ _height_        | 2D image                                 |
+ * | `A` _kernel_ _index_ `m`/`p`/`l` _value_                 | Kernel argument (memory, private, local) |
+ * | `K` _cmd_ _queue_ _kernel_ _gws_ _lws_ _waits_           | Kernel launch                            |
+ * | `R`/`W` _cmd_ _queue_ _mem_ _block_ _origin_ _region_ _bytes_ _waits_ | Read or write            |
+ * | `S` _cmd_ `E` _events_, or `S` _cmd_ `Q` _queue_         | Host waits for events or finishes queue  |
+ *
+ * Lists (work sizes, origins, regions, events) are comma-separated, with
+ * `-` for an empty list. Sources and build options are escaped with
+ * g_strescape() and private argument values are written in hexadecimal.
+ * Kernel arguments keep their values between launches, as in OpenCL, so
+ * only arguments which change need to be captured.
+ *
+ * Only commands captured by the example are recorded, so commands
+ * enqueued internally by other modules (e.g. device input generation or
+ * instrumentation) are not part of the stream. Capture functions are
+ * thread-safe, and the order in which they are called is the replay
+ * order. A command must be captured before the host thread allows
+ * dependent commands to be enqueued in other threads. Errors are kept
+ * and reported by ccl_ex_capture_close().
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#ifndef _CCL_EXAMPLES_CAPTURE_H_
+#define _CCL_EXAMPLES_CAPTURE_H_
+
+#include "examples_common.h"
+
+/** First line of capture files. */
+#define CCL_EX_CAPTURE_MAGIC "# cf4ocl-examples command stream 1"
+
+/** Command-stream capture. */
+typedef struct ccl_ex_capture CCLExCapture;
+
+/* Start capturing commands to a file. */
+CCLExCapture* ccl_ex_capture_new(const char* filename, GError** err);
+
+/* Capture program sources and build options. */
+void ccl_ex_capture_program(CCLExCapture* cap, cl_uint count,
+	const char* const* filenames, const char* options);
+
+/* Capture a memory object kernel argument. */
+void ccl_ex_capture_arg_mem(CCLExCapture* cap, CCLKernel* krnl,
+	cl_uint index, void* memobj);
+
+/* Capture a private kernel argument. */
+void ccl_ex_capture_arg_priv(CCLExCapture* cap, CCLKernel* krnl,
+	cl_uint index, const void* value, size_t size);
+
+/* Capture a local memory kernel argument. */
+void ccl_ex_capture_arg_local(CCLExCapture* cap, CCLKernel* krnl,
+	cl_uint index, size_t size);
+
+/* Capture a kernel launch. */
+void ccl_ex_capture_kernel(CCLExCapture* cap, CCLEvent* evt,
+	CCLQueue* cq, CCLKernel* krnl, cl_uint dims, const size_t* gws,
+	const size_t* lws, ...) G_GNUC_NULL_TERMINATED;
+
+/* Capture a read from a buffer or image. */
+void ccl_ex_capture_read(CCLExCapture* cap, CCLEvent* evt, CCLQueue* cq,
+	void* memobj, cl_bool blocking, const size_t* origin,
+	const size_t* region, ...) G_GNUC_NULL_TERMINATED;
+
+/* Capture a write to a buffer or image. */
+void ccl_ex_capture_write(CCLExCapture* cap, CCLEvent* evt, CCLQueue* cq,
+	void* memobj, cl_bool blocking, const size_t* origin,
+	const size_t* region, ...) G_GNUC_NULL_TERMINATED;
+
+/* Capture host waiting for events. */
+void ccl_ex_capture_wait(CCLExCapture* cap, ...) G_GNUC_NULL_TERMINATED;
+
+/* Capture host finishing a queue. */
+void ccl_ex_capture_finish(CCLExCapture* cap, CCLQueue* cq);
+
+/* Stop capturing and close the capture file. */
+gboolean ccl_ex_capture_close(CCLExCapture* cap, GError** err);
+
+#endif
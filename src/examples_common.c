@@ -26,6 +26,31 @@
  * */
 
 #include "examples_common.h"
+#include "examples_footprint.h"
+#include <string.h>
+
+/* Format a work size with the given number of dimensions. */
+static void ccl_ex_ws_print(const char* label, cl_uint dims, size_t* ws) {
+
+	g_printf("     %-23s: (", label);
+	for (cl_uint i = 0; i < dims; i++)
+		g_printf(i > 0 ? ", %lu" : "%lu", (unsigned long) ws[i]);
+	g_printf(")\n");
+}
+
+/* Print device requirements for program with the given number of
+ * dimensions. */
+static void ccl_ex_reqs_print_dims(cl_uint dims, size_t* gws, size_t* lws,
+	size_t gmem, size_t lmem) {
+
+	g_printf("\n   ========================= Execution requirements ========================\n\n");
+	ccl_ex_ws_print("Global work size", dims, gws);
+	ccl_ex_ws_print("Local work size", dims, lws);
+	g_printf("     Global memory required : %lu bytes (%lu Kb = %lu Mb)\n",
+		(unsigned long) gmem, (unsigned long) (gmem / 1024), (unsigned long) (gmem / 1024 / 1024));
+	g_printf("     Local memory required  : %lu bytes (%lu Kb)\n",
+		(unsigned long) lmem, (unsigned long) (lmem / 1024));
+}
 
 /**
  * Print device requirements for program.
@@ -36,16 +61,322 @@
  * @param[in] lmem Local memory required.
  * */
 void ccl_ex_reqs_print(size_t* gws, size_t* lws, size_t gmem, size_t lmem) {
+	ccl_ex_reqs_print_dims(2, gws, lws, gmem, lmem);
+}
 
-	g_printf("\n   ========================= Execution requirements ========================\n\n");
-	g_printf("     Global work size       : (%lu, %lu)\n",
-		(unsigned long) gws[0], (unsigned long) gws[1]);
-	g_printf("     Local work size        : (%lu, %lu)\n",
-		(unsigned long) lws[0], (unsigned long) lws[1]);
-	g_printf("     Global memory required : %lu bytes (%lu Kb = %lu Mb)\n",
-		(unsigned long) gmem, (unsigned long) (gmem / 1024), (unsigned long) (gmem / 1024 / 1024));
-	g_printf("     Local memory required  : %lu bytes (%lu Kb)\n",
-		(unsigned long) lmem, (unsigned long) (lmem / 1024));
+/* Estimate number of work-groups which can be resident in one compute
+ * unit, given the local memory per work-group and the maximum kernel
+ * work-group size. OpenCL doesn't report register usage, so the only
+ * other bound is the number of work-items the runtime accepts in one
+ * work-group of this kernel. */
+static size_t ccl_ex_wgs_per_cu(size_t wg_size, size_t lmem,
+	cl_ulong dev_lmem, size_t krnl_wg_max, size_t* wgs_by_lmem) {
+
+	size_t wgs_by_items = (wg_size > 0) ? krnl_wg_max / wg_size : 0;
+
+	*wgs_by_lmem = (lmem > 0) ? (size_t) (dev_lmem / lmem) : G_MAXSIZE;
+	return MIN(*wgs_by_lmem, wgs_by_items);
+}
+
+/* Get the local memory statically used by a kernel (i.e. `__local`
+ * variables and implementation needs). CL_KERNEL_LOCAL_MEM_SIZE also
+ * counts local memory arguments once they are set, so it is queried on
+ * a new kernel object for the same function. */
+static cl_ulong ccl_ex_kernel_lmem_static(CCLKernel* krnl, CCLDevice* dev,
+	GError** err) {
+
+	GError* err_internal = NULL;
+	CCLProgram* prg = NULL;
+	CCLKernel* krnl_new = NULL;
+	cl_program prg_raw;
+	char* name;
+	cl_ulong lmem = 0;
+
+	prg_raw = ccl_kernel_get_info_scalar(
+		krnl, CL_KERNEL_PROGRAM, cl_program, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	name = ccl_kernel_get_info_array(
+		krnl, CL_KERNEL_FUNCTION_NAME, char, &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	/* Wrapping an already wrapped program only increments the reference
+	 * count of its wrapper. */
+	prg = ccl_program_new_wrap(prg_raw);
+	krnl_new = ccl_kernel_new(prg, name, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	lmem = ccl_kernel_get_workgroup_info_scalar(krnl_new, dev,
+		CL_KERNEL_LOCAL_MEM_SIZE, cl_ulong, &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	goto finish;
+
+error_handler:
+	g_propagate_error(err, err_internal);
+
+finish:
+	if (krnl_new) ccl_kernel_destroy(krnl_new);
+	if (prg) ccl_program_destroy(prg);
+	return lmem;
+}
+
+/* Does `l` fit and evenly divide global work size `g`? */
+#define CCL_EX_LWS_FITS(l, g) (((l) <= (g)) && ((g) % (l) == 0))
+
+/**
+ * Print device requirements for program and analyze them against the
+ * resources of the device and of the kernel.
+ *
+ * Kernel local and private memory, the preferred work-group size
+ * multiple and the device limits are queried. The number of work-groups
+ * which fit in a compute unit is estimated from the local memory per
+ * work-group (static kernel local memory plus `lmem`) and the maximum
+ * kernel work-group size, and warnings are given for work sizes which
+ * do not fit the device or are not a multiple of the preferred
+ * work-group size multiple. If a better local work size which evenly
+ * divides the global work size exists, it is suggested.
+ *
+ * @param[in] krnl Kernel to analyze.
+ * @param[in] dev Device where kernel will run.
+ * @param[in] dims Number of dimensions (1 to 3).
+ * @param[in] gws Global work size.
+ * @param[in] lws Local work size.
+ * @param[in] gmem Global memory required.
+ * @param[in] lmem Local memory required per work-group (dynamic local
+ * memory, i.e. local memory kernel arguments).
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * */
+void ccl_ex_reqs_analyze(CCLKernel* krnl, CCLDevice* dev, cl_uint dims,
+	size_t* gws, size_t* lws, size_t gmem, size_t lmem, GError** err) {
+
+	/* Internal error handling object. */
+	GError* err_internal = NULL;
+	/* Device limits. */
+	cl_uint dev_cus;
+	cl_ulong dev_lmem, dev_gmem, dev_maxalloc;
+	size_t dev_wg_max;
+	size_t* dev_wi_max;
+	/* Kernel resources. */
+	cl_ulong krnl_lmem, krnl_pmem;
+	size_t krnl_wg_max, krnl_pref;
+	/* Analysis. */
+	size_t wg_size = 1, num_wgs = 1, lmem_wg, lmem_wi;
+	size_t wgs_cu, wgs_by_lmem, waves;
+	size_t best_lws[3] = { 1, 1, 1 }, best_items = 0;
+	double tail_eff;
+	gboolean warned = FALSE;
+
+	g_return_if_fail(krnl != NULL);
+	g_return_if_fail(dev != NULL);
+	g_return_if_fail((dims >= 1) && (dims <= 3));
+
+	/* Print requirements as given. */
+	ccl_ex_reqs_print_dims(dims, gws, lws, gmem, lmem);
+
+	/* Query device limits. */
+	dev_cus = ccl_device_get_info_scalar(
+		dev, CL_DEVICE_MAX_COMPUTE_UNITS, cl_uint, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	dev_lmem = ccl_device_get_info_scalar(
+		dev, CL_DEVICE_LOCAL_MEM_SIZE, cl_ulong, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	dev_gmem = ccl_device_get_info_scalar(
+		dev, CL_DEVICE_GLOBAL_MEM_SIZE, cl_ulong, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	dev_maxalloc = ccl_device_get_info_scalar(
+		dev, CL_DEVICE_MAX_MEM_ALLOC_SIZE, cl_ulong, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	dev_wg_max = ccl_device_get_info_scalar(
+		dev, CL_DEVICE_MAX_WORK_GROUP_SIZE, size_t, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	dev_wi_max = ccl_device_get_info_array(
+		dev, CL_DEVICE_MAX_WORK_ITEM_SIZES, size_t, &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	/* Query kernel resources. */
+	krnl_lmem = ccl_ex_kernel_lmem_static(krnl, dev, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	krnl_pmem = ccl_kernel_get_workgroup_info_scalar(
+		krnl, dev, CL_KERNEL_PRIVATE_MEM_SIZE, cl_ulong, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	krnl_wg_max = ccl_kernel_get_workgroup_info_scalar(
+		krnl, dev, CL_KERNEL_WORK_GROUP_SIZE, size_t, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	krnl_pref = ccl_kernel_get_workgroup_info_scalar(krnl, dev,
+		CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, size_t,
+		&err_internal);
+	if_err_goto(err_internal, error_handler);
+	if (krnl_pref == 0) krnl_pref = 1;
+
+	/* Work-group size and number of work-groups. */
+	for (cl_uint i = 0; i < dims; i++) {
+		wg_size *= lws[i];
+		num_wgs *= (lws[i] > 0) ? (gws[i] + lws[i] - 1) / lws[i] : 0;
+	}
+
+	/* Local memory per work-group is the static kernel local memory plus
+	 * the local memory arguments. Only the latter is assumed to scale
+	 * with the work-group size. */
+	lmem_wg = (size_t) krnl_lmem + lmem;
+	lmem_wi = (wg_size > 0) ? lmem / wg_size : 0;
+
+	/* Occupancy estimate. */
+	wgs_cu = ccl_ex_wgs_per_cu(wg_size, lmem_wg, dev_lmem, krnl_wg_max,
+		&wgs_by_lmem);
+	waves = (wgs_cu > 0) ? (num_wgs + dev_cus * wgs_cu - 1)
+		/ (dev_cus * wgs_cu) : 0;
+	tail_eff = (waves > 0) ? 100.0 * num_wgs / (waves * dev_cus * wgs_cu)
+		: 0.0;
+
+	g_printf("\n   =========================== Resource analysis ===========================\n\n");
+	g_printf("     Compute units          : %u\n", dev_cus);
+	g_printf("     Max. work-group size   : %lu (device), %lu (kernel)\n",
+		(unsigned long) dev_wg_max, (unsigned long) krnl_wg_max);
+	g_printf("     Preferred WG multiple  : %lu\n", (unsigned long) krnl_pref);
+	g_printf("     Kernel local memory    : %lu bytes static + %lu bytes "
+		"args (device has %lu Kb)\n", (unsigned long) krnl_lmem,
+		(unsigned long) lmem, (unsigned long) (dev_lmem / 1024));
+	g_printf("     Kernel private memory  : %lu bytes per work-item\n",
+		(unsigned long) krnl_pmem);
+	g_printf("     Work-groups            : %lu of %lu work-items\n",
+		(unsigned long) num_wgs, (unsigned long) wg_size);
+	g_printf("     WGs per CU (estimate)  : %lu (local mem. limit: ",
+		(unsigned long) wgs_cu);
+	if (wgs_by_lmem == G_MAXSIZE) g_printf("none)\n");
+	else g_printf("%lu)\n", (unsigned long) wgs_by_lmem);
+	g_printf("     Waves / last wave use  : %lu / %.1f%%\n",
+		(unsigned long) waves, tail_eff);
+
+	/* Warnings. */
+	g_printf("\n");
+	if (wg_size > krnl_wg_max) {
+		g_printf("     ! Work-group size exceeds kernel maximum of %lu\n",
+			(unsigned long) krnl_wg_max);
+		warned = TRUE;
+	}
+	for (cl_uint i = 0; i < dims; i++) {
+		if (lws[i] > dev_wi_max[i]) {
+			g_printf("     ! Local work size in dimension %u exceeds device "
+				"maximum of %lu\n", i, (unsigned long) dev_wi_max[i]);
+			warned = TRUE;
+		}
+	}
+	if (lmem_wg > dev_lmem) {
+		g_printf("     ! Local memory per work-group exceeds device local "
+			"memory\n");
+		warned = TRUE;
+	}
+	if (gmem > dev_gmem) {
+		g_printf("     ! Global memory required exceeds device global "
+			"memory\n");
+		warned = TRUE;
+	} else if (gmem > dev_maxalloc) {
+		g_printf("     ! Global memory required exceeds max. allocation "
+			"size of %lu Mb; check individual buffers\n",
+			(unsigned long) (dev_maxalloc / 1024 / 1024));
+		warned = TRUE;
+	}
+	if (wg_size % krnl_pref != 0) {
+		g_printf("     ! Work-group size is not a multiple of %lu\n",
+			(unsigned long) krnl_pref);
+		warned = TRUE;
+	} else if (lws[0] % krnl_pref != 0) {
+		g_printf("     ! Local work size in dimension 0 is not a multiple "
+			"of %lu, accesses may not coalesce\n",
+			(unsigned long) krnl_pref);
+		warned = TRUE;
+	}
+	if (krnl_pmem > 0) {
+		g_printf("     ! Kernel uses private memory, possibly register "
+			"spills\n");
+		warned = TRUE;
+	}
+	if (!warned) g_printf("     No resource warnings\n");
+
+	/* Look for a better local work size: dimension 0 is a multiple of
+	 * the preferred multiple, remaining dimensions are powers of two,
+	 * and each dimension evenly divides the global work size. Local
+	 * memory arguments per work-item are assumed constant. The candidate
+	 * with most resident work-items per compute unit is chosen,
+	 * preferring wider work-groups in dimension 0. */
+	for (size_t l0 = krnl_pref; l0 <= MIN(krnl_wg_max, dev_wi_max[0]);
+		l0 += krnl_pref) {
+
+		if (!CCL_EX_LWS_FITS(l0, gws[0])) continue;
+
+		for (size_t l1 = 1; (dims >= 2) && (l1 <= dev_wi_max[1])
+			&& (l0 * l1 <= krnl_wg_max); l1 *= 2) {
+
+			size_t cand_wg = l0 * l1, cand_wgs, cand_items, unused;
+
+			if (!CCL_EX_LWS_FITS(l1, gws[1])) continue;
+
+			cand_wgs = ccl_ex_wgs_per_cu(cand_wg,
+				(size_t) krnl_lmem + lmem_wi * cand_wg, dev_lmem,
+				krnl_wg_max, &unused);
+			cand_items = cand_wgs * cand_wg;
+			if ((cand_items > best_items) || ((cand_items == best_items)
+				&& (l0 > best_lws[0]))) {
+
+				best_items = cand_items;
+				best_lws[0] = l0;
+				best_lws[1] = l1;
+			}
+		}
+
+		if (dims == 1) {
+			size_t cand_wgs, cand_items, unused;
+			cand_wgs = ccl_ex_wgs_per_cu(l0,
+				(size_t) krnl_lmem + lmem_wi * l0, dev_lmem,
+				krnl_wg_max, &unused);
+			cand_items = cand_wgs * l0;
+			if (cand_items >= best_items) {
+				best_items = cand_items;
+				best_lws[0] = l0;
+			}
+		}
+	}
+
+	/* Suggest if estimate is better than current local work size. */
+	if ((dims <= 2) && (best_items > wgs_cu * wg_size)) {
+		g_printf("     Suggested local work size : ");
+		if (dims == 1) g_printf("%lu", (unsigned long) best_lws[0]);
+		else g_printf("%lu,%lu", (unsigned long) best_lws[0],
+			(unsigned long) best_lws[1]);
+		g_printf(" (%lu vs %lu resident work-items per CU)\n",
+			(unsigned long) best_items, (unsigned long) (wgs_cu * wg_size));
+	}
+
+	/* If we got here, everything is OK. */
+	g_assert(err_internal == NULL);
+	return;
+
+error_handler:
+	/* If we got here there was an error, verify that it is so. */
+	g_assert(err_internal != NULL);
+	g_propagate_error(err, err_internal);
+}
+
+/**
+ * Get OpenCL compiler options for a program whose largest buffer has the
+ * given size. If the buffer is larger than #CCL_EX_IDX32_MAX_BYTES,
+ * `-D IDX64` is added to the options, so that kernels compute global
+ * indexes with 64-bit integers.
+ *
+ * @param[in] opts User compiler options, can be `NULL`.
+ * @param[in] max_buf_size Size in bytes of the largest buffer.
+ * @return Compiler options, should be freed with g_free().
+ * */
+gchar* ccl_ex_compiler_opts_get(const gchar* opts, size_t max_buf_size) {
+
+	/* Are 64-bit indexes required? */
+	if ((guint64) max_buf_size > CCL_EX_IDX32_MAX_BYTES) {
+		g_debug("Largest buffer has %zu bytes, using 64-bit indexes.",
+			max_buf_size);
+		return g_strdup_printf("%s -D IDX64", opts ? opts : "");
+	}
+
+	return g_strdup(opts ? opts : "");
 }
 
 /**
@@ -90,6 +421,477 @@ gchar* ccl_ex_kernelpath_get(gchar* kernel_filename, char* exec_name) {
 
 }
 
+/* Calibration kernels: single precision multiply-add chains and a
+ * global memory copy. */
+static const char* ccl_ex_devsel_src =
+	"__kernel void calib_compute(__global float* out, uint iters) {\n"
+	"	float4 x = (float4) (get_global_id(0), 1.0f, 2.0f, 3.0f) * 1e-7f;\n"
+	"	for (uint i = 0; i < iters; ++i)\n"
+	"		x = mad(x, (float4) 0.999f, (float4) 1e-3f);\n"
+	"	out[get_global_id(0)] = x.x + x.y + x.z + x.w;\n"
+	"}\n"
+	"__kernel void calib_memory(__global const float4* in,\n"
+	"	__global float4* out) {\n"
+	"	out[get_global_id(0)] = in[get_global_id(0)];\n"
+	"}\n";
+
+/* Work-items and iterations of the compute calibration kernel. */
+#define CCL_EX_DEVSEL_ITEMS (1 << 20)
+#define CCL_EX_DEVSEL_ITERS 256
+
+/* Largest buffer of the memory calibration kernel. */
+#define CCL_EX_DEVSEL_BYTES (64 * 1024 * 1024)
+
+/* Timed runs of each calibration kernel, after one warm-up run. */
+#define CCL_EX_DEVSEL_RUNS 3
+
+/* Names of workload classes, used as keys of the calibration cache. */
+static const char* ccl_ex_workload_names[] = { "compute", "memory" };
+
+/* Get calibration cache file path. */
+static gchar* ccl_ex_devsel_cache_path(void) {
+
+	const gchar* env = g_getenv("CCL_EX_DEVSEL_CACHE");
+
+	if (env != NULL) return g_strdup(env);
+	return g_build_filename(
+		g_get_user_cache_dir(), "cf4ocl-examples", "devsel.ini", NULL);
+}
+
+/* Get calibration cache key of a device. */
+static gchar* ccl_ex_devsel_key(CCLDevice* dev, GError** err) {
+
+	GError* err_internal = NULL;
+	char* dev_name;
+	char* driver;
+	gchar* key;
+
+	dev_name = ccl_device_get_info_array(
+		dev, CL_DEVICE_NAME, char, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	driver = ccl_device_get_info_array(
+		dev, CL_DRIVER_VERSION, char, &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	key = g_strdup_printf("%s|%s", dev_name, driver);
+	g_strcanon(key,
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+		"0123456789 ._-|^()", '_');
+	return key;
+
+error_handler:
+	g_propagate_error(err, err_internal);
+	return NULL;
+}
+
+/* Run a calibration kernel and return its best time in seconds. */
+static double ccl_ex_devsel_time(CCLKernel* krnl, CCLQueue* cq,
+	size_t gws, CCLBuffer* buf1, CCLBuffer* buf2, GError** err) {
+
+	CCLEvent* evt;
+	CCLEventWaitList ewl = NULL;
+	GError* err_internal = NULL;
+	cl_ulong tstart, tend;
+	cl_uint iters = CCL_EX_DEVSEL_ITERS;
+	double t, t_best = -1;
+
+	for (int r = 0; r <= CCL_EX_DEVSEL_RUNS; ++r) {
+
+		if (buf2 == NULL)
+			evt = ccl_kernel_set_args_and_enqueue_ndrange(krnl, cq, 1,
+				NULL, &gws, NULL, NULL, &err_internal,
+				buf1, ccl_arg_priv(iters, cl_uint), NULL);
+		else
+			evt = ccl_kernel_set_args_and_enqueue_ndrange(krnl, cq, 1,
+				NULL, &gws, NULL, NULL, &err_internal,
+				buf1, buf2, NULL);
+		if_err_goto(err_internal, error_handler);
+		ccl_event_wait_list_add(&ewl, evt, NULL);
+		ccl_event_wait(&ewl, &err_internal);
+		if_err_goto(err_internal, error_handler);
+
+		/* First run is a warm-up. */
+		if (r == 0) continue;
+
+		tstart = ccl_event_get_profiling_info_scalar(
+			evt, CL_PROFILING_COMMAND_START, cl_ulong, &err_internal);
+		if_err_goto(err_internal, error_handler);
+		tend = ccl_event_get_profiling_info_scalar(
+			evt, CL_PROFILING_COMMAND_END, cl_ulong, &err_internal);
+		if_err_goto(err_internal, error_handler);
+
+		t = (tend - tstart) * 1e-9;
+		if ((t_best < 0) || (t < t_best)) t_best = t;
+	}
+
+	return t_best;
+
+error_handler:
+	g_propagate_error(err, err_internal);
+	return -1;
+}
+
+/* Measure the throughput of a device for a workload class, in GFLOP/s
+ * (compute) or GB/s (memory). */
+static double ccl_ex_devsel_calibrate(CCLDevice* dev,
+	CCLExWorkload workload, GError** err) {
+
+	GError* err_internal = NULL;
+	CCLContext* ctx = NULL;
+	CCLQueue* cq = NULL;
+	CCLProgram* prg = NULL;
+	CCLKernel* krnl;
+	CCLBuffer* buf1 = NULL;
+	CCLBuffer* buf2 = NULL;
+	cl_ulong max_alloc;
+	size_t bytes;
+	double t, score = -1;
+
+	ctx = ccl_context_new_from_devices(1, &dev, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	cq = ccl_queue_new(ctx, dev, CL_QUEUE_PROFILING_ENABLE, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	prg = ccl_program_new_from_source(ctx, ccl_ex_devsel_src, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	ccl_program_build(prg, NULL, &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	if (workload == CCL_EX_WORKLOAD_COMPUTE) {
+
+		/* Eight flops per iteration of each work-item. */
+		krnl = ccl_program_get_kernel(prg, "calib_compute", &err_internal);
+		if_err_goto(err_internal, error_handler);
+		buf1 = ccl_ex_footprint_buffer_new(ctx, CL_MEM_WRITE_ONLY,
+			CCL_EX_DEVSEL_ITEMS * sizeof(cl_float), NULL, &err_internal);
+		if_err_goto(err_internal, error_handler);
+		t = ccl_ex_devsel_time(krnl, cq, CCL_EX_DEVSEL_ITEMS, buf1, NULL,
+			&err_internal);
+		if_err_goto(err_internal, error_handler);
+		score = 8.0 * CCL_EX_DEVSEL_ITEMS * CCL_EX_DEVSEL_ITERS / t * 1e-9;
+
+	} else {
+
+		/* Each byte is read and written once. */
+		max_alloc = ccl_device_get_info_scalar(
+			dev, CL_DEVICE_MAX_MEM_ALLOC_SIZE, cl_ulong, &err_internal);
+		if_err_goto(err_internal, error_handler);
+		bytes = (size_t) MIN((cl_ulong) CCL_EX_DEVSEL_BYTES, max_alloc / 2);
+		bytes -= bytes % sizeof(cl_float4);
+		krnl = ccl_program_get_kernel(prg, "calib_memory", &err_internal);
+		if_err_goto(err_internal, error_handler);
+		buf1 = ccl_ex_footprint_buffer_new(ctx, CL_MEM_READ_ONLY,
+			bytes, NULL, &err_internal);
+		if_err_goto(err_internal, error_handler);
+		buf2 = ccl_ex_footprint_buffer_new(ctx, CL_MEM_WRITE_ONLY,
+			bytes, NULL, &err_internal);
+		if_err_goto(err_internal, error_handler);
+		t = ccl_ex_devsel_time(krnl, cq, bytes / sizeof(cl_float4),
+			buf1, buf2, &err_internal);
+		if_err_goto(err_internal, error_handler);
+		score = 2.0 * bytes / t * 1e-9;
+
+	}
+
+	goto finish;
+
+error_handler:
+	g_propagate_error(err, err_internal);
+
+finish:
+	if (buf1) ccl_ex_footprint_buffer_destroy(buf1);
+	if (buf2) ccl_ex_footprint_buffer_destroy(buf2);
+	if (prg) ccl_program_destroy(prg);
+	if (cq) ccl_queue_destroy(cq);
+	if (ctx) ccl_context_destroy(ctx);
+	return score;
+}
+
+/* Get the throughput of a device for a workload class from the
+ * calibration cache, or calibrate the device and cache the result.
+ * Devices which fail to calibrate get a throughput of zero, which is
+ * not cached, so that they are measured again on the next selection. */
+static double ccl_ex_devsel_score(CCLDevice* dev, CCLExWorkload workload,
+	GError** err) {
+
+	GKeyFile* kf = g_key_file_new();
+	gchar* path = ccl_ex_devsel_cache_path();
+	gchar* dir = NULL;
+	gchar* key;
+	const char* wname = ccl_ex_workload_names[workload];
+	GError* err_internal = NULL;
+	double score = -1;
+
+	key = ccl_ex_devsel_key(dev, &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	/* Try cache first. */
+	if (g_key_file_load_from_file(kf, path, G_KEY_FILE_KEEP_COMMENTS, NULL)
+		&& g_key_file_has_key(kf, key, wname, NULL)) {
+
+		score = g_key_file_get_double(kf, key, wname, NULL);
+		g_debug("Device '%s': %s throughput %g (cached).", key, wname, score);
+		goto finish;
+	}
+
+	/* Calibrate and cache result. */
+	score = ccl_ex_devsel_calibrate(dev, workload, &err_internal);
+	if (err_internal != NULL) {
+		g_debug("Device '%s' failed to calibrate: %s", key,
+			err_internal->message);
+		g_clear_error(&err_internal);
+		score = 0;
+		goto finish;
+	}
+	g_debug("Device '%s': %s throughput %g.", key, wname, score);
+
+	g_key_file_set_double(kf, key, wname, score);
+	dir = g_path_get_dirname(path);
+	g_mkdir_with_parents(dir, 0755);
+	if (!g_key_file_save_to_file(kf, path, &err_internal)) {
+		/* A missing cache only makes the next selection slower. */
+		g_debug("Unable to save calibration cache: %s",
+			err_internal->message);
+		g_clear_error(&err_internal);
+	}
+
+	goto finish;
+
+error_handler:
+	g_propagate_error(err, err_internal);
+
+finish:
+	g_key_file_free(kf);
+	g_free(path);
+	g_free(dir);
+	g_free(key);
+	return score;
+}
+
+/* Device selection filter: device meets the requirements. */
+static cl_bool ccl_ex_devsel_reqs(CCLDevice* dev, void* data,
+	CCLErr** err) {
+
+	const CCLExDevReqs* reqs = (const CCLExDevReqs*) data;
+	GError* err_internal = NULL;
+	cl_bool images;
+	cl_ulong lmem;
+	char* exts;
+
+	if (reqs->images) {
+		images = ccl_device_get_info_scalar(
+			dev, CL_DEVICE_IMAGE_SUPPORT, cl_bool, &err_internal);
+		if_err_goto(err_internal, error_handler);
+		if (!images) return CL_FALSE;
+	}
+	if (reqs->fp64) {
+		exts = ccl_device_get_info_array(
+			dev, CL_DEVICE_EXTENSIONS, char, &err_internal);
+		if_err_goto(err_internal, error_handler);
+		if (strstr(exts, "cl_khr_fp64") == NULL) return CL_FALSE;
+	}
+	if (reqs->local_mem > 0) {
+		lmem = ccl_device_get_info_scalar(
+			dev, CL_DEVICE_LOCAL_MEM_SIZE, cl_ulong, &err_internal);
+		if_err_goto(err_internal, error_handler);
+		if (lmem < reqs->local_mem) return CL_FALSE;
+	}
+	return CL_TRUE;
+
+error_handler:
+	g_propagate_error(err, err_internal);
+	return CL_FALSE;
+}
+
+/* Data for the device index selection filter. */
+struct ccl_ex_devsel_index_data {
+	const CCLExDevReqs* reqs;
+	cl_int index;
+};
+
+/* Device selection filter: keep the device with the given index in the
+ * list of all devices, as shown by `ccl_devsel_print_device_strings()`,
+ * failing if it doesn't meet the requirements. Invalid indexes show a
+ * menu of the devices which meet the requirements. */
+static CCLDevSelDevices ccl_ex_devsel_index(CCLDevSelDevices devices,
+	void* data, CCLErr** err) {
+
+	const struct ccl_ex_devsel_index_data* sel =
+		(const struct ccl_ex_devsel_index_data*) data;
+	GError* err_internal = NULL;
+	cl_bool meets;
+
+	/* Invalid index, select from the devices which meet the
+	 * requirements. */
+	if ((sel->index < 0) || ((guint) sel->index >= devices->len)) {
+		for (guint i = devices->len; i > 0; --i) {
+			meets = ccl_ex_devsel_reqs((CCLDevice*) devices->pdata[i - 1],
+				(void*) sel->reqs, &err_internal);
+			if_err_goto(err_internal, error_handler);
+			if (!meets) g_ptr_array_remove_index(devices, i - 1);
+		}
+		if_err_create_goto(err_internal, CCL_EX_ERROR,
+			devices->len == 0, CCL_EX_FAIL, error_handler,
+			"No device meets the requirements of this example.");
+		return ccl_devsel_dep_menu(devices, NULL, err);
+	}
+
+	/* Valid index, the device must meet the requirements. */
+	meets = ccl_ex_devsel_reqs((CCLDevice*) devices->pdata[sel->index],
+		(void*) sel->reqs, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	if_err_create_goto(err_internal, CCL_EX_ERROR, !meets, CCL_EX_FAIL,
+		error_handler,
+		"Device %d does not meet the requirements of this example.",
+		sel->index);
+
+	/* Remove all other devices. */
+	for (guint i = devices->len; i > 0; --i)
+		if (i - 1 != (guint) sel->index)
+			g_ptr_array_remove_index(devices, i - 1);
+
+	return devices;
+
+error_handler:
+	g_propagate_error(err, err_internal);
+	return NULL;
+}
+
+/* Device selection filter: keep the device with highest throughput for
+ * the workload class. */
+static CCLDevSelDevices ccl_ex_devsel_fastest(CCLDevSelDevices devices,
+	void* data, CCLErr** err) {
+
+	const CCLExDevReqs* reqs = (const CCLExDevReqs*) data;
+	GError* err_internal = NULL;
+	double score, best_score = -1;
+	guint best = 0;
+
+	for (guint i = 0; i < devices->len; ++i) {
+		score = ccl_ex_devsel_score((CCLDevice*) devices->pdata[i],
+			reqs->workload, &err_internal);
+		if_err_goto(err_internal, error_handler);
+		if (score > best_score) {
+			best_score = score;
+			best = i;
+		}
+	}
+
+	/* Remove all other devices. */
+	for (guint i = devices->len; i > 0; --i)
+		if (i - 1 != best) g_ptr_array_remove_index(devices, i - 1);
+
+	return devices;
+
+error_handler:
+	g_propagate_error(err, err_internal);
+	return NULL;
+}
+
+/**
+ * Create a context with a device selected by capability and, optionally,
+ * by measured throughput, without user interaction unless asked for.
+ *
+ * Only devices which meet the requirements in `reqs` are considered.
+ * The selector can be:
+ *
+ * * `menu` - select from a menu if more than one device is available.
+ * * A device index, as shown by the `-i/--list` option of the examples;
+ *   the device must meet the requirements, and invalid indexes show the
+ *   menu.
+ * * `first` - first device.
+ * * `gpu`, `cpu` or `accel` - first device of the given type.
+ * * `fastest` - device with highest throughput for the workload class
+ *   of `reqs`. Each candidate runs a short calibration kernel, whose
+ *   result is cached per device and driver (in
+ *   `cf4ocl-examples/devsel.ini` in the user cache directory, or in the
+ *   file given by the `CCL_EX_DEVSEL_CACHE` environment variable).
+ *
+ * If `selector` is `NULL`, the `CCL_EX_DEVICE` environment variable is
+ * used, then the fallback selector in `reqs`, and finally `menu`.
+ *
+ * @param[in] selector Device selector, or `NULL`.
+ * @param[in] reqs Device requirements and workload class.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return A new context wrapper with one device, or `NULL` if an error
+ * occurs (e.g. no device meets the requirements).
+ * */
+CCLContext* ccl_ex_context_new(const char* selector,
+	const CCLExDevReqs* reqs, GError** err) {
+
+	CCLDevSelFilters filters = NULL;
+	CCLContext* ctx;
+	gchar* end;
+	struct ccl_ex_devsel_index_data sel = { reqs, -1 };
+	cl_uint first = 0;
+
+	g_return_val_if_fail(reqs != NULL, NULL);
+	g_return_val_if_fail(err == NULL || *err == NULL, NULL);
+
+	/* Determine selector. */
+	if ((selector == NULL) || (*selector == '\0'))
+		selector = g_getenv("CCL_EX_DEVICE");
+	if ((selector == NULL) || (*selector == '\0'))
+		selector = reqs->fallback;
+	if ((selector == NULL) || (*selector == '\0'))
+		selector = "menu";
+
+	/* Parse device index before creating filters. */
+	if (g_ascii_isdigit(*selector)) {
+		sel.index = (cl_int) g_ascii_strtoll(selector, &end, 10);
+		if (*end != '\0') {
+			g_set_error(err, CCL_EX_ERROR, CCL_EX_FAIL,
+				"Invalid device selector '%s'.", selector);
+			return NULL;
+		}
+	} else if ((g_strcmp0(selector, "fastest") != 0)
+		&& (g_strcmp0(selector, "first") != 0)
+		&& (g_strcmp0(selector, "gpu") != 0)
+		&& (g_strcmp0(selector, "cpu") != 0)
+		&& (g_strcmp0(selector, "accel") != 0)
+		&& (g_strcmp0(selector, "menu") != 0)) {
+		g_set_error(err, CCL_EX_ERROR, CCL_EX_FAIL,
+			"Unknown device selector '%s'.", selector);
+		return NULL;
+	}
+
+	/* A device index refers to the list of all devices, so requirements
+	 * are checked on the selected device only. */
+	if (sel.index >= 0) {
+		ccl_devsel_add_dep_filter(&filters, ccl_ex_devsel_index, &sel);
+		return ccl_context_new_from_filters(&filters, err);
+	}
+
+	/* Otherwise, only consider devices which meet the requirements. */
+	ccl_devsel_add_indep_filter(&filters, ccl_ex_devsel_reqs,
+		(void*) reqs);
+
+	if (g_strcmp0(selector, "fastest") == 0) {
+		ccl_devsel_add_dep_filter(&filters, ccl_ex_devsel_fastest,
+			(void*) reqs);
+	} else if (g_strcmp0(selector, "first") == 0) {
+		ccl_devsel_add_dep_filter(&filters, ccl_devsel_dep_index, &first);
+	} else if (g_strcmp0(selector, "gpu") == 0) {
+		ccl_devsel_add_indep_filter(&filters, ccl_devsel_indep_type_gpu,
+			NULL);
+		ccl_devsel_add_dep_filter(&filters, ccl_devsel_dep_index, &first);
+	} else if (g_strcmp0(selector, "cpu") == 0) {
+		ccl_devsel_add_indep_filter(&filters, ccl_devsel_indep_type_cpu,
+			NULL);
+		ccl_devsel_add_dep_filter(&filters, ccl_devsel_dep_index, &first);
+	} else if (g_strcmp0(selector, "accel") == 0) {
+		ccl_devsel_add_indep_filter(&filters, ccl_devsel_indep_type_accel,
+			NULL);
+		ccl_devsel_add_dep_filter(&filters, ccl_devsel_dep_index, &first);
+	} else {
+		/* Menu. */
+		ccl_devsel_add_dep_filter(&filters, ccl_devsel_dep_menu, NULL);
+	}
+
+	ctx = ccl_context_new_from_filters(&filters, err);
+	return ctx;
+}
+
 /**
  * Print executable version.
  *
@@ -36,8 +36,15 @@
 #include <stdio.h>
 #include <cf4ocl2.h>
 
+/** Buffers larger than this (4 GiB) require 64-bit kernel indexes. */
+#define CCL_EX_IDX32_MAX_BYTES G_GUINT64_CONSTANT(4294967296)
+
 /**
- * Parse a pair of positive integers from a string separated by a comma.
+ * Parse a pair of integers from a string separated by a comma.
+ *
+ * Values are read as 64-bit integers, so this macro can fill both `int`
+ * and `size_t` arrays. Values which don't fit the type of `out` are
+ * rejected, including negative values when `out` is unsigned.
  *
  * @param[in] in Input string from where to extract pair of integers.
  * @param[in] out Array where to put pair of integers.
@@ -50,15 +57,23 @@
 #define ccl_ex_parse_pairs(in, out, option_name, data, err) \
 	/* Avoid compiler warnings. */ \
 	option_name = option_name; data = data; \
+	gint64 _pair[2]; \
 	/* Two numbers must be read... */ \
-	if (sscanf(in, "%6d,%6d", (int*) &out[0], (int*) &out[1]) == 2) { \
+	if ((sscanf(in, "%" G_GINT64_MODIFIER "d,%" G_GINT64_MODIFIER "d", \
+			&_pair[0], &_pair[1]) == 2) \
+		/* ...and fit in the output array, keeping their sign (negative \
+		 * values wrap around to positive ones in unsigned arrays). */ \
+		&& ((gint64) (out[0] = _pair[0]) == _pair[0]) \
+		&& ((out[0] > 0) == (_pair[0] > 0)) \
+		&& ((gint64) (out[1] = _pair[1]) == _pair[1]) \
+		&& ((out[1] > 0) == (_pair[1] > 0))) { \
 		/* Ok! */ \
 		return TRUE; \
 	} else { \
 		/* Bad argument. */ \
 		g_set_error(err, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE, \
 			"The option '%s' does not accept the argument '%s'", \
-			option_name, value); \
+			option_name, in); \
 		return FALSE; \
 	}
 
@@ -105,12 +120,52 @@
 /* Print device requirements for program. */
 void ccl_ex_reqs_print(size_t* gws, size_t* lws, size_t gmem, size_t lmem);
 
+/* Print device requirements for program and analyze them against the
+ * resources of the device and kernel. */
+void ccl_ex_reqs_analyze(CCLKernel* krnl, CCLDevice* dev, cl_uint dims,
+	size_t* gws, size_t* lws, size_t gmem, size_t lmem, GError** err);
+
+/* Get OpenCL compiler options, selecting 64-bit kernel indexes for
+ * buffers larger than 4 GiB. */
+gchar* ccl_ex_compiler_opts_get(const gchar* opts, size_t max_buf_size);
+
 /* Get full kernel path name. */
 gchar* ccl_ex_kernelpath_get(gchar* kernel_filename, char* exec_name);
 
 /* Print executable version. */
 void ccl_ex_version_print(const char* exec_name);
 
+/**
+ * Workload class, used to select the fastest device.
+ * */
+typedef enum ccl_ex_workload {
+	/** Compute bound, measured in GFLOP/s. */
+	CCL_EX_WORKLOAD_COMPUTE = 0,
+	/** Memory bound, measured in GB/s. */
+	CCL_EX_WORKLOAD_MEMORY = 1
+} CCLExWorkload;
+
+/**
+ * Device requirements for ccl_ex_context_new().
+ * */
+typedef struct ccl_ex_devreqs {
+	/** Device must support images. */
+	gboolean images;
+	/** Device must support double precision. */
+	gboolean fp64;
+	/** Minimum local memory size in bytes (0 for any). */
+	cl_ulong local_mem;
+	/** Workload class of the example. */
+	CCLExWorkload workload;
+	/** Selector used if none is given, or `NULL` for the menu. */
+	const char* fallback;
+} CCLExDevReqs;
+
+/* Create a context with a device selected by capability and measured
+ * throughput. */
+CCLContext* ccl_ex_context_new(const char* selector,
+	const CCLExDevReqs* reqs, GError** err);
+
 /**
  * Error codes.
  * */
@@ -0,0 +1,234 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Counter-based input generation implementation for cf4ocl-examples.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#include "examples_fill.h"
+
+/* Device input generator. */
+struct ccl_ex_fill {
+	/* Program with the input generation kernels. */
+	CCLProgram* prg;
+	/* Device where kernels run. */
+	CCLDevice* dev;
+};
+
+/**
+ * Create a device input generator. The program in
+ * #CCL_EX_FILL_KERNEL_FILE is built for the first device in the
+ * context.
+ *
+ * @param[in] ctx Context wrapper.
+ * @param[in] exec_name Name of executable (argv[0]), used to find the
+ * kernel file.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return A new device input generator, or `NULL` if an error occurs.
+ * */
+CCLExFill* ccl_ex_fill_new(CCLContext* ctx, char* exec_name,
+	GError** err) {
+
+	CCLExFill* fill = g_slice_new0(CCLExFill);
+	gchar* kernel_path = NULL;
+	GError* err_internal = NULL;
+
+	fill->dev = ccl_context_get_device(ctx, 0, &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	kernel_path = ccl_ex_kernelpath_get(CCL_EX_FILL_KERNEL_FILE, exec_name);
+	fill->prg = ccl_program_new_from_source_file(
+		ctx, kernel_path, &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	ccl_program_build(fill->prg, NULL, &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	g_free(kernel_path);
+	return fill;
+
+error_handler:
+	/* If we got here there was an error, verify that it is so. */
+	g_assert(err_internal != NULL);
+	g_propagate_error(err, err_internal);
+	if (kernel_path) g_free(kernel_path);
+	ccl_ex_fill_destroy(fill);
+	return NULL;
+}
+
+/**
+ * Fill buffer with integers in the interval [`min`, `max`) on the
+ * device. The buffer will contain the same values as an array filled
+ * with ccl_ex_fill_int_host().
+ *
+ * @param[in] fill Device input generator.
+ * @param[in] cq Command queue wrapper.
+ * @param[in] buf Buffer to fill.
+ * @param[in] n Number of `cl_int` elements to fill.
+ * @param[in] seed Seed.
+ * @param[in] min Minimum value.
+ * @param[in] max Maximum value (exclusive), must not be smaller than
+ * `min`. If equal to `min`, the buffer is filled with `min`.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return Event wrapper of the fill kernel, or `NULL` if an error
+ * occurs.
+ * */
+CCLEvent* ccl_ex_fill_int(CCLExFill* fill, CCLQueue* cq, CCLBuffer* buf,
+	size_t n, cl_uint seed, cl_int min, cl_int max, GError** err) {
+
+	CCLKernel* krnl;
+	CCLEvent* evt;
+	size_t gws, lws = 0;
+	cl_ulong n_arg = n;
+	cl_uint range = (cl_uint) max - (cl_uint) min;
+	GError* err_internal = NULL;
+
+	if_err_create_goto(err_internal, CCL_EX_ERROR, max < min,
+		CCL_EX_FAIL, error_handler,
+		"Invalid fill range: maximum %d is smaller than minimum %d.",
+		max, min);
+
+	krnl = ccl_program_get_kernel(fill->prg, "fill_int", &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	ccl_kernel_suggest_worksizes(krnl, fill->dev, 1, &n, &gws, &lws,
+		&err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	evt = ccl_kernel_set_args_and_enqueue_ndrange(
+		krnl, cq, 1, NULL, &gws, &lws, NULL, &err_internal,
+		buf, ccl_arg_priv(n_arg, cl_ulong), ccl_arg_priv(seed, cl_uint),
+		ccl_arg_priv(min, cl_int), ccl_arg_priv(range, cl_uint), NULL);
+	if_err_goto(err_internal, error_handler);
+
+	return evt;
+
+error_handler:
+	/* If we got here there was an error, verify that it is so. */
+	g_assert(err_internal != NULL);
+	g_propagate_error(err, err_internal);
+	return NULL;
+}
+
+/**
+ * Fill image with an initial cellular automata state on the device. The
+ * image will contain the same values as an array filled with
+ * ccl_ex_fill_ca_host().
+ *
+ * @param[in] fill Device input generator.
+ * @param[in] cq Command queue wrapper.
+ * @param[in] img Image to fill, with `CL_RGBA` / `CL_UNSIGNED_INT8`
+ * format.
+ * @param[in] width Image width.
+ * @param[in] height Image height.
+ * @param[in] seed Seed.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return Event wrapper of the fill kernel, or `NULL` if an error
+ * occurs.
+ * */
+CCLEvent* ccl_ex_fill_ca(CCLExFill* fill, CCLQueue* cq, CCLImage* img,
+	size_t width, size_t height, cl_uint seed, GError** err) {
+
+	CCLKernel* krnl;
+	size_t rws[2] = { width, height }, gws[2], lws[2] = { 0, 0 };
+
+	krnl = ccl_program_get_kernel(fill->prg, "fill_ca", err);
+	if (!krnl) return NULL;
+
+	if (!ccl_kernel_suggest_worksizes(krnl, fill->dev, 2, rws, gws, lws,
+		err)) return NULL;
+
+	return ccl_kernel_set_args_and_enqueue_ndrange(
+		krnl, cq, 2, NULL, gws, lws, NULL, err,
+		img, ccl_arg_priv(seed, cl_uint), NULL);
+}
+
+/**
+ * Destroy a device input generator.
+ *
+ * @param[in] fill Device input generator to destroy.
+ * */
+void ccl_ex_fill_destroy(CCLExFill* fill) {
+	if (fill->prg) ccl_program_destroy(fill->prg);
+	g_slice_free(CCLExFill, fill);
+}
+
+/**
+ * Host implementation of the counter-based hash used by the kernels in
+ * #CCL_EX_FILL_KERNEL_FILE.
+ *
+ * @param[in] seed Seed.
+ * @param[in] index Element index.
+ * @return 32-bit pseudo-random value.
+ * */
+cl_uint ccl_ex_fill_hash(cl_uint seed, cl_ulong index) {
+	cl_ulong z = index * G_GUINT64_CONSTANT(0x9E3779B97F4A7C15)
+		+ (((cl_ulong) seed) + 1) * G_GUINT64_CONSTANT(0xD1B54A32D192ED03);
+	z = (z ^ (z >> 30)) * G_GUINT64_CONSTANT(0xBF58476D1CE4E5B9);
+	z = (z ^ (z >> 27)) * G_GUINT64_CONSTANT(0x94D049BB133111EB);
+	return (cl_uint) ((z ^ (z >> 31)) >> 32);
+}
+
+/**
+ * Fill array with integers in the interval [`min`, `max`) on the host,
+ * with the same values as ccl_ex_fill_int().
+ *
+ * @param[out] out Array to fill.
+ * @param[in] n Number of elements to fill.
+ * @param[in] seed Seed.
+ * @param[in] min Minimum value.
+ * @param[in] max Maximum value (exclusive), must not be smaller than
+ * `min`. If equal to `min`, the array is filled with `min`.
+ * */
+void ccl_ex_fill_int_host(cl_int* out, size_t n, cl_uint seed,
+	cl_int min, cl_int max) {
+
+	cl_uint range = (cl_uint) max - (cl_uint) min;
+
+	g_return_if_fail(max >= min);
+
+	for (size_t i = 0; i < n; ++i)
+		out[i] = (cl_int) ((cl_uint) min + (cl_uint)
+			((((cl_ulong) ccl_ex_fill_hash(seed, i)) * range) >> 32));
+}
+
+/**
+ * Fill array with an initial cellular automata state on the host, with
+ * the same values as ccl_ex_fill_ca().
+ *
+ * @param[out] out Array to fill, in row-major order.
+ * @param[in] width Image width.
+ * @param[in] height Image height.
+ * @param[in] seed Seed.
+ * */
+void ccl_ex_fill_ca_host(cl_uchar4* out, size_t width, size_t height,
+	cl_uint seed) {
+
+	for (size_t i = 0; i < width * height; ++i) {
+		cl_uchar state = (ccl_ex_fill_hash(seed, i) & 0x3) ? 0xFF : 0x00;
+		out[i] = (cl_uchar4) {{ state, state, state, 0xFF }};
+	}
+}
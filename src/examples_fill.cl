@@ -0,0 +1,82 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Kernels which generate example inputs directly on the device. Each
+ * element is a function of the seed and of its index only, so elements
+ * are generated in parallel and in any order. The host implementation
+ * in examples_fill.c must produce the same values.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+/**
+ * Counter-based hash of seed and index (SplitMix64 finalizer).
+ *
+ * @param[in] seed Seed.
+ * @param[in] index Element index.
+ * @return 32-bit pseudo-random value.
+ * */
+uint fill_hash(uint seed, ulong index) {
+	ulong z = index * 0x9E3779B97F4A7C15UL
+		+ (((ulong) seed) + 1) * 0xD1B54A32D192ED03UL;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9UL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBUL;
+	return (uint) ((z ^ (z >> 31)) >> 32);
+}
+
+/**
+ * Fill buffer with integers in the interval [`min`, `min + range`).
+ *
+ * @param[out] out Buffer to fill.
+ * @param[in] n Number of elements in buffer.
+ * @param[in] seed Seed.
+ * @param[in] min Minimum value.
+ * @param[in] range Number of possible values.
+ * */
+__kernel void fill_int(__global int* out, const ulong n, const uint seed,
+	const int min, const uint range) {
+
+	ulong gid = get_global_id(0);
+
+	if (gid < n)
+		out[gid] = as_int((uint) min
+			+ (uint) ((((ulong) fill_hash(seed, gid)) * range) >> 32));
+}
+
+/**
+ * Fill image with an initial cellular automata state. One in four cells
+ * is alive.
+ *
+ * @param[out] img Image to fill.
+ * @param[in] seed Seed.
+ * */
+__kernel void fill_ca(__write_only image2d_t img, const uint seed) {
+
+	int2 imdim = get_image_dim(img);
+	int2 coord = (int2) (get_global_id(0), get_global_id(1));
+
+	if (all(coord < imdim)) {
+		ulong index = ((ulong) coord.y) * imdim.x + coord.x;
+		uint state = (fill_hash(seed, index) & 0x3) ? 0xFF : 0x00;
+		write_imageui(img, coord, (uint4) (state, state, state, 0xFF));
+	}
+}
@@ -0,0 +1,72 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Counter-based input generation for cf4ocl-examples.
+ *
+ * Inputs are generated from a seed and the element index, either on
+ * the device, with the kernels in `examples_fill.cl`, or on the host,
+ * with the same values. Device generation avoids generating and
+ * uploading large inputs on the host, while the host implementation
+ * provides the inputs required for verification.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#ifndef _CCL_EXAMPLES_FILL_H_
+#define _CCL_EXAMPLES_FILL_H_
+
+#include "examples_common.h"
+
+/** File with the input generation kernels, which should be in the same
+ * location as the example executable. */
+#define CCL_EX_FILL_KERNEL_FILE "examples_fill.cl"
+
+/** Device input generator. */
+typedef struct ccl_ex_fill CCLExFill;
+
+/* Create a device input generator. */
+CCLExFill* ccl_ex_fill_new(CCLContext* ctx, char* exec_name,
+	GError** err);
+
+/* Fill buffer with integers on the device. */
+CCLEvent* ccl_ex_fill_int(CCLExFill* fill, CCLQueue* cq, CCLBuffer* buf,
+	size_t n, cl_uint seed, cl_int min, cl_int max, GError** err);
+
+/* Fill image with an initial cellular automata state on the device. */
+CCLEvent* ccl_ex_fill_ca(CCLExFill* fill, CCLQueue* cq, CCLImage* img,
+	size_t width, size_t height, cl_uint seed, GError** err);
+
+/* Destroy a device input generator. */
+void ccl_ex_fill_destroy(CCLExFill* fill);
+
+/* Host implementation of the counter-based hash. */
+cl_uint ccl_ex_fill_hash(cl_uint seed, cl_ulong index);
+
+/* Fill array with integers on the host. */
+void ccl_ex_fill_int_host(cl_int* out, size_t n, cl_uint seed,
+	cl_int min, cl_int max);
+
+/* Fill array with an initial cellular automata state on the host. */
+void ccl_ex_fill_ca_host(cl_uchar4* out, size_t width, size_t height,
+	cl_uint seed);
+
+#endif
@@ -0,0 +1,457 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Memory footprint accounting implementation for cf4ocl-examples.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#include "examples_footprint.h"
+
+#ifdef G_OS_UNIX
+	#include <unistd.h>
+	#include <sys/resource.h>
+#endif
+
+/* Accounted memory. */
+struct ccl_ex_footprint_entry {
+	/* Category. */
+	CCLExFootprintCat cat;
+	/* Size in bytes. */
+	size_t bytes;
+};
+
+/* A problem size parameter. */
+struct ccl_ex_footprint_param {
+	gchar* name;
+	gint64 value;
+};
+
+/* Accounted memory, statistics and parameters, protected by a lock. */
+static GMutex footprint_lock;
+static GHashTable* footprint_entries = NULL;
+static CCLExFootprintStats footprint_stats;
+static GArray* footprint_params = NULL;
+
+/* Report destination at exit. */
+static gchar* footprint_exec_name = NULL;
+static FILE* footprint_out = NULL;
+
+/* Category names, for reports. */
+static const char* footprint_cat_names[] = { "host", "device", "pinned" };
+
+/* Current resident set size in bytes, or 0 if unknown. */
+static size_t ccl_ex_footprint_rss(void) {
+
+	size_t rss = 0;
+#ifdef G_OS_UNIX
+	FILE* statm;
+	unsigned long size, resident;
+
+	/* Linux: second field of /proc/self/statm, in pages. */
+	if ((statm = fopen("/proc/self/statm", "r")) != NULL) {
+		if (fscanf(statm, "%lu %lu", &size, &resident) == 2)
+			rss = (size_t) resident * sysconf(_SC_PAGESIZE);
+		fclose(statm);
+	}
+#endif
+	return rss;
+}
+
+/* Sample RSS. Must be called with the lock held. */
+static void ccl_ex_footprint_sample_locked(void) {
+
+	footprint_stats.rss = ccl_ex_footprint_rss();
+	footprint_stats.rss_peak =
+		MAX(footprint_stats.rss_peak, footprint_stats.rss);
+	footprint_stats.rss_samples++;
+}
+
+/**
+ * Account for memory.
+ *
+ * @param[in] cat Memory category.
+ * @param[in] key Key which identifies the memory, usually its address
+ * or wrapper.
+ * @param[in] bytes Size in bytes.
+ * */
+void ccl_ex_footprint_add(CCLExFootprintCat cat, const void* key,
+	size_t bytes) {
+
+	struct ccl_ex_footprint_entry* entry;
+	size_t total = 0;
+
+	g_return_if_fail(key != NULL);
+	g_return_if_fail(cat < CCL_EX_FOOTPRINT_NUM_CATS);
+
+	entry = g_slice_new(struct ccl_ex_footprint_entry);
+	entry->cat = cat;
+	entry->bytes = bytes;
+
+	g_mutex_lock(&footprint_lock);
+
+	if (footprint_entries == NULL)
+		footprint_entries = g_hash_table_new(g_direct_hash, g_direct_equal);
+	g_hash_table_insert(footprint_entries, (gpointer) key, entry);
+
+	footprint_stats.allocs[cat]++;
+	footprint_stats.bytes[cat] += bytes;
+	footprint_stats.bytes_peak[cat] =
+		MAX(footprint_stats.bytes_peak[cat], footprint_stats.bytes[cat]);
+	for (guint i = 0; i < CCL_EX_FOOTPRINT_NUM_CATS; i++)
+		total += footprint_stats.bytes[i];
+	footprint_stats.bytes_peak_total =
+		MAX(footprint_stats.bytes_peak_total, total);
+
+	ccl_ex_footprint_sample_locked();
+
+	g_mutex_unlock(&footprint_lock);
+}
+
+/**
+ * Stop accounting for memory added with ccl_ex_footprint_add(). Does
+ * nothing if the key is not known.
+ *
+ * @param[in] key Key which identifies the memory.
+ * */
+void ccl_ex_footprint_remove(const void* key) {
+
+	struct ccl_ex_footprint_entry* entry = NULL;
+
+	g_mutex_lock(&footprint_lock);
+
+	/* Sample before removing, memory may still be resident. */
+	ccl_ex_footprint_sample_locked();
+
+	if (footprint_entries != NULL)
+		entry = g_hash_table_lookup(footprint_entries, key);
+	if (entry != NULL) {
+		g_hash_table_remove(footprint_entries, key);
+		footprint_stats.bytes[entry->cat] -= entry->bytes;
+	}
+
+	g_mutex_unlock(&footprint_lock);
+
+	if (entry != NULL) g_slice_free(struct ccl_ex_footprint_entry, entry);
+}
+
+/**
+ * Category of a memory object created with the given flags. Memory
+ * allocated by the OpenCL implementation in host memory
+ * (`CL_MEM_ALLOC_HOST_PTR`) is pinned, other memory objects are device
+ * memory.
+ *
+ * @param[in] flags Memory flags.
+ * @return Memory category.
+ * */
+CCLExFootprintCat ccl_ex_footprint_cat(cl_mem_flags flags) {
+	return (flags & CL_MEM_ALLOC_HOST_PTR)
+		? CCL_EX_FOOTPRINT_PINNED : CCL_EX_FOOTPRINT_DEVICE;
+}
+
+/**
+ * Size in bytes of one pixel with the given image format (formats used
+ * in the examples only; others are assumed to have 4 channels of 4
+ * bytes).
+ *
+ * @param[in] image_format Image format.
+ * @return Size in bytes of one pixel.
+ * */
+size_t ccl_ex_footprint_pixel_size(const cl_image_format* image_format) {
+
+	size_t channels, channel_size;
+
+	switch (image_format->image_channel_order) {
+		case CL_R: channels = 1; break;
+		case CL_RGBA: channels = 4; break;
+		default: channels = 4;
+	}
+	switch (image_format->image_channel_data_type) {
+		case CL_UNSIGNED_INT8: channel_size = 1; break;
+		case CL_SIGNED_INT32: channel_size = 4; break;
+		default: channel_size = 4;
+	}
+	return channels * channel_size;
+}
+
+/**
+ * Create a buffer and account for it. Same parameters as
+ * `ccl_buffer_new()`.
+ *
+ * @param[in] ctx Context.
+ * @param[in] flags Memory flags.
+ * @param[in] size Size in bytes.
+ * @param[in] host_ptr Host pointer, or `NULL`.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return A new buffer, or `NULL` if an error occurs.
+ * */
+CCLBuffer* ccl_ex_footprint_buffer_new(CCLContext* ctx,
+	cl_mem_flags flags, size_t size, void* host_ptr, GError** err) {
+
+	CCLBuffer* buf = ccl_buffer_new(ctx, flags, size, host_ptr, err);
+	if (buf != NULL)
+		ccl_ex_footprint_add(ccl_ex_footprint_cat(flags), buf, size);
+	return buf;
+}
+
+/**
+ * Destroy a buffer created with ccl_ex_footprint_buffer_new().
+ *
+ * @param[in] buf Buffer to destroy.
+ * */
+void ccl_ex_footprint_buffer_destroy(CCLBuffer* buf) {
+	ccl_ex_footprint_remove(buf);
+	ccl_buffer_destroy(buf);
+}
+
+/**
+ * Create a 2D image and account for it.
+ *
+ * @param[in] ctx Context.
+ * @param[in] flags Memory flags.
+ * @param[in] image_format Image format.
+ * @param[in] width Image width in pixels.
+ * @param[in] height Image height in pixels.
+ * @param[in] host_ptr Host pointer, or `NULL`.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return A new image, or `NULL` if an error occurs.
+ * */
+CCLImage* ccl_ex_footprint_image2d_new(CCLContext* ctx,
+	cl_mem_flags flags, const cl_image_format* image_format,
+	size_t width, size_t height, void* host_ptr, GError** err) {
+
+	CCLImage* img = ccl_image_new(ctx, flags, image_format, host_ptr, err,
+		"image_type", (cl_mem_object_type) CL_MEM_OBJECT_IMAGE2D,
+		"image_width", width,
+		"image_height", height,
+		NULL);
+	if (img != NULL)
+		ccl_ex_footprint_add(ccl_ex_footprint_cat(flags), img,
+			width * height * ccl_ex_footprint_pixel_size(image_format));
+	return img;
+}
+
+/**
+ * Destroy an image created with ccl_ex_footprint_image2d_new().
+ *
+ * @param[in] img Image to destroy.
+ * */
+void ccl_ex_footprint_image_destroy(CCLImage* img) {
+	ccl_ex_footprint_remove(img);
+	ccl_image_destroy(img);
+}
+
+/**
+ * Sample process RSS. RSS is also sampled whenever memory is added or
+ * removed; examples should sample it where usage is expected to peak,
+ * e.g. after host buffers are filled.
+ * */
+void ccl_ex_footprint_sample(void) {
+	g_mutex_lock(&footprint_lock);
+	ccl_ex_footprint_sample_locked();
+	g_mutex_unlock(&footprint_lock);
+}
+
+/**
+ * Describe problem size with a named parameter, for the report. Setting
+ * a parameter again replaces its value.
+ *
+ * @param[in] name Parameter name.
+ * @param[in] value Parameter value.
+ * */
+void ccl_ex_footprint_param(const char* name, gint64 value) {
+
+	struct ccl_ex_footprint_param param;
+
+	g_return_if_fail(name != NULL);
+
+	g_mutex_lock(&footprint_lock);
+
+	if (footprint_params == NULL)
+		footprint_params = g_array_new(FALSE, FALSE,
+			sizeof(struct ccl_ex_footprint_param));
+	for (guint i = 0; i < footprint_params->len; i++) {
+		struct ccl_ex_footprint_param* p = &g_array_index(
+			footprint_params, struct ccl_ex_footprint_param, i);
+		if (g_strcmp0(p->name, name) == 0) {
+			p->value = value;
+			g_mutex_unlock(&footprint_lock);
+			return;
+		}
+	}
+	param.name = g_strdup(name);
+	param.value = value;
+	g_array_append_val(footprint_params, param);
+
+	g_mutex_unlock(&footprint_lock);
+}
+
+/**
+ * Get memory footprint statistics. Samples RSS.
+ *
+ * @param[out] stats Location where to place statistics.
+ * */
+void ccl_ex_footprint_stats_get(CCLExFootprintStats* stats) {
+
+	g_return_if_fail(stats != NULL);
+
+	g_mutex_lock(&footprint_lock);
+	ccl_ex_footprint_sample_locked();
+	*stats = footprint_stats;
+	g_mutex_unlock(&footprint_lock);
+
+	/* Peak RSS according to the OS (kilobytes on Linux). */
+	stats->rss_max = 0;
+#ifdef G_OS_UNIX
+	{
+		struct rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) == 0)
+			stats->rss_max = (size_t) usage.ru_maxrss * 1024;
+	}
+#endif
+}
+
+/**
+ * Print memory footprint report.
+ *
+ * @param[in] out Stream where to print report (examples which write
+ * data to `stdout` should use `stderr`).
+ * */
+void ccl_ex_footprint_print(FILE* out) {
+
+	CCLExFootprintStats s;
+
+	ccl_ex_footprint_stats_get(&s);
+
+	g_fprintf(out, "\n   ========================= Memory footprint ==============================\n\n");
+	for (guint i = 0; i < CCL_EX_FOOTPRINT_NUM_CATS; i++) {
+		g_fprintf(out, "     %-7s current / peak : %lu / %lu Kb (%lu allocations)\n",
+			footprint_cat_names[i],
+			(unsigned long) (s.bytes[i] / 1024),
+			(unsigned long) (s.bytes_peak[i] / 1024), s.allocs[i]);
+	}
+	g_fprintf(out, "     Peak total             : %lu Kb\n",
+		(unsigned long) (s.bytes_peak_total / 1024));
+	g_fprintf(out, "     RSS current / peak     : %lu / %lu Kb (%lu samples)\n",
+		(unsigned long) (s.rss / 1024), (unsigned long) (s.rss_peak / 1024),
+		s.rss_samples);
+	g_fprintf(out, "     RSS peak (OS)          : %lu Kb\n",
+		(unsigned long) (s.rss_max / 1024));
+}
+
+/**
+ * Save memory footprint report as JSON.
+ *
+ * @param[in] filename File where to save report.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return `TRUE` if successful, `FALSE` otherwise.
+ * */
+gboolean ccl_ex_footprint_json_save(const char* filename, GError** err) {
+
+	CCLExFootprintStats s;
+	GString* json;
+	gboolean ok;
+
+	ccl_ex_footprint_stats_get(&s);
+
+	json = g_string_new("{\n");
+	g_string_append_printf(json, "  \"program\": \"%s\",\n",
+		footprint_exec_name ? footprint_exec_name : "");
+
+	/* Problem size. */
+	g_string_append(json, "  \"params\": {");
+	g_mutex_lock(&footprint_lock);
+	for (guint i = 0; footprint_params && i < footprint_params->len; i++) {
+		struct ccl_ex_footprint_param* p = &g_array_index(
+			footprint_params, struct ccl_ex_footprint_param, i);
+		g_string_append_printf(json, "%s\"%s\": %" G_GINT64_FORMAT,
+			i ? ", " : "", p->name, p->value);
+	}
+	g_mutex_unlock(&footprint_lock);
+	g_string_append(json, "},\n");
+
+	/* Categories. */
+	g_string_append(json, "  \"memory\": {\n");
+	for (guint i = 0; i < CCL_EX_FOOTPRINT_NUM_CATS; i++) {
+		g_string_append_printf(json, "    \"%s\": { \"current\": %"
+			G_GUINT64_FORMAT ", \"peak\": %" G_GUINT64_FORMAT
+			", \"allocations\": %lu }%s\n",
+			footprint_cat_names[i], (guint64) s.bytes[i],
+			(guint64) s.bytes_peak[i], s.allocs[i],
+			i < CCL_EX_FOOTPRINT_NUM_CATS - 1 ? "," : "");
+	}
+	g_string_append(json, "  },\n");
+	g_string_append_printf(json, "  \"peak_total\": %" G_GUINT64_FORMAT
+		",\n", (guint64) s.bytes_peak_total);
+
+	/* RSS. */
+	g_string_append_printf(json, "  \"rss\": { \"current\": %"
+		G_GUINT64_FORMAT ", \"peak_sampled\": %" G_GUINT64_FORMAT
+		", \"peak\": %" G_GUINT64_FORMAT ", \"samples\": %lu }\n}\n",
+		(guint64) s.rss, (guint64) s.rss_peak, (guint64) s.rss_max,
+		s.rss_samples);
+
+	ok = g_file_set_contents(filename, json->str, json->len, err);
+	g_string_free(json, TRUE);
+	return ok;
+}
+
+/* Print and save report as requested, registered with atexit(). */
+static void ccl_ex_footprint_at_exit(void) {
+
+	GError* err = NULL;
+	const gchar* filename = g_getenv(CCL_EX_FOOTPRINT_JSON_ENV);
+
+	if (g_getenv(CCL_EX_FOOTPRINT_ENV) != NULL)
+		ccl_ex_footprint_print(footprint_out);
+	if (filename && !ccl_ex_footprint_json_save(filename, &err)) {
+		g_fprintf(stderr, "Unable to save memory footprint: %s\n",
+			err->message);
+		g_error_free(err);
+	}
+	g_free(footprint_exec_name);
+	footprint_exec_name = NULL;
+}
+
+/**
+ * Print and save memory footprint report when the program exits,
+ * normally or by calling `exit()`, if requested with the
+ * ::CCL_EX_FOOTPRINT_ENV and ::CCL_EX_FOOTPRINT_JSON_ENV environment
+ * variables. Should be called once, at the start of the program.
+ *
+ * @param[in] exec_name Executable name (`argv[0]`).
+ * @param[in] out Stream where to print report.
+ * */
+void ccl_ex_footprint_report_at_exit(const char* exec_name, FILE* out) {
+
+	g_return_if_fail(footprint_exec_name == NULL);
+
+	if ((g_getenv(CCL_EX_FOOTPRINT_ENV) == NULL)
+		&& (g_getenv(CCL_EX_FOOTPRINT_JSON_ENV) == NULL)) return;
+
+	footprint_exec_name = g_path_get_basename(exec_name);
+	footprint_out = out;
+	atexit(ccl_ex_footprint_at_exit);
+}
@@ -0,0 +1,136 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Memory footprint accounting for cf4ocl-examples.
+ *
+ * Keeps current and peak bytes of host memory, device memory and pinned
+ * (`CL_MEM_ALLOC_HOST_PTR`) memory, and samples the resident set size
+ * (RSS) of the process whenever memory is added or removed. Host buffers
+ * allocated with ccl_ex_hugemem_alloc(), memory objects created with
+ * the wrappers below and memory objects of the device memory pool are
+ * accounted for automatically.
+ *
+ * An example calls ccl_ex_footprint_report_at_exit() once, and
+ * optionally describes its problem size with ccl_ex_footprint_param().
+ * At exit, a report is printed if the ::CCL_EX_FOOTPRINT_ENV
+ * environment variable is set, and saved as JSON in the file given by
+ * the ::CCL_EX_FOOTPRINT_JSON_ENV environment variable, if set, so that
+ * memory scaling can be checked against problem size.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#ifndef _CCL_EXAMPLES_FOOTPRINT_H_
+#define _CCL_EXAMPLES_FOOTPRINT_H_
+
+#include "examples_common.h"
+
+/** Environment variable which enables printing the report at exit. */
+#define CCL_EX_FOOTPRINT_ENV "CCL_EX_FOOTPRINT"
+
+/** Environment variable with the file where the JSON report is saved
+ * at exit. */
+#define CCL_EX_FOOTPRINT_JSON_ENV "CCL_EX_FOOTPRINT_JSON"
+
+/**
+ * Memory categories.
+ * */
+typedef enum ccl_ex_footprint_cat {
+	/** Host memory. */
+	CCL_EX_FOOTPRINT_HOST = 0,
+	/** Device memory. */
+	CCL_EX_FOOTPRINT_DEVICE = 1,
+	/** Pinned host memory, allocated by the OpenCL implementation. */
+	CCL_EX_FOOTPRINT_PINNED = 2,
+	/** Number of categories. */
+	CCL_EX_FOOTPRINT_NUM_CATS = 3
+} CCLExFootprintCat;
+
+/** Memory footprint statistics. */
+typedef struct ccl_ex_footprint_stats {
+
+	/** Current bytes, per category. */
+	size_t bytes[CCL_EX_FOOTPRINT_NUM_CATS];
+	/** Peak bytes, per category. */
+	size_t bytes_peak[CCL_EX_FOOTPRINT_NUM_CATS];
+	/** Peak of the sum of all categories. */
+	size_t bytes_peak_total;
+	/** Number of allocations, per category. */
+	gulong allocs[CCL_EX_FOOTPRINT_NUM_CATS];
+	/** Last sampled RSS in bytes (0 if unknown). */
+	size_t rss;
+	/** Peak of sampled RSS in bytes. */
+	size_t rss_peak;
+	/** Peak RSS in bytes as reported by the OS (0 if unknown). */
+	size_t rss_max;
+	/** Number of RSS samples. */
+	gulong rss_samples;
+
+} CCLExFootprintStats;
+
+/* Account for memory. */
+void ccl_ex_footprint_add(CCLExFootprintCat cat, const void* key,
+	size_t bytes);
+
+/* Stop accounting for memory. */
+void ccl_ex_footprint_remove(const void* key);
+
+/* Category of a memory object created with the given flags. */
+CCLExFootprintCat ccl_ex_footprint_cat(cl_mem_flags flags);
+
+/* Size in bytes of one pixel with the given image format. */
+size_t ccl_ex_footprint_pixel_size(const cl_image_format* image_format);
+
+/* Create a buffer and account for it. */
+CCLBuffer* ccl_ex_footprint_buffer_new(CCLContext* ctx,
+	cl_mem_flags flags, size_t size, void* host_ptr, GError** err);
+
+/* Destroy a buffer created with ccl_ex_footprint_buffer_new(). */
+void ccl_ex_footprint_buffer_destroy(CCLBuffer* buf);
+
+/* Create a 2D image and account for it. */
+CCLImage* ccl_ex_footprint_image2d_new(CCLContext* ctx,
+	cl_mem_flags flags, const cl_image_format* image_format,
+	size_t width, size_t height, void* host_ptr, GError** err);
+
+/* Destroy an image created with ccl_ex_footprint_image2d_new(). */
+void ccl_ex_footprint_image_destroy(CCLImage* img);
+
+/* Sample process RSS. */
+void ccl_ex_footprint_sample(void);
+
+/* Describe problem size with a named parameter, for the report. */
+void ccl_ex_footprint_param(const char* name, gint64 value);
+
+/* Get memory footprint statistics. */
+void ccl_ex_footprint_stats_get(CCLExFootprintStats* stats);
+
+/* Print memory footprint report. */
+void ccl_ex_footprint_print(FILE* out);
+
+/* Save memory footprint report as JSON. */
+gboolean ccl_ex_footprint_json_save(const char* filename, GError** err);
+
+/* Print and save memory footprint report when the program exits. */
+void ccl_ex_footprint_report_at_exit(const char* exec_name, FILE* out);
+
+#endif
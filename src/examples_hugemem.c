@@ -0,0 +1,336 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Huge page backed host memory implementation for cf4ocl-examples.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#include "examples_hugemem.h"
+#include "examples_footprint.h"
+
+#ifdef __linux__
+	#define CCL_EX_HUGEMEM_LINUX
+	#include <sys/mman.h>
+#endif
+
+/* A host buffer allocated by this module. */
+struct ccl_ex_hugemem_entry {
+	/* Mapped (or allocated) size in bytes. */
+	size_t size;
+	/* How the buffer is backed. */
+	CCLExHugeMemKind kind;
+};
+
+/* Allocated buffers, protected by a lock. */
+static GMutex hugemem_lock;
+static GHashTable* hugemem_entries = NULL;
+
+/* Statistics. */
+static CCLExHugeMemStats hugemem_stats;
+
+/* Best kind to try first, from environment or configuration. */
+static CCLExHugeMemKind ccl_ex_hugemem_kind_wanted(void) {
+
+	static gsize init = 0;
+	static CCLExHugeMemKind kind;
+
+	if (g_once_init_enter(&init)) {
+		const gchar* env = g_getenv("CCL_EX_HUGEMEM");
+#ifdef WITH_HUGETLB
+		kind = CCL_EX_HUGEMEM_HUGETLB;
+#else
+		kind = CCL_EX_HUGEMEM_THP;
+#endif
+		if (env != NULL) {
+			if (!g_ascii_strcasecmp(env, "off")
+					|| !g_ascii_strcasecmp(env, "0"))
+				kind = CCL_EX_HUGEMEM_MALLOC;
+			else if (!g_ascii_strcasecmp(env, "thp"))
+				kind = CCL_EX_HUGEMEM_THP;
+			else if (!g_ascii_strcasecmp(env, "hugetlb"))
+				kind = CCL_EX_HUGEMEM_HUGETLB;
+		}
+		g_once_init_leave(&init, 1);
+	}
+	return kind;
+}
+
+#ifdef CCL_EX_HUGEMEM_LINUX
+
+/* Map `size` bytes (a multiple of the huge page size) aligned to the
+ * huge page size and advise the kernel to use huge pages for them. */
+static void* ccl_ex_hugemem_map_thp(size_t size) {
+
+	char* p;
+	char* aligned;
+	size_t head, tail;
+
+	/* Map one huge page more than needed and unmap the unaligned head
+	 * and the tail. */
+	p = mmap(NULL, size + CCL_EX_HUGEMEM_PAGE, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) return NULL;
+
+	aligned = (char*) (((guintptr) p + CCL_EX_HUGEMEM_PAGE - 1)
+		& ~((guintptr) CCL_EX_HUGEMEM_PAGE - 1));
+	head = aligned - p;
+	tail = CCL_EX_HUGEMEM_PAGE - head;
+	if (head > 0) munmap(p, head);
+	if (tail > 0) munmap(aligned + size, tail);
+
+#ifdef MADV_HUGEPAGE
+	/* Only advice, ignore failures (e.g. THP disabled). */
+	madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+
+	return aligned;
+}
+
+/* Map `size` bytes (a multiple of the huge page size) with explicit
+ * huge pages. */
+static void* ccl_ex_hugemem_map_hugetlb(size_t size) {
+#ifdef MAP_HUGETLB
+	void* p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	return p == MAP_FAILED ? NULL : p;
+#else
+	(void) size;
+	return NULL;
+#endif
+}
+
+#endif
+
+/**
+ * Allocate a host buffer. Buffers of at least ::CCL_EX_HUGEMEM_PAGE
+ * bytes are huge page backed, if possible; see examples_hugemem.h.
+ *
+ * @param[in] size Size in bytes.
+ * @return The buffer, to be freed with ccl_ex_hugemem_free(). As
+ * `g_malloc()`, aborts if memory can't be allocated.
+ * */
+void* ccl_ex_hugemem_alloc(size_t size) {
+
+	struct ccl_ex_hugemem_entry* entry;
+	void* mem = NULL;
+	CCLExHugeMemKind kind = ccl_ex_hugemem_kind_wanted();
+	size_t size_alloc = size;
+	size_t bytes_total = 0;
+
+	/* Small buffers are not worth a huge page. */
+	if (size < CCL_EX_HUGEMEM_PAGE) kind = CCL_EX_HUGEMEM_MALLOC;
+
+#ifdef CCL_EX_HUGEMEM_LINUX
+
+	/* Huge page mappings are a multiple of the huge page size. */
+	if (kind != CCL_EX_HUGEMEM_MALLOC)
+		size_alloc = (size + CCL_EX_HUGEMEM_PAGE - 1)
+			& ~((size_t) CCL_EX_HUGEMEM_PAGE - 1);
+
+	/* Try explicit huge pages, falling back to THP. */
+	if (kind == CCL_EX_HUGEMEM_HUGETLB) {
+		mem = ccl_ex_hugemem_map_hugetlb(size_alloc);
+		if (mem == NULL) kind = CCL_EX_HUGEMEM_THP;
+	}
+
+	/* Try THP, falling back to regular pages. */
+	if (kind == CCL_EX_HUGEMEM_THP) {
+		mem = ccl_ex_hugemem_map_thp(size_alloc);
+		if (mem == NULL) kind = CCL_EX_HUGEMEM_MALLOC;
+	}
+
+#else
+	kind = CCL_EX_HUGEMEM_MALLOC;
+#endif
+
+	if (kind == CCL_EX_HUGEMEM_MALLOC) {
+		size_alloc = size;
+		mem = g_malloc(size);
+	}
+
+	/* Keep track of buffer. */
+	entry = g_slice_new(struct ccl_ex_hugemem_entry);
+	entry->size = size_alloc;
+	entry->kind = kind;
+
+	g_mutex_lock(&hugemem_lock);
+	if (hugemem_entries == NULL)
+		hugemem_entries = g_hash_table_new(g_direct_hash, g_direct_equal);
+	g_hash_table_insert(hugemem_entries, mem, entry);
+	hugemem_stats.buffers[kind]++;
+	hugemem_stats.bytes[kind] += size_alloc;
+	for (guint i = 0; i < CCL_EX_HUGEMEM_NUM_KINDS; i++)
+		bytes_total += hugemem_stats.bytes[i];
+	hugemem_stats.bytes_peak = MAX(hugemem_stats.bytes_peak, bytes_total);
+	g_mutex_unlock(&hugemem_lock);
+
+	ccl_ex_footprint_add(CCL_EX_FOOTPRINT_HOST, mem, size_alloc);
+
+	return mem;
+}
+
+/**
+ * Free a host buffer allocated with ccl_ex_hugemem_alloc().
+ *
+ * @param[in] mem Buffer to free; can be `NULL`.
+ * */
+void ccl_ex_hugemem_free(void* mem) {
+
+	struct ccl_ex_hugemem_entry* entry;
+
+	if (mem == NULL) return;
+
+	g_mutex_lock(&hugemem_lock);
+	entry = hugemem_entries
+		? g_hash_table_lookup(hugemem_entries, mem) : NULL;
+	if (entry != NULL) {
+		g_hash_table_remove(hugemem_entries, mem);
+		hugemem_stats.buffers[entry->kind]--;
+		hugemem_stats.bytes[entry->kind] -= entry->size;
+	}
+	g_mutex_unlock(&hugemem_lock);
+
+	g_return_if_fail(entry != NULL);
+
+	ccl_ex_footprint_remove(mem);
+
+#ifdef CCL_EX_HUGEMEM_LINUX
+	if (entry->kind != CCL_EX_HUGEMEM_MALLOC)
+		munmap(mem, entry->size);
+	else
+#endif
+		g_free(mem);
+
+	g_slice_free(struct ccl_ex_hugemem_entry, entry);
+}
+
+/**
+ * How a host buffer allocated with ccl_ex_hugemem_alloc() is backed.
+ *
+ * @param[in] mem Buffer.
+ * @return How the buffer is backed.
+ * */
+CCLExHugeMemKind ccl_ex_hugemem_kind(void* mem) {
+
+	struct ccl_ex_hugemem_entry* entry;
+	CCLExHugeMemKind kind = CCL_EX_HUGEMEM_MALLOC;
+
+	g_mutex_lock(&hugemem_lock);
+	entry = hugemem_entries
+		? g_hash_table_lookup(hugemem_entries, mem) : NULL;
+	if (entry != NULL) kind = entry->kind;
+	g_mutex_unlock(&hugemem_lock);
+
+	return kind;
+}
+
+/* Bytes of THP buffers backed by huge pages, from the AnonHugePages
+ * field of the mappings which contain them in /proc/self/smaps. Must be
+ * called with the lock held. */
+static size_t ccl_ex_hugemem_thp_backed(void) {
+
+	size_t backed = 0;
+#ifdef CCL_EX_HUGEMEM_LINUX
+	FILE* smaps;
+	char line[512];
+	gboolean in_thp = FALSE;
+
+	if ((hugemem_entries == NULL)
+			|| (hugemem_stats.buffers[CCL_EX_HUGEMEM_THP] == 0))
+		return 0;
+	if ((smaps = fopen("/proc/self/smaps", "r")) == NULL) return 0;
+
+	while (fgets(line, sizeof(line), smaps) != NULL) {
+
+		unsigned long start, end, kb;
+
+		if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+
+			/* Mapping header: does the mapping overlap a THP buffer? */
+			GHashTableIter iter;
+			gpointer mem, value;
+			in_thp = FALSE;
+			g_hash_table_iter_init(&iter, hugemem_entries);
+			while (!in_thp && g_hash_table_iter_next(&iter, &mem, &value)) {
+				struct ccl_ex_hugemem_entry* entry = value;
+				in_thp = (entry->kind == CCL_EX_HUGEMEM_THP)
+					&& ((guintptr) mem < end)
+					&& ((guintptr) mem + entry->size > start);
+			}
+
+		} else if (in_thp
+				&& (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1)) {
+
+			backed += kb * 1024;
+		}
+	}
+	fclose(smaps);
+#endif
+	return backed;
+}
+
+/**
+ * Get host memory statistics.
+ *
+ * @param[out] stats Location where to place statistics.
+ * */
+void ccl_ex_hugemem_stats_get(CCLExHugeMemStats* stats) {
+
+	g_return_if_fail(stats != NULL);
+
+	g_mutex_lock(&hugemem_lock);
+	*stats = hugemem_stats;
+	stats->bytes_thp_backed = ccl_ex_hugemem_thp_backed();
+	g_mutex_unlock(&hugemem_lock);
+}
+
+/**
+ * Print host memory statistics.
+ *
+ * @param[in] out Stream where to print statistics (examples which write
+ * data to `stdout` should use `stderr`).
+ * */
+void ccl_ex_hugemem_stats_print(FILE* out) {
+
+	CCLExHugeMemStats s;
+	const char* wanted[] = { "off", "thp", "hugetlb" };
+
+	ccl_ex_hugemem_stats_get(&s);
+
+	g_fprintf(out, "\n   ========================= Host memory ===================================\n\n");
+	g_fprintf(out, "     Huge pages             : %s\n",
+		wanted[ccl_ex_hugemem_kind_wanted()]);
+	g_fprintf(out, "     Regular pages          : %lu buffers, %lu bytes\n",
+		s.buffers[CCL_EX_HUGEMEM_MALLOC],
+		(unsigned long) s.bytes[CCL_EX_HUGEMEM_MALLOC]);
+	g_fprintf(out, "     THP advised            : %lu buffers, %lu bytes (%lu backed)\n",
+		s.buffers[CCL_EX_HUGEMEM_THP],
+		(unsigned long) s.bytes[CCL_EX_HUGEMEM_THP],
+		(unsigned long) s.bytes_thp_backed);
+	g_fprintf(out, "     Explicit huge pages    : %lu buffers, %lu bytes\n",
+		s.buffers[CCL_EX_HUGEMEM_HUGETLB],
+		(unsigned long) s.bytes[CCL_EX_HUGEMEM_HUGETLB]);
+	g_fprintf(out, "     Peak bytes             : %lu bytes (%lu Kb)\n",
+		(unsigned long) s.bytes_peak,
+		(unsigned long) (s.bytes_peak / 1024));
+}
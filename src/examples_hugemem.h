@@ -0,0 +1,92 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Huge page backed host memory for cf4ocl-examples.
+ *
+ * Large host buffers (at least ::CCL_EX_HUGEMEM_PAGE bytes) are mapped
+ * 2 Mb-aligned and advised with `MADV_HUGEPAGE`, so that the kernel
+ * backs them with transparent huge pages, or are mapped with
+ * `MAP_HUGETLB` if the examples were configured with `HUGETLB=ON`.
+ * Allocations fall back to the next method if one fails, and smaller
+ * buffers are allocated with `g_malloc()`. Pages are not touched.
+ *
+ * The `CCL_EX_HUGEMEM` environment variable overrides the configured
+ * method: `off` (always `g_malloc()`), `thp` or `hugetlb`. Running an
+ * example with `CCL_EX_HUGEMEM=off` and comparing its timings gives the
+ * effect of huge pages.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#ifndef _CCL_EXAMPLES_HUGEMEM_H_
+#define _CCL_EXAMPLES_HUGEMEM_H_
+
+#include "examples_common.h"
+
+/** Huge page size assumed for alignment (2 Mb). */
+#define CCL_EX_HUGEMEM_PAGE (2 * 1024 * 1024)
+
+/**
+ * How a host buffer is backed.
+ * */
+typedef enum ccl_ex_hugemem_kind {
+	/** Regular pages, allocated with `g_malloc()`. */
+	CCL_EX_HUGEMEM_MALLOC = 0,
+	/** Mapping advised for transparent huge pages. */
+	CCL_EX_HUGEMEM_THP = 1,
+	/** Explicit huge pages (`MAP_HUGETLB`). */
+	CCL_EX_HUGEMEM_HUGETLB = 2,
+	/** Number of kinds. */
+	CCL_EX_HUGEMEM_NUM_KINDS = 3
+} CCLExHugeMemKind;
+
+/** Host memory statistics. */
+typedef struct ccl_ex_hugemem_stats {
+
+	/** Buffers currently allocated, per kind. */
+	gulong buffers[CCL_EX_HUGEMEM_NUM_KINDS];
+	/** Bytes currently allocated, per kind. */
+	size_t bytes[CCL_EX_HUGEMEM_NUM_KINDS];
+	/** Peak of bytes allocated, all kinds. */
+	size_t bytes_peak;
+	/** Bytes of THP mappings currently backed by huge pages, as reported
+	 * by the kernel (0 if unknown). */
+	size_t bytes_thp_backed;
+
+} CCLExHugeMemStats;
+
+/* Allocate a host buffer, huge page backed if large enough. */
+void* ccl_ex_hugemem_alloc(size_t size);
+
+/* Free a host buffer allocated with ccl_ex_hugemem_alloc(). */
+void ccl_ex_hugemem_free(void* mem);
+
+/* How a host buffer allocated with ccl_ex_hugemem_alloc() is backed. */
+CCLExHugeMemKind ccl_ex_hugemem_kind(void* mem);
+
+/* Get host memory statistics. */
+void ccl_ex_hugemem_stats_get(CCLExHugeMemStats* stats);
+
+/* Print host memory statistics. */
+void ccl_ex_hugemem_stats_print(FILE* out);
+
+#endif
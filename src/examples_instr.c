@@ -0,0 +1,743 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Host side of in-kernel instrumentation implementation for
+ * cf4ocl-examples.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#include "examples_instr.h"
+#include "examples_footprint.h"
+#include <string.h>
+
+/* Number of cl_ulong in a work-group record. */
+#define CCL_EX_INSTR_REC (sizeof(CCLExInstrRecord) / sizeof(cl_ulong))
+
+/* Number of slowest work-groups shown in summaries. */
+#define CCL_EX_INSTR_SLOWEST 5
+
+/* Maximum number of compute units shown in timelines. */
+#define CCL_EX_INSTR_UNITS_MAX 64
+
+/* In-kernel instrumentation of one kernel. */
+struct ccl_ex_instr {
+	/* Context where the instrumentation buffer is created (NULL for
+	 * loaded records). */
+	CCLContext* ctx;
+	/* Instrumentation buffer. */
+	CCLBuffer* buf;
+	/* Number of records the buffer can hold. */
+	size_t capacity;
+	/* Kernel name. */
+	gchar* kernel_name;
+	/* Counter names, NULL if unused. */
+	gchar* counter_names[CCL_EX_INSTR_COUNTERS];
+	/* Work-group grid of the last prepared launch. */
+	size_t groups[3];
+	size_t num_groups;
+	/* Device timer. */
+	CCLExInstrTimer timer;
+	/* Work-group records. */
+	CCLExInstrRecord* recs;
+	size_t num_recs;
+	/* Buffer header. */
+	cl_ulong header[CCL_EX_INSTR_HEADER];
+};
+
+/* Timer descriptions, for reports. */
+static const char* instr_timer_names[] = {
+	"none (order stamps only)", "global timer (ns)", "real time counter (100 MHz)"
+};
+
+/* Levels of activity, for timelines. */
+static const char instr_levels[] = " .:-=+*#%@";
+
+/**
+ * Create instrumentation for a kernel. The instrumentation buffer is
+ * only created by ccl_ex_instr_prepare().
+ *
+ * @param[in] ctx Context wrapper.
+ * @param[in] kernel_name Kernel name, for reports.
+ * @param[in] counter_names `NULL`-terminated names of the per-group
+ * counters used by the kernel (at most ::CCL_EX_INSTR_COUNTERS), or
+ * `NULL` if no counters are used.
+ * @return A new instrumentation object.
+ * */
+CCLExInstr* ccl_ex_instr_new(CCLContext* ctx, const char* kernel_name,
+	const char* const* counter_names) {
+
+	CCLExInstr* instr = g_new0(CCLExInstr, 1);
+
+	instr->ctx = ctx;
+	instr->kernel_name = g_strdup(kernel_name);
+	for (guint i = 0; counter_names && i < CCL_EX_INSTR_COUNTERS
+		&& counter_names[i]; ++i)
+		instr->counter_names[i] = g_strdup(counter_names[i]);
+	instr->groups[0] = instr->groups[1] = instr->groups[2] = 1;
+
+	return instr;
+}
+
+/**
+ * Reset the instrumentation buffer and set it as the last argument of
+ * an instrumented kernel. Must be called before each instrumented
+ * launch, since records are only written for the work-groups of the
+ * last prepared launch. Calling it with `dims` set to 0 sets an
+ * instrumentation buffer which records nothing, e.g. for tuning.
+ *
+ * @param[in] instr Instrumentation object.
+ * @param[in] krnl Kernel wrapper, built with ::CCL_EX_INSTR_BUILD_OPT.
+ * @param[in] cq Command queue wrapper.
+ * @param[in] dims Number of dimensions of the launch.
+ * @param[in] gws Global work size of the launch.
+ * @param[in] lws Local work size of the launch.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return `TRUE` if successful, `FALSE` otherwise.
+ * */
+gboolean ccl_ex_instr_prepare(CCLExInstr* instr, CCLKernel* krnl,
+	CCLQueue* cq, cl_uint dims, const size_t* gws, const size_t* lws,
+	GError** err) {
+
+	size_t num_groups = 0;
+	cl_uint num_args;
+
+	g_return_val_if_fail(instr != NULL, FALSE);
+	g_return_val_if_fail(dims == 0 || (gws != NULL && lws != NULL), FALSE);
+
+	/* Work-group grid. */
+	if (dims > 0) {
+		num_groups = 1;
+		for (cl_uint d = 0; d < 3; ++d) {
+			instr->groups[d] =
+				d < dims ? (gws[d] + lws[d] - 1) / lws[d] : 1;
+			num_groups *= instr->groups[d];
+		}
+	}
+	instr->num_groups = num_groups;
+
+	/* Create instrumentation buffer, or a larger one. */
+	if (!instr->buf || num_groups > instr->capacity) {
+		if (instr->buf) ccl_ex_footprint_buffer_destroy(instr->buf);
+		instr->capacity = 0;
+		instr->buf = ccl_ex_footprint_buffer_new(instr->ctx,
+			CL_MEM_READ_WRITE, (CCL_EX_INSTR_HEADER
+				+ num_groups * CCL_EX_INSTR_REC) * sizeof(cl_ulong),
+			NULL, err);
+		if (!instr->buf) return FALSE;
+		instr->capacity = num_groups;
+	}
+
+	/* Reset order stamp counter and set number of records to write. */
+	memset(instr->header, 0, sizeof(instr->header));
+	instr->header[1] = num_groups;
+	if (!ccl_buffer_enqueue_write(instr->buf, cq, CL_TRUE, 0,
+		sizeof(instr->header), instr->header, NULL, err)) return FALSE;
+
+	/* Instrumentation buffer is the last kernel argument. */
+	num_args = ccl_kernel_get_info_scalar(
+		krnl, CL_KERNEL_NUM_ARGS, cl_uint, err);
+	if (num_args == 0) return FALSE;
+	ccl_kernel_set_arg(krnl, num_args - 1, instr->buf);
+
+	return TRUE;
+}
+
+/**
+ * Read work-group records of the last instrumented launch. Blocks until
+ * the launch completes. Times are converted to nanoseconds relative to
+ * the earliest work-group start.
+ *
+ * @param[in] instr Instrumentation object.
+ * @param[in] cq Command queue wrapper where the launch was enqueued.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return `TRUE` if successful, `FALSE` otherwise.
+ * */
+gboolean ccl_ex_instr_read(CCLExInstr* instr, CCLQueue* cq,
+	GError** err) {
+
+	size_t n;
+	cl_ulong t0 = G_MAXUINT64;
+
+	g_return_val_if_fail(instr != NULL, FALSE);
+	g_return_val_if_fail(instr->buf != NULL, FALSE);
+
+	n = instr->num_groups;
+	instr->recs = g_renew(CCLExInstrRecord, instr->recs, MAX(n, 1));
+	instr->num_recs = 0;
+
+	if (!ccl_buffer_enqueue_read(instr->buf, cq, CL_TRUE, 0,
+		sizeof(instr->header), instr->header, NULL, err)) return FALSE;
+	if ((n > 0) && !ccl_buffer_enqueue_read(instr->buf, cq, CL_TRUE,
+		sizeof(instr->header), n * sizeof(CCLExInstrRecord), instr->recs,
+		NULL, err)) return FALSE;
+	instr->num_recs = n;
+
+	/* Each work-group takes two order stamps. */
+	if ((cl_uint) instr->header[0] != 2 * n)
+		g_warning("Instrumentation of '%s': %u order stamps for %lu "
+			"work-groups.", instr->kernel_name,
+			(cl_uint) instr->header[0], (unsigned long) n);
+
+	/* Times in nanoseconds, relative to the earliest start. */
+	instr->timer = (CCLExInstrTimer) instr->header[2];
+	if (instr->timer == CCL_EX_INSTR_TIMER_NONE) return TRUE;
+	for (size_t g = 0; g < n; ++g)
+		t0 = MIN(t0, instr->recs[g].t_start);
+	for (size_t g = 0; g < n; ++g) {
+		instr->recs[g].t_start -= t0;
+		instr->recs[g].t_end -= t0;
+		if (instr->timer == CCL_EX_INSTR_TIMER_100MHZ) {
+			instr->recs[g].t_start *= 10;
+			instr->recs[g].t_end *= 10;
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+ * Get work-group records, read with ccl_ex_instr_read() or loaded with
+ * ccl_ex_instr_load(). Records are indexed by linear work-group id.
+ *
+ * @param[in] instr Instrumentation object.
+ * @param[out] num_groups Location where to put the number of records.
+ * @return Work-group records, owned by the instrumentation object.
+ * */
+const CCLExInstrRecord* ccl_ex_instr_records(CCLExInstr* instr,
+	size_t* num_groups) {
+
+	*num_groups = instr->num_recs;
+	return instr->recs;
+}
+
+/**
+ * Save work-group records as tab-separated values, one work-group per
+ * line, preceded by `#` lines with the kernel name, work-group grid,
+ * timer and counter names.
+ *
+ * @param[in] instr Instrumentation object.
+ * @param[in] filename File where to save records.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return `TRUE` if successful, `FALSE` otherwise.
+ * */
+gboolean ccl_ex_instr_save(CCLExInstr* instr, const char* filename,
+	GError** err) {
+
+	GString* tsv;
+	gboolean ok;
+
+	tsv = g_string_new(NULL);
+	g_string_append_printf(tsv, "# kernel\t%s\n", instr->kernel_name);
+	g_string_append_printf(tsv, "# groups\t%lu\t%lu\t%lu\n",
+		(unsigned long) instr->groups[0], (unsigned long) instr->groups[1],
+		(unsigned long) instr->groups[2]);
+	g_string_append_printf(tsv, "# timer\t%d\n", (int) instr->timer);
+	g_string_append(tsv, "# counters");
+	for (guint i = 0; i < CCL_EX_INSTR_COUNTERS; ++i)
+		g_string_append_printf(tsv, "\t%s",
+			instr->counter_names[i] ? instr->counter_names[i] : "-");
+	g_string_append(tsv, "\n");
+
+	for (size_t g = 0; g < instr->num_recs; ++g) {
+		const CCLExInstrRecord* r = &instr->recs[g];
+		g_string_append_printf(tsv, "%" G_GUINT64_FORMAT "\t%"
+			G_GUINT64_FORMAT "\t%" G_GUINT64_FORMAT "\t%" G_GUINT64_FORMAT
+			"\t%" G_GUINT64_FORMAT, (guint64) r->order_start,
+			(guint64) r->order_end, (guint64) r->t_start,
+			(guint64) r->t_end, (guint64) r->unit);
+		for (guint i = 0; i < CCL_EX_INSTR_COUNTERS; ++i)
+			g_string_append_printf(tsv, "\t%" G_GUINT64_FORMAT,
+				(guint64) r->counters[i]);
+		g_string_append(tsv, "\n");
+	}
+
+	ok = g_file_set_contents(filename, tsv->str, tsv->len, err);
+	g_string_free(tsv, TRUE);
+	return ok;
+}
+
+/**
+ * Load work-group records saved with ccl_ex_instr_save(). The returned
+ * object can only be used for reports.
+ *
+ * @param[in] filename File with saved records.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return A new instrumentation object, or `NULL` if an error occurs.
+ * */
+CCLExInstr* ccl_ex_instr_load(const char* filename, GError** err) {
+
+	CCLExInstr* instr = NULL;
+	gchar* contents = NULL;
+	gchar** lines = NULL;
+	GArray* recs = NULL;
+	GError* err_internal = NULL;
+
+	g_file_get_contents(filename, &contents, NULL, &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	instr = ccl_ex_instr_new(NULL, "", NULL);
+	recs = g_array_new(FALSE, TRUE, sizeof(CCLExInstrRecord));
+	lines = g_strsplit(contents, "\n", -1);
+
+	for (guint l = 0; lines[l]; ++l) {
+
+		gchar** fields;
+		guint nf;
+
+		if (*g_strstrip(lines[l]) == '\0') continue;
+		fields = g_strsplit(lines[l], "\t", -1);
+		nf = g_strv_length(fields);
+
+		if (lines[l][0] == '#') {
+			/* Header line. */
+			if (g_str_has_prefix(lines[l], "# kernel") && nf >= 2) {
+				g_free(instr->kernel_name);
+				instr->kernel_name = g_strdup(fields[1]);
+			} else if (g_str_has_prefix(lines[l], "# groups") && nf >= 4) {
+				for (guint d = 0; d < 3; ++d)
+					instr->groups[d] = MAX(1,
+						g_ascii_strtoull(fields[d + 1], NULL, 10));
+			} else if (g_str_has_prefix(lines[l], "# timer") && nf >= 2) {
+				instr->timer = (CCLExInstrTimer)
+					g_ascii_strtoull(fields[1], NULL, 10);
+			} else if (g_str_has_prefix(lines[l], "# counters")) {
+				for (guint i = 0; i < CCL_EX_INSTR_COUNTERS
+					&& i + 1 < nf; ++i) {
+					if (g_strcmp0(fields[i + 1], "-") != 0)
+						instr->counter_names[i] = g_strdup(fields[i + 1]);
+				}
+			}
+		} else if (nf == CCL_EX_INSTR_REC) {
+			/* Work-group record. */
+			CCLExInstrRecord r;
+			cl_ulong* v = (cl_ulong*) &r;
+			for (guint i = 0; i < nf; ++i)
+				v[i] = g_ascii_strtoull(fields[i], NULL, 10);
+			g_array_append_val(recs, r);
+		} else {
+			g_set_error(&err_internal, CCL_EX_ERROR, CCL_EX_FAIL,
+				"%s:%u: expected %u fields, got %u.", filename, l + 1,
+				(guint) CCL_EX_INSTR_REC, nf);
+		}
+		g_strfreev(fields);
+		if_err_goto(err_internal, error_handler);
+	}
+
+	instr->num_recs = recs->len;
+	instr->num_groups = recs->len;
+	instr->recs = (CCLExInstrRecord*) g_array_free(recs, FALSE);
+
+	g_strfreev(lines);
+	g_free(contents);
+	return instr;
+
+error_handler:
+	/* If we got here there was an error, verify that it is so. */
+	g_assert(err_internal != NULL);
+	g_propagate_error(err, err_internal);
+	if (recs) g_array_free(recs, TRUE);
+	if (lines) g_strfreev(lines);
+	if (contents) g_free(contents);
+	if (instr) ccl_ex_instr_destroy(instr);
+	return NULL;
+}
+
+/* Compare doubles, for qsort(). */
+static int ccl_ex_instr_cmp_double(const void* a, const void* b) {
+	double da = *((const double*) a), db = *((const double*) b);
+	return (da > db) - (da < db);
+}
+
+/* Nearest-rank percentile of sorted values. */
+static double ccl_ex_instr_percentile(const double* sorted, size_t n,
+	double p) {
+
+	size_t k = (size_t) ceil(p * n);
+	return sorted[CLAMP(k, 1, n) - 1];
+}
+
+/* Duration of a work-group, in ns if there is a timer, or in order
+ * stamps otherwise. */
+static double ccl_ex_instr_duration(CCLExInstr* instr,
+	const CCLExInstrRecord* r) {
+
+	return instr->timer != CCL_EX_INSTR_TIMER_NONE
+		? (double) (r->t_end - r->t_start)
+		: (double) (r->order_end - r->order_start);
+}
+
+/* Rank of each work-group in start order. */
+static size_t* ccl_ex_instr_start_ranks(CCLExInstr* instr) {
+
+	size_t n = instr->num_recs, stamps = 2 * n, rank = 0;
+	size_t* ranks = g_new(size_t, MAX(n, 1));
+	size_t* by_stamp = g_new0(size_t, MAX(stamps, 1));
+
+	/* Order stamps are unique and below 2n, so ranks follow from a
+	 * direct mapping of stamps to groups. */
+	for (size_t g = 0; g < n; ++g) {
+		ranks[g] = n;
+		if (instr->recs[g].order_start < stamps)
+			by_stamp[instr->recs[g].order_start] = g + 1;
+	}
+	for (size_t s = 0; s < stamps; ++s)
+		if (by_stamp[s]) ranks[by_stamp[s] - 1] = rank++;
+	for (size_t g = 0; g < n; ++g)
+		if (ranks[g] == n) ranks[g] = rank++;
+
+	g_free(by_stamp);
+	return ranks;
+}
+
+/* Maximum and mean number of work-groups active at the same time,
+ * from order stamps. */
+static void ccl_ex_instr_residency(CCLExInstr* instr, guint* max_active,
+	double* mean_active) {
+
+	size_t n = instr->num_recs, stamps = 2 * n;
+	gint* delta = g_new0(gint, MAX(stamps, 1));
+	gint active = 0;
+	double sum = 0;
+
+	*max_active = 0;
+	for (size_t g = 0; g < n; ++g) {
+		if (instr->recs[g].order_start < stamps)
+			delta[instr->recs[g].order_start]++;
+		if (instr->recs[g].order_end < stamps)
+			delta[instr->recs[g].order_end]--;
+	}
+	for (size_t s = 0; s < stamps; ++s) {
+		active += delta[s];
+		*max_active = MAX(*max_active, (guint) MAX(active, 0));
+		sum += active;
+	}
+	*mean_active = stamps ? sum / stamps : 0;
+
+	g_free(delta);
+}
+
+/* Work-group coordinates from linear id. */
+static void ccl_ex_instr_coords(CCLExInstr* instr, size_t g,
+	size_t* coords) {
+
+	coords[0] = g % instr->groups[0];
+	coords[1] = (g / instr->groups[0]) % instr->groups[1];
+	coords[2] = g / (instr->groups[0] * instr->groups[1]);
+}
+
+/**
+ * Print summary of the distribution of work-group records: durations,
+ * imbalance and tail, residency, start order, counters and, if known,
+ * compute units.
+ *
+ * @param[in] instr Instrumentation object.
+ * @param[in] out Stream where to print summary.
+ * */
+void ccl_ex_instr_summary_print(CCLExInstr* instr, FILE* out) {
+
+	size_t n = instr->num_recs;
+	gboolean timed = instr->timer != CCL_EX_INSTR_TIMER_NONE;
+	const char* unit = timed ? "ns" : "stamps";
+	double* dur;
+	double* ends;
+	double dur_sum = 0, disp = 0;
+	size_t* ranks;
+	size_t slowest[CCL_EX_INSTR_SLOWEST];
+	guint num_slowest = 0, max_active;
+	double mean_active;
+
+	g_fprintf(out, "\n   ===================== Work-group instrumentation ========================\n\n");
+	g_fprintf(out, "     Kernel                 : %s\n", instr->kernel_name);
+	g_fprintf(out, "     Work-groups            : %lu (%lu x %lu x %lu)\n",
+		(unsigned long) n, (unsigned long) instr->groups[0],
+		(unsigned long) instr->groups[1], (unsigned long) instr->groups[2]);
+	g_fprintf(out, "     Device timer           : %s\n",
+		instr_timer_names[CLAMP(instr->timer, 0, 2)]);
+	if (n == 0) return;
+
+	/* Durations. */
+	dur = g_new(double, n);
+	ends = g_new(double, n);
+	for (size_t g = 0; g < n; ++g) {
+		dur[g] = ccl_ex_instr_duration(instr, &instr->recs[g]);
+		ends[g] = timed
+			? (double) instr->recs[g].t_end
+			: (double) instr->recs[g].order_end;
+		dur_sum += dur[g];
+	}
+
+	/* Slowest work-groups, by simple selection. */
+	for (size_t g = 0; g < n; ++g) {
+		guint i = num_slowest;
+		while (i > 0 && dur[slowest[i - 1]] < dur[g]) i--;
+		if (i >= CCL_EX_INSTR_SLOWEST) continue;
+		if (num_slowest < CCL_EX_INSTR_SLOWEST) num_slowest++;
+		memmove(&slowest[i + 1], &slowest[i],
+			(num_slowest - 1 - i) * sizeof(size_t));
+		slowest[i] = g;
+	}
+
+	qsort(dur, n, sizeof(double), ccl_ex_instr_cmp_double);
+	qsort(ends, n, sizeof(double), ccl_ex_instr_cmp_double);
+
+	g_fprintf(out, "     Duration (%s)%*s: min %.0f, mean %.1f, median %.0f, "
+		"p95 %.0f, max %.0f\n", unit, (int) (12 - strlen(unit)), "",
+		dur[0], dur_sum / n, ccl_ex_instr_percentile(dur, n, 0.5),
+		ccl_ex_instr_percentile(dur, n, 0.95), dur[n - 1]);
+	g_fprintf(out, "     Imbalance (max/mean)   : %.2f\n",
+		dur_sum > 0 ? dur[n - 1] / (dur_sum / n) : 1.0);
+	if (timed) {
+		double t95 = ccl_ex_instr_percentile(ends, n, 0.95);
+		double span = ends[n - 1];
+		g_fprintf(out, "     Kernel span (ns)       : %.0f\n", span);
+		g_fprintf(out, "     Tail after 95%% done    : %.0f ns (%.1f%% of span)\n",
+			span - t95, span > 0 ? 100.0 * (span - t95) / span : 0.0);
+	}
+
+	/* Residency and start order. */
+	ccl_ex_instr_residency(instr, &max_active, &mean_active);
+	g_fprintf(out, "     Active groups max/mean : %u / %.1f\n",
+		max_active, mean_active);
+	ranks = ccl_ex_instr_start_ranks(instr);
+	for (size_t g = 0; g < n; ++g)
+		disp += ranks[g] > g ? (double) (ranks[g] - g) : (double) (g - ranks[g]);
+	g_fprintf(out, "     Start order vs. id     : mean displacement %.1f groups\n",
+		disp / n);
+	g_free(ranks);
+
+	/* Counters. */
+	for (guint i = 0; i < CCL_EX_INSTR_COUNTERS; ++i) {
+		cl_ulong cmin = G_MAXUINT64, cmax = 0;
+		double csum = 0;
+		if (!instr->counter_names[i]) continue;
+		for (size_t g = 0; g < n; ++g) {
+			cl_ulong c = instr->recs[g].counters[i];
+			cmin = MIN(cmin, c);
+			cmax = MAX(cmax, c);
+			csum += c;
+		}
+		g_fprintf(out, "     Counter %-15s: min %" G_GUINT64_FORMAT
+			", mean %.1f, max %" G_GUINT64_FORMAT ", total %.0f\n",
+			instr->counter_names[i], (guint64) cmin, csum / n,
+			(guint64) cmax, csum);
+	}
+
+	/* Compute units. */
+	if (instr->timer == CCL_EX_INSTR_TIMER_NS) {
+		GHashTable* units = g_hash_table_new(g_direct_hash, g_direct_equal);
+		GHashTableIter iter;
+		gpointer key, value;
+		guint umin = G_MAXUINT, umax = 0;
+		for (size_t g = 0; g < n; ++g) {
+			gpointer k = GSIZE_TO_POINTER(instr->recs[g].unit + 1);
+			g_hash_table_insert(units, k, GUINT_TO_POINTER(
+				GPOINTER_TO_UINT(g_hash_table_lookup(units, k)) + 1));
+		}
+		g_hash_table_iter_init(&iter, units);
+		while (g_hash_table_iter_next(&iter, &key, &value)) {
+			umin = MIN(umin, GPOINTER_TO_UINT(value));
+			umax = MAX(umax, GPOINTER_TO_UINT(value));
+		}
+		g_fprintf(out, "     Compute units used     : %u (%u to %u groups each)\n",
+			g_hash_table_size(units), umin, umax);
+		g_hash_table_destroy(units);
+	}
+
+	/* Slowest work-groups. */
+	g_fprintf(out, "     Slowest groups         :\n");
+	for (guint i = 0; i < num_slowest; ++i) {
+		const CCLExInstrRecord* r = &instr->recs[slowest[i]];
+		size_t c[3];
+		ccl_ex_instr_coords(instr, slowest[i], c);
+		g_fprintf(out, "       (%lu, %lu, %lu) %.0f %s, start order %"
+			G_GUINT64_FORMAT, (unsigned long) c[0], (unsigned long) c[1],
+			(unsigned long) c[2], ccl_ex_instr_duration(instr, r), unit,
+			(guint64) r->order_start);
+		if (instr->timer == CCL_EX_INSTR_TIMER_NS)
+			g_fprintf(out, ", unit %" G_GUINT64_FORMAT, (guint64) r->unit);
+		for (guint j = 0; j < CCL_EX_INSTR_COUNTERS; ++j)
+			if (instr->counter_names[j])
+				g_fprintf(out, ", %s %" G_GUINT64_FORMAT,
+					instr->counter_names[j], (guint64) r->counters[j]);
+		g_fprintf(out, "\n");
+	}
+
+	g_free(dur);
+	g_free(ends);
+}
+
+/**
+ * Print the order in which work-groups started, as a map of the
+ * work-group grid where each cell shows the decile of start order
+ * (0 first, 9 last). The z dimension is stacked below y. Grids wider
+ * than `width` are downsampled, each cell showing the mean rank of the
+ * work-groups it covers.
+ *
+ * @param[in] instr Instrumentation object.
+ * @param[in] width Maximum number of columns.
+ * @param[in] out Stream where to print map.
+ * */
+void ccl_ex_instr_order_print(CCLExInstr* instr, guint width, FILE* out) {
+
+	size_t n = instr->num_recs;
+	size_t cols = instr->groups[0];
+	size_t rows = instr->groups[1] * instr->groups[2];
+	size_t step;
+	size_t* ranks;
+
+	if (n == 0 || n != cols * rows) return;
+	step = (cols + MAX(width, 1) - 1) / MAX(width, 1);
+	ranks = ccl_ex_instr_start_ranks(instr);
+
+	g_fprintf(out, "\n     Start order map (decile of start order, %lux%lu "
+		"groups per cell):\n\n", (unsigned long) step, (unsigned long) step);
+	for (size_t y = 0; y < rows; y += step) {
+		g_fprintf(out, "     ");
+		for (size_t x = 0; x < cols; x += step) {
+			double sum = 0;
+			guint count = 0;
+			for (size_t yy = y; yy < MIN(y + step, rows); ++yy) {
+				for (size_t xx = x; xx < MIN(x + step, cols); ++xx) {
+					sum += ranks[yy * cols + xx];
+					count++;
+				}
+			}
+			g_fprintf(out, "%c", '0' + (int) MIN(9, 10 * sum / count / n));
+		}
+		g_fprintf(out, "\n");
+	}
+
+	g_free(ranks);
+}
+
+/* Add activity of a work-group in [start, end) to timeline bins. */
+static void ccl_ex_instr_bins_add(double* bins, guint nbins,
+	double bin_len, double start, double end) {
+
+	guint b0 = (guint) MIN(start / bin_len, nbins - 1);
+	guint b1 = (guint) MIN(end / bin_len, nbins - 1);
+
+	for (guint b = b0; b <= b1; ++b) {
+		double lo = MAX(start, b * bin_len);
+		double hi = MIN(end, (b + 1) * bin_len);
+		if (hi > lo) bins[b] += (hi - lo) / bin_len;
+	}
+}
+
+/* Print one timeline row, with activity levels relative to `max`. */
+static void ccl_ex_instr_bins_print(const double* bins, guint nbins,
+	double max, FILE* out) {
+
+	guint nlevels = sizeof(instr_levels) - 2;
+	for (guint b = 0; b < nbins; ++b) {
+		guint level = max > 0 ? (guint) ceil(nlevels * bins[b] / max) : 0;
+		g_fprintf(out, "%c", instr_levels[MIN(level, nlevels)]);
+	}
+}
+
+/**
+ * Print a timeline of active work-groups: the mean number of active
+ * work-groups in each of `width` time bins and, if the device exposes
+ * them, one lane per compute unit. Without a device timer, the time
+ * axis is in order stamps.
+ *
+ * @param[in] instr Instrumentation object.
+ * @param[in] width Number of time bins.
+ * @param[in] out Stream where to print timeline.
+ * */
+void ccl_ex_instr_timeline_print(CCLExInstr* instr, guint width,
+	FILE* out) {
+
+	size_t n = instr->num_recs;
+	gboolean timed = instr->timer != CCL_EX_INSTR_TIMER_NONE;
+	gboolean lanes = instr->timer == CCL_EX_INSTR_TIMER_NS;
+	double span = 0, bin_len, max = 0;
+	double* bins;
+	guint num_units = 0;
+
+	if ((n == 0) || (width == 0)) return;
+
+	for (size_t g = 0; g < n; ++g) {
+		span = MAX(span, timed
+			? (double) instr->recs[g].t_end
+			: (double) instr->recs[g].order_end + 1);
+		if (lanes)
+			num_units = MAX(num_units, (guint) instr->recs[g].unit + 1);
+	}
+	if (span <= 0) return;
+	bin_len = span / width;
+	lanes = lanes && (num_units <= CCL_EX_INSTR_UNITS_MAX);
+
+	/* Row 0 for all groups, then one row per compute unit. */
+	bins = g_new0(double, (size_t) width * (1 + (lanes ? num_units : 0)));
+	for (size_t g = 0; g < n; ++g) {
+		const CCLExInstrRecord* r = &instr->recs[g];
+		double start = timed ? (double) r->t_start : (double) r->order_start;
+		double end = timed ? (double) r->t_end : (double) r->order_end + 1;
+		ccl_ex_instr_bins_add(bins, width, bin_len, start, end);
+		if (lanes)
+			ccl_ex_instr_bins_add(bins + width * (1 + r->unit), width,
+				bin_len, start, end);
+	}
+	for (guint b = 0; b < width; ++b) max = MAX(max, bins[b]);
+
+	g_fprintf(out, "\n     Timeline (%.0f %s per column, '%s' scale, "
+		"max %.1f active groups):\n\n", bin_len,
+		timed ? "ns" : "stamps", instr_levels + 1, max);
+	g_fprintf(out, "     all  |");
+	ccl_ex_instr_bins_print(bins, width, max, out);
+	g_fprintf(out, "|\n");
+
+	if (lanes) {
+		double umax = 0;
+		for (guint b = width; b < width * (1 + num_units); ++b)
+			umax = MAX(umax, bins[b]);
+		for (guint u = 0; u < num_units; ++u) {
+			g_fprintf(out, "     u%-3u |", u);
+			ccl_ex_instr_bins_print(bins + width * (1 + u), width, umax, out);
+			g_fprintf(out, "|\n");
+		}
+	}
+
+	g_free(bins);
+}
+
+/**
+ * Destroy instrumentation.
+ *
+ * @param[in] instr Instrumentation object to destroy.
+ * */
+void ccl_ex_instr_destroy(CCLExInstr* instr) {
+
+	if (!instr) return;
+	if (instr->buf) ccl_ex_footprint_buffer_destroy(instr->buf);
+	for (guint i = 0; i < CCL_EX_INSTR_COUNTERS; ++i)
+		g_free(instr->counter_names[i]);
+	g_free(instr->kernel_name);
+	g_free(instr->recs);
+	g_free(instr);
+}
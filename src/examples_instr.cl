@@ -0,0 +1,161 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * In-kernel instrumentation macros, enabled with `-D INSTRUMENT`. This
+ * file must be the first source of programs whose kernels use them.
+ *
+ * An instrumented kernel takes an extra last argument (::INSTR_ARG),
+ * calls INSTR_BEGIN() at the start of its body, INSTR_COUNT() to add to
+ * per-group counters and INSTR_END() at the end. All work-items must
+ * reach INSTR_BEGIN() and INSTR_END(), which contain barriers.
+ *
+ * The instrumentation buffer has a header of ::INSTR_HEADER ulongs
+ * (order stamp counter, record capacity, timer kind) followed by one
+ * record of ::INSTR_REC ulongs per work-group: start order stamp, end
+ * order stamp, start time, end time, compute unit, and
+ * ::INSTR_COUNTERS counters. Order stamps come from a single atomic
+ * counter, so they give the global order in which work-groups started
+ * and finished. Times and compute units are only available on devices
+ * which expose them (NVIDIA: global timer in ns and SM id; AMD: real
+ * time counter); otherwise they are zero.
+ *
+ * Without `-D INSTRUMENT` all macros expand to nothing.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#ifdef INSTRUMENT
+
+/* Header size, record size and number of counters (in sync with
+ * examples_instr.h). */
+#define INSTR_HEADER 4
+#define INSTR_COUNTERS 4
+#define INSTR_REC (5 + INSTR_COUNTERS)
+
+/* Device timer: 0 - none, 1 - nanoseconds, 2 - 100 MHz ticks. */
+#if defined(cl_nv_pragma_unroll)
+
+	#define INSTR_TIMER_KIND 1
+
+	inline ulong instr_clock(void) {
+		ulong t;
+		asm volatile("mov.u64 %0, %%globaltimer;" : "=l"(t));
+		return t;
+	}
+
+	inline uint instr_unit(void) {
+		uint u;
+		asm volatile("mov.u32 %0, %%smid;" : "=r"(u));
+		return u;
+	}
+
+#elif defined(__AMDGCN__) && defined(__has_builtin)
+#if __has_builtin(__builtin_amdgcn_s_memrealtime)
+
+	#define INSTR_TIMER_KIND 2
+
+	inline ulong instr_clock(void) {
+		return __builtin_amdgcn_s_memrealtime();
+	}
+
+	inline uint instr_unit(void) { return 0; }
+
+#endif
+#endif
+
+#ifndef INSTR_TIMER_KIND
+
+	#define INSTR_TIMER_KIND 0
+
+	inline ulong instr_clock(void) { return 0; }
+
+	inline uint instr_unit(void) { return 0; }
+
+#endif
+
+/* Linear ids of the work-item in its group and of the group. */
+inline uint instr_lid(void) {
+	return get_local_id(0) + get_local_size(0)
+		* (get_local_id(1) + get_local_size(1) * get_local_id(2));
+}
+inline ulong instr_gid(void) {
+	return get_group_id(0) + get_num_groups(0)
+		* (get_group_id(1) + (ulong) get_num_groups(1) * get_group_id(2));
+}
+
+/* Start of work-group: take start order stamp and time, reset
+ * counters. */
+inline void instr_begin(__global ulong* buf, __local uint* cnt,
+	__local uint* order, __local ulong* t0) {
+
+	if (instr_lid() == 0) {
+		*t0 = instr_clock();
+		*order = atomic_inc((__global uint*) buf);
+		for (uint i = 0; i < INSTR_COUNTERS; i++) cnt[i] = 0;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+/* End of work-group: take end order stamp and time, write record. */
+inline void instr_end(__global ulong* buf, __local uint* cnt,
+	__local uint* order, __local ulong* t0) {
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+	if (instr_lid() == 0) {
+		ulong t1 = instr_clock();
+		uint order_end = atomic_inc((__global uint*) buf);
+		ulong g = instr_gid();
+		if (g == 0) buf[2] = INSTR_TIMER_KIND;
+		if (g < buf[1]) {
+			__global ulong* rec = buf + INSTR_HEADER + g * INSTR_REC;
+			rec[0] = *order;
+			rec[1] = order_end;
+			rec[2] = *t0;
+			rec[3] = t1;
+			rec[4] = instr_unit();
+			for (uint i = 0; i < INSTR_COUNTERS; i++)
+				rec[5 + i] = cnt[i];
+		}
+	}
+}
+
+#define INSTR_ARG , __global ulong* instr_buf
+
+#define INSTR_BEGIN() \
+	__local uint instr_cnt[INSTR_COUNTERS]; \
+	__local uint instr_order; \
+	__local ulong instr_t0; \
+	instr_begin(instr_buf, instr_cnt, &instr_order, &instr_t0)
+
+#define INSTR_COUNT(i, n) atomic_add(&instr_cnt[i], (uint) (n))
+
+#define INSTR_END() \
+	instr_end(instr_buf, instr_cnt, &instr_order, &instr_t0)
+
+#else
+
+#define INSTR_ARG
+#define INSTR_BEGIN()
+#define INSTR_COUNT(i, n)
+#define INSTR_END()
+
+#endif
@@ -0,0 +1,127 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Host side of in-kernel instrumentation for cf4ocl-examples.
+ *
+ * Programs with instrumented kernels are created from
+ * ::CCL_EX_INSTR_KERNEL_FILE followed by their own sources, and built
+ * with ::CCL_EX_INSTR_BUILD_OPT (see `examples_instr.cl`). Before each
+ * instrumented launch, ccl_ex_instr_prepare() resets the instrumentation
+ * buffer and sets it as the last kernel argument. After the launch,
+ * ccl_ex_instr_read() reads one record per work-group, which can be
+ * summarized, visualized and saved for the `instr_view` tool.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#ifndef _CCL_EXAMPLES_INSTR_H_
+#define _CCL_EXAMPLES_INSTR_H_
+
+#include "examples_common.h"
+
+/** File with the instrumentation macros, which should be in the same
+ * location as the example executable. */
+#define CCL_EX_INSTR_KERNEL_FILE "examples_instr.cl"
+
+/** Build option which enables instrumentation. */
+#define CCL_EX_INSTR_BUILD_OPT " -D INSTRUMENT"
+
+/** Number of `cl_ulong` in the header of the instrumentation buffer. */
+#define CCL_EX_INSTR_HEADER 4
+
+/** Number of per-group counters. */
+#define CCL_EX_INSTR_COUNTERS 4
+
+/**
+ * Device timer used in work-group records.
+ * */
+typedef enum ccl_ex_instr_timer {
+	/** No timer, only order stamps are available. */
+	CCL_EX_INSTR_TIMER_NONE = 0,
+	/** Global timer in nanoseconds, with compute unit ids (NVIDIA). */
+	CCL_EX_INSTR_TIMER_NS = 1,
+	/** Real time counter at 100 MHz (AMD). */
+	CCL_EX_INSTR_TIMER_100MHZ = 2
+} CCLExInstrTimer;
+
+/**
+ * Work-group record, with the same layout as in the instrumentation
+ * buffer. After ccl_ex_instr_read(), times are in nanoseconds relative
+ * to the earliest start.
+ * */
+typedef struct ccl_ex_instr_record {
+	/** Order stamp when the work-group started. */
+	cl_ulong order_start;
+	/** Order stamp when the work-group finished. */
+	cl_ulong order_end;
+	/** Start time. */
+	cl_ulong t_start;
+	/** End time. */
+	cl_ulong t_end;
+	/** Compute unit where the work-group ran. */
+	cl_ulong unit;
+	/** Operation counters. */
+	cl_ulong counters[CCL_EX_INSTR_COUNTERS];
+} CCLExInstrRecord;
+
+/** In-kernel instrumentation of one kernel. */
+typedef struct ccl_ex_instr CCLExInstr;
+
+/* Create instrumentation for a kernel. */
+CCLExInstr* ccl_ex_instr_new(CCLContext* ctx, const char* kernel_name,
+	const char* const* counter_names);
+
+/* Reset the instrumentation buffer and set it as last kernel
+ * argument. */
+gboolean ccl_ex_instr_prepare(CCLExInstr* instr, CCLKernel* krnl,
+	CCLQueue* cq, cl_uint dims, const size_t* gws, const size_t* lws,
+	GError** err);
+
+/* Read work-group records of the last instrumented launch. */
+gboolean ccl_ex_instr_read(CCLExInstr* instr, CCLQueue* cq,
+	GError** err);
+
+/* Get work-group records. */
+const CCLExInstrRecord* ccl_ex_instr_records(CCLExInstr* instr,
+	size_t* num_groups);
+
+/* Save work-group records as tab-separated values. */
+gboolean ccl_ex_instr_save(CCLExInstr* instr, const char* filename,
+	GError** err);
+
+/* Load work-group records saved with ccl_ex_instr_save(). */
+CCLExInstr* ccl_ex_instr_load(const char* filename, GError** err);
+
+/* Print summary of the distribution of work-group records. */
+void ccl_ex_instr_summary_print(CCLExInstr* instr, FILE* out);
+
+/* Print the order in which work-groups started. */
+void ccl_ex_instr_order_print(CCLExInstr* instr, guint width, FILE* out);
+
+/* Print a timeline of active work-groups. */
+void ccl_ex_instr_timeline_print(CCLExInstr* instr, guint width,
+	FILE* out);
+
+/* Destroy instrumentation. */
+void ccl_ex_instr_destroy(CCLExInstr* instr);
+
+#endif
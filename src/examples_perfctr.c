@@ -0,0 +1,351 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Hardware performance counters implementation for cf4ocl-examples.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#include "examples_perfctr.h"
+#include <string.h>
+#include <errno.h>
+
+#ifdef __linux__
+	#include <unistd.h>
+	#include <sys/syscall.h>
+	#include <linux/perf_event.h>
+#endif
+
+/* Counted events. */
+enum ccl_ex_perfctr_event {
+	PC_CYCLES, PC_INSTR, PC_CACHE_REFS, PC_CACHE_MISSES, PC_LLC_LOADS,
+	PC_LLC_MISSES, PC_BRANCHES, PC_BRANCH_MISSES, PC_DTLB_LOADS,
+	PC_DTLB_MISSES, PC_NUM
+};
+
+/* Event names, for reports. */
+static const char* perfctr_names[PC_NUM] = { "cycles", "instructions",
+	"cache-references", "cache-misses", "LLC-loads", "LLC-load-misses",
+	"branches", "branch-misses", "dTLB-loads", "dTLB-load-misses" };
+
+#ifdef __linux__
+
+/* Generalized cache event configuration. */
+#define PC_HW_CACHE(cache, result) \
+	((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | ((result) << 16))
+
+/* Event types and configurations. */
+static const struct { guint32 type; guint64 config; }
+	perfctr_events[PC_NUM] = {
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	{ PERF_TYPE_HW_CACHE, PC_HW_CACHE(PERF_COUNT_HW_CACHE_LL,
+		PERF_COUNT_HW_CACHE_RESULT_ACCESS) },
+	{ PERF_TYPE_HW_CACHE, PC_HW_CACHE(PERF_COUNT_HW_CACHE_LL,
+		PERF_COUNT_HW_CACHE_RESULT_MISS) },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	{ PERF_TYPE_HW_CACHE, PC_HW_CACHE(PERF_COUNT_HW_CACHE_DTLB,
+		PERF_COUNT_HW_CACHE_RESULT_ACCESS) },
+	{ PERF_TYPE_HW_CACHE, PC_HW_CACHE(PERF_COUNT_HW_CACHE_DTLB,
+		PERF_COUNT_HW_CACHE_RESULT_MISS) } };
+
+#endif
+
+/* A named region. */
+struct ccl_ex_perfctr_region {
+	/* Region name. */
+	gchar* name;
+	/* Number of times the region was counted. */
+	guint calls;
+	/* Is the region being counted? */
+	gboolean running;
+	/* Value, time enabled and time running of each event at start. */
+	guint64 start[PC_NUM][3];
+	/* Counts, scaled for multiplexing. */
+	double counts[PC_NUM];
+};
+
+/* Hardware counters of host regions. */
+struct ccl_ex_perfctr {
+	/* Event file descriptors, -1 if not available. */
+	int fd[PC_NUM];
+	/* Number of available events. */
+	guint num_open;
+	/* Error number of the first event which could not be opened. */
+	int open_errno;
+	/* Regions, in order of first use. */
+	GPtrArray* regions;
+};
+
+/* Free a region. */
+static void ccl_ex_perfctr_region_free(gpointer data) {
+
+	struct ccl_ex_perfctr_region* r =
+		(struct ccl_ex_perfctr_region*) data;
+
+	g_free(r->name);
+	g_slice_free(struct ccl_ex_perfctr_region, r);
+}
+
+/* Get a region by name, creating it if required. */
+static struct ccl_ex_perfctr_region* ccl_ex_perfctr_region_get(
+	CCLExPerfCtr* pc, const char* name) {
+
+	struct ccl_ex_perfctr_region* r;
+
+	for (guint i = 0; i < pc->regions->len; ++i) {
+		r = g_ptr_array_index(pc->regions, i);
+		if (strcmp(r->name, name) == 0) return r;
+	}
+	r = g_slice_new0(struct ccl_ex_perfctr_region);
+	r->name = g_strdup(name);
+	g_ptr_array_add(pc->regions, r);
+	return r;
+}
+
+/* Read value, time enabled and time running of available events. */
+static void ccl_ex_perfctr_read(CCLExPerfCtr* pc, guint64 vals[][3]) {
+
+	for (guint e = 0; e < PC_NUM; ++e) {
+		memset(vals[e], 0, sizeof(vals[e]));
+#ifdef __linux__
+		if ((pc->fd[e] >= 0) &&
+			(read(pc->fd[e], vals[e], sizeof(vals[e]))
+				!= (ssize_t) sizeof(vals[e])))
+			memset(vals[e], 0, sizeof(vals[e]));
+#endif
+	}
+}
+
+/**
+ * Open hardware counters for the calling thread. Counters which cannot
+ * be opened are not counted; if none can be opened, regions do nothing.
+ *
+ * @param[in] inherit Also count threads created afterwards by the
+ * calling thread (e.g. OpenMP worker threads, but also threads created
+ * by the OpenCL runtime), which requires creating counters before these
+ * threads.
+ * @return New hardware counters, never `NULL`.
+ * */
+CCLExPerfCtr* ccl_ex_perfctr_new(gboolean inherit) {
+
+	CCLExPerfCtr* pc = g_slice_new0(CCLExPerfCtr);
+
+	pc->regions = g_ptr_array_new_with_free_func(
+		ccl_ex_perfctr_region_free);
+
+	for (guint e = 0; e < PC_NUM; ++e) {
+
+		pc->fd[e] = -1;
+
+#ifdef __linux__
+		struct perf_event_attr attr;
+
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = perfctr_events[e].type;
+		attr.config = perfctr_events[e].config;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+			| PERF_FORMAT_TOTAL_TIME_RUNNING;
+		attr.inherit = inherit ? 1 : 0;
+		/* User space only, allowed with perf_event_paranoid <= 2. */
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+
+		/* Calling thread, any CPU, no group. */
+		pc->fd[e] = (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1,
+			0);
+		if (pc->fd[e] >= 0)
+			pc->num_open++;
+		else if (pc->open_errno == 0)
+			pc->open_errno = errno;
+#else
+		(void) inherit;
+		pc->open_errno = ENOSYS;
+#endif
+	}
+
+	return pc;
+}
+
+/**
+ * Are any hardware counters available?
+ *
+ * @param[in] pc Hardware counters.
+ * @return `TRUE` if at least one event is counted, `FALSE` otherwise.
+ * */
+gboolean ccl_ex_perfctr_available(CCLExPerfCtr* pc) {
+
+	g_return_val_if_fail(pc != NULL, FALSE);
+	return pc->num_open > 0;
+}
+
+/**
+ * Start counting a named region. Regions with the same name are
+ * accumulated, and different regions may nest.
+ *
+ * @param[in] pc Hardware counters.
+ * @param[in] region Region name.
+ * */
+void ccl_ex_perfctr_start(CCLExPerfCtr* pc, const char* region) {
+
+	struct ccl_ex_perfctr_region* r;
+
+	g_return_if_fail(pc != NULL);
+	g_return_if_fail(region != NULL);
+
+	if (pc->num_open == 0) return;
+
+	r = ccl_ex_perfctr_region_get(pc, region);
+	g_return_if_fail(!r->running);
+	r->running = TRUE;
+
+	/* Read last, so that region bookkeeping is not counted. */
+	ccl_ex_perfctr_read(pc, r->start);
+}
+
+/**
+ * Stop counting a named region started with ccl_ex_perfctr_start().
+ *
+ * @param[in] pc Hardware counters.
+ * @param[in] region Region name.
+ * */
+void ccl_ex_perfctr_stop(CCLExPerfCtr* pc, const char* region) {
+
+	guint64 end[PC_NUM][3];
+	struct ccl_ex_perfctr_region* r;
+
+	g_return_if_fail(pc != NULL);
+	g_return_if_fail(region != NULL);
+
+	if (pc->num_open == 0) return;
+
+	/* Read first, so that region bookkeeping is not counted. */
+	ccl_ex_perfctr_read(pc, end);
+
+	r = ccl_ex_perfctr_region_get(pc, region);
+	g_return_if_fail(r->running);
+	r->running = FALSE;
+	r->calls++;
+
+	for (guint e = 0; e < PC_NUM; ++e) {
+		guint64 enabled = end[e][1] - r->start[e][1];
+		guint64 running = end[e][2] - r->start[e][2];
+		/* Scale for the fraction of time the event was counted. */
+		if (running > 0)
+			r->counts[e] += (double) (end[e][0] - r->start[e][0])
+				* enabled / running;
+	}
+}
+
+/* Print ratio of two events as a percentage (or as is, if `scale` is
+ * 1), or "n/a" if any of the events is unavailable. */
+static void ccl_ex_perfctr_ratio_print(CCLExPerfCtr* pc,
+	struct ccl_ex_perfctr_region* r, guint num, guint den, double scale,
+	int width, FILE* out) {
+
+	if ((pc->fd[num] >= 0) && (pc->fd[den] >= 0) && (r->counts[den] > 0))
+		fprintf(out, " %*.2f", width, scale * r->counts[num] / r->counts[den]);
+	else
+		fprintf(out, " %*s", width, "n/a");
+}
+
+/**
+ * Print counters, instructions per cycle and miss rates per region.
+ * Miss rates are percentages of cache references (cache), LLC loads
+ * (LLC), branches (branch) and dTLB loads (dTLB).
+ *
+ * @param[in] pc Hardware counters.
+ * @param[in] out Where to print summary.
+ * */
+void ccl_ex_perfctr_summary_print(CCLExPerfCtr* pc, FILE* out) {
+
+	g_return_if_fail(pc != NULL);
+	g_return_if_fail(out != NULL);
+
+	if (pc->num_open == 0) {
+		fprintf(out, "\n   == Hardware counters unavailable: %s%s\n",
+			g_strerror(pc->open_errno),
+			((pc->open_errno == EACCES) || (pc->open_errno == EPERM))
+				? " (see /proc/sys/kernel/perf_event_paranoid)" : "");
+		return;
+	}
+
+	fprintf(out, "\n   == Hardware counters (user space)\n\n");
+	fprintf(out, "     %-20s %6s %14s %14s %6s %7s %7s %7s %7s\n",
+		"Region", "Calls", "Cycles", "Instructions", "IPC", "Cache%",
+		"LLC%", "Branch%", "dTLB%");
+
+	for (guint i = 0; i < pc->regions->len; ++i) {
+
+		struct ccl_ex_perfctr_region* r =
+			g_ptr_array_index(pc->regions, i);
+
+		if (r->calls == 0) continue;
+
+		fprintf(out, "     %-20.20s %6u", r->name, r->calls);
+		for (guint e = PC_CYCLES; e <= PC_INSTR; ++e) {
+			if (pc->fd[e] >= 0)
+				fprintf(out, " %14.0f", r->counts[e]);
+			else
+				fprintf(out, " %14s", "n/a");
+		}
+		ccl_ex_perfctr_ratio_print(pc, r, PC_INSTR, PC_CYCLES, 1, 6, out);
+		ccl_ex_perfctr_ratio_print(pc, r, PC_CACHE_MISSES, PC_CACHE_REFS,
+			100, 7, out);
+		ccl_ex_perfctr_ratio_print(pc, r, PC_LLC_MISSES, PC_LLC_LOADS,
+			100, 7, out);
+		ccl_ex_perfctr_ratio_print(pc, r, PC_BRANCH_MISSES, PC_BRANCHES,
+			100, 7, out);
+		ccl_ex_perfctr_ratio_print(pc, r, PC_DTLB_MISSES, PC_DTLB_LOADS,
+			100, 7, out);
+		fprintf(out, "\n");
+	}
+
+	/* List events which could not be counted. */
+	if (pc->num_open < PC_NUM) {
+		fprintf(out, "\n     Unavailable:");
+		for (guint e = 0; e < PC_NUM; ++e)
+			if (pc->fd[e] < 0) fprintf(out, " %s", perfctr_names[e]);
+		fprintf(out, "\n");
+	}
+}
+
+/**
+ * Close hardware counters.
+ *
+ * @param[in] pc Hardware counters to destroy.
+ * */
+void ccl_ex_perfctr_destroy(CCLExPerfCtr* pc) {
+
+	g_return_if_fail(pc != NULL);
+
+#ifdef __linux__
+	for (guint e = 0; e < PC_NUM; ++e)
+		if (pc->fd[e] >= 0) close(pc->fd[e]);
+#endif
+	g_ptr_array_free(pc->regions, TRUE);
+	g_slice_free(CCLExPerfCtr, pc);
+}
@@ -0,0 +1,73 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Hardware performance counters of host regions for cf4ocl-examples.
+ *
+ * Wall-clock time of a host region does not say why it is slow. This
+ * module uses Linux `perf_event_open()` to count cycles, instructions,
+ * cache references and misses, last level cache loads and misses,
+ * branches and branch misses, and dTLB loads and misses (user space
+ * only) around named regions delimited by ccl_ex_perfctr_start() and
+ * ccl_ex_perfctr_stop(). The summary shows, per region, instructions
+ * per cycle and miss rates.
+ *
+ * Counters which cannot be opened (e.g. not supported by the CPU or
+ * hypervisor, or not allowed by `/proc/sys/kernel/perf_event_paranoid`)
+ * are reported as unavailable. If no counter is available, or on other
+ * systems, regions do nothing and the summary says why. When the CPU
+ * has fewer counters than requested, the kernel multiplexes them and
+ * counts are scaled by the fraction of time each counter was running.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#ifndef _CCL_EXAMPLES_PERFCTR_H_
+#define _CCL_EXAMPLES_PERFCTR_H_
+
+#include "examples_common.h"
+
+/** Environment variable which enables hardware counters in examples
+ * without a command line option for it. */
+#define CCL_EX_PERFCTR_ENV "CCL_EX_PERFCTR"
+
+/** Hardware counters of host regions. */
+typedef struct ccl_ex_perfctr CCLExPerfCtr;
+
+/* Open hardware counters for the calling thread. */
+CCLExPerfCtr* ccl_ex_perfctr_new(gboolean inherit);
+
+/* Are any hardware counters available? */
+gboolean ccl_ex_perfctr_available(CCLExPerfCtr* pc);
+
+/* Start counting a named region. */
+void ccl_ex_perfctr_start(CCLExPerfCtr* pc, const char* region);
+
+/* Stop counting a named region. */
+void ccl_ex_perfctr_stop(CCLExPerfCtr* pc, const char* region);
+
+/* Print counters, IPC and miss rates per region. */
+void ccl_ex_perfctr_summary_print(CCLExPerfCtr* pc, FILE* out);
+
+/* Close hardware counters. */
+void ccl_ex_perfctr_destroy(CCLExPerfCtr* pc);
+
+#endif
@@ -0,0 +1,453 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Device reduction, scan and compaction primitives implementation for
+ * cf4ocl-examples.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#include "examples_reduce.h"
+#include "examples_footprint.h"
+
+/* Device reduction primitives. */
+struct ccl_ex_reduce {
+	/* Context and device where kernels run. */
+	CCLContext* ctx;
+	CCLDevice* dev;
+	/* Program with the reduction kernels. */
+	CCLProgram* prg;
+	/* Work-group size (power of two). */
+	size_t lws;
+	/* Number of work-groups in the first pass of reductions. */
+	size_t num_groups;
+};
+
+/* First and second pass kernels for each reduction operation. */
+static const char* const reduce_kernels[] =
+	{ "reduce_sum", "reduce_min", "reduce_max", "reduce_count" };
+static const char* const final_kernels[] =
+	{ "final_sum", "final_min", "final_max", "final_sum" };
+
+/* Largest power of two not larger than `x` (`x > 0`). */
+static size_t ccl_ex_reduce_pow2_floor(size_t x) {
+	size_t p = 1;
+	while (p <= x / 2) p *= 2;
+	return p;
+}
+
+/**
+ * Create reduction primitives for the first device in a context. The
+ * program in #CCL_EX_REDUCE_KERNEL_FILE is built with the preferred
+ * integer vector width of the device, and work sizes are determined from
+ * the kernel and device limits.
+ *
+ * @param[in] ctx Context wrapper.
+ * @param[in] exec_name Name of executable (argv[0]), used to find the
+ * kernel file.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return New reduction primitives, or `NULL` if an error occurs.
+ * */
+CCLExReduce* ccl_ex_reduce_new(CCLContext* ctx, char* exec_name,
+	GError** err) {
+
+	CCLExReduce* r = g_slice_new0(CCLExReduce);
+	gchar* kernel_path = NULL;
+	gchar* opts = NULL;
+	GError* err_internal = NULL;
+	cl_uint vw, cus;
+	size_t wg_max = CCL_EX_REDUCE_LWS_MAX;
+	const char* const sized_kernels[] = { "reduce_sum", "mismatch",
+		"scan_block" };
+
+	r->ctx = ctx;
+	r->dev = ccl_context_get_device(ctx, 0, &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	/* Vector width for loads, a power of two up to 16. */
+	vw = ccl_device_get_info_scalar(r->dev,
+		CL_DEVICE_PREFERRED_VECTOR_WIDTH_INT, cl_uint, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	vw = (cl_uint) ccl_ex_reduce_pow2_floor(CLAMP(vw, 1, 16));
+
+	cus = ccl_device_get_info_scalar(r->dev,
+		CL_DEVICE_MAX_COMPUTE_UNITS, cl_uint, &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	/* Build program. */
+	kernel_path = ccl_ex_kernelpath_get(
+		CCL_EX_REDUCE_KERNEL_FILE, exec_name);
+	r->prg = ccl_program_new_from_source_file(
+		ctx, kernel_path, &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	opts = g_strdup_printf("-D VW=%u", vw);
+	ccl_program_build(r->prg, opts, &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	/* Work-group size must suit all kernels which use local memory. */
+	for (guint i = 0; i < G_N_ELEMENTS(sized_kernels); ++i) {
+		CCLKernel* krnl;
+		size_t krnl_wg;
+		krnl = ccl_program_get_kernel(
+			r->prg, sized_kernels[i], &err_internal);
+		if_err_goto(err_internal, error_handler);
+		krnl_wg = ccl_kernel_get_workgroup_info_scalar(krnl, r->dev,
+			CL_KERNEL_WORK_GROUP_SIZE, size_t, &err_internal);
+		if_err_goto(err_internal, error_handler);
+		wg_max = MIN(wg_max, krnl_wg);
+	}
+	r->lws = ccl_ex_reduce_pow2_floor(wg_max);
+	r->num_groups = MAX(cus, 1) * CCL_EX_REDUCE_GROUPS_PER_CU;
+
+	g_debug("Reductions: vector width %u, %zu work-groups of %zu "
+		"work-items.", vw, r->num_groups, r->lws);
+
+	g_free(opts);
+	g_free(kernel_path);
+	return r;
+
+error_handler:
+	/* If we got here there was an error, verify that it is so. */
+	g_assert(err_internal != NULL);
+	g_propagate_error(err, err_internal);
+	if (opts) g_free(opts);
+	if (kernel_path) g_free(kernel_path);
+	ccl_ex_reduce_destroy(r);
+	return NULL;
+}
+
+/* Second pass of a reduction: reduce `n` partial results in `partials`
+ * and read back the result. */
+static gboolean ccl_ex_reduce_final(CCLExReduce* r, CCLQueue* cq,
+	const char* kernel_name, CCLBuffer* partials, cl_uint n,
+	cl_long* result, GError** err) {
+
+	CCLKernel* krnl;
+
+	krnl = ccl_program_get_kernel(r->prg, kernel_name, err);
+	if (!krnl) return FALSE;
+
+	if (!ccl_kernel_set_args_and_enqueue_ndrange(
+		krnl, cq, 1, NULL, &r->lws, &r->lws, NULL, err,
+		partials, ccl_arg_priv(n, cl_uint),
+		ccl_arg_local(r->lws, cl_long), NULL)) return FALSE;
+
+	return ccl_buffer_enqueue_read(partials, cq, CL_TRUE, 0,
+		sizeof(cl_long), result, NULL, err) != NULL;
+}
+
+/**
+ * Reduce a buffer of integers on the device. Only the result is read
+ * back to the host.
+ *
+ * @param[in] r Reduction primitives.
+ * @param[in] cq Command queue wrapper.
+ * @param[in] buf Buffer of `cl_int` to reduce.
+ * @param[in] n Number of elements in buffer.
+ * @param[in] op Reduction operation.
+ * @param[out] result Location where to put the result.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return `TRUE` if the operation was successful, `FALSE` otherwise.
+ * */
+gboolean ccl_ex_reduce_int(CCLExReduce* r, CCLQueue* cq, CCLBuffer* buf,
+	size_t n, CCLExReduceOp op, cl_long* result, GError** err) {
+
+	CCLKernel* krnl;
+	CCLBuffer* partials;
+	size_t gws = r->num_groups * r->lws;
+	cl_ulong n_arg = n;
+	gboolean ok = FALSE;
+
+	partials = ccl_ex_footprint_buffer_new(
+		r->ctx, CL_MEM_READ_WRITE, r->num_groups * sizeof(cl_long), NULL, err);
+	if (!partials) return FALSE;
+
+	krnl = ccl_program_get_kernel(r->prg, reduce_kernels[op], err);
+	if (!krnl) goto finish;
+
+	if (!ccl_kernel_set_args_and_enqueue_ndrange(
+		krnl, cq, 1, NULL, &gws, &r->lws, NULL, err,
+		buf, ccl_arg_priv(n_arg, cl_ulong), partials,
+		ccl_arg_local(r->lws, cl_long), NULL)) goto finish;
+
+	ok = ccl_ex_reduce_final(r, cq, final_kernels[op], partials,
+		(cl_uint) r->num_groups, result, err);
+
+finish:
+	ccl_ex_footprint_buffer_destroy(partials);
+	return ok;
+}
+
+/**
+ * Compare two buffers of integers on the device. Only the number of
+ * mismatches and the index of the first mismatch are read back to the
+ * host.
+ *
+ * @param[in] r Reduction primitives.
+ * @param[in] cq Command queue wrapper.
+ * @param[in] a First buffer of `cl_int`.
+ * @param[in] b Second buffer of `cl_int`.
+ * @param[in] n Number of elements in buffers.
+ * @param[out] count Location where to put the number of mismatches.
+ * @param[out] first Location where to put the index of the first
+ * mismatch (`n` if there are no mismatches).
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return `TRUE` if the operation was successful, `FALSE` otherwise.
+ * */
+gboolean ccl_ex_reduce_mismatch_int(CCLExReduce* r, CCLQueue* cq,
+	CCLBuffer* a, CCLBuffer* b, size_t n, cl_ulong* count,
+	cl_ulong* first, GError** err) {
+
+	CCLKernel* krnl;
+	CCLBuffer* partials_count = NULL;
+	CCLBuffer* partials_first = NULL;
+	size_t gws = r->num_groups * r->lws;
+	cl_ulong n_arg = n;
+	cl_long res;
+	gboolean ok = FALSE;
+
+	partials_count = ccl_ex_footprint_buffer_new(
+		r->ctx, CL_MEM_READ_WRITE, r->num_groups * sizeof(cl_long), NULL, err);
+	if (!partials_count) goto finish;
+	partials_first = ccl_ex_footprint_buffer_new(
+		r->ctx, CL_MEM_READ_WRITE, r->num_groups * sizeof(cl_long), NULL, err);
+	if (!partials_first) goto finish;
+
+	krnl = ccl_program_get_kernel(r->prg, "mismatch", err);
+	if (!krnl) goto finish;
+
+	if (!ccl_kernel_set_args_and_enqueue_ndrange(
+		krnl, cq, 1, NULL, &gws, &r->lws, NULL, err,
+		a, b, ccl_arg_priv(n_arg, cl_ulong), partials_count,
+		partials_first, ccl_arg_local(r->lws, cl_long),
+		ccl_arg_local(r->lws, cl_long), NULL)) goto finish;
+
+	if (!ccl_ex_reduce_final(r, cq, "final_sum", partials_count,
+		(cl_uint) r->num_groups, &res, err)) goto finish;
+	*count = (cl_ulong) res;
+
+	if (!ccl_ex_reduce_final(r, cq, "final_min", partials_first,
+		(cl_uint) r->num_groups, &res, err)) goto finish;
+	*first = (cl_ulong) res;
+
+	ok = TRUE;
+
+finish:
+	if (partials_count) ccl_ex_footprint_buffer_destroy(partials_count);
+	if (partials_first) ccl_ex_footprint_buffer_destroy(partials_first);
+	return ok;
+}
+
+/**
+ * Inclusive or exclusive scan (prefix sum) of a buffer of integers on
+ * the device. Blocks of one work-group are scanned, and block totals
+ * are scanned recursively and added to each block.
+ *
+ * @param[in] r Reduction primitives.
+ * @param[in] cq Command queue wrapper.
+ * @param[in] in Buffer of `cl_int` to scan.
+ * @param[out] out Buffer of `cl_int` where to put the scan, can be the
+ * same as `in`.
+ * @param[in] n Number of elements in buffers.
+ * @param[in] inclusive Perform an inclusive scan?
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return `TRUE` if the operation was successful, `FALSE` otherwise.
+ * */
+gboolean ccl_ex_reduce_scan_int(CCLExReduce* r, CCLQueue* cq,
+	CCLBuffer* in, CCLBuffer* out, size_t n, gboolean inclusive,
+	GError** err) {
+
+	CCLKernel* krnl;
+	CCLBuffer* block_sums = NULL;
+	CCLBuffer* block_offsets = NULL;
+	size_t num_blocks = (n + r->lws - 1) / r->lws;
+	size_t gws = num_blocks * r->lws;
+	cl_ulong n_arg = n;
+	cl_uint incl_arg = inclusive ? 1 : 0;
+	gboolean ok = FALSE;
+
+	if (n == 0) return TRUE;
+
+	/* Scan blocks. */
+	block_sums = ccl_ex_footprint_buffer_new(
+		r->ctx, CL_MEM_READ_WRITE, num_blocks * sizeof(cl_int), NULL, err);
+	if (!block_sums) goto finish;
+
+	krnl = ccl_program_get_kernel(r->prg, "scan_block", err);
+	if (!krnl) goto finish;
+
+	if (!ccl_kernel_set_args_and_enqueue_ndrange(
+		krnl, cq, 1, NULL, &gws, &r->lws, NULL, err,
+		in, out, ccl_arg_priv(n_arg, cl_ulong), block_sums,
+		ccl_arg_local(r->lws, cl_uint), ccl_arg_priv(incl_arg, cl_uint),
+		NULL)) goto finish;
+
+	/* If there is more than one block, add totals of previous blocks
+	 * to each block. */
+	if (num_blocks > 1) {
+
+		block_offsets = ccl_ex_footprint_buffer_new(
+			r->ctx, CL_MEM_READ_WRITE, num_blocks * sizeof(cl_int), NULL, err);
+		if (!block_offsets) goto finish;
+
+		if (!ccl_ex_reduce_scan_int(r, cq, block_sums, block_offsets,
+			num_blocks, FALSE, err)) goto finish;
+
+		krnl = ccl_program_get_kernel(r->prg, "scan_add", err);
+		if (!krnl) goto finish;
+
+		if (!ccl_kernel_set_args_and_enqueue_ndrange(
+			krnl, cq, 1, NULL, &gws, &r->lws, NULL, err,
+			out, ccl_arg_priv(n_arg, cl_ulong), block_offsets, NULL))
+			goto finish;
+	}
+
+	ok = TRUE;
+
+finish:
+	/* Temporary buffers are only released by OpenCL after the enqueued
+	 * kernels which use them complete. */
+	if (block_sums) ccl_ex_footprint_buffer_destroy(block_sums);
+	if (block_offsets) ccl_ex_footprint_buffer_destroy(block_offsets);
+	return ok;
+}
+
+/**
+ * Flag the elements which differ between two buffers of integers on the
+ * device, e.g. for compacting the mismatches of a result.
+ *
+ * @param[in] r Reduction primitives.
+ * @param[in] cq Command queue wrapper.
+ * @param[in] a Buffer of `cl_int`.
+ * @param[in] b Buffer of `cl_int`.
+ * @param[out] flags Buffer of `cl_int` where to put 1 where elements
+ * differ and 0 otherwise.
+ * @param[in] n Number of elements in buffers.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return `TRUE` if the operation was successful, `FALSE` otherwise.
+ * */
+gboolean ccl_ex_reduce_flag_ne_int(CCLExReduce* r, CCLQueue* cq,
+	CCLBuffer* a, CCLBuffer* b, CCLBuffer* flags, size_t n,
+	GError** err) {
+
+	CCLKernel* krnl;
+	size_t gws = ((n + r->lws - 1) / r->lws) * r->lws;
+	cl_ulong n_arg = n;
+
+	if (n == 0) return TRUE;
+
+	krnl = ccl_program_get_kernel(r->prg, "flag_ne", err);
+	if (!krnl) return FALSE;
+
+	return ccl_kernel_set_args_and_enqueue_ndrange(
+		krnl, cq, 1, NULL, &gws, &r->lws, NULL, err,
+		a, b, ccl_arg_priv(n_arg, cl_ulong), flags, NULL) != NULL;
+}
+
+/**
+ * Compact a buffer of integers on the device, keeping the elements whose
+ * flag is 1, in order.
+ *
+ * @param[in] r Reduction primitives.
+ * @param[in] cq Command queue wrapper.
+ * @param[in] in Buffer of `cl_int` to compact, or `NULL` to keep the
+ * indexes of flagged elements instead (`n` must then be at most
+ * `G_MAXINT32`).
+ * @param[in] flags Buffer of `cl_int` flags, 0 or 1.
+ * @param[out] out Buffer of `cl_int` where to put kept elements, must
+ * not be the same as `in`.
+ * @param[in] n Number of elements in `in` and `flags`.
+ * @param[out] n_out Location where to put the number of kept elements.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return `TRUE` if the operation was successful, `FALSE` otherwise.
+ * */
+gboolean ccl_ex_reduce_compact_int(CCLExReduce* r, CCLQueue* cq,
+	CCLBuffer* in, CCLBuffer* flags, CCLBuffer* out, size_t n,
+	size_t* n_out, GError** err) {
+
+	CCLKernel* krnl;
+	CCLBuffer* offsets = NULL;
+	size_t gws = ((n + r->lws - 1) / r->lws) * r->lws;
+	cl_ulong n_arg = n;
+	cl_int last[2];
+	gboolean ok = FALSE;
+
+	*n_out = 0;
+	if (n == 0) return TRUE;
+	g_return_val_if_fail((in != NULL) || (n <= G_MAXINT32), FALSE);
+
+	/* Output positions are given by the exclusive scan of the flags. */
+	offsets = ccl_ex_footprint_buffer_new(
+		r->ctx, CL_MEM_READ_WRITE, n * sizeof(cl_int), NULL, err);
+	if (!offsets) goto finish;
+
+	if (!ccl_ex_reduce_scan_int(r, cq, flags, offsets, n, FALSE, err))
+		goto finish;
+
+	krnl = ccl_program_get_kernel(
+		r->prg, in ? "scatter" : "scatter_index", err);
+	if (!krnl) goto finish;
+
+	if (in) {
+		if (!ccl_kernel_set_args_and_enqueue_ndrange(
+			krnl, cq, 1, NULL, &gws, &r->lws, NULL, err,
+			in, flags, offsets, ccl_arg_priv(n_arg, cl_ulong), out, NULL))
+			goto finish;
+	} else {
+		if (!ccl_kernel_set_args_and_enqueue_ndrange(
+			krnl, cq, 1, NULL, &gws, &r->lws, NULL, err,
+			flags, offsets, ccl_arg_priv(n_arg, cl_ulong), out, NULL))
+			goto finish;
+	}
+
+	/* Number of kept elements is the last offset plus the last flag. */
+	if (!ccl_buffer_enqueue_read(offsets, cq, CL_FALSE,
+		(n - 1) * sizeof(cl_int), sizeof(cl_int), &last[0], NULL, err))
+		goto finish;
+	if (!ccl_buffer_enqueue_read(flags, cq, CL_TRUE,
+		(n - 1) * sizeof(cl_int), sizeof(cl_int), &last[1], NULL, err))
+		goto finish;
+	*n_out = (size_t) last[0] + last[1];
+
+	ok = TRUE;
+
+finish:
+	if (offsets) ccl_ex_footprint_buffer_destroy(offsets);
+	return ok;
+}
+
+/**
+ * Destroy reduction primitives.
+ *
+ * @param[in] r Reduction primitives to destroy.
+ * */
+void ccl_ex_reduce_destroy(CCLExReduce* r) {
+	if (r->prg) ccl_program_destroy(r->prg);
+	g_slice_free(CCLExReduce, r);
+}
@@ -0,0 +1,282 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Reduction, scan and compaction kernels for integer buffers.
+ *
+ * Reductions work in two passes: a fixed number of work-groups reduce
+ * the input into one partial result each, and a single work-group
+ * reduces the partial results. Inputs are read with vector loads of
+ * `VW` integers (defined by the host from the preferred vector width of
+ * the device). Work-group sizes must be powers of two.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+/* Vector width for loads. */
+#ifndef VW
+#define VW 4
+#endif
+
+#define CAT(a, b) a ## b
+#define XCAT(a, b) CAT(a, b)
+
+#if VW > 1
+typedef XCAT(int, VW) intv;
+#define VLOAD(i, p) XCAT(vload, VW)((i), (p))
+#else
+typedef int intv;
+#define VLOAD(i, p) (p)[i]
+#endif
+
+/* Operations: accumulate an element into a partial result, and combine
+ * two partial results. */
+#define OP_SUM(acc, x) ((acc) + (x))
+#define OP_MIN(acc, x) min((acc), (long) (x))
+#define OP_MAX(acc, x) max((acc), (long) (x))
+#define OP_COUNT(acc, x) ((acc) + ((x) != 0))
+
+/* Tree reduction in local memory of the partial result `acc` of each
+ * work-item. Leaves the result of the work-group in `scratch[0]`. */
+#define LOCAL_REDUCE(scratch, acc, COMB) \
+	do { \
+		uint _lid = get_local_id(0); \
+		scratch[_lid] = (acc); \
+		barrier(CLK_LOCAL_MEM_FENCE); \
+		for (uint _s = get_local_size(0) / 2; _s > 0; _s >>= 1) { \
+			if (_lid < _s) \
+				scratch[_lid] = COMB(scratch[_lid], scratch[_lid + _s]); \
+			barrier(CLK_LOCAL_MEM_FENCE); \
+		} \
+	} while (0)
+
+/* First pass: each work-group reduces a strided part of the input into
+ * partials[group]. */
+#define REDUCE_KERNEL(name, OP, COMB, IDENT) \
+__kernel void reduce_ ## name(__global const int* in, const ulong n, \
+	__global long* partials, __local long* scratch) { \
+	\
+	ulong gid = get_global_id(0); \
+	ulong gsize = get_global_size(0); \
+	ulong nv = n / VW; \
+	long acc = IDENT; \
+	\
+	/* Vector loads. */ \
+	for (ulong i = gid; i < nv; i += gsize) { \
+		intv v = VLOAD(i, in); \
+		int* e = (int*) &v; \
+		for (uint k = 0; k < VW; k++) \
+			acc = OP(acc, e[k]); \
+	} \
+	/* Remaining elements. */ \
+	for (ulong i = nv * VW + gid; i < n; i += gsize) \
+		acc = OP(acc, in[i]); \
+	\
+	LOCAL_REDUCE(scratch, acc, COMB); \
+	if (get_local_id(0) == 0) \
+		partials[get_group_id(0)] = scratch[0]; \
+}
+
+/* Second pass: a single work-group reduces the partial results into
+ * partials[0]. */
+#define FINAL_KERNEL(name, COMB, IDENT) \
+__kernel void final_ ## name(__global long* partials, const uint n, \
+	__local long* scratch) { \
+	\
+	long acc = IDENT; \
+	\
+	for (uint i = get_local_id(0); i < n; i += get_local_size(0)) \
+		acc = COMB(acc, partials[i]); \
+	\
+	LOCAL_REDUCE(scratch, acc, COMB); \
+	if (get_local_id(0) == 0) \
+		partials[0] = scratch[0]; \
+}
+
+REDUCE_KERNEL(sum, OP_SUM, OP_SUM, 0)
+REDUCE_KERNEL(min, OP_MIN, OP_MIN, LONG_MAX)
+REDUCE_KERNEL(max, OP_MAX, OP_MAX, LONG_MIN)
+REDUCE_KERNEL(count, OP_COUNT, OP_SUM, 0)
+
+FINAL_KERNEL(sum, OP_SUM, 0)
+FINAL_KERNEL(min, OP_MIN, LONG_MAX)
+FINAL_KERNEL(max, OP_MAX, LONG_MIN)
+
+/**
+ * First pass of a comparison of two buffers: each work-group counts the
+ * elements which differ, and finds the lowest index where they differ
+ * (`n` if none).
+ *
+ * @param[in] a First buffer.
+ * @param[in] b Second buffer.
+ * @param[in] n Number of elements in buffers.
+ * @param[out] partials_count Number of mismatches of each work-group.
+ * @param[out] partials_first First mismatch of each work-group.
+ * @param[in] scratch_count Local memory for counts.
+ * @param[in] scratch_first Local memory for first mismatches.
+ * */
+__kernel void mismatch(__global const int* a, __global const int* b,
+	const ulong n, __global long* partials_count,
+	__global long* partials_first, __local long* scratch_count,
+	__local long* scratch_first) {
+
+	ulong gid = get_global_id(0);
+	ulong gsize = get_global_size(0);
+	ulong nv = n / VW;
+	long count = 0;
+	long first = n;
+
+	/* Vector loads. */
+	for (ulong i = gid; i < nv; i += gsize) {
+		intv va = VLOAD(i, a);
+		intv vb = VLOAD(i, b);
+		int* ea = (int*) &va;
+		int* eb = (int*) &vb;
+		for (uint k = 0; k < VW; k++) {
+			if (ea[k] != eb[k]) {
+				count++;
+				first = min(first, (long) (i * VW + k));
+			}
+		}
+	}
+	/* Remaining elements. */
+	for (ulong i = nv * VW + gid; i < n; i += gsize) {
+		if (a[i] != b[i]) {
+			count++;
+			first = min(first, (long) i);
+		}
+	}
+
+	LOCAL_REDUCE(scratch_count, count, OP_SUM);
+	LOCAL_REDUCE(scratch_first, first, OP_MIN);
+	if (get_local_id(0) == 0) {
+		partials_count[get_group_id(0)] = scratch_count[0];
+		partials_first[get_group_id(0)] = scratch_first[0];
+	}
+}
+
+/**
+ * Scan each block of the input (one block per work-group), and keep the
+ * total of each block.
+ *
+ * @param[in] in Input buffer.
+ * @param[out] out Output buffer, can be the same as `in`.
+ * @param[in] n Number of elements in buffers.
+ * @param[out] block_sums Total of each block.
+ * @param[in] scratch Local memory, one element per work-item.
+ * @param[in] inclusive Inclusive (1) or exclusive (0) scan.
+ * */
+__kernel void scan_block(__global const int* in, __global int* out,
+	const ulong n, __global int* block_sums, __local uint* scratch,
+	const uint inclusive) {
+
+	ulong gid = get_global_id(0);
+	uint lid = get_local_id(0);
+	uint lsize = get_local_size(0);
+	uint x = (gid < n) ? as_uint(in[gid]) : 0;
+
+	/* Hillis-Steele inclusive scan in local memory. Sums wrap around
+	 * modulo 2^32. */
+	scratch[lid] = x;
+	barrier(CLK_LOCAL_MEM_FENCE);
+	for (uint s = 1; s < lsize; s <<= 1) {
+		uint y = (lid >= s) ? scratch[lid - s] : 0;
+		barrier(CLK_LOCAL_MEM_FENCE);
+		scratch[lid] += y;
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	if (gid < n)
+		out[gid] = as_int(inclusive ? scratch[lid] : scratch[lid] - x);
+	if (lid == lsize - 1)
+		block_sums[get_group_id(0)] = as_int(scratch[lid]);
+}
+
+/**
+ * Add the scanned block totals to each block.
+ *
+ * @param[in,out] out Output of scan_block.
+ * @param[in] n Number of elements in buffer.
+ * @param[in] block_offsets Exclusive scan of block totals.
+ * */
+__kernel void scan_add(__global int* out, const ulong n,
+	__global const int* block_offsets) {
+
+	ulong gid = get_global_id(0);
+
+	if (gid < n)
+		out[gid] = as_int(as_uint(out[gid])
+			+ as_uint(block_offsets[get_group_id(0)]));
+}
+
+/**
+ * Scatter flagged elements to the positions given by an exclusive scan
+ * of the flags.
+ *
+ * @param[in] in Input buffer.
+ * @param[in] flags Flags (0 or 1) of elements to keep.
+ * @param[in] offsets Exclusive scan of flags.
+ * @param[in] n Number of elements in buffers.
+ * @param[out] out Output buffer.
+ * */
+__kernel void scatter(__global const int* in, __global const int* flags,
+	__global const int* offsets, const ulong n, __global int* out) {
+
+	ulong gid = get_global_id(0);
+
+	if ((gid < n) && flags[gid])
+		out[offsets[gid]] = in[gid];
+}
+
+/**
+ * Scatter the indexes of flagged elements to the positions given by an
+ * exclusive scan of the flags.
+ *
+ * @param[in] flags Flags (0 or 1) of elements to keep.
+ * @param[in] offsets Exclusive scan of flags.
+ * @param[in] n Number of elements in buffers (at most `INT_MAX`).
+ * @param[out] out Output buffer.
+ * */
+__kernel void scatter_index(__global const int* flags,
+	__global const int* offsets, const ulong n, __global int* out) {
+
+	ulong gid = get_global_id(0);
+
+	if ((gid < n) && flags[gid])
+		out[offsets[gid]] = (int) gid;
+}
+
+/**
+ * Flag the elements which differ between two buffers.
+ *
+ * @param[in] a First buffer.
+ * @param[in] b Second buffer.
+ * @param[in] n Number of elements in buffers.
+ * @param[out] flags 1 where elements differ, 0 otherwise.
+ * */
+__kernel void flag_ne(__global const int* a, __global const int* b,
+	const ulong n, __global int* flags) {
+
+	ulong gid = get_global_id(0);
+
+	if (gid < n)
+		flags[gid] = (a[gid] != b[gid]) ? 1 : 0;
+}
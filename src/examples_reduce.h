@@ -0,0 +1,97 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Device reduction, scan and compaction primitives for cf4ocl-examples.
+ *
+ * The kernels in `examples_reduce.cl` are built for a specific device,
+ * with vector loads of the device's preferred integer vector width,
+ * and run with the largest power-of-two work-group size the kernels
+ * allow (up to #CCL_EX_REDUCE_LWS_MAX). These primitives allow examples
+ * to obtain statistics of device buffers without reading them back to
+ * the host.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#ifndef _CCL_EXAMPLES_REDUCE_H_
+#define _CCL_EXAMPLES_REDUCE_H_
+
+#include "examples_common.h"
+
+/** File with the reduction kernels, which should be in the same
+ * location as the example executable. */
+#define CCL_EX_REDUCE_KERNEL_FILE "examples_reduce.cl"
+
+/** Maximum work-group size. */
+#define CCL_EX_REDUCE_LWS_MAX 256
+
+/** Number of work-groups per compute unit in the first pass of
+ * reductions. */
+#define CCL_EX_REDUCE_GROUPS_PER_CU 4
+
+/** Reduction operations. */
+typedef enum ccl_ex_reduce_op {
+	/** Sum of elements. */
+	CCL_EX_REDUCE_SUM = 0,
+	/** Minimum element (`G_MAXINT64` for empty buffers). */
+	CCL_EX_REDUCE_MIN = 1,
+	/** Maximum element (`G_MININT64` for empty buffers). */
+	CCL_EX_REDUCE_MAX = 2,
+	/** Number of non-zero elements. */
+	CCL_EX_REDUCE_COUNT = 3
+} CCLExReduceOp;
+
+/** Device reduction primitives. */
+typedef struct ccl_ex_reduce CCLExReduce;
+
+/* Create reduction primitives for the first device in a context. */
+CCLExReduce* ccl_ex_reduce_new(CCLContext* ctx, char* exec_name,
+	GError** err);
+
+/* Reduce a buffer of integers. */
+gboolean ccl_ex_reduce_int(CCLExReduce* r, CCLQueue* cq, CCLBuffer* buf,
+	size_t n, CCLExReduceOp op, cl_long* result, GError** err);
+
+/* Compare two buffers of integers. */
+gboolean ccl_ex_reduce_mismatch_int(CCLExReduce* r, CCLQueue* cq,
+	CCLBuffer* a, CCLBuffer* b, size_t n, cl_ulong* count,
+	cl_ulong* first, GError** err);
+
+/* Inclusive or exclusive scan of a buffer of integers. */
+gboolean ccl_ex_reduce_scan_int(CCLExReduce* r, CCLQueue* cq,
+	CCLBuffer* in, CCLBuffer* out, size_t n, gboolean inclusive,
+	GError** err);
+
+/* Flag elements which differ between two buffers of integers. */
+gboolean ccl_ex_reduce_flag_ne_int(CCLExReduce* r, CCLQueue* cq,
+	CCLBuffer* a, CCLBuffer* b, CCLBuffer* flags, size_t n,
+	GError** err);
+
+/* Compact a buffer of integers, keeping flagged elements. */
+gboolean ccl_ex_reduce_compact_int(CCLExReduce* r, CCLQueue* cq,
+	CCLBuffer* in, CCLBuffer* flags, CCLBuffer* out, size_t n,
+	size_t* n_out, GError** err);
+
+/* Destroy reduction primitives. */
+void ccl_ex_reduce_destroy(CCLExReduce* r);
+
+#endif
@@ -0,0 +1,312 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Sampled profiling implementation for cf4ocl-examples.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#include "examples_sampprof.h"
+
+/* Durations of one event name. */
+struct ccl_ex_sampprof_event {
+	/* Queue and event name. */
+	gchar* name;
+	/* Number of profiled events. */
+	guint count;
+	/* Total, minimum and maximum durations in nanoseconds. */
+	cl_ulong total;
+	cl_ulong min;
+	cl_ulong max;
+};
+
+/* Iteration times, profiled or not. */
+struct ccl_ex_sampprof_iters {
+	/* Number of iterations. */
+	guint count;
+	/* Total duration in seconds. */
+	double time;
+	/* Host seconds spent in ccl_ex_sampprof_collect(). */
+	double time_collect;
+};
+
+/* Sampled profiling. */
+struct ccl_ex_sampprof {
+	/* Sample period, negative for random sampling. */
+	gint period;
+	/* Seed for random sampling. */
+	guint32 seed;
+	/* Event statistics, by queue and event name. */
+	GHashTable* events;
+	/* Profiled (1) and unprofiled (0) iterations. */
+	struct ccl_ex_sampprof_iters iters[2];
+	/* Queues may be collected from different threads. */
+	GMutex lock;
+};
+
+/* Hash an iteration number, for random sampling which doesn't depend on
+ * the order in which iterations are queried. */
+static guint32 ccl_ex_sampprof_hash(guint32 seed, guint iter) {
+	guint32 h = seed ^ ((guint32) iter * 0x9E3779B9u);
+	h ^= h >> 16;
+	h *= 0x85EBCA6Bu;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35u;
+	h ^= h >> 16;
+	return h;
+}
+
+/* Free event statistics (hash table value destroy function). */
+static void ccl_ex_sampprof_event_free(gpointer data) {
+	struct ccl_ex_sampprof_event* se = (struct ccl_ex_sampprof_event*) data;
+	g_free(se->name);
+	g_slice_free(struct ccl_ex_sampprof_event, se);
+}
+
+/* Sort event statistics by total duration, longest first. */
+static gint ccl_ex_sampprof_event_cmp(gconstpointer a, gconstpointer b) {
+	const struct ccl_ex_sampprof_event* sa = a;
+	const struct ccl_ex_sampprof_event* sb = b;
+	return sa->total < sb->total ? 1 : (sa->total > sb->total ? -1 : 0);
+}
+
+/**
+ * Create sampled profiling.
+ *
+ * @param[in] period Sample period: 1 profiles all iterations, @f$N>1@f$
+ * profiles every Nth iteration (starting with the first), and
+ * @f$-N@f$ profiles a random sample of one in @f$N@f$ iterations.
+ * @param[in] seed Seed for random sampling. The same seed gives the same
+ * sampled iterations.
+ * @return A new sampled profiling object, to be destroyed with
+ * ccl_ex_sampprof_destroy().
+ * */
+CCLExSampProf* ccl_ex_sampprof_new(gint period, guint32 seed) {
+
+	CCLExSampProf* sp;
+
+	g_return_val_if_fail(period != 0, NULL);
+
+	sp = g_slice_new0(CCLExSampProf);
+	sp->period = period;
+	sp->seed = seed;
+	sp->events = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+		ccl_ex_sampprof_event_free);
+	g_mutex_init(&sp->lock);
+
+	return sp;
+}
+
+/**
+ * Is the given iteration profiled? The answer only depends on the
+ * iteration number, so that threads working on the same iteration agree
+ * without communicating.
+ *
+ * @param[in] sp Sampled profiling object.
+ * @param[in] iter Iteration number.
+ * @return `TRUE` if the iteration should run on a profiling-enabled
+ * queue, `FALSE` otherwise.
+ * */
+gboolean ccl_ex_sampprof_is_sampled(CCLExSampProf* sp, guint iter) {
+
+	g_return_val_if_fail(sp != NULL, FALSE);
+
+	if (sp->period > 0)
+		return iter % (guint) sp->period == 0;
+	return ccl_ex_sampprof_hash(sp->seed, iter) % (guint) -sp->period == 0;
+}
+
+/**
+ * Collect profiling information of an iteration and release all events
+ * of the queue. All events of the queue must be complete. If the
+ * iteration is sampled, the queue must have profiling enabled, and the
+ * duration of each event is added to the statistics of its name.
+ *
+ * @param[in] sp Sampled profiling object.
+ * @param[in] cq Queue where the iteration ran.
+ * @param[in] queue_name Queue name, prefixed to event names.
+ * @param[in] iter Iteration number.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return `TRUE` if successful, `FALSE` otherwise.
+ * */
+gboolean ccl_ex_sampprof_collect(CCLExSampProf* sp, CCLQueue* cq,
+	const char* queue_name, guint iter, GError** err) {
+
+	CCLEvent* evt;
+	struct ccl_ex_sampprof_event* se;
+	gchar* name;
+	cl_ulong tstart, tend;
+	gboolean sampled;
+	gint64 t0 = g_get_monotonic_time();
+	GError* err_internal = NULL;
+
+	g_return_val_if_fail(sp != NULL, FALSE);
+	g_return_val_if_fail(cq != NULL, FALSE);
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	sampled = ccl_ex_sampprof_is_sampled(sp, iter);
+
+	g_mutex_lock(&sp->lock);
+
+	if (sampled) {
+		ccl_queue_iter_event_init(cq);
+		while ((evt = ccl_queue_iter_event_next(cq)) != NULL) {
+
+			tstart = ccl_event_get_profiling_info_scalar(
+				evt, CL_PROFILING_COMMAND_START, cl_ulong, &err_internal);
+			if_err_goto(err_internal, error_handler);
+			tend = ccl_event_get_profiling_info_scalar(
+				evt, CL_PROFILING_COMMAND_END, cl_ulong, &err_internal);
+			if_err_goto(err_internal, error_handler);
+
+			name = g_strdup_printf("%s: %s",
+				queue_name, ccl_event_get_final_name(evt));
+			se = g_hash_table_lookup(sp->events, name);
+			if (se == NULL) {
+				se = g_slice_new0(struct ccl_ex_sampprof_event);
+				se->name = name;
+				se->min = G_MAXUINT64;
+				g_hash_table_insert(sp->events, se->name, se);
+			} else {
+				g_free(name);
+			}
+			se->count++;
+			se->total += tend - tstart;
+			se->min = MIN(se->min, tend - tstart);
+			se->max = MAX(se->max, tend - tstart);
+		}
+	}
+
+	/* Release events, profiled or not. */
+	ccl_queue_gc(cq);
+
+	goto finish;
+
+error_handler:
+
+	g_propagate_error(err, err_internal);
+
+finish:
+
+	sp->iters[sampled ? 1 : 0].time_collect +=
+		(g_get_monotonic_time() - t0) * 1e-6;
+	g_mutex_unlock(&sp->lock);
+
+	return err_internal == NULL;
+}
+
+/**
+ * Account for the duration of an iteration, which should not include
+ * the time spent in ccl_ex_sampprof_collect().
+ *
+ * @param[in] sp Sampled profiling object.
+ * @param[in] iter Iteration number.
+ * @param[in] seconds Duration of the iteration.
+ * */
+void ccl_ex_sampprof_iter_time(CCLExSampProf* sp, guint iter,
+	double seconds) {
+
+	struct ccl_ex_sampprof_iters* it;
+
+	g_return_if_fail(sp != NULL);
+
+	g_mutex_lock(&sp->lock);
+	it = &sp->iters[ccl_ex_sampprof_is_sampled(sp, iter) ? 1 : 0];
+	it->count++;
+	it->time += seconds;
+	g_mutex_unlock(&sp->lock);
+}
+
+/**
+ * Print per-event statistics and profiling overhead. The overhead is the
+ * relative difference between the average duration of profiled and
+ * unprofiled iterations.
+ *
+ * @param[in] sp Sampled profiling object.
+ * @param[in] out Stream where to print.
+ * */
+void ccl_ex_sampprof_summary_print(CCLExSampProf* sp, FILE* out) {
+
+	GList* events;
+	struct ccl_ex_sampprof_iters* prof;
+	struct ccl_ex_sampprof_iters* noprof;
+	double avg_prof, avg_noprof;
+
+	g_return_if_fail(sp != NULL);
+	g_return_if_fail(out != NULL);
+
+	g_mutex_lock(&sp->lock);
+
+	prof = &sp->iters[1];
+	noprof = &sp->iters[0];
+	avg_prof = prof->count > 0 ? prof->time / prof->count : 0.0;
+	avg_noprof = noprof->count > 0 ? noprof->time / noprof->count : 0.0;
+
+	fprintf(out, "\n   ========================== Sampled profiling ============================\n\n");
+	if (sp->period > 0)
+		fprintf(out, "     Sampling               : every %d iterations\n",
+			sp->period);
+	else
+		fprintf(out, "     Sampling               : random, 1 in %d iterations (seed %u)\n",
+			-sp->period, (unsigned int) sp->seed);
+	fprintf(out, "     Profiled iterations    : %u of %u\n",
+		prof->count, prof->count + noprof->count);
+
+	fprintf(out, "\n     %-30s %7s %12s %12s %12s\n",
+		"Event", "Count", "Avg. (s)", "Min. (s)", "Max. (s)");
+	events = g_list_sort(g_hash_table_get_values(sp->events),
+		ccl_ex_sampprof_event_cmp);
+	for (GList* l = events; l != NULL; l = l->next) {
+		struct ccl_ex_sampprof_event* se = l->data;
+		fprintf(out, "     %-30s %7u %12.4e %12.4e %12.4e\n",
+			se->name, se->count, se->total * 1e-9 / se->count,
+			se->min * 1e-9, se->max * 1e-9);
+	}
+	g_list_free(events);
+
+	fprintf(out, "\n     Iteration (profiled)   : %es avg.\n", avg_prof);
+	fprintf(out, "     Iteration (unprofiled) : %es avg.\n", avg_noprof);
+	if ((prof->count > 0) && (noprof->count > 0))
+		fprintf(out, "     Profiling overhead     : %+.2f%%\n",
+			100.0 * (avg_prof - avg_noprof) / avg_noprof);
+	else
+		fprintf(out, "     Profiling overhead     : n/a (needs both kinds of iterations)\n");
+	fprintf(out, "     Collection time        : %es (%es unprofiled)\n",
+		prof->time_collect, noprof->time_collect);
+
+	g_mutex_unlock(&sp->lock);
+}
+
+/**
+ * Destroy sampled profiling.
+ *
+ * @param[in] sp Sampled profiling object to destroy.
+ * */
+void ccl_ex_sampprof_destroy(CCLExSampProf* sp) {
+
+	g_return_if_fail(sp != NULL);
+
+	g_hash_table_destroy(sp->events);
+	g_mutex_clear(&sp->lock);
+	g_slice_free(CCLExSampProf, sp);
+}
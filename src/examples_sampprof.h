@@ -0,0 +1,72 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Sampled profiling of long runs for cf4ocl-examples.
+ *
+ * Profiling every iteration of a long run keeps all events alive until
+ * ccl_prof_calc(), so memory grows with the number of iterations and
+ * the final calculation becomes slow. With sampled profiling, only
+ * every Nth iteration (or a random sample of one in N iterations) is
+ * profiled. After each iteration, ccl_ex_sampprof_collect() adds the
+ * durations of the events of sampled iterations to per-event
+ * statistics and releases all events of the queue, so memory stays
+ * constant.
+ *
+ * Programs run unsampled iterations on queues without profiling
+ * enabled, and report iteration times with ccl_ex_sampprof_iter_time().
+ * Comparing profiled and unprofiled iterations of the same run gives the
+ * overhead of profiling itself, which is shown with the statistics,
+ * together with the host time spent collecting profiling information.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#ifndef _CCL_EXAMPLES_SAMPPROF_H_
+#define _CCL_EXAMPLES_SAMPPROF_H_
+
+#include "examples_common.h"
+
+/** Sampled profiling of a long run. */
+typedef struct ccl_ex_sampprof CCLExSampProf;
+
+/* Create sampled profiling. */
+CCLExSampProf* ccl_ex_sampprof_new(gint period, guint32 seed);
+
+/* Is the given iteration profiled? */
+gboolean ccl_ex_sampprof_is_sampled(CCLExSampProf* sp, guint iter);
+
+/* Collect profiling information of a sampled iteration and release all
+ * events of the queue. */
+gboolean ccl_ex_sampprof_collect(CCLExSampProf* sp, CCLQueue* cq,
+	const char* queue_name, guint iter, GError** err);
+
+/* Account for the duration of an iteration. */
+void ccl_ex_sampprof_iter_time(CCLExSampProf* sp, guint iter,
+	double seconds);
+
+/* Print per-event statistics and profiling overhead. */
+void ccl_ex_sampprof_summary_print(CCLExSampProf* sp, FILE* out);
+
+/* Destroy sampled profiling. */
+void ccl_ex_sampprof_destroy(CCLExSampProf* sp);
+
+#endif
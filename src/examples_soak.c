@@ -0,0 +1,409 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Soak mode implementation for cf4ocl-examples.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#include "examples_soak.h"
+#include "examples_footprint.h"
+#include <signal.h>
+
+/* Statistics of iteration latencies in one window. */
+struct ccl_ex_soak_stats {
+	/* Number of iterations. */
+	guint64 n;
+	/* Mean and sample variance of latency, in seconds. */
+	double mean;
+	double var;
+	/* Throughput, in work units per second. */
+	double thr;
+	/* Process RSS in bytes. */
+	size_t rss;
+	/* Events held by the tracked queues. */
+	guint events;
+};
+
+/* Soak mode. */
+struct ccl_ex_soak {
+	/* Duration in seconds (0 runs until interrupted). */
+	double duration;
+	/* Window length in seconds. */
+	double window;
+	/* Work unit, for throughput. */
+	gchar* work_unit;
+	/* Where to log windows. */
+	FILE* out;
+	/* Queues whose events are counted. */
+	GPtrArray* queues;
+	/* Start of run and of current window (monotonic time, 0 if not
+	 * started). */
+	gint64 t_start;
+	gint64 t_window;
+	/* Iteration latencies and work of the current window. */
+	GArray* lat;
+	double work;
+	/* Total iterations and work. */
+	guint64 iters;
+	double work_total;
+	/* Logged windows. */
+	guint windows;
+	/* Statistics of the first and of the last window. */
+	struct ccl_ex_soak_stats first;
+	struct ccl_ex_soak_stats last;
+	/* Consecutive windows where RSS or event count grew. */
+	guint growth;
+	/* Windows flagged as degraded or growing. */
+	guint degraded;
+	guint growing;
+	/* Previous SIGINT handler. */
+	void (*sigint_prev)(int);
+};
+
+/* Set when the user interrupts the run. */
+static volatile sig_atomic_t ccl_ex_soak_interrupted = 0;
+
+/* SIGINT handler: stop the run at the end of the current iteration. */
+static void ccl_ex_soak_sigint(int signum) {
+	(void) signum;
+	ccl_ex_soak_interrupted = 1;
+}
+
+/* Parse a time in seconds, with an optional s, m, h or d suffix. */
+static gboolean ccl_ex_soak_parse_time(const char* str, double* seconds) {
+
+	gchar* end;
+	double t = g_ascii_strtod(str, &end);
+
+	if ((end == str) || (t < 0)) return FALSE;
+	switch (*end) {
+		case '\0': case 's': break;
+		case 'm': t *= 60; break;
+		case 'h': t *= 3600; break;
+		case 'd': t *= 86400; break;
+		default: return FALSE;
+	}
+	if ((*end != '\0') && (*(end + 1) != '\0')) return FALSE;
+
+	*seconds = t;
+	return TRUE;
+}
+
+/* Compare latencies, for sorting. */
+static gint ccl_ex_soak_cmp(gconstpointer a, gconstpointer b) {
+	double da = *((const double*) a), db = *((const double*) b);
+	return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+/* Nearest-rank percentile of sorted latencies. */
+static double ccl_ex_soak_percentile(GArray* lat, double p) {
+	guint idx = (guint) ceil(p * lat->len);
+	return g_array_index(lat, double, idx > 0 ? idx - 1 : 0);
+}
+
+/* Count events held by the tracked queues. */
+static guint ccl_ex_soak_events(CCLExSoak* soak) {
+
+	guint n = 0;
+
+	for (guint i = 0; i < soak->queues->len; ++i) {
+		CCLQueue* cq = (CCLQueue*) g_ptr_array_index(soak->queues, i);
+		ccl_queue_iter_event_init(cq);
+		while (ccl_queue_iter_event_next(cq) != NULL) n++;
+	}
+	return n;
+}
+
+/* Close current window: compute its statistics, compare them with the
+ * first window and log them. */
+static void ccl_ex_soak_window(CCLExSoak* soak, gint64 now) {
+
+	struct ccl_ex_soak_stats ws = { 0, 0, 0, 0, 0, 0 };
+	struct ccl_ex_soak_stats* first = &soak->first;
+	CCLExFootprintStats fs;
+	double elapsed = (now - soak->t_window) * 1e-6;
+	double t = 0, se;
+	gboolean degraded = FALSE, growing = FALSE;
+
+	/* Latency statistics. */
+	ws.n = soak->lat->len;
+	for (guint i = 0; i < soak->lat->len; ++i)
+		ws.mean += g_array_index(soak->lat, double, i);
+	ws.mean /= ws.n;
+	for (guint i = 0; i < soak->lat->len; ++i) {
+		double d = g_array_index(soak->lat, double, i) - ws.mean;
+		ws.var += d * d;
+	}
+	ws.var = ws.n > 1 ? ws.var / (ws.n - 1) : 0;
+	ws.thr = elapsed > 0 ? soak->work / elapsed : 0;
+	g_array_sort(soak->lat, ccl_ex_soak_cmp);
+
+	/* Memory and events. */
+	ccl_ex_footprint_stats_get(&fs);
+	ws.rss = fs.rss;
+	ws.events = ccl_ex_soak_events(soak);
+
+	if (soak->windows == 0) {
+
+		/* First window is the reference. */
+		*first = ws;
+		fprintf(soak->out, "\n   %6s %10s %12s %10s %10s %10s %10s %8s  %s\n",
+			"Window", "Time (s)", "Thr. (/s)", "p50 (ms)", "p95 (ms)",
+			"p99 (ms)", "RSS (Kb)", "Events", "Flags");
+
+	} else {
+
+		/* Welch's t-test of mean latency against the first window. */
+		se = sqrt(ws.var / ws.n + first->var / first->n);
+		if ((ws.n > 1) && (first->n > 1) && (se > 0))
+			t = (ws.mean - first->mean) / se;
+		degraded = (t > CCL_EX_SOAK_T_CRIT)
+			&& (ws.mean > first->mean * (1 + CCL_EX_SOAK_SLOWDOWN));
+
+		/* Sustained growth of RSS or events. */
+		if ((ws.rss > soak->last.rss) || (ws.events > soak->last.events))
+			soak->growth++;
+		else
+			soak->growth = 0;
+		growing = soak->growth >= CCL_EX_SOAK_GROWTH;
+
+		if (degraded) soak->degraded++;
+		if (growing) soak->growing++;
+	}
+
+	fprintf(soak->out, "   %6u %10.0f %12.4e %10.4f %10.4f %10.4f %10lu %8u  %s%s%s\n",
+		soak->windows, (now - soak->t_start) * 1e-6, ws.thr,
+		ccl_ex_soak_percentile(soak->lat, 0.50) * 1e3,
+		ccl_ex_soak_percentile(soak->lat, 0.95) * 1e3,
+		ccl_ex_soak_percentile(soak->lat, 0.99) * 1e3,
+		(unsigned long) (ws.rss / 1024), ws.events,
+		degraded ? "DEGRADED" : "", degraded && growing ? "," : "",
+		growing ? "GROWING" : "");
+	fflush(soak->out);
+
+	/* Start next window. */
+	soak->last = ws;
+	soak->windows++;
+	soak->t_window = now;
+	soak->work = 0;
+	g_array_set_size(soak->lat, 0);
+}
+
+/**
+ * Create soak mode. While soak mode exists, `Ctrl+C` (SIGINT) stops
+ * the run at the end of the current iteration instead of terminating
+ * the program.
+ *
+ * @param[in] spec Duration of the run and, optionally, window length, as
+ * `DURATION[:WINDOW]`. Times are in seconds, or in minutes, hours or
+ * days with an `m`, `h` or `d` suffix. A duration of zero runs until
+ * interrupted. The default window is ::CCL_EX_SOAK_WINDOW seconds.
+ * @param[in] work_unit Name of the work unit reported with each
+ * iteration, e.g. "cells".
+ * @param[in] out Where to log windows.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return A new soak mode object, to be destroyed with
+ * ccl_ex_soak_destroy(), or `NULL` if `spec` is invalid.
+ * */
+CCLExSoak* ccl_ex_soak_new(const char* spec, const char* work_unit,
+	FILE* out, GError** err) {
+
+	CCLExSoak* soak;
+	gchar** parts;
+	double duration = 0, window = CCL_EX_SOAK_WINDOW;
+	gboolean ok;
+
+	g_return_val_if_fail(spec != NULL, NULL);
+	g_return_val_if_fail(out != NULL, NULL);
+	g_return_val_if_fail(err == NULL || *err == NULL, NULL);
+
+	parts = g_strsplit(spec, ":", 2);
+	ok = (parts[0] != NULL) && ccl_ex_soak_parse_time(parts[0], &duration);
+	if (ok && (parts[1] != NULL))
+		ok = ccl_ex_soak_parse_time(parts[1], &window) && (window > 0);
+	g_strfreev(parts);
+	if (!ok) {
+		g_set_error(err, CCL_EX_ERROR, CCL_EX_FAIL,
+			"Invalid soak specification '%s', expected DURATION[:WINDOW].",
+			spec);
+		return NULL;
+	}
+
+	soak = g_slice_new0(CCLExSoak);
+	soak->duration = duration;
+	soak->window = window;
+	soak->work_unit = g_strdup(work_unit);
+	soak->out = out;
+	soak->queues = g_ptr_array_new();
+	soak->lat = g_array_new(FALSE, FALSE, sizeof(double));
+
+	ccl_ex_soak_interrupted = 0;
+	soak->sigint_prev = signal(SIGINT, ccl_ex_soak_sigint);
+
+	return soak;
+}
+
+/**
+ * Track the number of events held by a queue. Events are counted when a
+ * window closes, in ccl_ex_soak_iter(), and released by
+ * ccl_ex_soak_gc(), so the queue should not be used by other threads at
+ * those times.
+ *
+ * @param[in] soak Soak mode object.
+ * @param[in] cq Queue to track.
+ * */
+void ccl_ex_soak_add_queue(CCLExSoak* soak, CCLQueue* cq) {
+
+	g_return_if_fail(soak != NULL);
+	g_return_if_fail(cq != NULL);
+
+	g_ptr_array_add(soak->queues, cq);
+}
+
+/**
+ * Account for an iteration and, if the current window is over, log it.
+ *
+ * @param[in] soak Soak mode object.
+ * @param[in] seconds Latency of the iteration.
+ * @param[in] work Work done in the iteration, in work units.
+ * @return `TRUE` if the run should go on, `FALSE` if the duration is
+ * over or the run was interrupted.
+ * */
+gboolean ccl_ex_soak_iter(CCLExSoak* soak, double seconds, double work) {
+
+	gint64 now = g_get_monotonic_time();
+	gboolean more;
+
+	g_return_val_if_fail(soak != NULL, FALSE);
+
+	/* Run starts with the first iteration. */
+	if (soak->t_start == 0) {
+		soak->t_start = now - (gint64) (seconds * 1e6);
+		soak->t_window = soak->t_start;
+		fprintf(soak->out, "\n * Soak mode: %s, %.0fs windows, "
+			"throughput in %s/s (Ctrl+C stops)\n",
+			soak->duration > 0 ? "timed run" : "until interrupted",
+			soak->window, soak->work_unit);
+	}
+
+	g_array_append_val(soak->lat, seconds);
+	soak->work += work;
+	soak->work_total += work;
+	soak->iters++;
+
+	more = (!ccl_ex_soak_interrupted) && ((soak->duration <= 0)
+		|| ((now - soak->t_start) * 1e-6 < soak->duration));
+
+	/* Log window when it is over, or when the run is over. */
+	if (((now - soak->t_window) * 1e-6 >= soak->window) || !more)
+		ccl_ex_soak_window(soak, now);
+
+	return more;
+}
+
+/**
+ * Release the events held by the tracked queues. Should be called after
+ * each iteration, once its events were waited for and are no longer
+ * needed, otherwise a long run keeps the events of every iteration
+ * (unless they are already released, e.g. by sampled profiling).
+ *
+ * @param[in] soak Soak mode object.
+ * */
+void ccl_ex_soak_gc(CCLExSoak* soak) {
+
+	g_return_if_fail(soak != NULL);
+
+	for (guint i = 0; i < soak->queues->len; ++i)
+		ccl_queue_gc((CCLQueue*) g_ptr_array_index(soak->queues, i));
+}
+
+/**
+ * Get number of iterations accounted for with ccl_ex_soak_iter().
+ *
+ * @param[in] soak Soak mode object.
+ * @return Number of iterations.
+ * */
+guint64 ccl_ex_soak_iters(CCLExSoak* soak) {
+
+	g_return_val_if_fail(soak != NULL, 0);
+
+	return soak->iters;
+}
+
+/**
+ * Print summary of the soak run, comparing the last window with the
+ * first one.
+ *
+ * @param[in] soak Soak mode object.
+ * @param[in] out Where to print summary.
+ * */
+void ccl_ex_soak_summary_print(CCLExSoak* soak, FILE* out) {
+
+	double elapsed;
+
+	g_return_if_fail(soak != NULL);
+	g_return_if_fail(out != NULL);
+
+	elapsed = soak->windows > 0
+		? (soak->t_window - soak->t_start) * 1e-6 : 0;
+
+	fprintf(out, "\n   ============================== Soak run =================================\n\n");
+	fprintf(out, "     Duration               : %.0fs%s\n", elapsed,
+		ccl_ex_soak_interrupted ? " (interrupted)" : "");
+	fprintf(out, "     Iterations / windows   : %" G_GUINT64_FORMAT " / %u\n",
+		soak->iters, soak->windows);
+	if (soak->windows == 0) return;
+	fprintf(out, "     Throughput (avg.)      : %.4e %s/s\n",
+		elapsed > 0 ? soak->work_total / elapsed : 0, soak->work_unit);
+	fprintf(out, "     Throughput first/last  : %.4e / %.4e %s/s (%+.2f%%)\n",
+		soak->first.thr, soak->last.thr, soak->work_unit,
+		soak->first.thr > 0
+			? 100.0 * (soak->last.thr - soak->first.thr) / soak->first.thr
+			: 0.0);
+	fprintf(out, "     Latency first/last     : %.4e / %.4e s avg.\n",
+		soak->first.mean, soak->last.mean);
+	fprintf(out, "     RSS first/last         : %lu / %lu Kb\n",
+		(unsigned long) (soak->first.rss / 1024),
+		(unsigned long) (soak->last.rss / 1024));
+	fprintf(out, "     Events first/last      : %u / %u\n",
+		soak->first.events, soak->last.events);
+	fprintf(out, "     Degraded windows       : %u\n", soak->degraded);
+	fprintf(out, "     Growing windows        : %u\n", soak->growing);
+}
+
+/**
+ * Destroy soak mode, restoring the previous SIGINT handler.
+ *
+ * @param[in] soak Soak mode object to destroy.
+ * */
+void ccl_ex_soak_destroy(CCLExSoak* soak) {
+
+	g_return_if_fail(soak != NULL);
+
+	signal(SIGINT, soak->sigint_prev);
+	g_ptr_array_free(soak->queues, TRUE);
+	g_array_free(soak->lat, TRUE);
+	g_free(soak->work_unit);
+	g_slice_free(CCLExSoak, soak);
+}
@@ -0,0 +1,92 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Soak mode for long runs of cf4ocl-examples.
+ *
+ * Problems such as thermal throttling, growing event lists or slowly
+ * leaking wrappers only show up after hours. In soak mode, a program
+ * runs for a given duration (or until interrupted with `Ctrl+C`), and
+ * reports each iteration with ccl_ex_soak_iter(). Every window (one
+ * minute by default), a line is logged with:
+ *
+ * * throughput in the window, in work units per second;
+ * * 50th, 95th and 99th percentiles of iteration latency;
+ * * process RSS;
+ * * number of event wrappers held by the tracked queues.
+ *
+ * Programs release the events of the tracked queues after each
+ * iteration with ccl_ex_soak_gc(), so the event count stays flat unless
+ * events are leaked elsewhere.
+ *
+ * Each window is compared with the first one: if iteration latency is
+ * higher with statistical significance (Welch's t-test) and by more than
+ * ::CCL_EX_SOAK_SLOWDOWN, the window is flagged as degraded. If RSS or
+ * the event count grew in each of the last ::CCL_EX_SOAK_GROWTH windows,
+ * the window is flagged as growing.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#ifndef _CCL_EXAMPLES_SOAK_H_
+#define _CCL_EXAMPLES_SOAK_H_
+
+#include "examples_common.h"
+
+/** Default window length in seconds. */
+#define CCL_EX_SOAK_WINDOW 60.0
+
+/** Minimum relative increase in mean latency flagged as degradation. */
+#define CCL_EX_SOAK_SLOWDOWN 0.05
+
+/** Critical value of Welch's t statistic (about 0.1% one-sided for
+ * large windows). */
+#define CCL_EX_SOAK_T_CRIT 3.09
+
+/** Consecutive windows of RSS or event growth flagged as growing. */
+#define CCL_EX_SOAK_GROWTH 3
+
+/** Soak mode of a long run. */
+typedef struct ccl_ex_soak CCLExSoak;
+
+/* Create soak mode from a `DURATION[:WINDOW]` specification. */
+CCLExSoak* ccl_ex_soak_new(const char* spec, const char* work_unit,
+	FILE* out, GError** err);
+
+/* Track the number of events held by a queue. */
+void ccl_ex_soak_add_queue(CCLExSoak* soak, CCLQueue* cq);
+
+/* Account for an iteration, and check whether the run should go on. */
+gboolean ccl_ex_soak_iter(CCLExSoak* soak, double seconds, double work);
+
+/* Release the events held by the tracked queues. */
+void ccl_ex_soak_gc(CCLExSoak* soak);
+
+/* Get number of accounted iterations. */
+guint64 ccl_ex_soak_iters(CCLExSoak* soak);
+
+/* Print summary of the soak run. */
+void ccl_ex_soak_summary_print(CCLExSoak* soak, FILE* out);
+
+/* Destroy soak mode. */
+void ccl_ex_soak_destroy(CCLExSoak* soak);
+
+#endif
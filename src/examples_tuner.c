@@ -0,0 +1,416 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Auto-tuner implementation for cf4ocl-examples.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#include "examples_tuner.h"
+#include <string.h>
+
+/* Seed for random search, fixed so that searches are reproducible. */
+#define CCL_EX_TUNER_SEED 0
+
+/* Auto-tuner. */
+struct ccl_ex_tuner {
+	/* Cache group for device, driver, kernel and problem size bucket. */
+	gchar* key;
+	/* Number of parameters. */
+	guint num_params;
+	/* Parameter names. */
+	gchar* names[CCL_EX_TUNER_MAX_PARAMS];
+	/* Possible values of each parameter. */
+	int* values[CCL_EX_TUNER_MAX_PARAMS];
+	/* Number of possible values of each parameter. */
+	guint num_values[CCL_EX_TUNER_MAX_PARAMS];
+};
+
+/* Search state. */
+struct ccl_ex_tuner_search {
+	/* Tuner. */
+	CCLExTuner* tuner;
+	/* Timing callback and its data. */
+	ccl_ex_tuner_timer timer;
+	void* data;
+	/* Evaluated configurations (flat index + 1 -> time). */
+	GHashTable* evaluated;
+	/* Best configuration so far (flat index) and its time. */
+	gsize best;
+	double best_time;
+};
+
+/* Get cache file path. */
+static gchar* ccl_ex_tuner_cache_path(void) {
+
+	const gchar* env = g_getenv("CCL_EX_TUNER_CACHE");
+
+	if (env != NULL) return g_strdup(env);
+	return g_build_filename(
+		g_get_user_cache_dir(), "cf4ocl-examples", "tuner.ini", NULL);
+}
+
+/* Convert a flat index into a configuration. */
+static void ccl_ex_tuner_decode(CCLExTuner* tuner, gsize flat,
+	guint* idx, int* config) {
+
+	for (guint p = 0; p < tuner->num_params; p++) {
+		idx[p] = flat % tuner->num_values[p];
+		flat /= tuner->num_values[p];
+		if (config) config[p] = tuner->values[p][idx[p]];
+	}
+}
+
+/* Convert a configuration (value indexes) into a flat index. */
+static gsize ccl_ex_tuner_encode(CCLExTuner* tuner, const guint* idx) {
+
+	gsize flat = 0;
+
+	for (guint p = tuner->num_params; p > 0; p--)
+		flat = flat * tuner->num_values[p - 1] + idx[p - 1];
+	return flat;
+}
+
+/* Evaluate a configuration, unless it was already evaluated. Returns
+ * the configuration time, negative if configuration is invalid. */
+static double ccl_ex_tuner_eval(struct ccl_ex_tuner_search* search,
+	gsize flat, GError** err) {
+
+	guint idx[CCL_EX_TUNER_MAX_PARAMS];
+	int config[CCL_EX_TUNER_MAX_PARAMS];
+	double* t;
+
+	t = g_hash_table_lookup(search->evaluated, GSIZE_TO_POINTER(flat + 1));
+	if (t != NULL) return *t;
+
+	ccl_ex_tuner_decode(search->tuner, flat, idx, config);
+
+	t = g_new(double, 1);
+	*t = search->timer(config, search->data, err);
+	g_hash_table_insert(search->evaluated, GSIZE_TO_POINTER(flat + 1), t);
+
+	if ((*t >= 0) && ((search->best_time < 0) || (*t < search->best_time))) {
+		search->best = flat;
+		search->best_time = *t;
+	}
+	return *t;
+}
+
+/* Load cached configuration. Returns TRUE if a valid cached
+ * configuration exists. */
+static gboolean ccl_ex_tuner_load(CCLExTuner* tuner, int* best) {
+
+	GKeyFile* kf = g_key_file_new();
+	gchar* path = ccl_ex_tuner_cache_path();
+	gboolean found = FALSE;
+
+	if (!g_key_file_load_from_file(kf, path, G_KEY_FILE_NONE, NULL))
+		goto finish;
+	if (!g_key_file_has_group(kf, tuner->key))
+		goto finish;
+
+	for (guint p = 0; p < tuner->num_params; p++) {
+
+		GError* err_internal = NULL;
+		gboolean valid = FALSE;
+		int v = g_key_file_get_integer(
+			kf, tuner->key, tuner->names[p], &err_internal);
+
+		if (err_internal != NULL) {
+			g_error_free(err_internal);
+			goto finish;
+		}
+		/* Only accept values which are part of the current space. */
+		for (guint i = 0; i < tuner->num_values[p]; i++)
+			if (tuner->values[p][i] == v) valid = TRUE;
+		if (!valid) goto finish;
+		best[p] = v;
+	}
+	found = TRUE;
+
+finish:
+	g_key_file_free(kf);
+	g_free(path);
+	return found;
+}
+
+/* Save best configuration to cache file. */
+static void ccl_ex_tuner_save(CCLExTuner* tuner, const int* best,
+	double best_time, GError** err) {
+
+	GKeyFile* kf = g_key_file_new();
+	gchar* path = ccl_ex_tuner_cache_path();
+	gchar* dir = g_path_get_dirname(path);
+
+	/* Keep existing entries. */
+	g_key_file_load_from_file(kf, path, G_KEY_FILE_KEEP_COMMENTS, NULL);
+
+	for (guint p = 0; p < tuner->num_params; p++)
+		g_key_file_set_integer(kf, tuner->key, tuner->names[p], best[p]);
+	g_key_file_set_double(kf, tuner->key, "time", best_time);
+
+	g_mkdir_with_parents(dir, 0755);
+	g_key_file_save_to_file(kf, path, err);
+
+	g_key_file_free(kf);
+	g_free(path);
+	g_free(dir);
+}
+
+/**
+ * Create a new auto-tuner.
+ *
+ * @param[in] dev Device for which to tune.
+ * @param[in] kernel_name Name of kernel (or kernel variant) to tune.
+ * @param[in] problem_size Problem size; results are cached for problem
+ * sizes with the same power of two.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return A new auto-tuner, to be destroyed with ccl_ex_tuner_destroy(),
+ * or `NULL` if an error occurs.
+ * */
+CCLExTuner* ccl_ex_tuner_new(CCLDevice* dev, const char* kernel_name,
+	size_t problem_size, GError** err) {
+
+	CCLExTuner* tuner;
+	GError* err_internal = NULL;
+	char* dev_name;
+	char* driver;
+	guint bucket = 0;
+
+	g_return_val_if_fail(dev != NULL, NULL);
+	g_return_val_if_fail(kernel_name != NULL, NULL);
+
+	dev_name = ccl_device_get_info_array(
+		dev, CL_DEVICE_NAME, char, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	driver = ccl_device_get_info_array(
+		dev, CL_DRIVER_VERSION, char, &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	while ((problem_size >> bucket) > 1) bucket++;
+
+	tuner = g_slice_new0(CCLExTuner);
+	tuner->key = g_strdup_printf("%s|%s|%s|2^%u",
+		dev_name, driver, kernel_name, bucket);
+	g_strcanon(tuner->key,
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+		"0123456789 ._-|^()", '_');
+
+	return tuner;
+
+error_handler:
+	g_propagate_error(err, err_internal);
+	return NULL;
+}
+
+/**
+ * Add a parameter and its possible values.
+ *
+ * @param[in] tuner Auto-tuner.
+ * @param[in] name Parameter name.
+ * @param[in] values Possible values of parameter.
+ * @param[in] num_values Number of possible values.
+ * */
+void ccl_ex_tuner_add_param(CCLExTuner* tuner, const char* name,
+	const int* values, guint num_values) {
+
+	guint p;
+
+	g_return_if_fail(tuner != NULL);
+	g_return_if_fail(tuner->num_params < CCL_EX_TUNER_MAX_PARAMS);
+	g_return_if_fail(num_values > 0);
+
+	p = tuner->num_params++;
+	tuner->names[p] = g_strdup(name);
+	tuner->values[p] = g_new(int, num_values);
+	memcpy(tuner->values[p], values, num_values * sizeof(int));
+	tuner->num_values[p] = num_values;
+}
+
+/**
+ * Add a parameter whose possible values are the powers of two between
+ * `min` and `max`, inclusive.
+ *
+ * @param[in] tuner Auto-tuner.
+ * @param[in] name Parameter name.
+ * @param[in] min Minimum value (positive).
+ * @param[in] max Maximum value.
+ * */
+void ccl_ex_tuner_add_param_pow2(CCLExTuner* tuner, const char* name,
+	int min, int max) {
+
+	int values[31];
+	guint n = 0;
+
+	g_return_if_fail(min > 0);
+
+	/* A 64-bit counter doesn't overflow when doubled past max. */
+	for (gint64 v = 1; v <= max; v *= 2)
+		if (v >= min) values[n++] = (int) v;
+	ccl_ex_tuner_add_param(tuner, name, values, n);
+}
+
+/**
+ * Get best configuration, from the cache file or by searching the
+ * parameter space. The result of a search is saved in the cache file.
+ *
+ * @param[in] tuner Auto-tuner.
+ * @param[in] timer Timing callback.
+ * @param[in] data User data passed to timing callback.
+ * @param[in] retune Ignore cached result and search again.
+ * @param[out] best Location where to place best value of each
+ * parameter, in the order in which parameters were added.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return `TRUE` if a configuration was found, `FALSE` otherwise.
+ * */
+gboolean ccl_ex_tuner_run(CCLExTuner* tuner, ccl_ex_tuner_timer timer,
+	void* data, gboolean retune, int* best, GError** err) {
+
+	struct ccl_ex_tuner_search search;
+	GError* err_internal = NULL;
+	GRand* rng = NULL;
+	guint idx[CCL_EX_TUNER_MAX_PARAMS];
+	gsize space = 1;
+	gboolean status;
+
+	g_return_val_if_fail(tuner != NULL, FALSE);
+	g_return_val_if_fail(timer != NULL, FALSE);
+	g_return_val_if_fail(best != NULL, FALSE);
+
+	/* Try cache first. */
+	if (!retune && ccl_ex_tuner_load(tuner, best)) {
+		g_printf("\n   == Auto-tuner: using cached configuration for '%s'\n",
+			tuner->key);
+		return TRUE;
+	}
+
+	/* Determine size of space. */
+	for (guint p = 0; p < tuner->num_params; p++)
+		space *= tuner->num_values[p];
+
+	search.tuner = tuner;
+	search.timer = timer;
+	search.data = data;
+	search.evaluated = g_hash_table_new_full(
+		g_direct_hash, g_direct_equal, NULL, g_free);
+	search.best = 0;
+	search.best_time = -1;
+
+	if (space <= CCL_EX_TUNER_EXHAUSTIVE_MAX) {
+
+		/* Small space, exhaustive search. */
+		for (gsize flat = 0; flat < space; flat++) {
+			ccl_ex_tuner_eval(&search, flat, &err_internal);
+			if_err_goto(err_internal, error_handler);
+		}
+
+	} else {
+
+		/* Large space, random sampling... */
+		rng = g_rand_new_with_seed(CCL_EX_TUNER_SEED);
+		for (guint i = 0; i < CCL_EX_TUNER_BUDGET / 2; i++) {
+			for (guint p = 0; p < tuner->num_params; p++)
+				idx[p] = g_rand_int_range(rng, 0, tuner->num_values[p]);
+			ccl_ex_tuner_eval(&search,
+				ccl_ex_tuner_encode(tuner, idx), &err_internal);
+			if_err_goto(err_internal, error_handler);
+		}
+
+		/* ...followed by hill-climbing from the best sample, moving to
+		 * the best neighbor (one step in one parameter) while it
+		 * improves. */
+		while ((search.best_time >= 0)
+			&& (g_hash_table_size(search.evaluated) < CCL_EX_TUNER_BUDGET)) {
+
+			gsize current = search.best;
+			ccl_ex_tuner_decode(tuner, current, idx, NULL);
+
+			for (guint p = 0; p < tuner->num_params; p++) {
+				for (int step = -1; step <= 1; step += 2) {
+					guint orig = idx[p];
+					if ((step < 0 && orig == 0)
+						|| (step > 0 && orig + 1 >= tuner->num_values[p]))
+						continue;
+					idx[p] = orig + step;
+					ccl_ex_tuner_eval(&search,
+						ccl_ex_tuner_encode(tuner, idx), &err_internal);
+					idx[p] = orig;
+					if_err_goto(err_internal, error_handler);
+				}
+			}
+
+			/* Local optimum reached? */
+			if (search.best == current) break;
+		}
+	}
+
+	if_err_create_goto(err_internal, CCL_EX_ERROR, search.best_time < 0,
+		CCL_EX_FAIL, error_handler,
+		"Auto-tuner found no valid configuration for '%s'.", tuner->key);
+
+	/* Report and save best configuration. */
+	ccl_ex_tuner_decode(tuner, search.best, idx, best);
+	g_printf("\n   == Auto-tuner: %u of %lu configurations evaluated, best"
+		" time %es:", g_hash_table_size(search.evaluated),
+		(unsigned long) space, search.best_time);
+	for (guint p = 0; p < tuner->num_params; p++)
+		g_printf(" %s=%d", tuner->names[p], best[p]);
+	g_printf("\n");
+
+	ccl_ex_tuner_save(tuner, best, search.best_time, &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	/* If we got here, everything is OK. */
+	g_assert(err_internal == NULL);
+	status = TRUE;
+	goto finish;
+
+error_handler:
+	/* If we got here there was an error, verify that it is so. */
+	g_assert(err_internal != NULL);
+	g_propagate_error(err, err_internal);
+	status = FALSE;
+
+finish:
+	if (rng) g_rand_free(rng);
+	g_hash_table_destroy(search.evaluated);
+	return status;
+}
+
+/**
+ * Destroy an auto-tuner.
+ *
+ * @param[in] tuner Auto-tuner to destroy.
+ * */
+void ccl_ex_tuner_destroy(CCLExTuner* tuner) {
+
+	g_return_if_fail(tuner != NULL);
+
+	for (guint p = 0; p < tuner->num_params; p++) {
+		g_free(tuner->names[p]);
+		g_free(tuner->values[p]);
+	}
+	g_free(tuner->key);
+	g_slice_free(CCLExTuner, tuner);
+}
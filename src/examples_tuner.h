@@ -0,0 +1,90 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Auto-tuner for cf4ocl-examples.
+ *
+ * An example registers its parameter space, i.e. a list of values for
+ * each parameter, and a timing callback. Small spaces are searched
+ * exhaustively, large ones by random sampling followed by
+ * hill-climbing. The best configuration is kept in a cache file, keyed
+ * by device, driver, kernel and problem size bucket, and reused in later
+ * runs.
+ *
+ * The cache file is given by the `CCL_EX_TUNER_CACHE` environment
+ * variable, or defaults to `cf4ocl-examples/tuner.ini` in the user cache
+ * directory.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#ifndef _CCL_EXAMPLES_TUNER_H_
+#define _CCL_EXAMPLES_TUNER_H_
+
+#include "examples_common.h"
+
+/** Maximum number of parameters. */
+#define CCL_EX_TUNER_MAX_PARAMS 8
+
+/** Spaces with up to this number of configurations are searched
+ * exhaustively. */
+#define CCL_EX_TUNER_EXHAUSTIVE_MAX 128
+
+/** Number of configurations evaluated in large spaces. */
+#define CCL_EX_TUNER_BUDGET 64
+
+/**
+ * Timing callback.
+ *
+ * @param[in] config Value of each parameter, in the order in which
+ * parameters were added.
+ * @param[in] data User data.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return Time in seconds for the given configuration, or a negative
+ * value if the configuration is not valid.
+ * */
+typedef double (*ccl_ex_tuner_timer)(const int* config, void* data,
+	GError** err);
+
+/** Auto-tuner. */
+typedef struct ccl_ex_tuner CCLExTuner;
+
+/* Create a new auto-tuner. */
+CCLExTuner* ccl_ex_tuner_new(CCLDevice* dev, const char* kernel_name,
+	size_t problem_size, GError** err);
+
+/* Add a parameter and its possible values. */
+void ccl_ex_tuner_add_param(CCLExTuner* tuner, const char* name,
+	const int* values, guint num_values);
+
+/* Add a parameter whose possible values are powers of two. */
+void ccl_ex_tuner_add_param_pow2(CCLExTuner* tuner, const char* name,
+	int min, int max);
+
+/* Get best configuration, from cache or by searching the space. */
+gboolean ccl_ex_tuner_run(CCLExTuner* tuner, ccl_ex_tuner_timer timer,
+	void* data, gboolean retune, int* best, GError** err);
+
+/* Destroy an auto-tuner. */
+void ccl_ex_tuner_destroy(CCLExTuner* tuner);
+
+#endif
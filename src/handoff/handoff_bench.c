@@ -0,0 +1,305 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Microbenchmark of thread hand-off mechanisms used in the examples:
+ * lock-free SPSC rings (spsc_ring.h), GLib asynchronous queues (as in
+ * ca_mt) and semaphores (cp_sem.h, as in rng_ccl).
+ *
+ * Two measurements are made for each mechanism:
+ *
+ * * Latency: two threads play ping-pong through a pair of channels;
+ *   the reported value is half the average round-trip time.
+ * * Throughput: one thread hands off items to another as fast as
+ *   possible through a single channel.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ */
+
+#include "examples_common.h"
+#include "spsc_ring.h"
+#include "prng/cp_sem.h"
+
+/** Default number of hand-offs per measurement. */
+#define ITERS 1000000
+
+/** Default number of repetitions of each measurement. */
+#define REPS 5
+
+/** A description of the program. */
+#define PROG_DESCRIPTION "Microbenchmark of thread hand-off mechanisms"
+
+/* Command line arguments and respective default values. */
+static int iters = ITERS;
+static int reps = REPS;
+static gboolean version;
+
+/* Valid command line options. */
+static GOptionEntry entries[] = {
+	{"iters",   'n', 0, G_OPTION_ARG_INT,  &iters,
+		"Number of hand-offs per measurement (default is "
+		G_STRINGIFY(ITERS) ")",
+		"N"},
+	{"reps",    'r', 0, G_OPTION_ARG_INT,  &reps,
+		"Number of repetitions of each measurement (default is "
+		G_STRINGIFY(REPS) ")",
+		"N"},
+	{"version",  0,  0, G_OPTION_ARG_NONE, &version,
+		"Output version information and exit",
+		NULL},
+	{ NULL, 0, 0, 0, NULL, NULL, NULL }
+};
+
+/* Item handed off between threads (GLib queues don't accept NULL). */
+static int token = 1;
+
+/**
+ * A hand-off mechanism, seen as a channel with blocking push and pop.
+ * */
+typedef struct handoff_impl {
+
+	/** Mechanism name. */
+	const char* name;
+	/** Create a channel. */
+	void* (*create)(void);
+	/** Push an item into the channel. */
+	void (*push)(void* ch, void* item);
+	/** Pop an item from the channel. */
+	void* (*pop)(void* ch);
+	/** Destroy the channel. */
+	void (*destroy)(void* ch);
+
+} HandoffImpl;
+
+/* SPSC ring. */
+static void* ring_create(void) {
+	void* r = NULL;
+	if (posix_memalign(&r, SPSC_RING_CACHE_LINE, sizeof(spsc_ring_t)))
+		g_error("Unable to allocate ring.");
+	spsc_ring_init((spsc_ring_t*) r);
+	return r;
+}
+static void ring_push(void* ch, void* item) {
+	spsc_ring_push((spsc_ring_t*) ch, item);
+}
+static void* ring_pop(void* ch) {
+	return spsc_ring_pop((spsc_ring_t*) ch);
+}
+static void ring_destroy(void* ch) {
+	spsc_ring_destroy((spsc_ring_t*) ch);
+	free(ch);
+}
+
+/* GLib asynchronous queue. */
+static void* gaq_create(void) {
+	return g_async_queue_new();
+}
+static void gaq_push(void* ch, void* item) {
+	g_async_queue_push((GAsyncQueue*) ch, item);
+}
+static void* gaq_pop(void* ch) {
+	return g_async_queue_pop((GAsyncQueue*) ch);
+}
+static void gaq_destroy(void* ch) {
+	g_async_queue_unref((GAsyncQueue*) ch);
+}
+
+/* Semaphore (carries no item). */
+static void* cpsem_create(void) {
+	cp_sem_t* s = g_new(cp_sem_t, 1);
+	cp_sem_init(s, 0);
+	return s;
+}
+static void cpsem_push(void* ch, void* item) {
+	(void) item;
+	cp_sem_post((cp_sem_t*) ch);
+}
+static void* cpsem_pop(void* ch) {
+	cp_sem_wait((cp_sem_t*) ch);
+	return &token;
+}
+static void cpsem_destroy(void* ch) {
+	cp_sem_destroy((cp_sem_t*) ch);
+	g_free(ch);
+}
+
+/* Mechanisms to benchmark. */
+static const HandoffImpl impls[] = {
+	{ "spsc_ring",    ring_create,  ring_push,  ring_pop,  ring_destroy  },
+	{ "GAsyncQueue",  gaq_create,   gaq_push,   gaq_pop,   gaq_destroy   },
+	{ "cp_sem",       cpsem_create, cpsem_push, cpsem_pop, cpsem_destroy }
+};
+
+/* Data shared by the main and peer threads. */
+typedef struct bench_data {
+	const HandoffImpl* impl;
+	void* ch_fwd;
+	void* ch_back;
+} BenchData;
+
+/* Ping-pong peer: send back each received item. */
+static gpointer pong_thread(gpointer data) {
+	BenchData* bd = (BenchData*) data;
+	for (int i = 0; i < iters; ++i)
+		bd->impl->push(bd->ch_back, bd->impl->pop(bd->ch_fwd));
+	return NULL;
+}
+
+/* Throughput consumer: receive all items. */
+static gpointer sink_thread(gpointer data) {
+	BenchData* bd = (BenchData*) data;
+	for (int i = 0; i < iters; ++i)
+		bd->impl->pop(bd->ch_fwd);
+	return NULL;
+}
+
+/**
+ * Measure one-way hand-off latency, in nanoseconds.
+ *
+ * @param[in] impl Mechanism to measure.
+ * @return Half the average round-trip time, in nanoseconds.
+ * */
+static double bench_latency(const HandoffImpl* impl) {
+
+	BenchData bd = { impl, impl->create(), impl->create() };
+	GThread* peer;
+	gint64 t0, t1;
+
+	peer = g_thread_new("pong", pong_thread, &bd);
+	t0 = g_get_monotonic_time();
+	for (int i = 0; i < iters; ++i) {
+		impl->push(bd.ch_fwd, &token);
+		impl->pop(bd.ch_back);
+	}
+	t1 = g_get_monotonic_time();
+	g_thread_join(peer);
+
+	impl->destroy(bd.ch_fwd);
+	impl->destroy(bd.ch_back);
+
+	return (t1 - t0) * 1000.0 / (2.0 * iters);
+}
+
+/**
+ * Measure one-way hand-off throughput, in millions of items per second.
+ *
+ * @param[in] impl Mechanism to measure.
+ * @return Throughput, in millions of items per second.
+ * */
+static double bench_throughput(const HandoffImpl* impl) {
+
+	BenchData bd = { impl, impl->create(), NULL };
+	GThread* peer;
+	gint64 t0, t1;
+
+	t0 = g_get_monotonic_time();
+	peer = g_thread_new("sink", sink_thread, &bd);
+	for (int i = 0; i < iters; ++i)
+		impl->push(bd.ch_fwd, &token);
+	g_thread_join(peer);
+	t1 = g_get_monotonic_time();
+
+	impl->destroy(bd.ch_fwd);
+
+	return ((double) iters) / MAX(t1 - t0, 1);
+}
+
+/**
+ * Hand-off microbenchmark main function.
+ *
+ * @param[in] argc Number of command line arguments.
+ * @param[in] argv Command line arguments.
+ * @return #CCL_EX_SUCCESS if program returns with no error, or
+ * #CCL_EX_FAIL otherwise.
+ * */
+int main(int argc, char *argv[]) {
+
+	/* Function and program return status. */
+	int status;
+	/* Error management. */
+	GError *err = NULL;
+	/* Command line options context. */
+	GOptionContext* opt_ctx = NULL;
+
+	/* Parse command line options. */
+	opt_ctx = g_option_context_new (" - " PROG_DESCRIPTION);
+	g_option_context_add_main_entries(opt_ctx, entries, NULL);
+	g_option_context_parse(opt_ctx, &argc, &argv, &err);
+	if_err_goto(err, error_handler);
+	if_err_create_goto(err, CCL_EX_ERROR, (iters < 1) || (reps < 1),
+		CCL_EX_FAIL, error_handler,
+		"Number of hand-offs and repetitions must be positive.");
+
+	/* If version was requested, output version and exit. */
+	if (version) {
+		ccl_ex_version_print("handoff_bench");
+		exit(0);
+	}
+
+	g_printf("\n   =========================== Hand-off benchmark ===========================\n\n");
+	g_printf("     Hand-offs per measurement : %d\n", iters);
+	g_printf("     Repetitions               : %d\n", reps);
+	g_printf("     Processors                : %u\n\n", g_get_num_processors());
+	g_printf("     %-14s %14s %14s %14s %14s\n", "Mechanism",
+		"Lat. min (ns)", "Lat. avg (ns)", "Thr. max (M/s)", "Thr. avg (M/s)");
+	g_printf("     -------------------------------------------------------------------------\n");
+
+	/* Benchmark each mechanism. */
+	for (guint i = 0; i < G_N_ELEMENTS(impls); ++i) {
+
+		double lat_min = G_MAXDOUBLE, lat_sum = 0;
+		double thr_max = 0, thr_sum = 0;
+
+		for (int r = 0; r < reps; ++r) {
+			double lat = bench_latency(&impls[i]);
+			double thr = bench_throughput(&impls[i]);
+			lat_min = MIN(lat_min, lat);
+			lat_sum += lat;
+			thr_max = MAX(thr_max, thr);
+			thr_sum += thr;
+		}
+
+		g_printf("     %-14s %14.1f %14.1f %14.3f %14.3f\n",
+			impls[i].name, lat_min, lat_sum / reps, thr_max, thr_sum / reps);
+	}
+	g_printf("\n");
+
+	/* If we get here, everything went Ok. */
+	status = CCL_EX_SUCCESS;
+	g_assert(err == NULL);
+	goto clean_all;
+
+error_handler:
+	/* Handle error. */
+	g_assert(err != NULL);
+	g_fprintf(stderr, "Error: %s\n", err->message);
+	status = err->code;
+	g_error_free(err);
+
+clean_all:
+
+	/* Free command line options context. */
+	if (opt_ctx) g_option_context_free(opt_ctx);
+
+	/* Return status. */
+	return status;
+
+}
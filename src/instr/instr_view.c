@@ -0,0 +1,139 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Viewer of work-group records saved by instrumented examples (matmult
+ * with `--instrument`, ca_mt with a seventh argument).
+ *
+ * For each file given in the command line, prints a summary of the
+ * distribution of work-group durations and counters, a map of the
+ * order in which work-groups started and a timeline of active
+ * work-groups, per compute unit if the device exposes them.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ */
+
+#include "examples_common.h"
+#include "examples_instr.h"
+
+/** Default width of maps and timelines. */
+#define WIDTH 64
+
+/** A description of the program. */
+#define PROG_DESCRIPTION "Viewer of work-group instrumentation records"
+
+/* Command line arguments and respective default values. */
+static int width = WIDTH;
+static gboolean no_map = FALSE;
+static gboolean no_timeline = FALSE;
+static gboolean version;
+
+/* Valid command line options. */
+static GOptionEntry entries[] = {
+	{"width",       'w', 0, G_OPTION_ARG_INT,  &width,
+		"Width of maps and timelines (default is "
+		G_STRINGIFY(WIDTH) ")",
+		"COLS"},
+	{"no-map",      'm', 0, G_OPTION_ARG_NONE, &no_map,
+		"Don't show the start order map",
+		NULL},
+	{"no-timeline", 't', 0, G_OPTION_ARG_NONE, &no_timeline,
+		"Don't show the timeline",
+		NULL},
+	{"version",      0,  0, G_OPTION_ARG_NONE, &version,
+		"Output version information and exit",
+		NULL},
+	{ NULL, 0, 0, 0, NULL, NULL, NULL }
+};
+
+/**
+ * Instrumentation viewer main function.
+ *
+ * @param[in] argc Number of command line arguments.
+ * @param[in] argv Command line arguments.
+ * @return #CCL_EX_SUCCESS if program returns with no error, or
+ * #CCL_EX_FAIL otherwise.
+ * */
+int main(int argc, char *argv[]) {
+
+	/* Function and program return status. */
+	int status;
+	/* Error management. */
+	GError *err = NULL;
+	/* Command line options context. */
+	GOptionContext* opt_ctx = NULL;
+	/* Loaded work-group records. */
+	CCLExInstr* instr = NULL;
+
+	/* Parse command line options. */
+	opt_ctx = g_option_context_new ("FILE... - " PROG_DESCRIPTION);
+	g_option_context_add_main_entries(opt_ctx, entries, NULL);
+	g_option_context_parse(opt_ctx, &argc, &argv, &err);
+	if_err_goto(err, error_handler);
+
+	/* If version was requested, output version and exit. */
+	if (version) {
+		ccl_ex_version_print("instr_view");
+		exit(0);
+	}
+
+	if_err_create_goto(err, CCL_EX_ERROR, (argc < 2) || (width < 1),
+		CCL_EX_FAIL, error_handler,
+		"At least one file and a positive width must be given.");
+
+	/* Show each file. */
+	for (int i = 1; i < argc; ++i) {
+
+		instr = ccl_ex_instr_load(argv[i], &err);
+		if_err_goto(err, error_handler);
+
+		g_printf("\n   == %s\n", argv[i]);
+		ccl_ex_instr_summary_print(instr, stdout);
+		if (!no_map) ccl_ex_instr_order_print(instr, width, stdout);
+		if (!no_timeline) ccl_ex_instr_timeline_print(instr, width, stdout);
+		g_printf("\n");
+
+		ccl_ex_instr_destroy(instr);
+		instr = NULL;
+	}
+
+	/* If we get here, everything went Ok. */
+	status = CCL_EX_SUCCESS;
+	g_assert(err == NULL);
+	goto clean_all;
+
+error_handler:
+	/* Handle error. */
+	g_assert(err != NULL);
+	g_fprintf(stderr, "Error: %s\n", err->message);
+	status = err->code;
+	g_error_free(err);
+
+clean_all:
+
+	/* Free loaded records and command line options context. */
+	if (instr) ccl_ex_instr_destroy(instr);
+	if (opt_ctx) g_option_context_free(opt_ctx);
+
+	/* Return status. */
+	return status;
+
+}
@@ -0,0 +1,440 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Benchmark of kernel launch round-trip latency under the
+ * synchronization strategies used in the examples and a few others:
+ *
+ * * `clFinish()` on each queue, as rng_ccl does per iteration.
+ * * `clWaitForEvents()` on the kernel events, as ca_mt does with event
+ *   wait lists.
+ * * Event callbacks, signalling a condition variable the host thread
+ *   waits on.
+ * * Busy-polling the execution status of the kernel events (keeps one
+ *   core busy).
+ * * A blocking read of the kernel output, as matmult does.
+ *
+ * Each iteration enqueues a tiny kernel on each of 1 to N queues,
+ * flushes them if the strategy doesn't, and waits for all kernels to
+ * complete. This is done with in-order queues and, if the device
+ * supports them, out-of-order queues. Latencies of individual
+ * iterations are reported as minimum, median, 99th percentile and mean,
+ * in microseconds.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ */
+
+#include "examples_common.h"
+#include <string.h>
+#include <time.h>
+
+/** Default number of timed iterations per measurement. */
+#define ITERS 1000
+
+/** Number of untimed iterations before each measurement. */
+#define WARMUP 20
+
+/** Default maximum number of queues in flight. */
+#define QUEUES 4
+
+/** Upper limit of queues in flight. */
+#define QUEUES_MAX 16
+
+/** A description of the program. */
+#define PROG_DESCRIPTION "Benchmark of kernel launch latency under " \
+	"different synchronization strategies"
+
+/* Tiny kernel, one work-item touches one value. */
+static const char* kernel_src =
+	"__kernel void tiny(__global uint *x) { x[0]++; }\n";
+
+/* Command line arguments and respective default values. */
+static int iters = ITERS;
+static int max_queues = QUEUES;
+static gchar* device = NULL;
+static gboolean version;
+
+/* Valid command line options. */
+static GOptionEntry entries[] = {
+	{"iters",   'n', 0, G_OPTION_ARG_INT,  &iters,
+		"Number of timed iterations per measurement (default is "
+		G_STRINGIFY(ITERS) ")",
+		"N"},
+	{"queues",  'q', 0, G_OPTION_ARG_INT,  &max_queues,
+		"Measure with 1 to N queues in flight (default is "
+		G_STRINGIFY(QUEUES) ", at most " G_STRINGIFY(QUEUES_MAX) ")",
+		"N"},
+	{"device",  'd', 0, G_OPTION_ARG_STRING, &device,
+		"Device index, or one of menu, first, gpu, cpu, accel or "\
+		"fastest (if not given, use $CCL_EX_DEVICE or chose device "\
+		"from menu)",
+		"INDEX|SELECTOR"},
+	{"version",  0,  0, G_OPTION_ARG_NONE, &version,
+		"Output version information and exit",
+		NULL},
+	{ NULL, 0, 0, 0, NULL, NULL, NULL }
+};
+
+/**
+ * Synchronization strategies.
+ * */
+typedef enum latency_sync {
+	/** Finish each queue. */
+	LATENCY_FINISH = 0,
+	/** Wait on the list of kernel events. */
+	LATENCY_WAIT = 1,
+	/** Wait for completion callbacks of kernel events. */
+	LATENCY_CALLBACK = 2,
+	/** Busy-poll execution status of kernel events. */
+	LATENCY_POLL = 3,
+	/** Blocking read of kernel output. */
+	LATENCY_READ = 4,
+	/** Number of strategies. */
+	LATENCY_NUM_SYNC = 5
+} LatencySync;
+
+/* Strategy names, for reports. */
+static const char* sync_names[] = {
+	"clFinish", "clWaitForEvents", "callback", "busy-poll", "blocking read"
+};
+
+/**
+ * Objects used by the measurements.
+ * */
+typedef struct latency_bench {
+
+	/** Tiny kernel. */
+	CCLKernel* krnl;
+	/** Queues, and one output buffer per queue. */
+	CCLQueue* cq[QUEUES_MAX];
+	CCLBuffer* buf[QUEUES_MAX];
+	/** Are queues out-of-order? */
+	gboolean ooo;
+	/** Completion callbacks still pending, protected by lock. */
+	gint pending;
+	GMutex lock;
+	GCond cond;
+	/** Latencies of one measurement, in nanoseconds. */
+	double* lat;
+
+} LatencyBench;
+
+/* Current time in nanoseconds. */
+static gint64 latency_now(void) {
+#ifdef G_OS_UNIX
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (gint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+	return g_get_monotonic_time() * 1000;
+#endif
+}
+
+/* Completion callback: count down pending callbacks. */
+static void CL_CALLBACK latency_callback(cl_event event,
+	cl_int status, void* data) {
+
+	LatencyBench* lb = (LatencyBench*) data;
+	(void) event;
+	(void) status;
+
+	g_mutex_lock(&lb->lock);
+	if (--lb->pending == 0) g_cond_signal(&lb->cond);
+	g_mutex_unlock(&lb->lock);
+}
+
+/* One iteration: enqueue the tiny kernel on `nq` queues and wait for
+ * all of them with the given strategy. */
+static gboolean latency_iter(LatencyBench* lb, LatencySync sync,
+	int nq, GError** err) {
+
+	CCLEvent* evts[QUEUES_MAX];
+	CCLEventWaitList ewl = NULL;
+	size_t ws = 1;
+	cl_uint val;
+
+	if (sync == LATENCY_CALLBACK) lb->pending = nq;
+
+	for (int q = 0; q < nq; ++q) {
+		evts[q] = ccl_kernel_set_args_and_enqueue_ndrange(lb->krnl,
+			lb->cq[q], 1, NULL, &ws, &ws, NULL, err, lb->buf[q], NULL);
+		if (!evts[q]) return FALSE;
+	}
+
+	switch (sync) {
+
+		case LATENCY_FINISH:
+			for (int q = 0; q < nq; ++q)
+				if (!ccl_queue_finish(lb->cq[q], err)) return FALSE;
+			break;
+
+		case LATENCY_WAIT:
+			for (int q = 0; q < nq; ++q)
+				ccl_event_wait_list_add(&ewl, evts[q], NULL);
+			if (!ccl_event_wait(&ewl, err)) return FALSE;
+			break;
+
+		case LATENCY_CALLBACK:
+			for (int q = 0; q < nq; ++q) {
+				if (!ccl_event_set_callback(evts[q], CL_COMPLETE,
+					latency_callback, lb, err)) return FALSE;
+				if (!ccl_queue_flush(lb->cq[q], err)) return FALSE;
+			}
+			g_mutex_lock(&lb->lock);
+			while (lb->pending > 0) g_cond_wait(&lb->cond, &lb->lock);
+			g_mutex_unlock(&lb->lock);
+			break;
+
+		case LATENCY_POLL:
+			for (int q = 0; q < nq; ++q)
+				if (!ccl_queue_flush(lb->cq[q], err)) return FALSE;
+			/* Query the raw event, since wrappers may cache info. */
+			for (int q = 0; q < nq; ++q) {
+				cl_int st;
+				do {
+					cl_int ocl_status = clGetEventInfo(
+						ccl_event_unwrap(evts[q]),
+						CL_EVENT_COMMAND_EXECUTION_STATUS,
+						sizeof(cl_int), &st, NULL);
+					if (ocl_status != CL_SUCCESS) st = ocl_status;
+				} while (st > CL_COMPLETE);
+				if (st < 0) {
+					g_set_error(err, CCL_EX_ERROR, CCL_EX_FAIL,
+						"Event status error %d while polling.", st);
+					return FALSE;
+				}
+			}
+			break;
+
+		case LATENCY_READ:
+			/* Out-of-order queues don't order the read after the
+			 * kernel, so wait for its event. */
+			for (int q = 0; q < nq; ++q) {
+				if (lb->ooo) ccl_event_wait_list_add(&ewl, evts[q], NULL);
+				if (!ccl_buffer_enqueue_read(lb->buf[q], lb->cq[q], CL_TRUE,
+					0, sizeof(cl_uint), &val, lb->ooo ? &ewl : NULL, err))
+					return FALSE;
+			}
+			break;
+
+		default:
+			g_assert_not_reached();
+	}
+
+	return TRUE;
+}
+
+/* Compare doubles, for qsort(). */
+static int latency_cmp(const void* a, const void* b) {
+	double da = *((const double*) a), db = *((const double*) b);
+	return (da > db) - (da < db);
+}
+
+/* Measure one strategy with `nq` queues and print a result line. */
+static gboolean latency_measure(LatencyBench* lb, LatencySync sync,
+	int nq, double* median, GError** err) {
+
+	double sum = 0;
+
+	for (int i = -WARMUP; i < iters; ++i) {
+		gint64 t0 = latency_now();
+		if (!latency_iter(lb, sync, nq, err)) return FALSE;
+		if (i >= 0) lb->lat[i] = (double) (latency_now() - t0);
+		/* Release completed events outside of the timed region. */
+		for (int q = 0; q < nq; ++q) ccl_queue_gc(lb->cq[q]);
+	}
+
+	qsort(lb->lat, iters, sizeof(double), latency_cmp);
+	for (int i = 0; i < iters; ++i) sum += lb->lat[i];
+	*median = lb->lat[iters / 2];
+
+	g_printf("     %-13s %6d %-8s %10.1f %10.1f %10.1f %10.1f\n",
+		sync_names[sync], nq, lb->ooo ? "ooo" : "in-order",
+		lb->lat[0] / 1000, *median / 1000,
+		lb->lat[MIN(iters - 1, (int) (0.99 * iters))] / 1000,
+		sum / iters / 1000);
+
+	return TRUE;
+}
+
+/**
+ * Launch latency benchmark main function.
+ *
+ * @param[in] argc Number of command line arguments.
+ * @param[in] argv Command line arguments.
+ * @return #CCL_EX_SUCCESS if program returns with no error, or
+ * #CCL_EX_FAIL otherwise.
+ * */
+int main(int argc, char *argv[]) {
+
+	/* Function and program return status. */
+	int status;
+	/* Error management. */
+	GError *err = NULL;
+	/* Command line options context. */
+	GOptionContext* opt_ctx = NULL;
+	/* Device requirements. */
+	CCLExDevReqs dev_reqs = { FALSE, FALSE, 0, CCL_EX_WORKLOAD_MEMORY,
+		NULL };
+	/* Wrappers. */
+	CCLContext* ctx = NULL;
+	CCLDevice* dev = NULL;
+	CCLProgram* prg = NULL;
+	/* Objects used by the measurements. */
+	LatencyBench lb;
+	/* Device name and supported queue properties. */
+	char* dev_name;
+	cl_command_queue_properties dev_qprops;
+	/* Queue modes to measure. */
+	int num_modes;
+	/* Best strategy with one queue, per mode. */
+	LatencySync best[2] = { LATENCY_FINISH, LATENCY_FINISH };
+
+	memset(&lb, 0, sizeof(LatencyBench));
+	g_mutex_init(&lb.lock);
+	g_cond_init(&lb.cond);
+
+	/* Parse command line options. */
+	opt_ctx = g_option_context_new (" - " PROG_DESCRIPTION);
+	g_option_context_add_main_entries(opt_ctx, entries, NULL);
+	g_option_context_parse(opt_ctx, &argc, &argv, &err);
+	if_err_goto(err, error_handler);
+	if_err_create_goto(err, CCL_EX_ERROR, (iters < 1) || (max_queues < 1)
+		|| (max_queues > QUEUES_MAX), CCL_EX_FAIL, error_handler,
+		"Iterations must be positive and queues between 1 and %d.",
+		QUEUES_MAX);
+
+	/* If version was requested, output version and exit. */
+	if (version) {
+		ccl_ex_version_print("latency_bench");
+		exit(0);
+	}
+
+	/* Create context, program and buffers. */
+	ctx = ccl_ex_context_new(device, &dev_reqs, &err);
+	if_err_goto(err, error_handler);
+	dev = ccl_context_get_device(ctx, 0, &err);
+	if_err_goto(err, error_handler);
+	dev_name = ccl_device_get_info_array(dev, CL_DEVICE_NAME, char, &err);
+	if_err_goto(err, error_handler);
+	dev_qprops = ccl_device_get_info_scalar(dev, CL_DEVICE_QUEUE_PROPERTIES,
+		cl_command_queue_properties, &err);
+	if_err_goto(err, error_handler);
+	num_modes =
+		(dev_qprops & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE) ? 2 : 1;
+
+	prg = ccl_program_new_from_source(ctx, kernel_src, &err);
+	if_err_goto(err, error_handler);
+	ccl_program_build(prg, NULL, &err);
+	if_err_goto(err, error_handler);
+	lb.krnl = ccl_program_get_kernel(prg, "tiny", &err);
+	if_err_goto(err, error_handler);
+
+	for (int q = 0; q < max_queues; ++q) {
+		lb.buf[q] = ccl_buffer_new(
+			ctx, CL_MEM_READ_WRITE, sizeof(cl_uint), NULL, &err);
+		if_err_goto(err, error_handler);
+	}
+	lb.lat = g_new(double, iters);
+
+	g_printf("\n   ========================= Launch latency benchmark =======================\n\n");
+	g_printf("     Device                : %s\n", dev_name);
+	g_printf("     Iterations            : %d (+%d warm-up)\n", iters, WARMUP);
+	g_printf("     Out-of-order queues   : %s\n\n",
+		num_modes > 1 ? "supported" : "not supported");
+	g_printf("     %-13s %6s %-8s %10s %10s %10s %10s\n", "Strategy",
+		"Queues", "Mode", "Min (us)", "Med. (us)", "p99 (us)", "Mean (us)");
+	g_printf("     -------------------------------------------------------------------------\n");
+
+	for (int mode = 0; mode < num_modes; ++mode) {
+
+		double best_median = G_MAXDOUBLE;
+
+		/* Create queues for this mode. */
+		lb.ooo = (mode == 1);
+		for (int q = 0; q < max_queues; ++q) {
+			lb.cq[q] = ccl_queue_new(ctx, dev,
+				lb.ooo ? CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE : 0, &err);
+			if_err_goto(err, error_handler);
+		}
+
+		for (int nq = 1; nq <= max_queues; ++nq) {
+			for (int s = 0; s < LATENCY_NUM_SYNC; ++s) {
+				double median;
+				latency_measure(&lb, (LatencySync) s, nq, &median, &err);
+				if_err_goto(err, error_handler);
+				if ((nq == 1) && (median < best_median)) {
+					best_median = median;
+					best[mode] = (LatencySync) s;
+				}
+			}
+		}
+
+		for (int q = 0; q < max_queues; ++q) {
+			ccl_queue_destroy(lb.cq[q]);
+			lb.cq[q] = NULL;
+		}
+	}
+
+	/* Lowest median latency with a single queue, per mode. */
+	g_printf("\n     Lowest median latency, 1 in-order queue     : %s\n",
+		sync_names[best[0]]);
+	if (num_modes > 1)
+		g_printf("     Lowest median latency, 1 out-of-order queue : %s\n",
+			sync_names[best[1]]);
+	g_printf("\n");
+
+	/* If we get here, everything went Ok. */
+	status = CCL_EX_SUCCESS;
+	g_assert(err == NULL);
+	goto clean_all;
+
+error_handler:
+	/* Handle error. */
+	g_assert(err != NULL);
+	g_fprintf(stderr, "Error: %s\n", err->message);
+	status = err->code;
+	g_error_free(err);
+
+clean_all:
+
+	/* Release wrappers and host memory. */
+	for (int q = 0; q < QUEUES_MAX; ++q) {
+		if (lb.cq[q]) ccl_queue_destroy(lb.cq[q]);
+		if (lb.buf[q]) ccl_buffer_destroy(lb.buf[q]);
+	}
+	if (lb.lat) g_free(lb.lat);
+	if (prg) ccl_program_destroy(prg);
+	if (ctx) ccl_context_destroy(ctx);
+	g_mutex_clear(&lb.lock);
+	g_cond_clear(&lb.cond);
+
+	/* Free command line options context and variables. */
+	if (opt_ctx) g_option_context_free(opt_ctx);
+	if (device) g_free(device);
+
+	/* Check all wrappers have been destroyed. */
+	g_assert(ccl_wrapper_memcheck());
+
+	/* Return status. */
+	return status;
+
+}
@@ -40,6 +40,44 @@
  * The OpenMP implementation is a basic parallelized for loop, which
  * runs on the CPU.
  *
+ * With `--dispatch`, the multiplication runs on the host or on the
+ * device, whichever is predicted to finish first for the requested
+ * matrix sizes (see `matmult_dispatch.c`).
+ *
+ * With `--scaling`, no device is used: the host multiplication is
+ * timed for a range of OpenMP thread counts, binding policies, places
+ * and schedule kinds, reporting speedup, efficiency and serial
+ * fraction (see `matmult_scaling.c`).
+ *
+ * With `--chain`, a chain of matrices of the given shapes is multiplied
+ * in the order which minimizes floating point operations, and with
+ * `--power`, matrix A is raised to a power by repeated squaring. In both
+ * cases intermediate products stay on the device (see
+ * `matmult_chain.c`).
+ *
+ * With `--image`, kernel 0 is compared with a variant which reads A
+ * and/or B from images (`CL_R`, `CL_SIGNED_INT32`), i.e. through the
+ * texture cache on devices which have one.
+ *
+ * With `--persistent`, kernels 0 to 2 are compared with a
+ * persistent-threads kernel, which launches only as many work-groups as
+ * fit the device, each claiming tiles of C from an atomic counter, for
+ * matrix sizes which are not multiples of the local work size.
+ *
+ * With `--load-a` and `--load-b`, input matrices are mapped from
+ * `.npy` or raw matrix files, and used directly as device buffers when
+ * their alignment permits. With `--save-c`, the result is read from the
+ * device into a mapped file (see `matmult_io.c`).
+ *
+ * With `--bias`, `--requant`, `--relu` and `--clamp`, epilogues are
+ * fused into the selected kernel, which applies them to each element
+ * of C before storing it, and the host reference applies them in
+ * separate passes over C.
+ *
+ * With `--counters`, hardware counters of the host multiplication
+ * (including OpenMP threads) are shown with the results (see
+ * `examples_perfctr.h`).
+ *
  * @author Nuno Fachada
  * @date 2016
  * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
@@ -73,6 +111,12 @@
 /* Default seed. */
 #define SEED 0
 
+/* Default number of runs of the OpenCL multiplication. */
+#define RUNS 1
+
+/* Default number of timed runs of each thread scaling configuration. */
+#define SCALING_REPS 3
+
 /* A description of the program. */
 #define PROG_DESCRIPTION "Program for testing matrix multiplication on " \
 	"a OpenCL device (GPU or CPU, although optimized for the former) " \
@@ -85,13 +129,54 @@ static size_t lws[] = {0, 0};
 static int matrix_range[] = {RANGE_MATRIX_FROM, RANGE_MATRIX_TO};
 static gchar* compiler_opts = NULL;
 static gboolean dev_list = FALSE;
-static int dev_idx = -1;
+static gchar* device = NULL;
 static gchar* name = NULL;
 static int kernel_id = KERNEL_ID;
 static gboolean verbose = VERBOSE;
 static guint32 seed = SEED;
 static gchar* output_export = NULL;
 static gboolean version = FALSE;
+static int runs = RUNS;
+static gboolean use_pool = FALSE;
+static gboolean tune = FALSE;
+static gboolean retune = FALSE;
+static gboolean gen_dev = FALSE;
+static gboolean check_dev = FALSE;
+static gchar* instr_file = NULL;
+static gboolean dispatch = FALSE;
+static gboolean recalibrate = FALSE;
+static gboolean scaling = FALSE;
+static gboolean scaling_worker = FALSE;
+static int scaling_reps = SCALING_REPS;
+static gboolean counters = FALSE;
+static gchar* chain_shapes = NULL;
+static int power = 0;
+static gchar* image_ops = NULL;
+static gboolean img_a = FALSE;
+static gboolean img_b = FALSE;
+static gboolean persistent = FALSE;
+static int groups_per_cu = 0;
+static gchar* epi_bias = NULL;
+static int epi_requant[] = {1, 0};
+static gboolean epi_requant_set = FALSE;
+static gboolean epi_relu = FALSE;
+static int epi_clamp[] = {0, 0};
+static gboolean epi_clamp_set = FALSE;
+
+/* Number of fused epilogue operations, determined from the command
+ * line options. */
+static guint epi_passes = 0;
+
+/* Device bias of the epilogue, NULL if there is no bias. */
+static CCLBuffer* epi_bias_dev = NULL;
+
+static gchar* load_a = NULL;
+static gchar* load_b = NULL;
+static gchar* save_c = NULL;
+
+/* Matrix files given in the command line, mapped when parsing it. */
+static MatmultMFile* mfile_a = NULL;
+static MatmultMFile* mfile_b = NULL;
 
 /* Callback functions to parse pairs of numbers. */
 static gboolean mm_parse_a(const gchar *option_name, const gchar *value, gpointer data, GError **err) {
@@ -106,6 +191,14 @@ static gboolean mm_parse_lws(const gchar *option_name, const gchar *value, gpoin
 static gboolean mm_parse_rge(const gchar *option_name, const gchar *value, gpointer data, GError **err) {
 	ccl_ex_parse_pairs(value, matrix_range, option_name, data, err);
 }
+static gboolean mm_parse_requant(const gchar *option_name, const gchar *value, gpointer data, GError **err) {
+	epi_requant_set = TRUE;
+	ccl_ex_parse_pairs(value, epi_requant, option_name, data, err);
+}
+static gboolean mm_parse_clamp(const gchar *option_name, const gchar *value, gpointer data, GError **err) {
+	epi_clamp_set = TRUE;
+	ccl_ex_parse_pairs(value, epi_clamp, option_name, data, err);
+}
 
 /* Valid command line options. */
 static GOptionEntry entries[] = {
@@ -132,33 +225,1319 @@ static GOptionEntry entries[] = {
 	{"seed",      's', 0, G_OPTION_ARG_INT,      &seed,
 		"RNG seed (default is " G_STRINGIFY(SEED)")",
 		"SEED"},
+	{"gen",       'g', 0, G_OPTION_ARG_NONE,     &gen_dev,
+		"Generate input matrices on the device from the seed (host " \
+		"copies, used for verification, are generated with the same " \
+		"values)",
+		NULL},
 	{"verbose",   'v', 0, G_OPTION_ARG_NONE,     &verbose,
 		"Print input and output matrices to stderr",
 		NULL},
+	{"dev-check", 'x', 0, G_OPTION_ARG_NONE,     &check_dev,
+		"Compare device and CPU results on the device, reading back " \
+		"only the number of mismatches and the first few mismatches",
+		NULL},
 	{"list",      'i', 0, G_OPTION_ARG_NONE,     &dev_list,
 		"List available devices (selectable with -d) and exit",
 		NULL},
-	{"device",    'd', 0, G_OPTION_ARG_INT,      &dev_idx,
-		"Device index, auto-selects device from menu (takes priority " \
-		"over -n option)",
-		"INDEX"},
+	{"device",    'd', 0, G_OPTION_ARG_STRING,   &device,
+		"Device index, or one of menu, first, gpu, cpu, accel or " \
+		"fastest (takes priority over -n option; default is " \
+		"$CCL_EX_DEVICE or menu)",
+		"INDEX|SELECTOR"},
 	{"name",     'n',  0, G_OPTION_ARG_STRING,   &name,
 		"Selects device by device, platform or vendor name",
 		"NAME"},
 	{"compiler",  'c', 0, G_OPTION_ARG_STRING,   &compiler_opts,
 		"Extra OpenCL compiler options",
 		"OPTS"},
+	{"runs",      't', 0, G_OPTION_ARG_INT,      &runs,
+		"Number of times to run the OpenCL multiplication (default is " \
+		G_STRINGIFY(RUNS) ")",
+		"RUNS"},
+	{"pool",      'p', 0, G_OPTION_ARG_NONE,     &use_pool,
+		"Keep device buffers in a memory pool between runs (otherwise " \
+		"buffers are destroyed after each run)",
+		NULL},
+	{"tune",      'u', 0, G_OPTION_ARG_NONE,     &tune,
+		"Auto-tune local work size if not given with -l (results are " \
+		"cached per device, kernel and problem size)",
+		NULL},
+	{"retune",      0, 0, G_OPTION_ARG_NONE,     &retune,
+		"Ignore cached auto-tuning results and tune again (implies -u)",
+		NULL},
 	{"output",    'o', 0, G_OPTION_ARG_FILENAME, &output_export,
 		"File where to export profiling info (default is none)",
 		"FILE"},
+	{"load-a",      0, 0, G_OPTION_ARG_FILENAME, &load_a,
+		"Map matrix A from a .npy (int32) or raw matrix file, instead " \
+		"of generating it (its dimensions override -a)",
+		"FILE"},
+	{"load-b",      0, 0, G_OPTION_ARG_FILENAME, &load_b,
+		"Map matrix B from a .npy (int32) or raw matrix file, instead " \
+		"of generating it (its dimensions override -b)",
+		"FILE"},
+	{"save-c",      0, 0, G_OPTION_ARG_FILENAME, &save_c,
+		"Write matrix C, as read from the device, to a mapped .npy " \
+		"(if FILE ends with .npy) or raw matrix file",
+		"FILE"},
+	{"instrument",  0, 0, G_OPTION_ARG_FILENAME, &instr_file,
+		"Instrument kernel work-groups, summarize the last run and " \
+		"save its records to FILE, for viewing with instr_view",
+		"FILE"},
+	{"dispatch",    0, 0, G_OPTION_ARG_NONE,     &dispatch,
+		"Run the multiplication on the host or on the device, " \
+		"whichever is predicted to finish first (predictions use a " \
+		"calibration table, cached per device, kernel and local work " \
+		"size)",
+		NULL},
+	{"recalibrate", 0, 0, G_OPTION_ARG_NONE,     &recalibrate,
+		"Ignore cached dispatch calibration table and build it again " \
+		"(implies --dispatch)",
+		NULL},
+	{"chain",       0, 0, G_OPTION_ARG_STRING,   &chain_shapes,
+		"Multiply a chain of matrices, where matrix i has Pi rows and " \
+		"Pi+1 columns, in optimal order and keeping intermediates on " \
+		"the device (requires a C=AB kernel)",
+		"P0,P1,...,Pn"},
+	{"power",       0, 0, G_OPTION_ARG_INT,      &power,
+		"Raise matrix A (which must be square) to the power K by " \
+		"repeated squaring, keeping intermediates on the device " \
+		"(requires a C=AB kernel)",
+		"K"},
+	{"image",       0, 0, G_OPTION_ARG_STRING,   &image_ops,
+		"Compare kernel 0 with a variant which reads operands A, B or " \
+		"both (AB) from images, on devices with image support",
+		"A|B|AB"},
+	{"persistent",  0, 0, G_OPTION_ARG_NONE,     &persistent,
+		"Compare tail efficiency of kernels 0 to 2 with a " \
+		"persistent-threads kernel which claims tiles of C from an " \
+		"atomic counter",
+		NULL},
+	{"groups-per-cu", 0, 0, G_OPTION_ARG_INT,    &groups_per_cu,
+		"Work-groups per compute unit of the persistent-threads kernel " \
+		"(default is as many as fit the device's maximum work-group size)",
+		"G"},
+	{"bias",        0, 0, G_OPTION_ARG_STRING,   &epi_bias,
+		"Epilogue: add a random bias per row or per column of C",
+		"row|col"},
+	{"requant",     0, 0, G_OPTION_ARG_CALLBACK, mm_parse_requant,
+		"Epilogue: requantize C to (C * SCALE) >> SHIFT, rounding to " \
+		"nearest",
+		"SCALE,SHIFT"},
+	{"relu",        0, 0, G_OPTION_ARG_NONE,     &epi_relu,
+		"Epilogue: replace negative values of C with zero",
+		NULL},
+	{"clamp",       0, 0, G_OPTION_ARG_CALLBACK, mm_parse_clamp,
+		"Epilogue: clamp values of C to [MIN, MAX]",
+		"MIN,MAX"},
+	{"counters",    0, 0, G_OPTION_ARG_NONE,     &counters,
+		"Count hardware events (cycles, instructions, cache, branch and " \
+		"dTLB misses) of the host multiplication (Linux only)",
+		NULL},
+	{"scaling",     0, 0, G_OPTION_ARG_NONE,     &scaling,
+		"Study OpenMP thread scaling of the host multiplication for " \
+		"power-of-two thread counts and the number of processors, " \
+		"binding policies, places and schedules (no device is used)",
+		NULL},
+	{"scaling-reps", 0, 0, G_OPTION_ARG_INT,     &scaling_reps,
+		"Timed runs of each thread scaling configuration (default is " \
+		G_STRINGIFY(SCALING_REPS) ")",
+		"REPS"},
+	{"scaling-worker", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE,
+		&scaling_worker, NULL, NULL},
 	{"version",     0, 0, G_OPTION_ARG_NONE,     &version,
 		"Output version information and exit",
 		NULL},
 	{ NULL, 0, 0, 0, NULL, NULL, NULL }
 };
 
-/* Kernel file. */
-static char* kernel_files[] = {"matmult.cl"};
+/* Kernel files, instrumentation macros first. */
+static char* kernel_files[] = {CCL_EX_INSTR_KERNEL_FILE, "matmult.cl"};
+
+/* Names of the per-group counters of instrumented kernels. */
+static const char* const instr_counters[] = {"items", NULL};
+
+/* Data passed to the auto-tuner timing callback. */
+struct matmult_tune_data {
+	CCLKernel* krnl;
+	CCLQueue* cq;
+	CCLBuffer* matrixA_dev;
+	CCLBuffer* matrixB_dev;
+	CCLBuffer* matrixC_dev;
+	size_t krnl_wg_max;
+	cl_ulong dev_lmem;
+};
+
+/* Number of timed kernel runs for each auto-tuner configuration. */
+#define TUNE_REPS 3
+
+/* Determine global work size from local work size, for matrices with
+ * dimensions `ad` and `bd`. */
+static void matmult_gws_get(const int* ad, const int* bd,
+	const size_t* lws_in, size_t* gws_out) {
+	gws_out[0] = lws_in[0] * ((bd[0] + lws_in[0] - 1) / lws_in[0]);
+	gws_out[1] = lws_in[1] * ((ad[1] + lws_in[1] - 1) / lws_in[1]);
+}
+
+/* Determine local memory required by kernel `kid` for matrices A and B
+ * with dimensions `ad` and `bd`, given a local work size. */
+static void matmult_lmem_get(int kid, const int* ad, const int* bd,
+	const size_t* lws_in,
+	size_t* l_mem_sizeA_in_bytes, size_t* l_mem_sizeB_in_bytes) {
+
+	/* Default is 0 for non-optimized kernels 0 and 3. */
+	*l_mem_sizeA_in_bytes = 0;
+	*l_mem_sizeB_in_bytes = 0;
+	if (kid >= 1)
+		/* Optimized matrix mult. 1*/
+		*l_mem_sizeA_in_bytes = ad[0] * lws_in[1] * sizeof(cl_int);
+	if (kid == 2)
+		/* Optimized matrix mult. 2*/
+		*l_mem_sizeB_in_bytes = lws_in[0] * bd[1] * sizeof(cl_int);
+	if (kid == 4) {
+		/* Optimized matrix transpose mult. */
+		*l_mem_sizeA_in_bytes = lws_in[1] * ad[0] * sizeof(cl_int);
+		*l_mem_sizeB_in_bytes = lws_in[0] * ad[0] * sizeof(cl_int);
+	}
+}
+
+/* Set arguments of kernel `kid`, for matrices with dimensions `ad` and
+ * `bd`. */
+static void matmult_args_set(int kid, CCLKernel* krnl, const int* ad,
+	const int* bd, CCLBuffer* matrixA_dev, CCLBuffer* matrixB_dev,
+	CCLBuffer* matrixC_dev, size_t l_mem_sizeA_in_bytes,
+	size_t l_mem_sizeB_in_bytes) {
+
+	/* Position of the epilogue bias in each kernel, after the
+	 * dimensions and local memory. */
+	static const cl_uint bias_arg[] = {5, 6, 7, 3, 5};
+
+	if (!IS_AAT(kid)) {
+
+		/* Arguments for C=AB */
+		if (kid == 0) {
+			ccl_kernel_set_args(krnl, matrixA_dev, matrixB_dev,
+				matrixC_dev, ccl_arg_full((void*) ad, sizeof(cl_int2)),
+				ccl_arg_full((void*) bd, sizeof(cl_int2)), NULL);
+		} else if (kid == 1) {
+			ccl_kernel_set_args(krnl, matrixA_dev, matrixB_dev,
+				matrixC_dev, ccl_arg_full((void*) ad, sizeof(cl_int2)),
+				ccl_arg_full((void*) bd, sizeof(cl_int2)),
+				ccl_arg_full(NULL, l_mem_sizeA_in_bytes), NULL);
+		} else if (kid == 2) {
+			ccl_kernel_set_args(krnl, matrixA_dev, matrixB_dev,
+				matrixC_dev, ccl_arg_full((void*) ad, sizeof(cl_int2)),
+				ccl_arg_full((void*) bd, sizeof(cl_int2)),
+				ccl_arg_full(NULL, l_mem_sizeA_in_bytes),
+				ccl_arg_full(NULL, l_mem_sizeB_in_bytes), NULL);
+		}
+
+	} else {
+
+		/* Arguments only for C=AA^T */
+		if (kid < 4) {
+			ccl_kernel_set_args(krnl, matrixA_dev, matrixC_dev,
+				ccl_arg_full((void*) ad, sizeof(cl_int2)), NULL);
+		} else if (kid == 4) {
+			ccl_kernel_set_args(krnl, matrixA_dev, matrixC_dev,
+				ccl_arg_full((void*) ad, sizeof(cl_int2)),
+				ccl_arg_full(NULL, l_mem_sizeA_in_bytes),
+				ccl_arg_full(NULL, l_mem_sizeB_in_bytes), NULL);
+		}
+	}
+
+	/* Epilogue bias, if any. */
+	if (epi_bias_dev)
+		ccl_kernel_set_arg(krnl, bias_arg[kid], epi_bias_dev);
+}
+
+/* Initialize input matrices on the device, either by generating them
+ * with `fill` or, if `fill` is NULL, by copying them from the host.
+ * Matrices whose host copy is NULL are already on the device. */
+static void matmult_inputs_init(CCLExFill* fill, CCLQueue* cq,
+	CCLBuffer* matrixA_dev, CCLBuffer* matrixB_dev,
+	cl_int* matrixA_host, cl_int* matrixB_host, GError** err) {
+
+	size_t numA = (size_t) a_dim[0] * a_dim[1];
+	size_t numB = (size_t) b_dim[0] * b_dim[1];
+
+	if (fill) {
+		/* Generate matrices on the device. */
+		if (!ccl_ex_fill_int(fill, cq, matrixA_dev, numA, seed,
+			matrix_range[0], matrix_range[1], err)) return;
+		if (!IS_AAT(kernel_id))
+			ccl_ex_fill_int(fill, cq, matrixB_dev, numB, seed + 1,
+				matrix_range[0], matrix_range[1], err);
+	} else {
+		/* Copy matrices to device. */
+		if (matrixA_host && !ccl_buffer_enqueue_write(matrixA_dev, cq,
+			CL_TRUE, 0, numA * sizeof(cl_int), matrixA_host, NULL, err))
+			return;
+		if (!IS_AAT(kernel_id) && matrixB_host)
+			/* Only required if we're not multiplying the transpose. */
+			ccl_buffer_enqueue_write(matrixB_dev, cq, CL_TRUE, 0,
+				numB * sizeof(cl_int), matrixB_host, NULL, err);
+	}
+}
+
+/* Auto-tuner timing callback: time the selected kernel with the local
+ * work size given in `config`. */
+static double matmult_tune_timer(const int* config, void* data,
+	GError** err) {
+
+	struct matmult_tune_data* td = (struct matmult_tune_data*) data;
+	size_t lws_cand[2] = { config[0], config[1] }, gws_cand[2];
+	size_t lmemA, lmemB;
+	CCLEvent* evt;
+	CCLEventWaitList ewl = NULL;
+	GError* err_internal = NULL;
+	double t_best = -1;
+
+	/* Skip configurations which don't fit the kernel or device. */
+	matmult_lmem_get(kernel_id, a_dim, b_dim, lws_cand, &lmemA, &lmemB);
+	if ((lws_cand[0] * lws_cand[1] > td->krnl_wg_max)
+		|| (lmemA + lmemB > td->dev_lmem)) return -1;
+
+	matmult_gws_get(a_dim, b_dim, lws_cand, gws_cand);
+	matmult_args_set(kernel_id, td->krnl, a_dim, b_dim, td->matrixA_dev,
+		td->matrixB_dev, td->matrixC_dev, lmemA, lmemB);
+
+	for (int r = 0; r < TUNE_REPS; r++) {
+
+		cl_ulong tstart, tend;
+
+		evt = ccl_kernel_enqueue_ndrange(td->krnl, td->cq, 2, NULL,
+			gws_cand, lws_cand, NULL, &err_internal);
+		if (err_internal != NULL) {
+			/* Runtime rejected configuration, consider it invalid. */
+			g_clear_error(&err_internal);
+			return -1;
+		}
+		ccl_event_wait_list_add(&ewl, evt, NULL);
+		ccl_event_wait(&ewl, &err_internal);
+		if_err_goto(err_internal, error_handler);
+
+		tstart = ccl_event_get_profiling_info_scalar(
+			evt, CL_PROFILING_COMMAND_START, cl_ulong, &err_internal);
+		if_err_goto(err_internal, error_handler);
+		tend = ccl_event_get_profiling_info_scalar(
+			evt, CL_PROFILING_COMMAND_END, cl_ulong, &err_internal);
+		if_err_goto(err_internal, error_handler);
+
+		if ((t_best < 0) || ((tend - tstart) * 1e-9 < t_best))
+			t_best = (tend - tstart) * 1e-9;
+	}
+
+	return t_best;
+
+error_handler:
+	g_propagate_error(err, err_internal);
+	return -1;
+}
+
+/* Compute column `col` of C=AB on the host. Products are accumulated
+ * in unsigned integers, as in the kernels, so that results wrap around
+ * modulo 2^32 instead of overflowing. */
+static void matmult_host_ab(const int* ad, const int* bd, const int* A,
+	const int* B, int* C, int col) {
+
+	for (size_t row = 0; row < (size_t) ad[1]; row++) {
+		guint32 sum = 0;
+		for (size_t i = 0; i < (size_t) ad[0]; i++) {
+			sum +=
+				(guint32) A[row * ad[0] + i]
+				*
+				(guint32) B[i * bd[0] + col];
+		}
+		C[row * bd[0] + col] = (int) sum;
+	}
+}
+
+/* Compute row `row` of C=AA^T on the host, accumulating in unsigned
+ * integers. */
+static void matmult_host_aat(const int* ad, const int* A, int* C,
+	int row) {
+
+	for (size_t col = 0; col < (size_t) ad[1]; col++) {
+		guint32 sum = 0;
+		for (int i = 0; i < ad[0]; i++) {
+			sum +=
+				(guint32) A[(size_t) row * ad[0] + i]
+				*
+				(guint32) A[col * ad[0] + i];
+		}
+		C[(size_t) row * ad[1] + col] = (int) sum;
+	}
+}
+
+/**
+ * Multiply matrices on the host, with OpenMP if available. The
+ * pragmas below make the loops parallel with threads = number of cores.
+ *
+ * @param[in] ad Dimensions (cols, rows) of matrix A.
+ * @param[in] bd Dimensions (cols, rows) of matrix B (of @f$A^T@f$ if
+ * `aat` is true).
+ * @param[in] aat Multiply A by its transpose (@f$C=AA^T@f$) instead of
+ * by B (@f$C=AB@f$).
+ * @param[in] runtime_sched Use the OpenMP runtime schedule (set with
+ * `omp_set_schedule()` or `OMP_SCHEDULE`) instead of the default one.
+ * @param[in] A Matrix A.
+ * @param[in] B Matrix B, ignored if `aat` is true.
+ * @param[out] C Result matrix.
+ * */
+void matmult_host(const int* ad, const int* bd, gboolean aat,
+	gboolean runtime_sched, const int* A, const int* B, int* C) {
+
+	if (!aat) {
+		/* C=AB */
+		if (runtime_sched) {
+#ifdef USE_OPENMP
+			#pragma omp parallel for schedule(runtime)
+#endif
+			for (int col = 0; col < bd[0]; col++)
+				matmult_host_ab(ad, bd, A, B, C, col);
+		} else {
+#ifdef USE_OPENMP
+			#pragma omp parallel for
+#endif
+			for (int col = 0; col < bd[0]; col++)
+				matmult_host_ab(ad, bd, A, B, C, col);
+		}
+	} else {
+		/* C=AA^T */
+		if (runtime_sched) {
+#ifdef USE_OPENMP
+			#pragma omp parallel for schedule(runtime)
+#endif
+			for (int row = 0; row < ad[1]; row++)
+				matmult_host_aat(ad, A, C, row);
+		} else {
+#ifdef USE_OPENMP
+			#pragma omp parallel for
+#endif
+			for (int row = 0; row < ad[1]; row++)
+				matmult_host_aat(ad, A, C, row);
+		}
+	}
+}
+
+/* Number of elements of C spot-checked when the dispatcher multiplies
+ * on the host. */
+#define SPOT_CHECK 16
+
+/**
+ * Spot-check a host result by recomputing a few elements, evenly spread
+ * over C from the first to the last, with serial dot products.
+ *
+ * @param[in] ad Dimensions (cols, rows) of matrix A.
+ * @param[in] bd Dimensions (cols, rows) of matrix B (of @f$A^T@f$ if
+ * `aat` is true).
+ * @param[in] aat Result is @f$C=AA^T@f$ instead of @f$C=AB@f$.
+ * @param[in] A Matrix A.
+ * @param[in] B Matrix B, ignored if `aat` is true.
+ * @param[in] C Result matrix to check.
+ * @param[in] n Number of elements to check.
+ * @return Number of checked elements which differ.
+ * */
+static guint matmult_host_spot_check(const int* ad, const int* bd,
+	gboolean aat, const int* A, const int* B, const int* C, guint n) {
+
+	size_t size = (size_t) bd[0] * ad[1];
+	guint mismatches = 0;
+
+	for (guint s = 0; s < n; ++s) {
+		size_t index = (s == n - 1) ? size - 1 : (size - 1) / (n - 1) * s;
+		size_t row = index / bd[0], col = index % bd[0];
+		guint32 sum = 0;
+		for (size_t i = 0; i < (size_t) ad[0]; i++)
+			sum += (guint32) A[row * ad[0] + i] * (guint32) (aat
+				? A[col * ad[0] + i] : B[i * bd[0] + col]);
+		if (C[index] != (int) sum) mismatches++;
+	}
+	return mismatches;
+}
+
+/* Duration of an event in seconds. */
+static double matmult_evt_time(CCLEvent* evt, GError** err) {
+
+	GError* err_internal = NULL;
+	cl_ulong tstart, tend;
+
+	tstart = ccl_event_get_profiling_info_scalar(
+		evt, CL_PROFILING_COMMAND_START, cl_ulong, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	tend = ccl_event_get_profiling_info_scalar(
+		evt, CL_PROFILING_COMMAND_END, cl_ulong, &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	return (tend - tstart) * 1e-9;
+
+error_handler:
+	g_propagate_error(err, err_internal);
+	return 0;
+}
+
+/* Number of timed runs, after one warm-up run, for each dispatch
+ * calibration size. */
+#define DISPATCH_REPS 3
+
+/* Data passed to the dispatch calibration callback. */
+struct matmult_dispatch_data {
+	CCLContext* ctx;
+	CCLKernel* krnl;
+	CCLQueue* cq;
+	const size_t* lws;
+	size_t krnl_wg_max;
+	cl_ulong dev_lmem;
+	GRand* rng;
+};
+
+/* Dispatch calibration callback: time the selected kernel and the host
+ * implementation for square matrices of the given size. As in the
+ * main program, inputs are written to the device and the result is
+ * read back, with the best of DISPATCH_REPS runs for each component. */
+static gboolean matmult_calib_timer(int size,
+	MatmultDispatchSample* sample, void* data, GError** err) {
+
+	struct matmult_dispatch_data* dd = (struct matmult_dispatch_data*) data;
+	int ad[2] = { size, size }, bd[2] = { size, size };
+	size_t gws_cal[2], lmemA, lmemB;
+	size_t bytes = (size_t) size * size * sizeof(cl_int);
+	int *A = NULL, *B = NULL, *C = NULL;
+	CCLBuffer *A_dev = NULL, *B_dev = NULL, *C_dev = NULL;
+	CCLEvent *evt_a, *evt_b = NULL, *evt_k, *evt_c;
+	GError* err_internal = NULL;
+	gint64 t0;
+	double t_wall, t_xfer, t_krnl, t_host;
+	gboolean status = FALSE;
+
+	/* Skip sizes which don't fit the kernel or device. */
+	matmult_lmem_get(kernel_id, ad, bd, dd->lws, &lmemA, &lmemB);
+	if ((dd->lws[0] * dd->lws[1] > dd->krnl_wg_max)
+		|| (lmemA + lmemB > dd->dev_lmem)) return FALSE;
+	matmult_gws_get(ad, bd, dd->lws, gws_cal);
+
+	A = matmult_matrix_new(size, size, matrix_range, dd->rng);
+	B = matmult_matrix_new(size, size, matrix_range, dd->rng);
+	C = matmult_matrix_new(size, size, NULL, NULL);
+
+	A_dev = ccl_ex_footprint_buffer_new(dd->ctx, CL_MEM_READ_ONLY,
+		bytes, NULL, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	B_dev = ccl_ex_footprint_buffer_new(dd->ctx, CL_MEM_READ_ONLY,
+		bytes, NULL, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	C_dev = ccl_ex_footprint_buffer_new(dd->ctx, CL_MEM_WRITE_ONLY,
+		bytes, NULL, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	matmult_args_set(kernel_id, dd->krnl, ad, bd, A_dev, B_dev, C_dev,
+		lmemA, lmemB);
+
+	sample->host = sample->xfer = sample->kernel = sample->overhead = -1;
+	sample->xfer_bytes = (IS_AAT(kernel_id) ? 2 : 3) * (double) bytes;
+
+	for (int r = 0; r <= DISPATCH_REPS; r++) {
+
+		/* Device: write inputs, run kernel, read result. */
+		t0 = g_get_monotonic_time();
+		evt_a = ccl_buffer_enqueue_write(A_dev, dd->cq, CL_FALSE, 0,
+			bytes, A, NULL, &err_internal);
+		if_err_goto(err_internal, error_handler);
+		if (!IS_AAT(kernel_id)) {
+			evt_b = ccl_buffer_enqueue_write(B_dev, dd->cq, CL_FALSE, 0,
+				bytes, B, NULL, &err_internal);
+			if_err_goto(err_internal, error_handler);
+		}
+		evt_k = ccl_kernel_enqueue_ndrange(dd->krnl, dd->cq, 2, NULL,
+			gws_cal, dd->lws, NULL, &err_internal);
+		if_err_goto(err_internal, error_handler);
+		evt_c = ccl_buffer_enqueue_read(C_dev, dd->cq, CL_FALSE, 0,
+			bytes, C, NULL, &err_internal);
+		if_err_goto(err_internal, error_handler);
+		ccl_queue_finish(dd->cq, &err_internal);
+		if_err_goto(err_internal, error_handler);
+		t_wall = (g_get_monotonic_time() - t0) * 1e-6;
+
+		t_xfer = matmult_evt_time(evt_a, &err_internal);
+		if_err_goto(err_internal, error_handler);
+		if (evt_b) {
+			t_xfer += matmult_evt_time(evt_b, &err_internal);
+			if_err_goto(err_internal, error_handler);
+		}
+		t_xfer += matmult_evt_time(evt_c, &err_internal);
+		if_err_goto(err_internal, error_handler);
+		t_krnl = matmult_evt_time(evt_k, &err_internal);
+		if_err_goto(err_internal, error_handler);
+		ccl_queue_gc(dd->cq);
+
+		/* Host. */
+		t0 = g_get_monotonic_time();
+		matmult_host(ad, bd, IS_AAT(kernel_id), FALSE, A, B, C);
+		t_host = (g_get_monotonic_time() - t0) * 1e-6;
+
+		/* First run is a warm-up. */
+		if (r == 0) continue;
+
+		if ((sample->host < 0) || (t_host < sample->host))
+			sample->host = t_host;
+		if ((sample->xfer < 0) || (t_xfer < sample->xfer))
+			sample->xfer = t_xfer;
+		if ((sample->kernel < 0) || (t_krnl < sample->kernel))
+			sample->kernel = t_krnl;
+		if ((sample->overhead < 0)
+			|| (t_wall - t_xfer - t_krnl < sample->overhead))
+			sample->overhead = MAX(t_wall - t_xfer - t_krnl, 0);
+	}
+
+	status = TRUE;
+	goto finish;
+
+error_handler:
+	g_propagate_error(err, err_internal);
+
+finish:
+	if (A_dev) ccl_ex_footprint_buffer_destroy(A_dev);
+	if (B_dev) ccl_ex_footprint_buffer_destroy(B_dev);
+	if (C_dev) ccl_ex_footprint_buffer_destroy(C_dev);
+	matmult_matrix_free(A);
+	matmult_matrix_free(B);
+	matmult_matrix_free(C);
+	return status;
+}
+
+/* Data passed to the matrix chain multiplication callback. */
+struct matmult_chain_data {
+	CCLKernel* krnl;
+	CCLDevice* dev;
+	CCLQueue* cq;
+};
+
+/* Get work sizes and local memory of C=AB in a matrix chain, for
+ * matrices with dimensions `ad` and `bd`. */
+static gboolean matmult_chain_ws_get(struct matmult_chain_data* cd,
+	const int* ad, const int* bd, size_t* gws_step, size_t* lws_step,
+	size_t* lmemA, size_t* lmemB, GError** err) {
+
+	lws_step[0] = lws[0];
+	lws_step[1] = lws[1];
+	if (lws_step[0] == 0) {
+		/* Suggest work sizes for this product. */
+		size_t real_ws_step[2] = { bd[0], ad[1] };
+		if (!ccl_kernel_suggest_worksizes(cd->krnl, cd->dev, 2,
+			real_ws_step, gws_step, lws_step, err)) return FALSE;
+	} else {
+		matmult_gws_get(ad, bd, lws_step, gws_step);
+	}
+	matmult_lmem_get(kernel_id, ad, bd, lws_step, lmemA, lmemB);
+	return TRUE;
+}
+
+/* Check, before multiplying, that the local memory of every product in
+ * a matrix chain fits the device. Local memory of the tiled kernels
+ * grows with the inner dimension, which differs between products. */
+static gboolean matmult_chain_lmem_check(MatmultChain* mc,
+	struct matmult_chain_data* cd, GError** err) {
+
+	GError* err_internal = NULL;
+	cl_ulong dev_lmem;
+	size_t gws_step[2], lws_step[2], lmemA, lmemB;
+	int ad[2], bd[2];
+
+	dev_lmem = ccl_device_get_info_scalar(cd->dev,
+		CL_DEVICE_LOCAL_MEM_SIZE, cl_ulong, &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	for (guint j = 0; j < matmult_chain_num_steps(mc); ++j) {
+		matmult_chain_step_dims_get(mc, j, ad, bd);
+		if (!matmult_chain_ws_get(cd, ad, bd, gws_step, lws_step,
+			&lmemA, &lmemB, &err_internal)) goto error_handler;
+		if_err_create_goto(err_internal, CCL_EX_ERROR,
+			lmemA + lmemB > dev_lmem, CCL_EX_FAIL, error_handler,
+			"Multiplication %u of the chain (%dx%d by %dx%d) requires "
+			"%lu bytes of local memory, but the device only has %lu.",
+			j, ad[1], ad[0], bd[1], bd[0], (unsigned long) (lmemA + lmemB),
+			(unsigned long) dev_lmem);
+	}
+	return TRUE;
+
+error_handler:
+	g_propagate_error(err, err_internal);
+	return FALSE;
+}
+
+/* Matrix chain callback: enqueue C=AB with the selected kernel, for
+ * matrices with dimensions `ad` and `bd`. */
+static CCLEvent* matmult_chain_step(const int* ad, const int* bd,
+	CCLBuffer* A, CCLBuffer* B, CCLBuffer* C, CCLEventWaitList* ewl,
+	void* data, GError** err) {
+
+	struct matmult_chain_data* cd = (struct matmult_chain_data*) data;
+	size_t lws_step[2], gws_step[2];
+	size_t lmemA, lmemB;
+
+	if (!matmult_chain_ws_get(cd, ad, bd, gws_step, lws_step,
+		&lmemA, &lmemB, err)) return NULL;
+	matmult_args_set(kernel_id, cd->krnl, ad, bd, A, B, C, lmemA, lmemB);
+
+	return ccl_kernel_enqueue_ndrange(cd->krnl, cd->cq, 2, NULL,
+		gws_step, lws_step, ewl, err);
+}
+
+/**
+ * Multiply a matrix chain or power on the device, with intermediates
+ * kept in device buffers, and verify it against the left-to-right
+ * product on the host.
+ *
+ * @param[in] mc Matrix chain or power.
+ * @param[in] ctx Context wrapper.
+ * @param[in] dev Device wrapper.
+ * @param[in] krnl Kernel wrapper of the selected C=AB kernel.
+ * @param[in] rng Random number generator for the input matrices.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return `TRUE` if the chain was multiplied, `FALSE` otherwise.
+ * */
+static gboolean matmult_chain_exec(MatmultChain* mc, CCLContext* ctx,
+	CCLDevice* dev, CCLKernel* krnl, GRand* rng, GError** err) {
+
+	GError* err_internal = NULL;
+	struct matmult_chain_data cd = { krnl, dev, NULL };
+	guint num = matmult_chain_num_inputs(mc);
+	int** inputs_host = g_new0(int*, num);
+	CCLBuffer** inputs_dev = g_new0(CCLBuffer*, num);
+	CCLBuffer* result_dev;
+	int* result_host = NULL;
+	int* result_test = NULL;
+	CCLProf* prof_cpu = NULL;
+	cl_command_queue_properties qprops;
+	int dims[2];
+	size_t num_result, mismatches = 0;
+	double t_dev;
+	gboolean ok;
+
+	/* Don't copy anything if some product doesn't fit the device. */
+	if (!matmult_chain_lmem_check(mc, &cd, &err_internal))
+		goto error_handler;
+
+	/* Independent products may run concurrently on an out-of-order
+	 * queue, if the device has one. */
+	qprops = ccl_device_get_info_scalar(dev, CL_DEVICE_QUEUE_PROPERTIES,
+		cl_command_queue_properties, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	cd.cq = ccl_queue_new(ctx, dev, CL_QUEUE_PROFILING_ENABLE
+		| (qprops & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE), &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	/* Input matrices, copied to the device once. */
+	for (guint i = 0; i < num; ++i) {
+		matmult_chain_dims_get(mc, i, dims);
+		inputs_host[i] = matmult_matrix_new(
+			dims[0], dims[1], matrix_range, rng);
+		inputs_dev[i] = ccl_ex_footprint_buffer_new(ctx,
+			CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+			(size_t) dims[0] * dims[1] * sizeof(cl_int), inputs_host[i],
+			&err_internal);
+		if_err_goto(err_internal, error_handler);
+	}
+
+	/* Multiply on the device, reading back only the result. */
+	result_dev = matmult_chain_run(mc, ctx, cd.cq, inputs_dev,
+		matmult_chain_step, &cd, &t_dev, &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	matmult_chain_dims_get(mc, num, dims);
+	num_result = (size_t) dims[0] * dims[1];
+	result_host = matmult_matrix_new(dims[0], dims[1], NULL, NULL);
+	ccl_buffer_enqueue_read(result_dev, cd.cq, CL_TRUE, 0,
+		num_result * sizeof(cl_int), result_host, NULL, &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	/* Multiply on the host, from left to right. Products are
+	 * accumulated in unsigned integers on both sides, so they are exact
+	 * modulo 2^32 and any order gives the same result. */
+	prof_cpu = ccl_prof_new();
+	ccl_prof_start(prof_cpu);
+	result_test = matmult_chain_host(mc, inputs_host);
+	ccl_prof_stop(prof_cpu);
+
+	for (size_t index = 0; index < num_result; index++)
+		if (result_host[index] != result_test[index]) mismatches++;
+
+	matmult_chain_print(mc, stdout);
+	g_printf("\n   ============================== Results ==================================\n\n");
+	g_printf("     Result                      : %dx%d\n", dims[1], dims[0]);
+	g_printf("     Device time (chosen order)  : %es\n", t_dev);
+	g_printf("     Host time (left-to-right)   : %es\n",
+		ccl_prof_time_elapsed(prof_cpu));
+	g_printf("     Mismatches (Device-CPU)     : %" G_GUINT64_FORMAT "\n",
+		(guint64) mismatches);
+	g_printf("\n");
+
+	ok = TRUE;
+	goto cleanup;
+
+error_handler:
+	g_propagate_error(err, err_internal);
+	ok = FALSE;
+
+cleanup:
+	if (prof_cpu) ccl_prof_destroy(prof_cpu);
+	if (result_host) matmult_matrix_free(result_host);
+	if (result_test) matmult_matrix_free(result_test);
+	for (guint i = 0; i < num; ++i) {
+		if (inputs_dev[i]) ccl_ex_footprint_buffer_destroy(inputs_dev[i]);
+		if (inputs_host[i]) matmult_matrix_free(inputs_host[i]);
+	}
+	g_free(inputs_dev);
+	g_free(inputs_host);
+	if (cd.cq) ccl_queue_destroy(cd.cq);
+	return ok;
+}
+
+/* Number of timed runs of each kernel, after one warm-up run, when
+ * comparing image and buffer operands. */
+#define IMAGE_REPS 5
+
+/**
+ * Compare kernel 0, which reads A and B from buffers, with its variant
+ * which reads the operands selected with `--image` from images. Both
+ * kernels compute the same product, and their results are compared.
+ *
+ * The effective bandwidth is the number of bytes requested by
+ * work-items (two operand reads per multiply-add, one write per element
+ * of C) divided by kernel time. Most requests are served by caches, so
+ * it may exceed the device's global memory bandwidth.
+ *
+ * @param[in] ctx Context wrapper.
+ * @param[in] dev Device wrapper.
+ * @param[in] prg Program wrapper, built with `IMG_A` and/or `IMG_B`.
+ * @param[in] krnl Kernel wrapper of kernel 0.
+ * @param[in] cq Command queue wrapper, with profiling enabled.
+ * @param[in] gws Global work size.
+ * @param[in] lws Local work size.
+ * @param[in] A Host matrix A.
+ * @param[in] B Host matrix B.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return `TRUE` if the comparison was performed, `FALSE` otherwise.
+ * */
+static gboolean matmult_image_compare(CCLContext* ctx, CCLDevice* dev,
+	CCLProgram* prg, CCLKernel* krnl, CCLQueue* cq, const size_t* gws,
+	const size_t* lws, cl_int* A, cl_int* B, GError** err) {
+
+	GError* err_internal = NULL;
+	cl_image_format image_format = { CL_R, CL_SIGNED_INT32 };
+	CCLKernel* krnl_img;
+	CCLBuffer* bufs[4] = { NULL, NULL, NULL, NULL };
+	CCLImage* imgs[2] = { NULL, NULL };
+	cl_int* C[2] = { NULL, NULL };
+	const char* names[2] = { "buffers", NULL };
+	double t_best[2] = { -1, -1 }, t_sum[2] = { 0, 0 };
+	size_t img_max[2], numC = (size_t) b_dim[0] * a_dim[1];
+	size_t mismatches = 0;
+	double bytes;
+	gboolean ok;
+
+	/* Images are limited in size. */
+	img_max[0] = ccl_device_get_info_scalar(dev,
+		CL_DEVICE_IMAGE2D_MAX_WIDTH, size_t, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	img_max[1] = ccl_device_get_info_scalar(dev,
+		CL_DEVICE_IMAGE2D_MAX_HEIGHT, size_t, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	if_err_create_goto(err_internal, CCL_EX_ERROR,
+		(img_a && (((size_t) a_dim[0] > img_max[0])
+			|| ((size_t) a_dim[1] > img_max[1])))
+		|| (img_b && (((size_t) b_dim[0] > img_max[0])
+			|| ((size_t) b_dim[1] > img_max[1]))),
+		CCL_EX_FAIL, error_handler,
+		"Matrices in images are limited to %zux%zu (cols x rows).",
+		img_max[0], img_max[1]);
+
+	/* Buffers A, B and C of each kernel, and images. */
+	bufs[0] = ccl_ex_footprint_buffer_new(ctx,
+		CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+		(size_t) a_dim[0] * a_dim[1] * sizeof(cl_int), A, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	bufs[1] = ccl_ex_footprint_buffer_new(ctx,
+		CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+		(size_t) b_dim[0] * b_dim[1] * sizeof(cl_int), B, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	for (guint k = 2; k < 4; ++k) {
+		bufs[k] = ccl_ex_footprint_buffer_new(ctx, CL_MEM_WRITE_ONLY,
+			numC * sizeof(cl_int), NULL, &err_internal);
+		if_err_goto(err_internal, error_handler);
+	}
+	if (img_a) {
+		imgs[0] = ccl_ex_footprint_image2d_new(ctx,
+			CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, &image_format,
+			a_dim[0], a_dim[1], A, &err_internal);
+		if_err_goto(err_internal, error_handler);
+	}
+	if (img_b) {
+		imgs[1] = ccl_ex_footprint_image2d_new(ctx,
+			CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, &image_format,
+			b_dim[0], b_dim[1], B, &err_internal);
+		if_err_goto(err_internal, error_handler);
+	}
+
+	/* Set arguments of both kernels. */
+	krnl_img = ccl_program_get_kernel(prg, "matmult0_img", &err_internal);
+	if_err_goto(err_internal, error_handler);
+	matmult_args_set(0, krnl, a_dim, b_dim, bufs[0], bufs[1], bufs[2],
+		0, 0);
+	ccl_kernel_set_args(krnl_img,
+		img_a ? (void*) imgs[0] : (void*) bufs[0],
+		img_b ? (void*) imgs[1] : (void*) bufs[1], bufs[3],
+		ccl_arg_full((void*) a_dim, sizeof(cl_int2)),
+		ccl_arg_full((void*) b_dim, sizeof(cl_int2)), NULL);
+	names[1] = img_a ? (img_b ? "images (AB)" : "image (A)") : "image (B)";
+
+	/* Time kernels alternately, so that both see similar conditions. */
+	for (int r = 0; r <= IMAGE_REPS; ++r) {
+		for (guint k = 0; k < 2; ++k) {
+
+			CCLEvent* evt;
+			double t;
+
+			evt = ccl_kernel_enqueue_ndrange(k ? krnl_img : krnl, cq, 2,
+				NULL, gws, lws, NULL, &err_internal);
+			if_err_goto(err_internal, error_handler);
+			ccl_queue_finish(cq, &err_internal);
+			if_err_goto(err_internal, error_handler);
+			t = matmult_evt_time(evt, &err_internal);
+			if_err_goto(err_internal, error_handler);
+
+			/* First run is a warm-up. */
+			if (r == 0) continue;
+			t_sum[k] += t;
+			if ((t_best[k] < 0) || (t < t_best[k])) t_best[k] = t;
+		}
+	}
+
+	/* Compare results. */
+	for (guint k = 0; k < 2; ++k) {
+		C[k] = matmult_matrix_new(b_dim[0], a_dim[1], NULL, NULL);
+		ccl_buffer_enqueue_read(bufs[2 + k], cq, CL_TRUE, 0,
+			numC * sizeof(cl_int), C[k], NULL, &err_internal);
+		if_err_goto(err_internal, error_handler);
+	}
+	for (size_t index = 0; index < numC; index++)
+		if (C[0][index] != C[1][index]) mismatches++;
+
+	/* Bytes requested by work-items. */
+	bytes = (2.0 * a_dim[0] + 1.0) * numC * sizeof(cl_int);
+
+	g_printf("\n   ============================== Image operands ===========================\n\n");
+	g_printf("     %-16s %12s %12s %12s\n", "Operands", "Best (s)",
+		"Mean (s)", "Eff. GB/s");
+	for (guint k = 0; k < 2; ++k)
+		g_printf("     %-16s %12.4e %12.4e %12.2f\n", names[k], t_best[k],
+			t_sum[k] / IMAGE_REPS, bytes / t_best[k] * 1e-9);
+	g_printf("\n     Speedup (image vs. buffer)  : %.2fx\n",
+		t_best[0] / t_best[1]);
+	g_printf("     Mismatches (image-buffer)   : %" G_GUINT64_FORMAT "\n\n",
+		(guint64) mismatches);
+
+	ok = TRUE;
+	goto cleanup;
+
+error_handler:
+	g_propagate_error(err, err_internal);
+	ok = FALSE;
+
+cleanup:
+	for (guint k = 0; k < 2; ++k) {
+		if (C[k]) matmult_matrix_free(C[k]);
+		if (imgs[k]) ccl_ex_footprint_image_destroy(imgs[k]);
+	}
+	for (guint k = 0; k < 4; ++k)
+		if (bufs[k]) ccl_ex_footprint_buffer_destroy(bufs[k]);
+	return ok;
+}
+
+/* Number of timed runs of each kernel, after one warm-up run, when
+ * comparing with the persistent-threads kernel. */
+#define PERSISTENT_REPS 5
+
+/* Value which C is filled with before each run when comparing with the
+ * persistent-threads kernel, so that skipped elements are detected. */
+#define PERSISTENT_SENTINEL ((cl_int) 0xDEADBEEF)
+
+/* Kernels compared with `--persistent`, persistent-threads kernel last. */
+static const char* const persistent_kernels[] =
+	{ "matmult0", "matmult1", "matmult2", "matmult_pt" };
+
+/**
+ * Compare tail efficiency of kernels 0 to 2 with the persistent-threads
+ * kernel, for the current matrix sizes and local work size.
+ *
+ * Kernels 0 to 2 launch one work-group per tile of C, padding the
+ * global work size to a multiple of the local work size. Work-groups
+ * run in waves of as many as fit the device at once, and the last wave
+ * may be mostly empty. The persistent-threads kernel launches a single
+ * wave, whose work-groups claim tiles until all are done. For each
+ * kernel, the number of work-groups, waves, the fill of the last wave,
+ * and the fraction of launched work-items within C are shown with
+ * kernel times. Results are compared with the host result.
+ *
+ * @param[in] ctx Context wrapper.
+ * @param[in] dev Device wrapper.
+ * @param[in] prg Program wrapper.
+ * @param[in] cq Command queue wrapper, with profiling enabled.
+ * @param[in] lws_in Local work size of all kernels.
+ * @param[in] A Host matrix A.
+ * @param[in] B Host matrix B.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return `TRUE` if the comparison was performed, `FALSE` otherwise.
+ * */
+static gboolean matmult_persistent_compare(CCLContext* ctx,
+	CCLDevice* dev, CCLProgram* prg, CCLQueue* cq, const size_t* lws_in,
+	cl_int* A, cl_int* B, GError** err) {
+
+	GError* err_internal = NULL;
+	CCLBuffer* bufs[4] = { NULL, NULL, NULL, NULL };
+	cl_int* C = NULL;
+	cl_int* C_ref = NULL;
+	cl_int* sentinels = NULL;
+	size_t numC = (size_t) b_dim[0] * a_dim[1];
+	size_t wg = lws_in[0] * lws_in[1];
+	size_t dev_wg_max, dev_lmem, tiles, resident;
+	cl_uint cus;
+	double flops = 2.0 * a_dim[0] * numC;
+	gboolean ok;
+
+	/* Work-groups which fit the device at once. */
+	cus = ccl_device_get_info_scalar(dev, CL_DEVICE_MAX_COMPUTE_UNITS,
+		cl_uint, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	dev_wg_max = ccl_device_get_info_scalar(dev,
+		CL_DEVICE_MAX_WORK_GROUP_SIZE, size_t, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	dev_lmem = ccl_device_get_info_scalar(dev, CL_DEVICE_LOCAL_MEM_SIZE,
+		cl_ulong, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	resident = (size_t) cus
+		* (groups_per_cu > 0 ? (size_t) groups_per_cu
+			: MAX(dev_wg_max / wg, 1));
+	tiles = ((b_dim[0] + lws_in[0] - 1) / lws_in[0])
+		* ((a_dim[1] + lws_in[1] - 1) / lws_in[1]);
+
+	/* Buffers A, B, C and tile counter. */
+	bufs[0] = ccl_ex_footprint_buffer_new(ctx,
+		CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+		(size_t) a_dim[0] * a_dim[1] * sizeof(cl_int), A, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	bufs[1] = ccl_ex_footprint_buffer_new(ctx,
+		CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+		(size_t) b_dim[0] * b_dim[1] * sizeof(cl_int), B, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	bufs[2] = ccl_ex_footprint_buffer_new(ctx, CL_MEM_WRITE_ONLY,
+		numC * sizeof(cl_int), NULL, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	bufs[3] = ccl_ex_footprint_buffer_new(ctx, CL_MEM_READ_WRITE,
+		sizeof(cl_uint), NULL, &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	C = matmult_matrix_new(b_dim[0], a_dim[1], NULL, NULL);
+
+	/* Host reference. */
+	C_ref = matmult_matrix_new(b_dim[0], a_dim[1], NULL, NULL);
+	matmult_host(a_dim, b_dim, FALSE, FALSE, A, B, C_ref);
+
+	/* Written to C before each run, since filling buffers requires
+	 * OpenCL 1.2. */
+	sentinels = g_new(cl_int, numC);
+	for (size_t index = 0; index < numC; index++)
+		sentinels[index] = PERSISTENT_SENTINEL;
+
+	g_printf("\n   ============================== Tail efficiency ==========================\n\n");
+	g_printf("     C is %dx%d, local work size is %zux%zu, %zu tiles, "
+		"%zu work-groups fit the device (%u compute units)\n\n",
+		a_dim[1], b_dim[0], lws_in[0], lws_in[1], tiles, resident, cus);
+	g_printf("     %-10s %8s %6s %9s %8s %12s %12s %9s %10s\n", "Kernel",
+		"Groups", "Waves", "Last wave", "Useful", "Best (s)", "Mean (s)",
+		"GFLOP/s", "Mismatches");
+
+	/* Kernels 0 to 2, then persistent-threads kernel. */
+	for (int kid = 0; kid < (int) G_N_ELEMENTS(persistent_kernels); ++kid) {
+
+		gboolean pt = (kid == (int) G_N_ELEMENTS(persistent_kernels) - 1);
+		CCLKernel* krnl;
+		size_t gws_k[2], groups, waves, lmemA = 0, lmemB = 0, krnl_wg_max;
+		double t_best = -1, t_sum = 0;
+		size_t mismatches = 0;
+
+		krnl = ccl_program_get_kernel(prg, persistent_kernels[kid],
+			&err_internal);
+		if_err_goto(err_internal, error_handler);
+
+		/* Skip kernels which don't fit the local work size. */
+		krnl_wg_max = ccl_kernel_get_workgroup_info_scalar(
+			krnl, dev, CL_KERNEL_WORK_GROUP_SIZE, size_t, &err_internal);
+		if_err_goto(err_internal, error_handler);
+		if (!pt) matmult_lmem_get(kid, a_dim, b_dim, lws_in, &lmemA, &lmemB);
+		if ((wg > krnl_wg_max) || (lmemA + lmemB > dev_lmem)) {
+			g_printf("     %-10s %8s\n", persistent_kernels[kid], "n/a");
+			continue;
+		}
+
+		if (pt) {
+			/* A single wave of work-groups, in one row. */
+			groups = MIN(resident, tiles);
+			gws_k[0] = groups * lws_in[0];
+			gws_k[1] = lws_in[1];
+			ccl_kernel_set_args(krnl, bufs[0], bufs[1], bufs[2],
+				ccl_arg_full((void*) a_dim, sizeof(cl_int2)),
+				ccl_arg_full((void*) b_dim, sizeof(cl_int2)), bufs[3],
+				NULL);
+		} else {
+			matmult_gws_get(a_dim, b_dim, lws_in, gws_k);
+			groups = (gws_k[0] / lws_in[0]) * (gws_k[1] / lws_in[1]);
+			matmult_args_set(kid, krnl, a_dim, b_dim, bufs[0], bufs[1],
+				bufs[2], lmemA, lmemB);
+		}
+		waves = (groups + resident - 1) / resident;
+
+		for (int r = 0; r <= PERSISTENT_REPS; ++r) {
+
+			CCLEvent* evt;
+			double t;
+
+			/* Don't let results of previous runs or kernels hide
+			 * elements which this run skips. */
+			ccl_buffer_enqueue_write(bufs[2], cq, CL_TRUE, 0,
+				numC * sizeof(cl_int), sentinels, NULL, &err_internal);
+			if_err_goto(err_internal, error_handler);
+
+			/* Reset tile counter. */
+			if (pt) {
+				cl_uint zero = 0;
+				ccl_buffer_enqueue_write(bufs[3], cq, CL_TRUE, 0,
+					sizeof(cl_uint), &zero, NULL, &err_internal);
+				if_err_goto(err_internal, error_handler);
+			}
+
+			evt = ccl_kernel_enqueue_ndrange(krnl, cq, 2, NULL, gws_k,
+				lws_in, NULL, &err_internal);
+			if_err_goto(err_internal, error_handler);
+			ccl_queue_finish(cq, &err_internal);
+			if_err_goto(err_internal, error_handler);
+			t = matmult_evt_time(evt, &err_internal);
+			if_err_goto(err_internal, error_handler);
+
+			/* First run is a warm-up. */
+			if (r == 0) continue;
+			t_sum += t;
+			if ((t_best < 0) || (t < t_best)) t_best = t;
+		}
+
+		/* Compare with the host result. */
+		ccl_buffer_enqueue_read(bufs[2], cq, CL_TRUE, 0,
+			numC * sizeof(cl_int), C, NULL, &err_internal);
+		if_err_goto(err_internal, error_handler);
+		for (size_t index = 0; index < numC; index++)
+			if (C[index] != C_ref[index]) mismatches++;
+
+		g_printf("     %-10s %8zu %6zu %8.1f%% %7.1f%% %12.4e %12.4e "
+			"%9.2f %10" G_GUINT64_FORMAT "\n",
+			persistent_kernels[kid], groups, waves,
+			100.0 * (groups - (waves - 1) * resident) / resident,
+			100.0 * numC / (pt ? tiles * wg : gws_k[0] * gws_k[1]),
+			t_best, t_sum / PERSISTENT_REPS, flops / t_best * 1e-9,
+			(guint64) mismatches);
+	}
+	g_printf("\n");
+
+	ok = TRUE;
+	goto cleanup;
+
+error_handler:
+	g_propagate_error(err, err_internal);
+	ok = FALSE;
+
+cleanup:
+	if (C) matmult_matrix_free(C);
+	if (C_ref) matmult_matrix_free(C_ref);
+	g_free(sentinels);
+	for (guint k = 0; k < 4; ++k)
+		if (bufs[k]) ccl_ex_footprint_buffer_destroy(bufs[k]);
+	return ok;
+}
+
+/* Maximum number of mismatches listed when checking on the device. */
+#define MISMATCH_LIST 5
+
+/**
+ * Locate the first mismatches between the device and the CPU results
+ * on the device, by flagging the elements which differ and compacting
+ * their positions and device values, so that only these are read back.
+ *
+ * @param[in] reduce Device reduction primitives.
+ * @param[in] pool Device memory pool.
+ * @param[in] ctx Context wrapper.
+ * @param[in] cq Command queue wrapper.
+ * @param[in] C Device result.
+ * @param[in] C_ref CPU result, on the device.
+ * @param[in] size Number of elements in C, at most `G_MAXINT32`.
+ * @param[out] pos Positions in C of the first mismatches, at least
+ * `MISMATCH_LIST` elements.
+ * @param[out] vals Device values of the first mismatches, at least
+ * `MISMATCH_LIST` elements.
+ * @param[out] n_list Number of mismatches in `pos` and `vals`.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return `TRUE` if the mismatches were located, `FALSE` otherwise.
+ * */
+static gboolean matmult_mismatch_list(CCLExReduce* reduce,
+	CCLExBufPool* pool, CCLContext* ctx, CCLQueue* cq, CCLBuffer* C,
+	CCLBuffer* C_ref, size_t size, cl_int* pos, cl_int* vals,
+	size_t* n_list, GError** err) {
+
+	GError* err_internal = NULL;
+	CCLBuffer* bufs[3] = { NULL, NULL, NULL };
+	size_t n_pos, n_vals;
+	gboolean ok;
+
+	*n_list = 0;
+
+	/* Flags, then positions and values of mismatching elements. */
+	for (guint k = 0; k < 3; ++k) {
+		bufs[k] = ccl_ex_bufpool_get(pool, ctx, CL_MEM_READ_WRITE,
+			size * sizeof(cl_int), &err_internal);
+		if_err_goto(err_internal, error_handler);
+	}
+
+	ccl_ex_reduce_flag_ne_int(reduce, cq, C, C_ref, bufs[0], size,
+		&err_internal);
+	if_err_goto(err_internal, error_handler);
+	ccl_ex_reduce_compact_int(reduce, cq, NULL, bufs[0], bufs[1], size,
+		&n_pos, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	ccl_ex_reduce_compact_int(reduce, cq, C, bufs[0], bufs[2], size,
+		&n_vals, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	g_assert(n_pos == n_vals);
+
+	*n_list = MIN(n_pos, MISMATCH_LIST);
+	if (*n_list > 0) {
+		ccl_buffer_enqueue_read(bufs[1], cq, CL_FALSE, 0,
+			*n_list * sizeof(cl_int), pos, NULL, &err_internal);
+		if_err_goto(err_internal, error_handler);
+		ccl_buffer_enqueue_read(bufs[2], cq, CL_TRUE, 0,
+			*n_list * sizeof(cl_int), vals, NULL, &err_internal);
+		if_err_goto(err_internal, error_handler);
+	}
+
+	ok = TRUE;
+	goto cleanup;
+
+error_handler:
+	g_propagate_error(err, err_internal);
+	*n_list = 0;
+	ok = FALSE;
+
+cleanup:
+	for (guint k = 0; k < 3; ++k)
+		if (bufs[k]) ccl_ex_bufpool_put(pool, bufs[k]);
+	return ok;
+}
+
+/**
+ * Apply the epilogues selected in the command line to matrix C on the
+ * host, one pass over C per epilogue, as they would be applied without
+ * fusing them into the multiplication kernel.
+ *
+ * @param[in] bias Bias per row or per column of C, or `NULL` if no bias
+ * was selected.
+ * @param[in,out] C Result matrix.
+ * @param[in] cols Number of columns in C.
+ * @param[in] rows Number of rows in C.
+ * */
+static void matmult_epilogue_host(const int* bias, int* C, int cols,
+	int rows) {
+
+	size_t size = (size_t) cols * rows;
+
+	if (bias) {
+		gboolean per_row = (g_strcmp0(epi_bias, "row") == 0);
+		/* Unsigned, so that overflow wraps around as on the device. */
+		for (size_t i = 0; i < size; ++i)
+			C[i] = (int) ((guint32) C[i]
+				+ (guint32) bias[per_row ? i / cols : i % cols]);
+	}
+	if (epi_requant_set) {
+		gint64 half = ((gint64) 1 << epi_requant[1]) >> 1;
+		for (size_t i = 0; i < size; ++i)
+			C[i] = (int) (((gint64) C[i] * epi_requant[0] + half)
+				>> epi_requant[1]);
+	}
+	if (epi_relu) {
+		for (size_t i = 0; i < size; ++i)
+			C[i] = MAX(C[i], 0);
+	}
+	if (epi_clamp_set) {
+		for (size_t i = 0; i < size; ++i)
+			C[i] = CLAMP(C[i], epi_clamp[0], epi_clamp[1]);
+	}
+}
+
+/**
+ * Print the global memory traffic saved by fusing the selected
+ * epilogues into the multiplication kernel. Each unfused epilogue
+ * would read and write C once, bias reads aside.
+ *
+ * @param[in] size_a Size of matrix A in bytes.
+ * @param[in] size_b Size of matrix B in bytes (0 for C=AA^T).
+ * @param[in] size_c Size of matrix C in bytes.
+ * @param[in] t_dev Device time of one multiplication, in seconds.
+ * */
+static void matmult_epilogue_print(size_t size_a, size_t size_b,
+	size_t size_c, double t_dev) {
+
+	double saved = 2.0 * size_c * epi_passes;
+	double fused = (double) size_a + size_b + size_c;
+
+	g_printf("     Fused epilogues             : %u (%s%s%s%s)\n",
+		epi_passes, epi_bias ? " bias" : "",
+		epi_requant_set ? " requant" : "", epi_relu ? " relu" : "",
+		epi_clamp_set ? " clamp" : "");
+	g_printf("     Global traffic saved        : %.2f MiB (%.1f%% of " \
+		"unfused)\n", saved / (1024 * 1024), 100 * saved / (fused + saved));
+	if (t_dev > 0)
+		g_printf("     Time saved (estimated)      : %es\n",
+			t_dev * saved / fused);
+}
+
+/**
+ * Build the command line of a thread scaling study worker, with the
+ * same matrices as this process.
+ *
+ * @param[in] exec_name Name of this executable.
+ * @return Worker command line, to be freed with g_strfreev().
+ * */
+static gchar** matmult_scaling_argv(const char* exec_name) {
+
+	GPtrArray* args = g_ptr_array_new();
+
+	g_ptr_array_add(args, g_strdup(exec_name));
+	g_ptr_array_add(args, g_strdup("--scaling-worker"));
+	g_ptr_array_add(args, g_strdup_printf("--kernel=%d", kernel_id));
+	g_ptr_array_add(args, g_strdup_printf("--asize=%d,%d",
+		a_dim[0], a_dim[1]));
+	g_ptr_array_add(args, g_strdup_printf("--bsize=%d,%d",
+		b_dim[0], b_dim[1]));
+	g_ptr_array_add(args, g_strdup_printf("--range=%d,%d",
+		matrix_range[0], matrix_range[1]));
+	g_ptr_array_add(args, g_strdup_printf("--seed=%u", seed));
+	g_ptr_array_add(args, g_strdup_printf("--scaling-reps=%d",
+		scaling_reps));
+	g_ptr_array_add(args, NULL);
+
+	return (gchar**) g_ptr_array_free(args, FALSE);
+}
 
 /**
  * OpenCL and OpenMP matrix multiplication main function.
@@ -190,6 +1569,9 @@ int main(int argc, char *argv[]) {
 	char* dev_vendor;
 	/* Context wrapper. */
 	CCLContext* ctx = NULL;
+	/* Device requirements. */
+	CCLExDevReqs dev_reqs = { FALSE, FALSE, 0, CCL_EX_WORKLOAD_COMPUTE,
+		NULL };
 	/* Device wrapper. */
 	CCLDevice* dev = NULL;
 	/* Program wrapper. */
@@ -200,8 +1582,8 @@ int main(int argc, char *argv[]) {
 	CCLKernel* krnl = NULL;
 	/* Kernel name */
 	gchar* kernel_name = NULL;
-	/* Full kernel path. */
-	gchar* kernel_path = NULL;
+	/* Full paths of kernel files. */
+	gchar* kernel_paths[G_N_ELEMENTS(kernel_files)] = { NULL };
 	/* Host matrix A */
 	cl_int* matrixA_host = NULL;
 	/* Host matrix B */
@@ -231,6 +1613,50 @@ int main(int argc, char *argv[]) {
 	size_t l_mem_sizeA_in_bytes;
 	/* Size of local memory required by matrix B (depends on kernel id). */
 	size_t l_mem_sizeB_in_bytes;
+	/* OpenCL compiler options. */
+	gchar* build_opts = NULL;
+	/* Device memory pool. */
+	CCLExBufPool* pool = NULL;
+	/* Auto-tuner. */
+	CCLExTuner* tuner = NULL;
+	/* Device input generator. */
+	CCLExFill* fill = NULL;
+	/* Device reduction primitives. */
+	CCLExReduce* reduce = NULL;
+	/* Device copy of the CPU result, for checking on the device. */
+	CCLBuffer* matrixC_ref_dev = NULL;
+	/* Number of mismatches and first mismatch, if checked on device. */
+	cl_ulong mismatches = 0, first_mismatch = 0;
+	/* Positions and device values of the first mismatches, if checked
+	 * on device. */
+	cl_int mismatch_pos[MISMATCH_LIST], mismatch_vals[MISMATCH_LIST];
+	size_t n_mismatch_list = 0;
+	/* Sum, minimum and maximum of C, on the device and on the host, if
+	 * checked on device. */
+	cl_long stats_dev[3] = { 0, 0, 0 }, stats_cpu[3] = { 0, 0, 0 };
+	/* In-kernel instrumentation. */
+	CCLExInstr* instr = NULL;
+	/* Host/device dispatcher. */
+	MatmultDispatch* md = NULL;
+	/* Hardware counters of the host multiplication. */
+	CCLExPerfCtr* pc = NULL;
+	/* Matrix chain or power, if requested. */
+	MatmultChain* mc = NULL;
+	/* Host bias of the epilogue, if requested. */
+	cl_int* bias_host = NULL;
+	/* Flags of device input matrices, which the fill kernel writes if
+	 * they are generated on the device, and of the result, which the
+	 * comparison kernel reads if it is checked on the device. */
+	cl_mem_flags in_flags, out_flags;
+	/* Mapped file for matrix C, if it is saved. */
+	MatmultMFile* mfile_c = NULL;
+	/* Device matrices A and B backed by their files, if loaded. */
+	CCLBuffer* fileA_dev = NULL;
+	CCLBuffer* fileB_dev = NULL;
+	/* Command line of thread scaling study workers. */
+	gchar** worker_argv = NULL;
+	/* Predicted host and device times, if dispatching. */
+	double t_host_pred = 0, t_dev_pred = 0;
 
 	/* ************************** */
 	/* Parse command line options */
@@ -238,6 +1664,8 @@ int main(int argc, char *argv[]) {
 
 	matmult_args_parse(argc, argv, &err);
 	if_err_goto(err, error_handler);
+	in_flags = gen_dev ? CL_MEM_READ_WRITE : CL_MEM_READ_ONLY;
+	out_flags = check_dev ? CL_MEM_READ_WRITE : CL_MEM_WRITE_ONLY;
 
 	/* If version was requested, output version and exit. */
 	if (version) {
@@ -254,10 +1682,54 @@ int main(int argc, char *argv[]) {
 		exit(0);
 	}
 
+	/* Open hardware counters before OpenMP threads are created, so
+	 * that they inherit them. */
+	if (counters) pc = ccl_ex_perfctr_new(TRUE);
+
+	/* Thread scaling study of the host multiplication, which does not
+	 * require a device. */
+	if (scaling) {
+		g_printf("\n   == Thread scaling study: C=%s, A=%dx%d, B=%dx%d\n",
+			IS_AAT(kernel_id) ? "AA^T" : "AB", a_dim[0], a_dim[1],
+			b_dim[0], b_dim[1]);
+		worker_argv = matmult_scaling_argv(argv[0]);
+		matmult_scaling_run(worker_argv, &err);
+		if_err_goto(err, error_handler);
+		g_printf("\n");
+		status = CCL_EX_SUCCESS;
+		goto cleanup;
+	}
+	if (scaling_worker) {
+		rng = g_rand_new_with_seed(seed);
+		matrixA_host = matmult_matrix_new(
+			a_dim[0], a_dim[1], matrix_range, rng);
+		if (!IS_AAT(kernel_id))
+			matrixB_host = matmult_matrix_new(
+				b_dim[0], b_dim[1], matrix_range, rng);
+		matmult_scaling_worker(a_dim, b_dim, IS_AAT(kernel_id),
+			matrixA_host, matrixB_host, scaling_reps, stdout);
+		status = CCL_EX_SUCCESS;
+		goto cleanup;
+	}
+
+	/* Plan matrix chain or power, which determines matrix sizes. */
+	if (chain_shapes)
+		mc = matmult_chain_new(chain_shapes, &err);
+	else if (power)
+		mc = matmult_chain_new_power(a_dim[0], power, &err);
+	if_err_goto(err, error_handler);
+
 	/* ******************************************************* */
 	/* Initialize profiler, OpenCL variables and build program */
 	/* ******************************************************* */
 
+	/* Report memory footprint at exit, for this problem size. */
+	ccl_ex_footprint_report_at_exit(argv[0], stdout);
+	ccl_ex_footprint_param("a_cols", a_dim[0]);
+	ccl_ex_footprint_param("a_rows", a_dim[1]);
+	ccl_ex_footprint_param("b_cols", b_dim[0]);
+	ccl_ex_footprint_param("b_rows", b_dim[1]);
+
 	/* Initialize RNG. */
 	rng = g_rand_new_with_seed(seed);
 
@@ -265,10 +1737,13 @@ int main(int argc, char *argv[]) {
 	prof_dev = ccl_prof_new();
 	prof_cpu = ccl_prof_new();
 
+	/* Image operands require image support. */
+	dev_reqs.images = img_a || img_b;
+
 	/* Create the context wrapper. */
-	if ((dev_idx != -1) || (name == NULL)) {
-		/* Select device by index or user choice. */
-		ctx = ccl_context_new_from_menu_full(&dev_idx, &err);
+	if ((device != NULL) || (name == NULL)) {
+		/* Select device by index, selector or user choice. */
+		ctx = ccl_ex_context_new(device, &dev_reqs, &err);
 	} else {
 		/* Select device by device name, platform name or vendor name. */
 		ctx = ccl_context_new_from_indep_filter(ccl_devsel_indep_string, name, &err);
@@ -287,15 +1762,58 @@ int main(int argc, char *argv[]) {
 
 	g_printf("\n   == Using device '%s' from '%s'\n", dev_name, dev_vendor);
 
-	/* Get location of kernel file, which should be in the same location
+	/* Get location of kernel files, which should be in the same location
 	 * of the matmult executable. */
-	kernel_path = ccl_ex_kernelpath_get(kernel_files[0], argv[0]);
+	for (guint i = 0; i < G_N_ELEMENTS(kernel_files); ++i)
+		kernel_paths[i] = ccl_ex_kernelpath_get(kernel_files[i], argv[0]);
+
+	/* Determine size of matrices in bytes. */
+	size_matA_in_bytes = (size_t) a_dim[0] * a_dim[1] * sizeof(cl_int);
+	if (!IS_AAT(kernel_id))
+		/* Only required if we're not multiplying the transpose. */
+		size_matB_in_bytes = (size_t) b_dim[0] * b_dim[1] * sizeof(cl_int);
+	size_matC_in_bytes = (size_t) b_dim[0] * a_dim[1] * sizeof(cl_int);
 
-	/* Create and build program. */
-	prg = ccl_program_new_from_source_file(ctx, kernel_path, &err);
+	/* Create and build program, with 64-bit indexes if required by the
+	 * largest matrix. */
+	prg = ccl_program_new_from_source_files(ctx,
+		G_N_ELEMENTS(kernel_paths), (const char**) kernel_paths, &err);
 	if_err_goto(err, error_handler);
 
-	ccl_program_build(prg, compiler_opts, &err);
+	build_opts = ccl_ex_compiler_opts_get(compiler_opts, MAX(MAX(
+		MAX(size_matA_in_bytes, size_matB_in_bytes), size_matC_in_bytes),
+		mc ? matmult_chain_max_bytes(mc) : 0));
+	if (img_a || img_b) {
+		/* Build the image variant of kernel 0. */
+		gchar* opts = g_strconcat(build_opts, img_a ? " -D IMG_A" : "",
+			img_b ? " -D IMG_B" : "", NULL);
+		g_free(build_opts);
+		build_opts = opts;
+	}
+	if (epi_passes > 0) {
+		/* Fuse the selected epilogues into the kernels. */
+		GString* opts = g_string_new(build_opts);
+		if (epi_bias)
+			g_string_append_printf(opts, " -D EPI_BIAS_%s",
+				(g_strcmp0(epi_bias, "row") == 0) ? "ROW" : "COL");
+		if (epi_requant_set)
+			g_string_append_printf(opts, " -D EPI_SCALE=%d -D EPI_SHIFT=%d",
+				epi_requant[0], epi_requant[1]);
+		if (epi_relu)
+			g_string_append(opts, " -D EPI_RELU");
+		if (epi_clamp_set)
+			g_string_append_printf(opts, " -D EPI_MIN=%d -D EPI_MAX=%d",
+				epi_clamp[0], epi_clamp[1]);
+		g_free(build_opts);
+		build_opts = g_string_free(opts, FALSE);
+	}
+	if (instr_file) {
+		/* Build instrumented kernels. */
+		gchar* opts = g_strconcat(build_opts, CCL_EX_INSTR_BUILD_OPT, NULL);
+		g_free(build_opts);
+		build_opts = opts;
+	}
+	ccl_program_build(prg, build_opts, &err);
 	if_err_goto(err, error_handler);
 
 	/* Determine kernel name. */
@@ -309,67 +1827,152 @@ int main(int argc, char *argv[]) {
 	cq = ccl_queue_new(ctx, dev, CL_QUEUE_PROFILING_ENABLE, &err);
 	if_err_goto(err, error_handler);
 
+	/* Instrumented kernels take the instrumentation buffer as their
+	 * last argument. */
+	if (instr_file) {
+		instr = ccl_ex_instr_new(ctx, kernel_name, instr_counters);
+		ccl_ex_instr_prepare(instr, krnl, cq, 0, NULL, NULL, &err);
+		if_err_goto(err, error_handler);
+	}
+
+	/* Multiply matrix chain or power instead of A and B. */
+	if (mc) {
+		matmult_chain_exec(mc, ctx, dev, krnl, rng, &err);
+		if_err_goto(err, error_handler);
+		status = CCL_EX_SUCCESS;
+		goto cleanup;
+	}
+
 	/* ********************************** */
 	/* Create and initialize host buffers */
 	/* ********************************** */
 
-	/* Matrix A */
-	size_matA_in_bytes = a_dim[0] * a_dim[1] * sizeof(cl_int);
-	matrixA_host = matmult_matrix_new(
-		a_dim[0], a_dim[1], matrix_range, rng);
+	if (gen_dev) {
 
-	/* Matrix B */
-	if (!IS_AAT(kernel_id)) {
-		/* Only required if we're not multiplying the transpose. */
-		size_matB_in_bytes = b_dim[0] * b_dim[1] * sizeof(cl_int);
-		matrixB_host = matmult_matrix_new(
-			b_dim[0], b_dim[1], matrix_range, rng);
-	}
+		/* Input matrices are generated on the device, host copies have
+		 * the same values and are only used for verification. */
+		fill = ccl_ex_fill_new(ctx, argv[0], &err);
+		if_err_goto(err, error_handler);
 
-	/* Matrix C (result) */
-	size_matC_in_bytes = b_dim[0] * a_dim[1] * sizeof(cl_int);
-	matrixC_host = matmult_matrix_new(b_dim[0], a_dim[1], NULL, NULL);
+		/* Matrix A */
+		matrixA_host = matmult_matrix_new(a_dim[0], a_dim[1], NULL, NULL);
+		ccl_ex_fill_int_host(matrixA_host, (size_t) a_dim[0] * a_dim[1],
+			seed, matrix_range[0], matrix_range[1]);
 
-	/* ********************* */
-	/* Create device buffers */
-	/* ********************* */
+		/* Matrix B */
+		if (!IS_AAT(kernel_id)) {
+			/* Only required if we're not multiplying the transpose. */
+			matrixB_host = matmult_matrix_new(
+				b_dim[0], b_dim[1], NULL, NULL);
+			ccl_ex_fill_int_host(matrixB_host,
+				(size_t) b_dim[0] * b_dim[1], seed + 1,
+				matrix_range[0], matrix_range[1]);
+		}
 
-	/* Matrix A */
-	matrixA_dev = ccl_buffer_new(ctx, CL_MEM_READ_ONLY,
-		size_matA_in_bytes, NULL, &err);
-	if_err_goto(err, error_handler);
+	} else {
 
-	/* Matrix B */
-	if (!IS_AAT(kernel_id)) {
-		/* Only required if we're not multiplying the transpose. */
-		matrixB_dev = ccl_buffer_new(ctx, CL_MEM_READ_ONLY,
-			size_matB_in_bytes, NULL, &err);
+		/* Matrix A, from its file if given. */
+		if (mfile_a) {
+			matrixA_host = matmult_mfile_data(mfile_a);
+		} else {
+			matrixA_host = matmult_matrix_new(
+				a_dim[0], a_dim[1], matrix_range, rng);
+		}
+
+		/* Matrix B */
+		if (mfile_b) {
+			matrixB_host = matmult_mfile_data(mfile_b);
+		} else if (!IS_AAT(kernel_id)) {
+			/* Only required if we're not multiplying the transpose. */
+			matrixB_host = matmult_matrix_new(
+				b_dim[0], b_dim[1], matrix_range, rng);
+		}
+	}
+
+	/* Matrix C (result), read from the device directly into its file
+	 * if it is saved. */
+	if (save_c) {
+		mfile_c = matmult_mfile_create(save_c, b_dim[0], a_dim[1], &err);
+		if_err_goto(err, error_handler);
+		matrixC_host = matmult_mfile_data(mfile_c);
+	} else {
+		matrixC_host = matmult_matrix_new(b_dim[0], a_dim[1], NULL, NULL);
+	}
+
+	/* Epilogue bias, one value per row or per column of C. */
+	if (epi_bias) {
+		int len = (g_strcmp0(epi_bias, "row") == 0) ? a_dim[1] : b_dim[0];
+		bias_host = matmult_matrix_new(len, 1, matrix_range, rng);
+		epi_bias_dev = ccl_ex_footprint_buffer_new(ctx,
+			CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+			(size_t) len * sizeof(cl_int), bias_host, &err);
 		if_err_goto(err, error_handler);
 	}
 
-	/* Matrix C */
-	matrixC_dev = ccl_buffer_new(ctx, CL_MEM_WRITE_ONLY,
-			size_matC_in_bytes, NULL, &err);
-	if_err_goto(err, error_handler);
+	/* Create device memory pool. If the pool is not used, buffers are
+	 * destroyed as soon as they are returned to the pool. */
+	pool = ccl_ex_bufpool_new(use_pool ? 0 : 1);
 
-	/* ************************* */
-	/* Initialize device buffers */
-	/* ************************* */
+	/* ************************** */
+	/*  Auto-tune local work size */
+	/* ************************** */
 
-	/* Start basic timming / profiling. */
-	ccl_prof_start(prof_dev);
+	if ((tune || retune) && (lws[0] == 0)) {
 
-	/* Copy matrix A to device. */
-	ccl_buffer_enqueue_write(matrixA_dev, cq, CL_TRUE, 0, size_matA_in_bytes,
-		matrixA_host, NULL, &err);
-	if_err_goto(err, error_handler);
+		struct matmult_tune_data td = { krnl, NULL, NULL, NULL, NULL, 0, 0 };
+		size_t* wi_max;
+		int best[2];
 
-	/* Copy matrix B to device. */
-	if (!IS_AAT(kernel_id)) {
-		/* Only required if we're not multiplying the transpose. */
-		ccl_buffer_enqueue_write(matrixB_dev, cq, CL_TRUE, 0,
-			size_matB_in_bytes, matrixB_host, NULL, &err);
+		/* Use a separate queue, so that tuning runs are not profiled. */
+		td.cq = ccl_queue_new(ctx, dev, CL_QUEUE_PROFILING_ENABLE, &err);
+		if_err_goto(err, error_handler);
+
+		td.krnl_wg_max = ccl_kernel_get_workgroup_info_scalar(
+			krnl, dev, CL_KERNEL_WORK_GROUP_SIZE, size_t, &err);
 		if_err_goto(err, error_handler);
+		td.dev_lmem = ccl_device_get_info_scalar(
+			dev, CL_DEVICE_LOCAL_MEM_SIZE, cl_ulong, &err);
+		if_err_goto(err, error_handler);
+		wi_max = ccl_device_get_info_array(
+			dev, CL_DEVICE_MAX_WORK_ITEM_SIZES, size_t, &err);
+		if_err_goto(err, error_handler);
+
+		/* Device buffers with the input matrices. */
+		td.matrixA_dev = ccl_ex_bufpool_get(pool, ctx, in_flags,
+			size_matA_in_bytes, &err);
+		if_err_goto(err, error_handler);
+		if (!IS_AAT(kernel_id)) {
+			td.matrixB_dev = ccl_ex_bufpool_get(pool, ctx,
+				in_flags, size_matB_in_bytes, &err);
+			if_err_goto(err, error_handler);
+		}
+		matmult_inputs_init(fill, td.cq, td.matrixA_dev, td.matrixB_dev,
+			matrixA_host, matrixB_host, &err);
+		if_err_goto(err, error_handler);
+		td.matrixC_dev = ccl_ex_bufpool_get(pool, ctx, out_flags,
+			size_matC_in_bytes, &err);
+		if_err_goto(err, error_handler);
+
+		/* Search local work sizes which are powers of two. */
+		tuner = ccl_ex_tuner_new(dev, kernel_name,
+			(size_t) a_dim[1] * b_dim[0] * a_dim[0], &err);
+		if_err_goto(err, error_handler);
+		ccl_ex_tuner_add_param_pow2(tuner, "lws0", 1,
+			(int) MIN(wi_max[0], td.krnl_wg_max));
+		ccl_ex_tuner_add_param_pow2(tuner, "lws1", 1,
+			(int) MIN(wi_max[1], td.krnl_wg_max));
+		ccl_ex_tuner_run(tuner, matmult_tune_timer, &td, retune, best,
+			&err);
+
+		/* Release tuning resources before checking for errors. */
+		ccl_ex_bufpool_put(pool, td.matrixA_dev);
+		if (td.matrixB_dev) ccl_ex_bufpool_put(pool, td.matrixB_dev);
+		ccl_ex_bufpool_put(pool, td.matrixC_dev);
+		ccl_queue_destroy(td.cq);
+		if_err_goto(err, error_handler);
+
+		lws[0] = best[0];
+		lws[1] = best[1];
 	}
 
 	/* ******************** */
@@ -383,10 +1986,9 @@ int main(int argc, char *argv[]) {
 		ccl_kernel_suggest_worksizes(krnl, dev, 2, real_ws, gws, lws, &err);
 		if_err_goto(err, error_handler);
 	} else {
-		/* If user specify local worksize, adjust global worksize
-		 * accordingly. */
-		gws[0] = lws[0]* ceil(((float) b_dim[0]) / lws[0]);
-		gws[1] = lws[1] * ceil(((float) a_dim[1]) / lws[1]);
+		/* If user specify (or auto-tuner found) local worksize, adjust
+		 * global worksize accordingly. */
+		matmult_gws_get(a_dim, b_dim, lws, gws);
 	}
 
 	/* ************************* */
@@ -397,84 +1999,235 @@ int main(int argc, char *argv[]) {
 	g_mem_size_in_bytes =
 		size_matA_in_bytes + size_matB_in_bytes + size_matC_in_bytes;
 
-	/* Local memory requirements. Default is 0 for non-optimized kernels 0 and 3. */
-	l_mem_sizeA_in_bytes = 0;
-	l_mem_sizeB_in_bytes = 0;
-	if (kernel_id >= 1)
-		/* Optimized matrix mult. 1*/
-		l_mem_sizeA_in_bytes = a_dim[0] * lws[1] * sizeof(cl_int);
-	if (kernel_id == 2)
-		/* Optimized matrix mult. 2*/
-		l_mem_sizeB_in_bytes = lws[0] * b_dim[1] * sizeof(cl_int);
-	if (kernel_id == 4) {
-		/* Optimized matrix transpose mult. */
-		l_mem_sizeA_in_bytes = lws[1] * a_dim[0] * sizeof(cl_int);
-		l_mem_sizeB_in_bytes = lws[0] * a_dim[0] * sizeof(cl_int);
-	}
+	/* Local memory requirements. */
+	matmult_lmem_get(kernel_id, a_dim, b_dim, lws,
+		&l_mem_sizeA_in_bytes, &l_mem_sizeB_in_bytes);
 
 	/* ****************************** */
 	/* Print requirements information */
 	/* ****************************** */
 
-	ccl_ex_reqs_print(gws, lws, g_mem_size_in_bytes,
-		l_mem_sizeA_in_bytes + l_mem_sizeB_in_bytes);
+	ccl_ex_reqs_analyze(krnl, dev, 2, gws, lws, g_mem_size_in_bytes,
+		l_mem_sizeA_in_bytes + l_mem_sizeB_in_bytes, &err);
+	if_err_goto(err, error_handler);
 
-	/* *************************** */
-	/*  Set fixed kernel arguments */
-	/* *************************** */
+	/* ************************************ */
+	/*  Compare persistent-threads kernel   */
+	/* ************************************ */
 
-	if (!IS_AAT(kernel_id)) {
+	if (persistent) {
+		matmult_persistent_compare(ctx, dev, prg, cq, lws, matrixA_host,
+			matrixB_host, &err);
+		if_err_goto(err, error_handler);
+		status = CCL_EX_SUCCESS;
+		goto cleanup;
+	}
 
-		/* Arguments for C=AB */
-		if (kernel_id == 0) {
-			ccl_kernel_set_args(krnl, matrixA_dev, matrixB_dev,
-				matrixC_dev, ccl_arg_priv(a_dim, cl_int2),
-				ccl_arg_priv(b_dim, cl_int2), NULL);
-		} else if (kernel_id == 1) {
-			ccl_kernel_set_args(krnl, matrixA_dev, matrixB_dev,
-				matrixC_dev, ccl_arg_priv(a_dim, cl_int2),
-				ccl_arg_priv(b_dim, cl_int2),
-				ccl_arg_full(NULL, l_mem_sizeA_in_bytes), NULL);
-		} else if (kernel_id == 2) {
-			ccl_kernel_set_args(krnl, matrixA_dev, matrixB_dev,
-				matrixC_dev, ccl_arg_priv(a_dim, cl_int2),
-				ccl_arg_priv(b_dim, cl_int2),
-				ccl_arg_full(NULL, l_mem_sizeA_in_bytes),
-				ccl_arg_full(NULL, l_mem_sizeB_in_bytes), NULL);
-		}
+	/* ************************************ */
+	/*  Compare image and buffer operands   */
+	/* ************************************ */
 
-	} else {
+	if (img_a || img_b) {
+		matmult_image_compare(ctx, dev, prg, krnl, cq, gws, lws,
+			matrixA_host, matrixB_host, &err);
+		if_err_goto(err, error_handler);
+		status = CCL_EX_SUCCESS;
+		goto cleanup;
+	}
 
-		/* Arguments only for C=AA^T */
-		if (kernel_id < 4) {
-			ccl_kernel_set_args(krnl, matrixA_dev, matrixC_dev,
-				ccl_arg_priv(a_dim, cl_int2), NULL);
-		} else if (kernel_id == 4) {
-			ccl_kernel_set_args(krnl, matrixA_dev, matrixC_dev,
-				ccl_arg_priv(a_dim, cl_int2),
-				ccl_arg_full(NULL, l_mem_sizeA_in_bytes),
-				ccl_arg_full(NULL, l_mem_sizeB_in_bytes), NULL);
+	/* ******************************** */
+	/*  Dispatch between host and device */
+	/* ******************************** */
+
+	if (dispatch || recalibrate) {
+
+		struct matmult_dispatch_data dd =
+			{ ctx, krnl, NULL, lws, 0, 0, rng };
+		double ops = (double) a_dim[1] * b_dim[0] * a_dim[0];
+		double bytes = 0;
+
+		/* Use a separate queue, so that calibration runs are not
+		 * profiled. */
+		dd.cq = ccl_queue_new(ctx, dev, CL_QUEUE_PROFILING_ENABLE, &err);
+		if_err_goto(err, error_handler);
+		dd.krnl_wg_max = ccl_kernel_get_workgroup_info_scalar(
+			krnl, dev, CL_KERNEL_WORK_GROUP_SIZE, size_t, &err);
+		if_err_goto(err, error_handler);
+		dd.dev_lmem = ccl_device_get_info_scalar(
+			dev, CL_DEVICE_LOCAL_MEM_SIZE, cl_ulong, &err);
+		if_err_goto(err, error_handler);
+
+		md = matmult_dispatch_new(dev, kernel_name, lws, &err);
+		if_err_goto(err, error_handler);
+		matmult_dispatch_calibrate(md, matmult_calib_timer, &dd,
+			recalibrate, &err);
+		ccl_queue_destroy(dd.cq);
+		if_err_goto(err, error_handler);
+
+		/* Inputs generated on the device and results checked there
+		 * aren't transferred. */
+		if (!gen_dev) bytes += size_matA_in_bytes + size_matB_in_bytes;
+		if (!check_dev) bytes += size_matC_in_bytes;
+		matmult_dispatch_predict(md, ops, bytes, &t_host_pred,
+			&t_dev_pred);
+
+		matmult_dispatch_print(md, stdout);
+		g_printf("      Predicted host time   : %es\n", t_host_pred);
+		g_printf("      Predicted device time : %es\n", t_dev_pred);
+		g_printf("      Decision              : %s\n",
+			t_host_pred < t_dev_pred ? "host" : "device");
+
+		/* If the host finishes first, multiply there and skip the
+		 * device. */
+		if (t_host_pred < t_dev_pred) {
+
+			matrixC_test = matmult_matrix_new(
+				b_dim[0], a_dim[1], NULL, NULL);
+			ccl_prof_start(prof_cpu);
+			if (pc) ccl_ex_perfctr_start(pc, "host multiply");
+			for (int run = 0; run < runs; run++)
+				matmult_host(a_dim, b_dim, IS_AAT(kernel_id), FALSE,
+					matrixA_host, matrixB_host, matrixC_test);
+			if (pc) ccl_ex_perfctr_stop(pc, "host multiply");
+			ccl_prof_stop(prof_cpu);
+
+			g_printf("\n   ============================== Results ==================================\n\n");
+			g_printf("     Host time (predicted)       : %es\n",
+				t_host_pred);
+			g_printf("     Host time (actual)          : %es\n",
+				ccl_prof_time_elapsed(prof_cpu) / runs);
+			/* The device isn't used, so only a few elements of the
+			 * host result are checked, independently of OpenMP. */
+			g_printf("     Spot check (%2d elements)    : %u mismatches\n",
+				SPOT_CHECK, matmult_host_spot_check(a_dim, b_dim,
+					IS_AAT(kernel_id), matrixA_host, matrixB_host,
+					matrixC_test, SPOT_CHECK));
+			g_printf("     Device check                : not run, "
+				"host result only\n");
+			if (pc) ccl_ex_perfctr_summary_print(pc, stdout);
+			g_printf("\n");
+
+			g_assert(err == NULL);
+			status = CCL_EX_SUCCESS;
+			goto cleanup;
 		}
 	}
 
-	/* ************ */
-	/*  Run kernel! */
-	/* ************ */
+	/* Start basic timming / profiling. */
+	ccl_prof_start(prof_dev);
 
-	ccl_kernel_enqueue_ndrange(krnl, cq, 2, NULL, gws, lws, NULL, &err);
-	if_err_goto(err, error_handler);
+	/* Device buffers of matrices loaded from files are created once,
+	 * backed by the file mappings if alignment permits. */
+	if (mfile_a) {
+		gboolean mapped;
+		fileA_dev = matmult_mfile_buffer_new(mfile_a, ctx, dev, &mapped,
+			&err);
+		if_err_goto(err, error_handler);
+		g_printf("     Matrix A file is %s the device buffer.\n",
+			mapped ? "used as" : "copied to");
+	}
+	if (mfile_b) {
+		gboolean mapped;
+		fileB_dev = matmult_mfile_buffer_new(mfile_b, ctx, dev, &mapped,
+			&err);
+		if_err_goto(err, error_handler);
+		g_printf("     Matrix B file is %s the device buffer.\n",
+			mapped ? "used as" : "copied to");
+	}
 
-	/* *********************** */
-	/*  Get result from device */
-	/* *********************** */
+	for (int run = 0; run < runs; run++) {
 
-	ccl_buffer_enqueue_read(matrixC_dev, cq, CL_TRUE, 0, size_matC_in_bytes,
-		matrixC_host, NULL, &err);
-	if_err_goto(err, error_handler);
+		/* ********************* */
+		/* Create device buffers */
+		/* ********************* */
 
-	/* Finish execution. */
-	ccl_queue_finish(cq, &err);
-	if_err_goto(err, error_handler);
+		/* Matrix A */
+		if (fileA_dev) {
+			matrixA_dev = fileA_dev;
+		} else {
+			matrixA_dev = ccl_ex_bufpool_get(pool, ctx, in_flags,
+				size_matA_in_bytes, &err);
+			if_err_goto(err, error_handler);
+		}
+
+		/* Matrix B */
+		if (fileB_dev) {
+			matrixB_dev = fileB_dev;
+		} else if (!IS_AAT(kernel_id)) {
+			/* Only required if we're not multiplying the transpose. */
+			matrixB_dev = ccl_ex_bufpool_get(pool, ctx, in_flags,
+				size_matB_in_bytes, &err);
+			if_err_goto(err, error_handler);
+		}
+
+		/* Matrix C */
+		matrixC_dev = ccl_ex_bufpool_get(pool, ctx, out_flags,
+			size_matC_in_bytes, &err);
+		if_err_goto(err, error_handler);
+
+		/* ************************* */
+		/* Initialize device buffers */
+		/* ************************* */
+
+		/* Copy matrices A and B to device, or generate them there.
+		 * File-backed buffers are already initialized. */
+		matmult_inputs_init(fill, cq, matrixA_dev, matrixB_dev,
+			fileA_dev ? NULL : matrixA_host,
+			fileB_dev ? NULL : matrixB_host, &err);
+		if_err_goto(err, error_handler);
+
+		/* *************************** */
+		/*  Set fixed kernel arguments */
+		/* *************************** */
+
+		matmult_args_set(kernel_id, krnl, a_dim, b_dim, matrixA_dev,
+			matrixB_dev, matrixC_dev, l_mem_sizeA_in_bytes,
+			l_mem_sizeB_in_bytes);
+
+		/* Only keep work-group records of this run. */
+		if (instr) {
+			ccl_ex_instr_prepare(instr, krnl, cq, 2, gws, lws, &err);
+			if_err_goto(err, error_handler);
+		}
+
+		/* ************ */
+		/*  Run kernel! */
+		/* ************ */
+
+		ccl_kernel_enqueue_ndrange(krnl, cq, 2, NULL, gws, lws, NULL, &err);
+		if_err_goto(err, error_handler);
+
+		/* *********************** */
+		/*  Get result from device */
+		/* *********************** */
+
+		/* Not required if result is checked on the device. */
+		if (!check_dev) {
+			ccl_buffer_enqueue_read(matrixC_dev, cq, CL_TRUE, 0,
+				size_matC_in_bytes, matrixC_host, NULL, &err);
+			if_err_goto(err, error_handler);
+		}
+
+		/* Finish execution. */
+		ccl_queue_finish(cq, &err);
+		if_err_goto(err, error_handler);
+
+		/* ******************************* */
+		/*  Return device buffers to pool  */
+		/* ******************************* */
+
+		if (matrixA_dev != fileA_dev) ccl_ex_bufpool_put(pool, matrixA_dev);
+		if (matrixB_dev && (matrixB_dev != fileB_dev))
+			ccl_ex_bufpool_put(pool, matrixB_dev);
+		matrixA_dev = matrixB_dev = NULL;
+
+		/* Keep result of last run if it's checked on the device. */
+		if (!check_dev || (run < runs - 1)) {
+			ccl_ex_bufpool_put(pool, matrixC_dev);
+			matrixC_dev = NULL;
+		}
+
+	}
 
 	/* ************************************** */
 	/*  Manage profiling of OpenCL operations */
@@ -499,6 +2252,16 @@ int main(int argc, char *argv[]) {
 		if_err_goto(err, error_handler);
 	}
 
+	/* Summarize and save work-group records of the last run. */
+	if (instr) {
+		ccl_ex_instr_read(instr, cq, &err);
+		if_err_goto(err, error_handler);
+		ccl_ex_instr_summary_print(instr, stdout);
+		ccl_ex_instr_save(instr, instr_file, &err);
+		if_err_goto(err, error_handler);
+		g_printf("\n     Work-group records saved to '%s'\n", instr_file);
+	}
+
 	/* ********************************************************* */
 	/* Perform multiplication on the CPU with the help of OpenMP */
 	/* ********************************************************* */
@@ -508,57 +2271,84 @@ int main(int argc, char *argv[]) {
 
 	/* Start basic timming / profiling. */
 	ccl_prof_start(prof_cpu);
+	if (pc) ccl_ex_perfctr_start(pc, "host multiply");
+
+	matmult_host(a_dim, b_dim, IS_AAT(kernel_id), FALSE,
+		matrixA_host, matrixB_host, matrixC_test);
 
-	if (!IS_AAT(kernel_id)) {
-		/* C=AB */
-		/* The pragma below makes the loop parallel with
-		 * threads = number of cores */
-#ifdef USE_OPENMP
-		#pragma omp parallel for
-#endif
-		for (int col = 0; col < b_dim[0]; col++) {
-			for (int row = 0; row < a_dim[1]; row++) {
-				matrixC_test[row * b_dim[0] + col] = 0;
-				for (int i = 0; i < a_dim[0]; i++) {
-					matrixC_test[row * b_dim[0] + col] +=
-						matrixA_host[row * a_dim[0] + i]
-						*
-						matrixB_host[i * b_dim[0] + col];
-				}
-			}
-		}
-	} else {
-		/* C=AA^T */
-		/* The pragma below makes the loop parallel with threads = number of cores */
-#ifdef USE_OPENMP
-		#pragma omp parallel for
-#endif
-		for (int row = 0; row < a_dim[1]; row++) {
-			for (int col = 0; col < a_dim[1]; col++) {
-				matrixC_test[row * a_dim[1] + col] = 0;
-				for (int i = 0; i < a_dim[0]; i++) {
-					matrixC_test[row * a_dim[1] + col] +=
-						matrixA_host[row * a_dim[0] + i]
-						*
-						matrixA_host[col * a_dim[0] + i];
-				}
-			}
-		}
-	}
 	/* Get finishing time */
+	if (pc) ccl_ex_perfctr_stop(pc, "host multiply");
 	ccl_prof_stop(prof_cpu);
 
+	/* Apply epilogues to the host result, unfused. */
+	if (epi_passes > 0)
+		matmult_epilogue_host(bias_host, matrixC_test, b_dim[0], a_dim[1]);
+
 	/* ******************************************************** */
 	/* Determine and print OpenCL/OpenMP comparison information */
 	/* ******************************************************** */
 
 	/* Check for correctness */
-	int error = 0;
-	unsigned int sizeC = b_dim[0] * a_dim[1];
-	for (unsigned int index = 0; index < sizeC; index++) {
-		error += matrixC_host[index] - matrixC_test[index];
+	gint64 error = 0;
+	size_t sizeC = (size_t) b_dim[0] * a_dim[1];
+	if (check_dev) {
+
+		/* Copy CPU result to device and compare it there with the
+		 * device result. */
+		reduce = ccl_ex_reduce_new(ctx, argv[0], &err);
+		if_err_goto(err, error_handler);
+		matrixC_ref_dev = ccl_ex_bufpool_get(pool, ctx, CL_MEM_READ_ONLY,
+			size_matC_in_bytes, &err);
+		if_err_goto(err, error_handler);
+		ccl_buffer_enqueue_write(matrixC_ref_dev, cq, CL_TRUE, 0,
+			size_matC_in_bytes, matrixC_test, NULL, &err);
+		if_err_goto(err, error_handler);
+		ccl_ex_reduce_mismatch_int(reduce, cq, matrixC_dev,
+			matrixC_ref_dev, sizeC, &mismatches, &first_mismatch, &err);
+		if_err_goto(err, error_handler);
+
+		/* List the first mismatches, compacted on the device. Positions
+		 * are kept in ints. */
+		if ((mismatches > 0) && (sizeC <= G_MAXINT32)) {
+			matmult_mismatch_list(reduce, pool, ctx, cq, matrixC_dev,
+				matrixC_ref_dev, sizeC, mismatch_pos, mismatch_vals,
+				&n_mismatch_list, &err);
+			if_err_goto(err, error_handler);
+		}
+
+		/* Summarize the device result there, and the CPU result on the
+		 * host, as a further check. */
+		ccl_ex_reduce_int(reduce, cq, matrixC_dev, sizeC,
+			CCL_EX_REDUCE_SUM, &stats_dev[0], &err);
+		if_err_goto(err, error_handler);
+		ccl_ex_reduce_int(reduce, cq, matrixC_dev, sizeC,
+			CCL_EX_REDUCE_MIN, &stats_dev[1], &err);
+		if_err_goto(err, error_handler);
+		ccl_ex_reduce_int(reduce, cq, matrixC_dev, sizeC,
+			CCL_EX_REDUCE_MAX, &stats_dev[2], &err);
+		if_err_goto(err, error_handler);
+		stats_cpu[1] = G_MAXINT64;
+		stats_cpu[2] = G_MININT64;
+		for (size_t index = 0; index < sizeC; index++) {
+			stats_cpu[0] += matrixC_test[index];
+			stats_cpu[1] = MIN(stats_cpu[1], matrixC_test[index]);
+			stats_cpu[2] = MAX(stats_cpu[2], matrixC_test[index]);
+		}
+
+		ccl_ex_bufpool_put(pool, matrixC_dev);
+		ccl_ex_bufpool_put(pool, matrixC_ref_dev);
+		matrixC_dev = matrixC_ref_dev = NULL;
+
+	} else {
+
+		for (size_t index = 0; index < sizeC; index++) {
+			error += matrixC_host[index] - matrixC_test[index];
+		}
 	}
 
+	/* All host matrices are filled at this point, sample memory usage. */
+	ccl_ex_footprint_sample();
+
 	printf("\n   ============================== Results ==================================\n\n");
 	printf("     Total CPU Time %s: %fs\n",
 #ifdef USE_OPENMP
@@ -573,8 +2363,62 @@ int main(int argc, char *argv[]) {
 #else
 		"1x CPU",
 #endif
-		ccl_prof_time_elapsed(prof_cpu) / ccl_prof_time_elapsed(prof_dev));
-	printf("     Error (Device-CPU)          : %d\n", error);
+		ccl_prof_time_elapsed(prof_cpu)
+		/ (ccl_prof_time_elapsed(prof_dev) / runs));
+	if (check_dev) {
+		printf("     Mismatches (Device-CPU)     : %" G_GUINT64_FORMAT "\n",
+			(guint64) mismatches);
+		if (mismatches > 0)
+			printf("     First mismatch (row, col)   : (%" G_GUINT64_FORMAT
+				", %" G_GUINT64_FORMAT ")\n",
+				(guint64) first_mismatch / b_dim[0],
+				(guint64) first_mismatch % b_dim[0]);
+		for (size_t i = 0; i < n_mismatch_list; ++i)
+			printf("       (%d, %d) : device %d, CPU %d\n",
+				mismatch_pos[i] / b_dim[0], mismatch_pos[i] % b_dim[0],
+				mismatch_vals[i], matrixC_test[mismatch_pos[i]]);
+		printf("     Sum/min/max (Device)        : %" G_GINT64_FORMAT
+			" / %" G_GINT64_FORMAT " / %" G_GINT64_FORMAT "\n",
+			(gint64) stats_dev[0], (gint64) stats_dev[1],
+			(gint64) stats_dev[2]);
+		printf("     Sum/min/max (CPU)           : %" G_GINT64_FORMAT
+			" / %" G_GINT64_FORMAT " / %" G_GINT64_FORMAT " (%s)\n",
+			(gint64) stats_cpu[0], (gint64) stats_cpu[1],
+			(gint64) stats_cpu[2],
+			memcmp(stats_dev, stats_cpu, sizeof(stats_cpu)) == 0
+				? "match" : "MISMATCH");
+	} else {
+		printf("     Error (Device-CPU)          : %" G_GINT64_FORMAT "\n",
+			error);
+	}
+	if (md) {
+		printf("     Device time (pred./actual)  : %es / %es\n",
+			t_dev_pred, ccl_prof_time_elapsed(prof_dev) / runs);
+		printf("     Host time (pred./actual)    : %es / %es\n",
+			t_host_pred, ccl_prof_time_elapsed(prof_cpu));
+	}
+	if (epi_passes > 0)
+		matmult_epilogue_print(size_matA_in_bytes, size_matB_in_bytes,
+			size_matC_in_bytes, ccl_prof_time_elapsed(prof_dev) / runs);
+	printf("\n");
+
+	/* The result is in its file once it is unmapped. */
+	if (save_c) {
+		printf("     Matrix C saved to '%s'\n\n", save_c);
+	}
+
+	/* Show why the host multiplication takes the time it takes. */
+	if (pc) {
+		ccl_ex_perfctr_summary_print(pc, stdout);
+		printf("\n");
+	}
+
+	/* Show how much allocation overhead the pool removed. */
+	ccl_ex_bufpool_stats_print(pool);
+	printf("\n");
+
+	/* Show how host matrices are backed. */
+	ccl_ex_hugemem_stats_print(stdout);
 	printf("\n");
 
 
@@ -583,7 +2427,7 @@ int main(int argc, char *argv[]) {
 		fprintf(stderr, "\n\"Matrix A\"\n");
 		for (int i = 0; i < a_dim[1]; i++) {
 			for (int j = 0; j < a_dim[0]; j++) {
-				fprintf(stderr, "%d\t", matrixA_host[a_dim[0] * i + j]);
+				fprintf(stderr, "%d\t", matrixA_host[(size_t) a_dim[0] * i + j]);
 			}
 			fprintf(stderr, "\n");
 		}
@@ -592,24 +2436,27 @@ int main(int argc, char *argv[]) {
 			fprintf(stderr, "\n\"Matrix B\"\n");
 			for (int i = 0; i < b_dim[1]; i++) {
 				for (int j = 0; j < b_dim[0]; j++) {
-					fprintf(stderr, "%d\t", matrixB_host[b_dim[0] * i + j]);
+					fprintf(stderr, "%d\t", matrixB_host[(size_t) b_dim[0] * i + j]);
 				}
 				fprintf(stderr, "\n");
 			}
 		}
 
-		fprintf(stderr, "\n\"Device matrix C\"\n");
-		for (int row = 0; row < a_dim[1]; row++) {
-			for (int col = 0; col < b_dim[0]; col++) {
-				fprintf(stderr, "%d\t", matrixC_host[b_dim[0] * row + col]);
+		/* Device result is only available if it was read back. */
+		if (!check_dev) {
+			fprintf(stderr, "\n\"Device matrix C\"\n");
+			for (int row = 0; row < a_dim[1]; row++) {
+				for (int col = 0; col < b_dim[0]; col++) {
+					fprintf(stderr, "%d\t", matrixC_host[(size_t) b_dim[0] * row + col]);
+				}
+				fprintf(stderr, "\n");
 			}
-			fprintf(stderr, "\n");
 		}
 
 		fprintf(stderr, "\n\"CPU matrix C\"\n");
 		for (int row = 0; row < a_dim[1]; row++) {
 			for (int col = 0; col < b_dim[0]; col++) {
-				fprintf(stderr, "%d\t", matrixC_test[b_dim[0] * row + col]);
+				fprintf(stderr, "%d\t", matrixC_test[(size_t) b_dim[0] * row + col]);
 			}
 			fprintf(stderr, "\n");
 		}
@@ -640,28 +2487,53 @@ cleanup:
 
 	/* Free string command line options. */
 	if (compiler_opts) g_free(compiler_opts);
+	if (build_opts) g_free(build_opts);
+	if (device) g_free(device);
 	//~ if (output_export) g_free(output_export);
 
 	/* Free miscelaneous objects. */
+	if (tuner) ccl_ex_tuner_destroy(tuner);
+	if (md) matmult_dispatch_destroy(md);
+	if (pc) ccl_ex_perfctr_destroy(pc);
+	if (mc) matmult_chain_destroy(mc);
+	if (chain_shapes) g_free(chain_shapes);
+	if (image_ops) g_free(image_ops);
+	if (epi_bias) g_free(epi_bias);
+	if (load_a) g_free(load_a);
+	if (load_b) g_free(load_b);
+	if (save_c) g_free(save_c);
 	if (kernel_name) g_free(kernel_name);
-	if (kernel_path) g_free(kernel_path);
+	for (guint i = 0; i < G_N_ELEMENTS(kernel_paths); ++i)
+		g_free(kernel_paths[i]);
+	if (instr_file) g_free(instr_file);
+	if (worker_argv) g_strfreev(worker_argv);
 
 	/* Free RNG */
 	if (rng) g_rand_free(rng);
 
-	/* Release wrappers. */
-	if (matrixC_dev) ccl_buffer_destroy(matrixC_dev);
-	if (matrixB_dev) ccl_buffer_destroy(matrixB_dev);
-	if (matrixA_dev) ccl_buffer_destroy(matrixA_dev);
+	/* Release wrappers. Device buffers belong to the pool, which must
+	 * be destroyed before the context. */
+	if (pool) ccl_ex_bufpool_destroy(pool);
+	if (epi_bias_dev) ccl_ex_footprint_buffer_destroy(epi_bias_dev);
+	if (fileA_dev) ccl_ex_footprint_buffer_destroy(fileA_dev);
+	if (fileB_dev) ccl_ex_footprint_buffer_destroy(fileB_dev);
+	if (fill) ccl_ex_fill_destroy(fill);
+	if (reduce) ccl_ex_reduce_destroy(reduce);
+	if (instr) ccl_ex_instr_destroy(instr);
 	if (prg) ccl_program_destroy(prg);
 	if (cq) ccl_queue_destroy(cq);
 	if (ctx) ccl_context_destroy(ctx);
 
-	/* Free host resources */
-	if (matrixA_host) matmult_matrix_free(matrixA_host);
-	if (matrixB_host) matmult_matrix_free(matrixB_host);
-	if (matrixC_host) matmult_matrix_free(matrixC_host);
+	/* Free host resources. Matrices mapped from files are unmapped
+	 * after the buffers they back were released. */
+	if (matrixA_host && !mfile_a) matmult_matrix_free(matrixA_host);
+	if (matrixB_host && !mfile_b) matmult_matrix_free(matrixB_host);
+	if (matrixC_host && !mfile_c) matmult_matrix_free(matrixC_host);
+	if (mfile_a) matmult_mfile_close(mfile_a);
+	if (mfile_b) matmult_mfile_close(mfile_b);
+	if (mfile_c) matmult_mfile_close(mfile_c);
 	if (matrixC_test) matmult_matrix_free(matrixC_test);
+	if (bias_host) matmult_matrix_free(bias_host);
 
 	/* Return program status. */
 	return status;
@@ -681,9 +2553,10 @@ cleanup:
  * @return The new matrix or NULL if memory allocation failed.
  * */
 int* matmult_matrix_new(int cols, int rows, int* matrix_range, GRand* rng) {
-	int *matrix = (int*) g_malloc(cols * rows * sizeof(int));
+	size_t n = (size_t) cols * rows;
+	int *matrix = (int*) ccl_ex_hugemem_alloc(n * sizeof(int));
 	if (matrix_range != NULL) {
-		for (int i = 0; i < cols * rows; i++) {
+		for (size_t i = 0; i < n; i++) {
 			matrix[i] = g_rand_int_range(
 				rng, matrix_range[0], matrix_range[1]);
 		}
@@ -697,7 +2570,7 @@ int* matmult_matrix_new(int cols, int rows, int* matrix_range, GRand* rng) {
  * @param[in] matrix The matrix to free.
  * */
 void matmult_matrix_free(int* matrix) {
-	g_free(matrix);
+	ccl_ex_hugemem_free(matrix);
 }
 
 /**
@@ -730,6 +2603,37 @@ int matmult_args_parse(int argc, char* argv[], GError** err) {
 	g_option_context_parse(context, &argc, &argv, err);
 	if_err_goto(*err, error_handler);
 
+	/* Matrices loaded from files have the dimensions in the files. */
+	if_err_create_goto(*err, CCL_EX_ERROR,
+		((load_a != NULL) || (load_b != NULL)) && (gen_dev || scaling
+			|| (chain_shapes != NULL) || (power != 0)),
+		CCL_EX_FAIL, error_handler,
+		"Matrices loaded from files can't be generated on the device, " \
+		"or used in thread scaling studies, chains or powers.");
+	if_err_create_goto(*err, CCL_EX_ERROR,
+		(load_b != NULL) && IS_AAT(kernel_id), CCL_EX_FAIL,
+		error_handler, "Matrix B can't be loaded for C=AA^T kernels.");
+	if (load_a) {
+		mfile_a = matmult_mfile_open(load_a, err);
+		if_err_goto(*err, error_handler);
+		matmult_mfile_dims_get(mfile_a, a_dim);
+	}
+	if (load_b) {
+		mfile_b = matmult_mfile_open(load_b, err);
+		if_err_goto(*err, error_handler);
+		matmult_mfile_dims_get(mfile_b, b_dim);
+	}
+
+	/* Matrix C is only saved after the usual device multiplication. */
+	if_err_create_goto(*err, CCL_EX_ERROR, (save_c != NULL)
+		&& (check_dev || dispatch || recalibrate || scaling
+			|| (chain_shapes != NULL) || (power != 0)
+			|| (image_ops != NULL) || persistent),
+		CCL_EX_FAIL, error_handler,
+		"Matrix C can't be saved when it is checked on the device, or " \
+		"with dispatch, thread scaling, chain, power, image operands " \
+		"or persistent-threads comparison.");
+
 	/* Make checks which depend if the multiplication is AB or AA^T
 	 * (transpose) */
 	if (!IS_AAT(kernel_id)) {
@@ -745,6 +2649,83 @@ int matmult_args_parse(int argc, char* argv[], GError** err) {
 		b_dim[1] = a_dim[0];
 	}
 
+	/* Matrix chains and powers use C=AB kernels without
+	 * instrumentation. */
+	if_err_create_goto(*err, CCL_EX_ERROR,
+		((chain_shapes != NULL) || (power != 0))
+			&& (IS_AAT(kernel_id) || (instr_file != NULL)
+				|| dispatch || recalibrate),
+		CCL_EX_FAIL, error_handler,
+		"Matrix chains and powers require a C=AB kernel (0, 1 or 2), " \
+		"and can't be instrumented or dispatched.");
+	if_err_create_goto(*err, CCL_EX_ERROR,
+		(chain_shapes != NULL) && (power != 0), CCL_EX_FAIL,
+		error_handler, "Choose either a matrix chain or a matrix power.");
+	if_err_create_goto(*err, CCL_EX_ERROR,
+		(power != 0) && (a_dim[0] != a_dim[1]), CCL_EX_FAIL,
+		error_handler, "Matrix powers require a square matrix A.");
+
+	/* Image operands, for kernel 0 only. */
+	if (image_ops) {
+		img_a = (strchr(image_ops, 'A') != NULL)
+			|| (strchr(image_ops, 'a') != NULL);
+		img_b = (strchr(image_ops, 'B') != NULL)
+			|| (strchr(image_ops, 'b') != NULL);
+		if_err_create_goto(*err, CCL_EX_ERROR,
+			(!img_a && !img_b)
+				|| (strspn(image_ops, "ABab") != strlen(image_ops)),
+			CCL_EX_FAIL, error_handler,
+			"Image operands must be A, B or AB.");
+		if_err_create_goto(*err, CCL_EX_ERROR,
+			(kernel_id != 0) || (instr_file != NULL) || gen_dev
+				|| (chain_shapes != NULL) || (power != 0),
+			CCL_EX_FAIL, error_handler,
+			"Image operands require kernel 0, host generated matrices, " \
+			"and no instrumentation, chain or power.");
+	}
+
+	/* Persistent-threads kernel computes C=AB. */
+	if_err_create_goto(*err, CCL_EX_ERROR, persistent
+		&& (IS_AAT(kernel_id) || (instr_file != NULL) || gen_dev
+			|| (chain_shapes != NULL) || (power != 0)
+			|| (image_ops != NULL)),
+		CCL_EX_FAIL, error_handler,
+		"Persistent-threads comparison requires a C=AB kernel (0, 1 or " \
+		"2), host generated matrices, and no instrumentation, chain, " \
+		"power or image operands.");
+	if_err_create_goto(*err, CCL_EX_ERROR, groups_per_cu < 0,
+		CCL_EX_FAIL, error_handler,
+		"Work-groups per compute unit must not be negative.");
+
+	/* Fused epilogues, for the selected kernel only. */
+	if_err_create_goto(*err, CCL_EX_ERROR, (epi_bias != NULL)
+		&& (g_strcmp0(epi_bias, "row") != 0)
+		&& (g_strcmp0(epi_bias, "col") != 0), CCL_EX_FAIL,
+		error_handler, "Epilogue bias must be row or col.");
+	if_err_create_goto(*err, CCL_EX_ERROR, epi_requant_set
+		&& ((epi_requant[1] < 0) || (epi_requant[1] > 31)),
+		CCL_EX_FAIL, error_handler,
+		"Requantization shift must be within 0 to 31.");
+	if_err_create_goto(*err, CCL_EX_ERROR, epi_clamp_set
+		&& (epi_clamp[0] > epi_clamp[1]), CCL_EX_FAIL, error_handler,
+		"Clamp minimum must not be larger than maximum.");
+	epi_passes = (epi_bias != NULL) + epi_requant_set + epi_relu
+		+ epi_clamp_set;
+	if_err_create_goto(*err, CCL_EX_ERROR, (epi_passes > 0)
+		&& (dispatch || recalibrate || (chain_shapes != NULL)
+			|| (power != 0) || (image_ops != NULL) || persistent),
+		CCL_EX_FAIL, error_handler,
+		"Epilogues can't be used with dispatch, chain, power, image " \
+		"operands or persistent-threads comparison.");
+
+	/* Check if number of thread scaling runs is positive. */
+	if_err_create_goto(*err, CCL_EX_ERROR, scaling_reps < 1, CCL_EX_FAIL,
+		error_handler, "Number of thread scaling runs must be positive.");
+
+	/* Check if number of runs is positive. */
+	if_err_create_goto(*err, CCL_EX_ERROR, runs < 1, CCL_EX_FAIL,
+		error_handler, "Number of runs must be positive.");
+
 	/* Check if kernel ID is within 0 to 4. */
 	if_err_create_goto(*err, CCL_EX_ERROR,
 		((kernel_id < 0) || (kernel_id > 4)), CCL_EX_FAIL, error_handler,
@@ -21,11 +21,73 @@
  * Matrix multiplication example OpenCL kernels based on the
  * [CUDA best practices guide](http://docs.nvidia.com/cuda/cuda-c-best-practices-guide/index.html).
  *
+ * Kernels are instrumented with the macros of `examples_instr.cl`,
+ * which must precede this file, counting the work-items of each
+ * work-group within the bounds of C (`items`).
+ *
+ * Kernels 0 to 4 apply an optional epilogue to each element of C while
+ * it is still in a register, configured by the host with the following
+ * defines, in this order:
+ *
+ * * `EPI_BIAS_ROW` or `EPI_BIAS_COL`: add a per-row or per-column bias,
+ *   given in an extra kernel argument after the matrix dimensions;
+ * * `EPI_SCALE` and `EPI_SHIFT`: integer requantization,
+ *   @f$(c \times scale + 2^{shift-1}) \gg shift@f$;
+ * * `EPI_RELU`: replace negative values with zero;
+ * * `EPI_MIN` and `EPI_MAX`: clamp to @f$[min, max]@f$.
+ *
  * @author Nuno Fachada
  * @date 2016
  * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
  * */
 
+/* Type of global indexes. The host defines IDX64 when a buffer is
+ * larger than 4 GiB. */
+#ifdef IDX64
+typedef ulong idx_t;
+#else
+typedef uint idx_t;
+#endif
+
+/* Bias, in an extra kernel argument. Added in unsigned arithmetic, so
+ * that overflow wraps around as on the host. */
+#if defined(EPI_BIAS_ROW)
+	#define EPI_ARG , __global int * bias
+	#define EPI_BIAS(v, row, col) as_int(as_uint(v) + as_uint(bias[row]))
+#elif defined(EPI_BIAS_COL)
+	#define EPI_ARG , __global int * bias
+	#define EPI_BIAS(v, row, col) as_int(as_uint(v) + as_uint(bias[col]))
+#else
+	#define EPI_ARG
+	#define EPI_BIAS(v, row, col) (v)
+#endif
+
+/* Requantization, with rounding. */
+#ifdef EPI_SHIFT
+	#define EPI_REQUANT(v) ((int) (((long) (v) * EPI_SCALE \
+		+ ((1L << EPI_SHIFT) >> 1)) >> EPI_SHIFT))
+#else
+	#define EPI_REQUANT(v) (v)
+#endif
+
+/* ReLU. */
+#ifdef EPI_RELU
+	#define EPI_ACT(v) max((v), 0)
+#else
+	#define EPI_ACT(v) (v)
+#endif
+
+/* Clamp. */
+#ifdef EPI_MIN
+	#define EPI_CLAMP(v) clamp((v), EPI_MIN, EPI_MAX)
+#else
+	#define EPI_CLAMP(v) (v)
+#endif
+
+/* Epilogue of element (row, col) of C. */
+#define EPILOGUE(v, row, col) \
+	EPI_CLAMP(EPI_ACT(EPI_REQUANT(EPI_BIAS(v, row, col))))
+
 /**
  * Matmult kernel non-optimized.
  *
@@ -38,20 +100,26 @@
  * @param[in] dimsB Dimensions of matrix B.
  */
 __kernel void matmult0(__global int * A, __global int * B,
-	__global int * C, __private int2 dimsA, __private int2 dimsB) {
+	__global int * C, __private int2 dimsA, __private int2 dimsB
+	EPI_ARG INSTR_ARG) {
+
+	INSTR_BEGIN();
 
 	/* Matrix position for this work-item */
-	uint col = get_global_id(0);
-	uint row = get_global_id(1);
+	idx_t col = get_global_id(0);
+	idx_t row = get_global_id(1);
 
 	/* Multiply! */
 	if ((row < dimsA.y) && (col < dimsB.x)) {
-		int sum = 0;
-		for (uint i = 0; i < dimsA.x; i++) {
-			sum += A[row * dimsA.x + i] * B[i * dimsB.x + col];
+		uint sum = 0;
+		for (idx_t i = 0; i < dimsA.x; i++) {
+			sum += (uint) A[row * dimsA.x + i] * (uint) B[i * dimsB.x + col];
 		}
-		C[row * dimsB.x + col] = sum;
+		C[row * dimsB.x + col] = EPILOGUE(as_int(sum), row, col);
+		INSTR_COUNT(0, 1);
 	}
+
+	INSTR_END();
 }
 
 /**
@@ -66,11 +134,13 @@ __kernel void matmult0(__global int * A, __global int * B,
  * @param[in] dimsB Dimensions of matrix B.
  * @param[in] tileOfA Local memory used to improve matrix multiplication.
  * */
-__kernel void matmult1(__global int * A, __global int * B, __global int * C, __private int2 dimsA, __private int2 dimsB, __local int * tileOfA)
+__kernel void matmult1(__global int * A, __global int * B, __global int * C, __private int2 dimsA, __private int2 dimsB, __local int * tileOfA EPI_ARG INSTR_ARG)
 {
+	INSTR_BEGIN();
+
 	/* Global matrix position for this work-item */
-	uint gCol = get_global_id(0);
-	uint gRow = get_global_id(1);
+	idx_t gCol = get_global_id(0);
+	idx_t gRow = get_global_id(1);
 
 	/* Local matrix position for this work-item */
 	uint lCol = get_local_id(0);
@@ -92,12 +162,15 @@ __kernel void matmult1(__global int * A, __global int * B, __global int * C, __p
 	if ((gRow < dimsA.y) && (gCol < dimsB.x)) {
 
 		/* Multiply! */
-		int sum = 0;
-		for (uint i = 0; i < dimsA.x; i++) {
-			sum += tileOfA[lRow * dimsA.x + i] * B[i * dimsB.x + gCol];
+		uint sum = 0;
+		for (idx_t i = 0; i < dimsA.x; i++) {
+			sum += (uint) tileOfA[lRow * dimsA.x + i] * (uint) B[i * dimsB.x + gCol];
 		}
-		C[gRow * dimsB.x + gCol] = sum;
+		C[gRow * dimsB.x + gCol] = EPILOGUE(as_int(sum), gRow, gCol);
+		INSTR_COUNT(0, 1);
 	}
+
+	INSTR_END();
 }
 
 /**
@@ -114,14 +187,16 @@ __kernel void matmult1(__global int * A, __global int * B, __global int * C, __p
  * @param[in] tileOfB Additional local memory used to improve matrix
  * multiplication.
  */
-__kernel void matmult2(__global int * A, __global int * B, __global int * C, __private int2 dimsA, __private int2 dimsB, __local int * tileOfA, __local int * tileOfB)
+__kernel void matmult2(__global int * A, __global int * B, __global int * C, __private int2 dimsA, __private int2 dimsB, __local int * tileOfA, __local int * tileOfB EPI_ARG INSTR_ARG)
 {
+	INSTR_BEGIN();
+
 	/* Variable used to control reads from global memory into local memory */
 	uint loops;
 
 	/* Global matrix position for this work-item */
-	uint gCol = get_global_id(0);
-	uint gRow = get_global_id(1);
+	idx_t gCol = get_global_id(0);
+	idx_t gRow = get_global_id(1);
 
 	/* Local matrix position for this work-item */
 	uint lCol = get_local_id(0);
@@ -141,8 +216,8 @@ __kernel void matmult2(__global int * A, __global int * B, __global int * C, __p
 	loops = (dimsB.y % localRows == 0) ? (dimsB.y / localRows) : (dimsB.y / localRows + 1);
 	for (uint i = 0; i < loops; i++) {
 		uint localPos = i * localCols * localRows + lRow * localCols + lCol;
-		uint globalRow = i * localRows + lRow;
-		uint globalCol = get_group_id(0) * localCols + lCol;
+		idx_t globalRow = i * localRows + lRow;
+		idx_t globalCol = get_group_id(0) * localCols + lCol;
 		if ((globalRow < dimsB.y) && (globalCol < dimsB.x))
 			tileOfB[localPos] = B[globalRow * dimsB.x + globalCol];
 	}
@@ -154,12 +229,15 @@ __kernel void matmult2(__global int * A, __global int * B, __global int * C, __p
 	if ((gRow < dimsA.y) && (gCol < dimsB.x)) {
 
 		/* Multiply! */
-		int sum = 0;
+		uint sum = 0;
 		for (uint i = 0; i < dimsA.x; i++) {
-			sum += tileOfA[lRow * dimsA.x + i] * tileOfB[i * localCols + lCol];
+			sum += (uint) tileOfA[lRow * dimsA.x + i] * (uint) tileOfB[i * localCols + lCol];
 		}
-		C[gRow * dimsB.x + gCol] = sum;
+		C[gRow * dimsB.x + gCol] = EPILOGUE(as_int(sum), gRow, gCol);
+		INSTR_COUNT(0, 1);
 	}
+
+	INSTR_END();
 }
 
 /**
@@ -171,20 +249,25 @@ __kernel void matmult2(__global int * A, __global int * B, __global int * C, __p
  * @param[out] C Result matrix.
  * @param[in] dimsA Dimensions of matrix A.
  */
-__kernel void matmult3(__global int * A, __global int * C, __private int2 dimsA)
+__kernel void matmult3(__global int * A, __global int * C, __private int2 dimsA EPI_ARG INSTR_ARG)
 {
+	INSTR_BEGIN();
+
 	/* Matrix position for this work-item */
-	uint row = get_global_id(1);
-	uint col = get_global_id(0);
+	idx_t row = get_global_id(1);
+	idx_t col = get_global_id(0);
 
 	/* Multiply! */
 	if ((row < dimsA.y) && (col < dimsA.y)) {
-		int sum = 0;
-		for (uint i = 0; i < dimsA.x; i++) {
-			sum += A[row * dimsA.x + i] * A[col * dimsA.x + i];
+		uint sum = 0;
+		for (idx_t i = 0; i < dimsA.x; i++) {
+			sum += (uint) A[row * dimsA.x + i] * (uint) A[col * dimsA.x + i];
 		}
-		C[row * dimsA.y + col] = sum;
+		C[row * dimsA.y + col] = EPILOGUE(as_int(sum), row, col);
+		INSTR_COUNT(0, 1);
 	}
+
+	INSTR_END();
 }
 
 /**
@@ -199,14 +282,16 @@ __kernel void matmult3(__global int * A, __global int * C, __private int2 dimsA)
  * @param[in] tileOfAT Additional local memory used to improve matrix
  * multiplication.
  */
-__kernel void matmult4(__global int * A, __global int * C, __private int2 dimsA, __local int * tileOfA, __local int * tileOfAT)
+__kernel void matmult4(__global int * A, __global int * C, __private int2 dimsA, __local int * tileOfA, __local int * tileOfAT EPI_ARG INSTR_ARG)
 {
+	INSTR_BEGIN();
+
 	/* Variable used to control reads from global memory into local memory */
 	uint loops;
 
 	/* Global matrix position for this work-item */
-	uint gRow = get_global_id(1);
-	uint gCol = get_global_id(0);
+	idx_t gRow = get_global_id(1);
+	idx_t gCol = get_global_id(0);
 
 	/* Local matrix position for this work-item */
 	uint lRow = get_local_id(1);
@@ -225,11 +310,11 @@ __kernel void matmult4(__global int * A, __global int * C, __private int2 dimsA,
 	uint localRows = min((uint) get_local_size(1), (uint) dimsA.y);
 	loops = (dimsA.x % localRows == 0) ? (dimsA.x / localRows) : (dimsA.x / localRows + 1);
 	for (uint i = 0; i < loops; i++) {
-		uint stripSize = dimsA.x * localCols;
-		uint globalPos = stripSize * get_group_id(0);
+		idx_t stripSize = (idx_t) dimsA.x * localCols;
+		idx_t globalPos = stripSize * get_group_id(0);
 		uint localPos = i * localCols * localRows;
 		uint localIndex = lRow * localCols + lCol;
-		uint globalIndex = globalPos + localPos + localIndex;
+		idx_t globalIndex = globalPos + localPos + localIndex;
 		if (globalIndex < stripSize * (get_group_id(0) + 1))
 			tileOfAT[localPos + localIndex] = A[globalIndex];
 	}
@@ -241,10 +326,137 @@ __kernel void matmult4(__global int * A, __global int * C, __private int2 dimsA,
 	if ((gRow < dimsA.y) && (gCol < dimsA.y)) {
 
 		/* Multiply! */
-		int sum = 0;
+		uint sum = 0;
 		for (uint i = 0; i < dimsA.x; i++) {
-			sum += tileOfA[lRow * dimsA.x + i] * tileOfAT[lCol * dimsA.x + i];
+			sum += (uint) tileOfA[lRow * dimsA.x + i] * (uint) tileOfAT[lCol * dimsA.x + i];
+		}
+		C[gRow * dimsA.y + gCol] = EPILOGUE(as_int(sum), gRow, gCol);
+		INSTR_COUNT(0, 1);
+	}
+
+	INSTR_END();
+}
+
+#if defined(IMG_A) || defined(IMG_B)
+
+/* Sampler for matrices stored in images, read element by element. */
+__constant sampler_t smp =
+	CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_NONE | CLK_FILTER_NEAREST;
+
+/* Matrix A, in an image if IMG_A is defined or in a buffer otherwise. */
+#ifdef IMG_A
+	#define MAT_A __read_only image2d_t
+	#define A_AT(row, col) read_imagei(A, smp, (int2) ((col), (row))).x
+#else
+	#define MAT_A __global int *
+	#define A_AT(row, col) A[(row) * dimsA.x + (col)]
+#endif
+
+/* Matrix B, in an image if IMG_B is defined or in a buffer otherwise. */
+#ifdef IMG_B
+	#define MAT_B __read_only image2d_t
+	#define B_AT(row, col) read_imagei(B, smp, (int2) ((col), (row))).x
+#else
+	#define MAT_B __global int *
+	#define B_AT(row, col) B[(row) * dimsB.x + (col)]
+#endif
+
+/**
+ * Matmult kernel non-optimized, reading A and/or B from images
+ * (`CL_R`, `CL_SIGNED_INT32`) through the texture cache, on devices
+ * which have one. Only built if the host defines `IMG_A` and/or `IMG_B`,
+ * which select the operands in images.
+ *
+ * @param[in] A Matrix A.
+ * @param[in] B Matrix B.
+ * @param[out] C Result matrix.
+ * @param[in] dimsA Dimensions of matrix A.
+ * @param[in] dimsB Dimensions of matrix B.
+ */
+__kernel void matmult0_img(MAT_A A, MAT_B B,
+	__global int * C, __private int2 dimsA, __private int2 dimsB INSTR_ARG) {
+
+	INSTR_BEGIN();
+
+	/* Matrix position for this work-item, images are limited to int
+	 * coordinates. */
+	int col = get_global_id(0);
+	int row = get_global_id(1);
+
+	/* Multiply! */
+	if ((row < dimsA.y) && (col < dimsB.x)) {
+		uint sum = 0;
+		for (int i = 0; i < dimsA.x; i++) {
+			sum += (uint) A_AT(row, i) * (uint) B_AT(i, col);
+		}
+		C[(idx_t) row * dimsB.x + col] = as_int(sum);
+		INSTR_COUNT(0, 1);
+	}
+
+	INSTR_END();
+}
+
+#endif
+
+/**
+ * Matmult kernel with persistent threads.
+ *
+ * Only as many work-groups as fit the device are launched. Each one
+ * repeatedly claims the next tile of C, with the size of a work-group,
+ * from a global atomic counter, until all tiles are done. Tiles at the
+ * right and bottom edges of C, partially outside of it, are processed
+ * along with full tiles, instead of forming a last, mostly empty, wave
+ * of work-groups.
+ *
+ * @param[in] A Matrix A.
+ * @param[in] B Matrix B.
+ * @param[out] C Result matrix.
+ * @param[in] dimsA Dimensions of matrix A.
+ * @param[in] dimsB Dimensions of matrix B.
+ * @param[in,out] next_tile Next tile to claim, must be zero at launch.
+ */
+__kernel void matmult_pt(__global int * A, __global int * B,
+	__global int * C, __private int2 dimsA, __private int2 dimsB,
+	volatile __global uint * next_tile INSTR_ARG) {
+
+	INSTR_BEGIN();
+
+	/* Tile claimed by the work-group. */
+	__local uint tile;
+
+	/* Tiles of C. */
+	uint lsx = get_local_size(0);
+	uint lsy = get_local_size(1);
+	uint tiles_x = (dimsB.x + lsx - 1) / lsx;
+	uint num_tiles = tiles_x * ((dimsA.y + lsy - 1) / lsy);
+
+	for (;;) {
+
+		/* First work-item claims the next tile for the group. */
+		if ((get_local_id(0) == 0) && (get_local_id(1) == 0))
+			tile = atomic_inc(next_tile);
+		barrier(CLK_LOCAL_MEM_FENCE);
+		uint t = tile;
+
+		/* All work-items have the tile before the next one is
+		 * claimed. */
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if (t >= num_tiles) break;
+
+		/* Matrix position for this work-item */
+		idx_t col = (t % tiles_x) * lsx + get_local_id(0);
+		idx_t row = (t / tiles_x) * lsy + get_local_id(1);
+
+		/* Multiply! */
+		if ((row < dimsA.y) && (col < dimsB.x)) {
+			uint sum = 0;
+			for (idx_t i = 0; i < dimsA.x; i++) {
+				sum += (uint) A[row * dimsA.x + i] * (uint) B[i * dimsB.x + col];
+			}
+			C[row * dimsB.x + col] = as_int(sum);
+			INSTR_COUNT(0, 1);
 		}
-		C[gRow * dimsA.y + gCol] = sum;
 	}
+
+	INSTR_END();
 }
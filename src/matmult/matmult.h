@@ -32,7 +32,16 @@
 #include <omp.h>
 #endif
 
+#include <string.h>
 #include "examples_common.h"
+#include "examples_bufpool.h"
+#include "examples_tuner.h"
+#include "examples_fill.h"
+#include "examples_reduce.h"
+#include "examples_hugemem.h"
+#include "examples_footprint.h"
+#include "examples_instr.h"
+#include "examples_perfctr.h"
 
 /**
  * Check if the multiplication is @f$C=AA^T@f$ (matrix A and its
@@ -50,7 +59,169 @@ int* matmult_matrix_new(int cols, int rows, int* matrix_range, GRand* rng);
 /** Free's a matrix created with matmult_matrix_new(). */
 void matmult_matrix_free(int* matrix);
 
+/** Multiply matrices on the host. */
+void matmult_host(const int* ad, const int* bd, gboolean aat,
+	gboolean runtime_sched, const int* A, const int* B, int* C);
+
 /** Parse and verify command line arguments. */
 int matmult_args_parse(int argc, char* argv[], GError** err);
 
+/**
+ * Times of one multiplication of square matrices, for dispatch
+ * calibration.
+ * */
+typedef struct matmult_dispatch_sample {
+	/** Host time in seconds. */
+	double host;
+	/** Device transfer time in seconds. */
+	double xfer;
+	/** Bytes transferred between host and device. */
+	double xfer_bytes;
+	/** Device kernel time in seconds. */
+	double kernel;
+	/** Device time in seconds not spent in transfers or kernel. */
+	double overhead;
+} MatmultDispatchSample;
+
+/**
+ * Dispatch calibration callback: times a multiplication of square
+ * matrices on the host and on the device.
+ *
+ * @param[in] size Number of rows and columns of the matrices.
+ * @param[out] sample Measured times.
+ * @param[in] data Data given to matmult_dispatch_calibrate().
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return `TRUE` if times were measured, `FALSE` if the size doesn't fit
+ * the device or if an error occurs.
+ * */
+typedef gboolean (*matmult_dispatch_timer)(int size,
+	MatmultDispatchSample* sample, void* data, GError** err);
+
+/** Size-aware dispatcher between host and device. */
+typedef struct matmult_dispatch MatmultDispatch;
+
+/** Create a new dispatcher. */
+MatmultDispatch* matmult_dispatch_new(CCLDevice* dev,
+	const char* kernel_name, const size_t* lws, GError** err);
+
+/** Get the calibration table, from cache or by a sweep. */
+gboolean matmult_dispatch_calibrate(MatmultDispatch* md,
+	matmult_dispatch_timer timer, void* data, gboolean recalibrate,
+	GError** err);
+
+/** Predict host and device times of a multiplication. */
+void matmult_dispatch_predict(MatmultDispatch* md, double ops,
+	double bytes, double* t_host, double* t_dev);
+
+/** Print the calibration models. */
+void matmult_dispatch_print(MatmultDispatch* md, FILE* out);
+
+/** Destroy a dispatcher. */
+void matmult_dispatch_destroy(MatmultDispatch* md);
+
+/**
+ * Matrix chain callback: enqueues @f$C=AB@f$ on the device.
+ *
+ * @param[in] ad Dimensions (cols, rows) of matrix A.
+ * @param[in] bd Dimensions (cols, rows) of matrix B.
+ * @param[in] A Device buffer with matrix A.
+ * @param[in] B Device buffer with matrix B.
+ * @param[out] C Device buffer for matrix C.
+ * @param[in] ewl Events to wait for, or `NULL`.
+ * @param[in] data Data given to matmult_chain_run().
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return Event of the multiplication, or `NULL` if an error occurs.
+ * */
+typedef CCLEvent* (*matmult_chain_mult)(const int* ad, const int* bd,
+	CCLBuffer* A, CCLBuffer* B, CCLBuffer* C, CCLEventWaitList* ewl,
+	void* data, GError** err);
+
+/** Matrix chain or matrix power. */
+typedef struct matmult_chain MatmultChain;
+
+/** Create a matrix chain, in optimal order. */
+MatmultChain* matmult_chain_new(const char* shapes, GError** err);
+
+/** Create a matrix power, by repeated squaring. */
+MatmultChain* matmult_chain_new_power(int size, int k, GError** err);
+
+/** Get the number of input matrices. */
+guint matmult_chain_num_inputs(MatmultChain* mc);
+
+/** Get the dimensions of an input matrix or of the result. */
+void matmult_chain_dims_get(MatmultChain* mc, guint i, int* dims);
+
+/** Get the number of multiplications. */
+guint matmult_chain_num_steps(MatmultChain* mc);
+
+/** Get the dimensions of the operands of a multiplication. */
+void matmult_chain_step_dims_get(MatmultChain* mc, guint j, int* ad,
+	int* bd);
+
+/** Get the size in bytes of the largest matrix. */
+size_t matmult_chain_max_bytes(MatmultChain* mc);
+
+/** Multiply the chain on the device. */
+CCLBuffer* matmult_chain_run(MatmultChain* mc, CCLContext* ctx,
+	CCLQueue* cq, CCLBuffer* const* inputs, matmult_chain_mult mult,
+	void* data, double* t_dev, GError** err);
+
+/** Multiply the chain on the host, from left to right. */
+int* matmult_chain_host(MatmultChain* mc, int* const* inputs);
+
+/** Print the order of multiplications and FLOPs saved. */
+void matmult_chain_print(MatmultChain* mc, FILE* out);
+
+/** Destroy a matrix chain. */
+void matmult_chain_destroy(MatmultChain* mc);
+
+/** Magic string at the start of raw matrix files. */
+#define MATMULT_RAW_MAGIC "MATMULT\0"
+
+/** Header of raw matrix files. Fields are little-endian. */
+typedef struct matmult_raw_header {
+	/** ::MATMULT_RAW_MAGIC. */
+	char magic[8];
+	/** Format version, currently 1. */
+	guint32 version;
+	/** Offset of matrix data from the start of the file, in bytes. */
+	guint32 offset;
+	/** Number of columns. */
+	guint32 cols;
+	/** Number of rows. */
+	guint32 rows;
+} MatmultRawHeader;
+
+/** Memory-mapped matrix file. */
+typedef struct matmult_mfile MatmultMFile;
+
+/** Map a matrix file for reading. */
+MatmultMFile* matmult_mfile_open(const char* filename, GError** err);
+
+/** Create and map a matrix file for writing. */
+MatmultMFile* matmult_mfile_create(const char* filename, int cols,
+	int rows, GError** err);
+
+/** Get the matrix of a mapped matrix file. */
+int* matmult_mfile_data(MatmultMFile* mf);
+
+/** Get the dimensions of the matrix of a mapped matrix file. */
+void matmult_mfile_dims_get(MatmultMFile* mf, int* dims);
+
+/** Create a device buffer backed by a mapped matrix file. */
+CCLBuffer* matmult_mfile_buffer_new(MatmultMFile* mf, CCLContext* ctx,
+	CCLDevice* dev, gboolean* use_host_ptr, GError** err);
+
+/** Unmap and close a matrix file. */
+void matmult_mfile_close(MatmultMFile* mf);
+
+/** Run the thread scaling study, one worker process per binding. */
+gboolean matmult_scaling_run(gchar** worker_argv, GError** err);
+
+/** Thread scaling study worker. */
+void matmult_scaling_worker(const int* ad, const int* bd, gboolean aat,
+	const int* A, const int* B, int reps, FILE* out);
+
 #endif
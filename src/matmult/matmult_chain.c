@@ -0,0 +1,526 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Matrix chain multiplication on the OpenCL device.
+ *
+ * A chain @f$A_0A_1 \cdots A_{n-1}@f$, where @f$A_i@f$ has @f$p_i@f$
+ * rows and @f$p_{i+1}@f$ columns, is multiplied in the order which
+ * minimizes floating point operations, found by dynamic programming.
+ * A matrix power @f$A^k@f$ is multiplied by repeated squaring, with at
+ * most @f$2\log_2k@f$ multiplications instead of @f$k-1@f$.
+ *
+ * Intermediate products stay in device buffers, and each multiplication
+ * waits only for the events of the products it uses, so independent
+ * products may run concurrently on an out-of-order queue. All
+ * intermediates are kept until the chain is destroyed.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#include "matmult.h"
+
+/* One multiplication of the chain. Operands below the number of input
+ * matrices are inputs, the others are results of previous steps. */
+struct matmult_chain_step {
+	/* Left and right operands. */
+	guint l, r;
+	/* Dimensions (cols, rows) of the result. */
+	int dims[2];
+};
+
+/* Matrix chain. */
+struct matmult_chain {
+	/* Number of input matrices. */
+	guint n;
+	/* Matrix i has p[i] rows and p[i + 1] columns. */
+	int* p;
+	/* Exponent of a matrix power, 0 for a chain. */
+	guint k;
+	/* Multiplications, in execution order. */
+	GArray* steps;
+	/* Order of multiplications, as text. */
+	gchar* order;
+	/* Floating point operations of the chosen and of the left-to-right
+	 * orders. */
+	double flops;
+	double flops_ltr;
+	/* Intermediate device buffers and their events, one per step. */
+	CCLBuffer** tmp;
+	CCLEvent** evts;
+};
+
+/* Floating point operations (multiply and add) of a product of a
+ * rows x inner matrix by an inner x cols matrix. */
+#define MATMULT_CHAIN_FLOPS(rows, inner, cols) \
+	(2.0 * (double) (rows) * (double) (inner) * (double) (cols))
+
+/* Add a step and return its operand id. */
+static guint matmult_chain_step_add(MatmultChain* mc, guint l, guint r,
+	int cols, int rows) {
+
+	struct matmult_chain_step step = { l, r, { cols, rows } };
+
+	g_array_append_val(mc->steps, step);
+	return mc->n + mc->steps->len - 1;
+}
+
+/* Get dimensions (cols, rows) of an operand. */
+static const int* matmult_chain_dims(MatmultChain* mc, guint id,
+	int* dims) {
+
+	if (id < mc->n) {
+		dims[0] = mc->p[id + 1];
+		dims[1] = mc->p[id];
+	} else {
+		struct matmult_chain_step* step = &g_array_index(
+			mc->steps, struct matmult_chain_step, id - mc->n);
+		dims[0] = step->dims[0];
+		dims[1] = step->dims[1];
+	}
+	return dims;
+}
+
+/* Add steps which multiply matrices i to j with the splits in `s`, and
+ * append their order to `order`. Returns the operand id of the
+ * product. */
+static guint matmult_chain_plan(MatmultChain* mc, const guint* s,
+	guint i, guint j, GString* order) {
+
+	guint l, r;
+
+	if (i == j) {
+		g_string_append_printf(order, "A%u", i);
+		return i;
+	}
+	g_string_append_c(order, '(');
+	l = matmult_chain_plan(mc, s, i, s[i * mc->n + j], order);
+	g_string_append_c(order, ' ');
+	r = matmult_chain_plan(mc, s, s[i * mc->n + j] + 1, j, order);
+	g_string_append_c(order, ')');
+	return matmult_chain_step_add(mc, l, r, mc->p[j + 1], mc->p[i]);
+}
+
+/**
+ * Create a matrix chain with the order of multiplications which
+ * minimizes floating point operations.
+ *
+ * @param[in] shapes Comma separated dimensions @f$p_0,...,p_n@f$, where
+ * matrix @f$A_i@f$ has @f$p_i@f$ rows and @f$p_{i+1}@f$ columns, with
+ * @f$n\geq2@f$.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return A new matrix chain, or `NULL` if `shapes` is invalid.
+ * */
+MatmultChain* matmult_chain_new(const char* shapes, GError** err) {
+
+	GError* err_internal = NULL;
+	MatmultChain* mc = NULL;
+	gchar** tokens = NULL;
+	double* m = NULL;
+	guint* s = NULL;
+	GString* order = NULL;
+	guint n;
+
+	g_return_val_if_fail(shapes != NULL, NULL);
+
+	tokens = g_strsplit(shapes, ",", -1);
+	n = g_strv_length(tokens);
+	if_err_create_goto(err_internal, CCL_EX_ERROR, n < 3, CCL_EX_FAIL,
+		error_handler, "A matrix chain requires at least two matrices, "
+		"i.e. three dimensions.");
+
+	mc = g_slice_new0(MatmultChain);
+	mc->n = n - 1;
+	mc->p = g_new(int, n);
+	mc->steps = g_array_new(FALSE, FALSE,
+		sizeof(struct matmult_chain_step));
+
+	for (guint i = 0; i < n; ++i) {
+		gchar* end;
+		gint64 d = g_ascii_strtoll(tokens[i], &end, 10);
+		if_err_create_goto(err_internal, CCL_EX_ERROR,
+			(end == tokens[i]) || (*end != '\0') || (d < 1)
+				|| (d > G_MAXINT),
+			CCL_EX_FAIL, error_handler,
+			"Invalid matrix chain dimension '%s'.", tokens[i]);
+		mc->p[i] = (int) d;
+	}
+
+	/* Minimum cost m[i][j] of multiplying matrices i to j, and split
+	 * s[i][j] which achieves it. */
+	m = g_new0(double, mc->n * mc->n);
+	s = g_new0(guint, mc->n * mc->n);
+	for (guint len = 2; len <= mc->n; ++len) {
+		for (guint i = 0; i + len - 1 < mc->n; ++i) {
+			guint j = i + len - 1;
+			m[i * mc->n + j] = -1;
+			for (guint k = i; k < j; ++k) {
+				double cost = m[i * mc->n + k] + m[(k + 1) * mc->n + j]
+					+ MATMULT_CHAIN_FLOPS(mc->p[i], mc->p[k + 1],
+						mc->p[j + 1]);
+				if ((m[i * mc->n + j] < 0) || (cost < m[i * mc->n + j])) {
+					m[i * mc->n + j] = cost;
+					s[i * mc->n + j] = k;
+				}
+			}
+		}
+	}
+	mc->flops = m[mc->n - 1];
+
+	/* Left-to-right order, for comparison. */
+	for (guint j = 1; j < mc->n; ++j)
+		mc->flops_ltr +=
+			MATMULT_CHAIN_FLOPS(mc->p[0], mc->p[j], mc->p[j + 1]);
+
+	order = g_string_new(NULL);
+	matmult_chain_plan(mc, s, 0, mc->n - 1, order);
+	mc->order = g_string_free(order, FALSE);
+
+	g_free(m);
+	g_free(s);
+	g_strfreev(tokens);
+	return mc;
+
+error_handler:
+	g_strfreev(tokens);
+	if (mc) matmult_chain_destroy(mc);
+	g_propagate_error(err, err_internal);
+	return NULL;
+}
+
+/**
+ * Create a matrix power, multiplied by repeated squaring.
+ *
+ * @param[in] size Number of rows and columns of the matrix.
+ * @param[in] k Exponent, at least 2.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return A new matrix power, or `NULL` if `k` is invalid.
+ * */
+MatmultChain* matmult_chain_new_power(int size, int k, GError** err) {
+
+	MatmultChain* mc;
+	GString* order;
+	guint base = 0, result = G_MAXUINT;
+
+	g_return_val_if_fail(size > 0, NULL);
+
+	if (k < 2) {
+		g_set_error(err, CCL_EX_ERROR, CCL_EX_FAIL,
+			"Exponent of a matrix power must be at least 2.");
+		return NULL;
+	}
+
+	mc = g_slice_new0(MatmultChain);
+	mc->n = 1;
+	mc->k = k;
+	mc->p = g_new(int, 2);
+	mc->p[0] = mc->p[1] = size;
+	mc->steps = g_array_new(FALSE, FALSE,
+		sizeof(struct matmult_chain_step));
+
+	/* Multiply the result by the base for each bit set in the exponent,
+	 * squaring the base for the next bit. */
+	order = g_string_new(NULL);
+	for (guint e = k, bit = 1; e > 0; e >>= 1, bit <<= 1) {
+		if (e & 1) {
+			g_string_append_printf(order, "%sA^%u",
+				result == G_MAXUINT ? "" : " ", bit);
+			result = (result == G_MAXUINT) ? base
+				: matmult_chain_step_add(mc, result, base, size, size);
+		}
+		if (e > 1)
+			base = matmult_chain_step_add(mc, base, base, size, size);
+	}
+	mc->order = g_string_free(order, FALSE);
+
+	mc->flops = mc->steps->len * MATMULT_CHAIN_FLOPS(size, size, size);
+	mc->flops_ltr = (k - 1) * MATMULT_CHAIN_FLOPS(size, size, size);
+
+	return mc;
+}
+
+/**
+ * Get the number of input matrices.
+ *
+ * @param[in] mc Matrix chain.
+ * @return Number of input matrices (1 for a matrix power).
+ * */
+guint matmult_chain_num_inputs(MatmultChain* mc) {
+
+	g_return_val_if_fail(mc != NULL, 0);
+	return mc->n;
+}
+
+/**
+ * Get the number of multiplications.
+ *
+ * @param[in] mc Matrix chain.
+ * @return Number of multiplications, in execution order.
+ * */
+guint matmult_chain_num_steps(MatmultChain* mc) {
+
+	g_return_val_if_fail(mc != NULL, 0);
+	return mc->steps->len;
+}
+
+/**
+ * Get the dimensions of the operands of a multiplication.
+ *
+ * @param[in] mc Matrix chain.
+ * @param[in] j Multiplication, in execution order.
+ * @param[out] ad Dimensions (cols, rows) of the left operand.
+ * @param[out] bd Dimensions (cols, rows) of the right operand.
+ * */
+void matmult_chain_step_dims_get(MatmultChain* mc, guint j, int* ad,
+	int* bd) {
+
+	struct matmult_chain_step* step;
+
+	g_return_if_fail(mc != NULL);
+	g_return_if_fail(j < mc->steps->len);
+
+	step = &g_array_index(mc->steps, struct matmult_chain_step, j);
+	matmult_chain_dims(mc, step->l, ad);
+	matmult_chain_dims(mc, step->r, bd);
+}
+
+/**
+ * Get the dimensions of an input matrix or of the result.
+ *
+ * @param[in] mc Matrix chain.
+ * @param[in] i Input matrix, or the number of input matrices for the
+ * result.
+ * @param[out] dims Dimensions (cols, rows).
+ * */
+void matmult_chain_dims_get(MatmultChain* mc, guint i, int* dims) {
+
+	g_return_if_fail(mc != NULL);
+	g_return_if_fail(i <= mc->n);
+
+	if (i < mc->n) {
+		matmult_chain_dims(mc, i, dims);
+	} else {
+		dims[0] = mc->p[mc->n];
+		dims[1] = mc->p[0];
+	}
+}
+
+/**
+ * Get the size in bytes of the largest matrix of the chain, inputs and
+ * intermediates included.
+ *
+ * @param[in] mc Matrix chain.
+ * @return Size in bytes of the largest matrix.
+ * */
+size_t matmult_chain_max_bytes(MatmultChain* mc) {
+
+	size_t max = 0;
+	int dims[2];
+
+	g_return_val_if_fail(mc != NULL, 0);
+
+	for (guint id = 0; id < mc->n + mc->steps->len; ++id) {
+		matmult_chain_dims(mc, id, dims);
+		max = MAX(max, (size_t) dims[0] * dims[1] * sizeof(cl_int));
+	}
+	return max;
+}
+
+/**
+ * Multiply the chain on the device, keeping intermediates in device
+ * buffers. Each multiplication waits for the events of the
+ * intermediates it uses.
+ *
+ * @param[in] mc Matrix chain.
+ * @param[in] ctx Context wrapper.
+ * @param[in] cq Command queue wrapper, possibly out-of-order, with
+ * profiling enabled.
+ * @param[in] inputs Device buffers with the input matrices.
+ * @param[in] mult Callback which enqueues one multiplication.
+ * @param[in] data Data passed to `mult`.
+ * @param[out] t_dev Device time in seconds, from the start of the first
+ * multiplication to the end of the last one.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return Device buffer with the result, which belongs to the chain, or
+ * `NULL` if an error occurs.
+ * */
+CCLBuffer* matmult_chain_run(MatmultChain* mc, CCLContext* ctx,
+	CCLQueue* cq, CCLBuffer* const* inputs, matmult_chain_mult mult,
+	void* data, double* t_dev, GError** err) {
+
+	GError* err_internal = NULL;
+	cl_ulong t_start = G_MAXUINT64, t_end = 0;
+
+	g_return_val_if_fail(mc != NULL, NULL);
+	g_return_val_if_fail(mc->tmp == NULL, NULL);
+	g_return_val_if_fail(mc->steps->len > 0, NULL);
+
+	mc->tmp = g_new0(CCLBuffer*, mc->steps->len);
+	mc->evts = g_new0(CCLEvent*, mc->steps->len);
+
+	for (guint j = 0; j < mc->steps->len; ++j) {
+
+		struct matmult_chain_step* step = &g_array_index(
+			mc->steps, struct matmult_chain_step, j);
+		guint ops[] = { step->l, step->r };
+		CCLBuffer* bufs[2];
+		int ad[2], bd[2];
+		CCLEventWaitList ewl = NULL;
+
+		/* Operands, waiting for those which are intermediates. */
+		for (guint o = 0; o < 2; ++o) {
+			if (ops[o] < mc->n) {
+				bufs[o] = inputs[ops[o]];
+			} else {
+				bufs[o] = mc->tmp[ops[o] - mc->n];
+				if ((o == 0) || (ops[1] != ops[0]))
+					ccl_event_wait_list_add(&ewl,
+						mc->evts[ops[o] - mc->n], NULL);
+			}
+		}
+		matmult_chain_dims(mc, step->l, ad);
+		matmult_chain_dims(mc, step->r, bd);
+
+		mc->tmp[j] = ccl_ex_footprint_buffer_new(ctx, CL_MEM_READ_WRITE,
+			(size_t) step->dims[0] * step->dims[1] * sizeof(cl_int), NULL,
+			&err_internal);
+		if_err_goto(err_internal, error_handler);
+
+		mc->evts[j] = mult(ad, bd, bufs[0], bufs[1], mc->tmp[j],
+			ewl ? &ewl : NULL, data, &err_internal);
+		ccl_event_wait_list_clear(&ewl);
+		if_err_goto(err_internal, error_handler);
+	}
+
+	ccl_queue_finish(cq, &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	/* With an out-of-order queue, the first and last multiplications to
+	 * run are not necessarily the first and last steps. */
+	for (guint j = 0; j < mc->steps->len; ++j) {
+		cl_ulong t;
+		t = ccl_event_get_profiling_info_scalar(mc->evts[j],
+			CL_PROFILING_COMMAND_START, cl_ulong, &err_internal);
+		if_err_goto(err_internal, error_handler);
+		t_start = MIN(t_start, t);
+		t = ccl_event_get_profiling_info_scalar(mc->evts[j],
+			CL_PROFILING_COMMAND_END, cl_ulong, &err_internal);
+		if_err_goto(err_internal, error_handler);
+		t_end = MAX(t_end, t);
+	}
+	*t_dev = (t_end - t_start) * 1e-9;
+
+	return mc->tmp[mc->steps->len - 1];
+
+error_handler:
+	g_propagate_error(err, err_internal);
+	return NULL;
+}
+
+/**
+ * Multiply the chain on the host, from left to right, for verifying the
+ * device result.
+ *
+ * @param[in] mc Matrix chain.
+ * @param[in] inputs Host input matrices.
+ * @return Result matrix, to be freed with matmult_matrix_free().
+ * */
+int* matmult_chain_host(MatmultChain* mc, int* const* inputs) {
+
+	guint num = mc->k ? mc->k : mc->n;
+	int* C = NULL;
+	int* prev = NULL;
+	int ad[2], bd[2];
+
+	g_return_val_if_fail(mc != NULL, NULL);
+
+	matmult_chain_dims(mc, 0, ad);
+	for (guint i = 1; i < num; ++i) {
+		matmult_chain_dims(mc, mc->k ? 0 : i, bd);
+		C = matmult_matrix_new(bd[0], ad[1], NULL, NULL);
+		matmult_host(ad, bd, FALSE, FALSE, prev ? prev : inputs[0],
+			inputs[mc->k ? 0 : i], C);
+		if (prev) matmult_matrix_free(prev);
+		prev = C;
+		ad[0] = bd[0];
+	}
+	return C;
+}
+
+/**
+ * Print the order of multiplications and the floating point operations
+ * saved with respect to the left-to-right order.
+ *
+ * @param[in] mc Matrix chain.
+ * @param[in] out Where to print.
+ * */
+void matmult_chain_print(MatmultChain* mc, FILE* out) {
+
+	int dims[2];
+
+	g_return_if_fail(mc != NULL);
+	g_return_if_fail(out != NULL);
+
+	if (mc->k) {
+		fprintf(out, "\n   == Matrix power: A^%u, A is %dx%d\n", mc->k,
+			mc->p[0], mc->p[0]);
+		fprintf(out, "     Repeated squaring     : %s (%u "
+			"multiplications, left-to-right: %u)\n",
+			mc->order, mc->steps->len, mc->k - 1);
+	} else {
+		fprintf(out, "\n   == Matrix chain: %u matrices\n", mc->n);
+		for (guint i = 0; i < mc->n; ++i) {
+			matmult_chain_dims(mc, i, dims);
+			fprintf(out, "     A%-2u                   : %dx%d\n",
+				i, dims[1], dims[0]);
+		}
+		fprintf(out, "     Optimal order         : %s\n", mc->order);
+	}
+	fprintf(out, "     FLOPs (chosen order)  : %.4e\n", mc->flops);
+	fprintf(out, "     FLOPs (left-to-right) : %.4e\n", mc->flops_ltr);
+	fprintf(out, "     FLOPs saved           : %.4e (%.1f%%)\n",
+		mc->flops_ltr - mc->flops,
+		100.0 * (mc->flops_ltr - mc->flops) / mc->flops_ltr);
+}
+
+/**
+ * Destroy a matrix chain, including its intermediate device buffers.
+ *
+ * @param[in] mc Matrix chain to destroy.
+ * */
+void matmult_chain_destroy(MatmultChain* mc) {
+
+	g_return_if_fail(mc != NULL);
+
+	if (mc->tmp) {
+		for (guint j = 0; j < mc->steps->len; ++j)
+			if (mc->tmp[j]) ccl_ex_footprint_buffer_destroy(mc->tmp[j]);
+		g_free(mc->tmp);
+	}
+	g_free(mc->evts);
+	g_free(mc->p);
+	g_free(mc->order);
+	g_array_free(mc->steps, TRUE);
+	g_slice_free(MatmultChain, mc);
+}
@@ -0,0 +1,379 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Size-aware dispatch of matrix multiplications between the host and
+ * the OpenCL device.
+ *
+ * Host and device times are predicted from a calibration table, built
+ * once per device, driver, kernel, local work size and number of host
+ * threads by a short sweep over square matrices, and cached in
+ * `cf4ocl-examples/dispatch.ini` in the user cache directory (or in the
+ * file given by the `CCL_EX_DISPATCH_CACHE` environment variable). The
+ * table keeps the measured times, and linear models are fitted to it:
+ *
+ * * host time as a function of multiply-adds;
+ * * device transfer time as a function of bytes transferred;
+ * * device kernel time as a function of multiply-adds;
+ * * a constant device overhead (enqueuing and synchronization).
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#include "matmult.h"
+
+/* Smallest and largest size of the calibration sweep (powers of two). */
+#define MATMULT_DISPATCH_MIN 16
+#define MATMULT_DISPATCH_MAX 512
+
+/* Maximum number of sizes in the calibration sweep. */
+#define MATMULT_DISPATCH_SIZES 6
+
+/* Linear model, @f$t = a + bx@f$. */
+struct matmult_dispatch_model {
+	double a;
+	double b;
+};
+
+/* Dispatcher. */
+struct matmult_dispatch {
+	/* Cache key. */
+	gchar* key;
+	/* Calibration table. */
+	int sizes[MATMULT_DISPATCH_SIZES];
+	MatmultDispatchSample samples[MATMULT_DISPATCH_SIZES];
+	guint num_samples;
+	/* Was the table loaded from the cache? */
+	gboolean cached;
+	/* Fitted models. */
+	struct matmult_dispatch_model host;
+	struct matmult_dispatch_model xfer;
+	struct matmult_dispatch_model kernel;
+	double overhead;
+};
+
+/* Get cache file path. */
+static gchar* matmult_dispatch_cache_path(void) {
+
+	const gchar* env = g_getenv("CCL_EX_DISPATCH_CACHE");
+
+	if (env != NULL) return g_strdup(env);
+	return g_build_filename(
+		g_get_user_cache_dir(), "cf4ocl-examples", "dispatch.ini", NULL);
+}
+
+/* Fit a linear model by least squares. Intercepts are times, so they
+ * can't be negative; if the fit gives a negative intercept, the line
+ * goes through the origin instead. */
+static struct matmult_dispatch_model matmult_dispatch_fit(
+	const double* x, const double* y, guint n) {
+
+	struct matmult_dispatch_model m = { 0, 0 };
+	double sx = 0, sy = 0, sxx = 0, sxy = 0, den;
+
+	for (guint i = 0; i < n; ++i) {
+		sx += x[i];
+		sy += y[i];
+		sxx += x[i] * x[i];
+		sxy += x[i] * y[i];
+	}
+
+	den = n * sxx - sx * sx;
+	if (den > 0) {
+		m.b = (n * sxy - sx * sy) / den;
+		m.a = (sy - m.b * sx) / n;
+	}
+	if ((den <= 0) || (m.a < 0)) {
+		m.a = 0;
+		m.b = sxx > 0 ? sxy / sxx : 0;
+	}
+	return m;
+}
+
+/* Fit models to the calibration table. */
+static void matmult_dispatch_models_fit(MatmultDispatch* md) {
+
+	double ops[MATMULT_DISPATCH_SIZES], bytes[MATMULT_DISPATCH_SIZES];
+	double host[MATMULT_DISPATCH_SIZES], xfer[MATMULT_DISPATCH_SIZES];
+	double kernel[MATMULT_DISPATCH_SIZES];
+	guint n = md->num_samples;
+
+	md->overhead = 0;
+	for (guint i = 0; i < n; ++i) {
+		ops[i] = (double) md->sizes[i] * md->sizes[i] * md->sizes[i];
+		bytes[i] = md->samples[i].xfer_bytes;
+		host[i] = md->samples[i].host;
+		xfer[i] = md->samples[i].xfer;
+		kernel[i] = md->samples[i].kernel;
+		md->overhead += md->samples[i].overhead / n;
+	}
+
+	md->host = matmult_dispatch_fit(ops, host, n);
+	md->xfer = matmult_dispatch_fit(bytes, xfer, n);
+	md->kernel = matmult_dispatch_fit(ops, kernel, n);
+}
+
+/* Load calibration table from cache. Returns TRUE if a valid table was
+ * found. */
+static gboolean matmult_dispatch_load(MatmultDispatch* md) {
+
+	GKeyFile* kf = g_key_file_new();
+	gchar* path = matmult_dispatch_cache_path();
+	gint* sizes = NULL;
+	gdouble* cols[5] = { NULL, NULL, NULL, NULL, NULL };
+	const char* names[5] =
+		{ "host", "xfer", "xfer_bytes", "kernel", "overhead" };
+	gsize n = 0, len;
+	gboolean found = FALSE;
+
+	if (!g_key_file_load_from_file(kf, path, G_KEY_FILE_NONE, NULL))
+		goto finish;
+
+	sizes = g_key_file_get_integer_list(kf, md->key, "sizes", &n, NULL);
+	if ((sizes == NULL) || (n < 2) || (n > MATMULT_DISPATCH_SIZES))
+		goto finish;
+	for (guint c = 0; c < 5; ++c) {
+		cols[c] = g_key_file_get_double_list(
+			kf, md->key, names[c], &len, NULL);
+		if ((cols[c] == NULL) || (len != n)) goto finish;
+	}
+
+	for (guint i = 0; i < n; ++i) {
+		md->sizes[i] = sizes[i];
+		md->samples[i].host = cols[0][i];
+		md->samples[i].xfer = cols[1][i];
+		md->samples[i].xfer_bytes = cols[2][i];
+		md->samples[i].kernel = cols[3][i];
+		md->samples[i].overhead = cols[4][i];
+	}
+	md->num_samples = n;
+	found = TRUE;
+
+finish:
+	g_free(sizes);
+	for (guint c = 0; c < 5; ++c) g_free(cols[c]);
+	g_key_file_free(kf);
+	g_free(path);
+	return found;
+}
+
+/* Save calibration table to cache file. */
+static void matmult_dispatch_save(MatmultDispatch* md, GError** err) {
+
+	GKeyFile* kf = g_key_file_new();
+	gchar* path = matmult_dispatch_cache_path();
+	gchar* dir = g_path_get_dirname(path);
+	gdouble col[MATMULT_DISPATCH_SIZES];
+	guint n = md->num_samples;
+
+	/* Keep existing entries. */
+	g_key_file_load_from_file(kf, path, G_KEY_FILE_KEEP_COMMENTS, NULL);
+
+	g_key_file_set_integer_list(kf, md->key, "sizes", md->sizes, n);
+	for (guint i = 0; i < n; ++i) col[i] = md->samples[i].host;
+	g_key_file_set_double_list(kf, md->key, "host", col, n);
+	for (guint i = 0; i < n; ++i) col[i] = md->samples[i].xfer;
+	g_key_file_set_double_list(kf, md->key, "xfer", col, n);
+	for (guint i = 0; i < n; ++i) col[i] = md->samples[i].xfer_bytes;
+	g_key_file_set_double_list(kf, md->key, "xfer_bytes", col, n);
+	for (guint i = 0; i < n; ++i) col[i] = md->samples[i].kernel;
+	g_key_file_set_double_list(kf, md->key, "kernel", col, n);
+	for (guint i = 0; i < n; ++i) col[i] = md->samples[i].overhead;
+	g_key_file_set_double_list(kf, md->key, "overhead", col, n);
+
+	g_mkdir_with_parents(dir, 0755);
+	g_key_file_save_to_file(kf, path, err);
+
+	g_key_file_free(kf);
+	g_free(path);
+	g_free(dir);
+}
+
+/**
+ * Create a new dispatcher.
+ *
+ * @param[in] dev Device which competes with the host.
+ * @param[in] kernel_name Name of the multiplication kernel.
+ * @param[in] lws Local work size used by the kernel.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return A new dispatcher, to be destroyed with
+ * matmult_dispatch_destroy(), or `NULL` if an error occurs.
+ * */
+MatmultDispatch* matmult_dispatch_new(CCLDevice* dev,
+	const char* kernel_name, const size_t* lws, GError** err) {
+
+	MatmultDispatch* md;
+	GError* err_internal = NULL;
+	char* dev_name;
+	char* driver;
+	int threads = 1;
+
+	g_return_val_if_fail(dev != NULL, NULL);
+	g_return_val_if_fail(kernel_name != NULL, NULL);
+	g_return_val_if_fail(lws != NULL, NULL);
+
+	dev_name = ccl_device_get_info_array(
+		dev, CL_DEVICE_NAME, char, &err_internal);
+	if_err_goto(err_internal, error_handler);
+	driver = ccl_device_get_info_array(
+		dev, CL_DRIVER_VERSION, char, &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+#ifdef USE_OPENMP
+	threads = omp_get_max_threads();
+#endif
+
+	md = g_slice_new0(MatmultDispatch);
+	md->key = g_strdup_printf("%s|%s|%s|%ux%u|%d threads",
+		dev_name, driver, kernel_name,
+		(unsigned int) lws[0], (unsigned int) lws[1], threads);
+	g_strcanon(md->key,
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+		"0123456789 ._-|^()", '_');
+
+	return md;
+
+error_handler:
+	g_propagate_error(err, err_internal);
+	return NULL;
+}
+
+/**
+ * Get the calibration table, from the cache file or by a sweep over
+ * square matrices. The result of a sweep is saved in the cache file.
+ *
+ * @param[in] md Dispatcher.
+ * @param[in] timer Function which times a multiplication of square
+ * matrices on the host and on the device.
+ * @param[in] data Data passed to `timer`.
+ * @param[in] recalibrate Ignore cached table and sweep again.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return `TRUE` if a calibration table is available, `FALSE` otherwise.
+ * */
+gboolean matmult_dispatch_calibrate(MatmultDispatch* md,
+	matmult_dispatch_timer timer, void* data, gboolean recalibrate,
+	GError** err) {
+
+	GError* err_internal = NULL;
+
+	g_return_val_if_fail(md != NULL, FALSE);
+	g_return_val_if_fail(timer != NULL, FALSE);
+
+	/* Try cache first. */
+	if (!recalibrate && matmult_dispatch_load(md)) {
+		md->cached = TRUE;
+		matmult_dispatch_models_fit(md);
+		return TRUE;
+	}
+
+	/* Sweep square sizes, skipping the ones which don't fit the
+	 * device. */
+	g_printf("\n   == Dispatch: calibrating '%s'\n", md->key);
+	md->num_samples = 0;
+	md->cached = FALSE;
+	for (int size = MATMULT_DISPATCH_MIN; size <= MATMULT_DISPATCH_MAX;
+		size *= 2) {
+
+		MatmultDispatchSample* s = &md->samples[md->num_samples];
+
+		if (!timer(size, s, data, &err_internal)) {
+			if_err_goto(err_internal, error_handler);
+			continue;
+		}
+		md->sizes[md->num_samples++] = size;
+		g_printf("      %4d x %-4d host %.3e s, device %.3e s\n", size,
+			size, s->host, s->xfer + s->kernel + s->overhead);
+	}
+
+	if_err_create_goto(err_internal, CCL_EX_ERROR, md->num_samples < 2,
+		CCL_EX_FAIL, error_handler,
+		"Dispatch calibration needs at least two matrix sizes which "
+		"fit the device.");
+
+	matmult_dispatch_models_fit(md);
+	matmult_dispatch_save(md, &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	return TRUE;
+
+error_handler:
+	g_propagate_error(err, err_internal);
+	return FALSE;
+}
+
+/**
+ * Predict host and device times of a multiplication.
+ *
+ * @param[in] md Dispatcher, with a calibration table.
+ * @param[in] ops Number of multiply-adds.
+ * @param[in] bytes Bytes transferred between host and device.
+ * @param[out] t_host Predicted host time in seconds.
+ * @param[out] t_dev Predicted device time in seconds, including
+ * transfers.
+ * */
+void matmult_dispatch_predict(MatmultDispatch* md, double ops,
+	double bytes, double* t_host, double* t_dev) {
+
+	g_return_if_fail(md != NULL);
+	g_return_if_fail(md->num_samples > 0);
+
+	*t_host = md->host.a + md->host.b * ops;
+	*t_dev = md->overhead + md->xfer.a + md->xfer.b * bytes
+		+ md->kernel.a + md->kernel.b * ops;
+}
+
+/**
+ * Print the calibration models.
+ *
+ * @param[in] md Dispatcher, with a calibration table.
+ * @param[in] out Where to print models.
+ * */
+void matmult_dispatch_print(MatmultDispatch* md, FILE* out) {
+
+	g_return_if_fail(md != NULL);
+	g_return_if_fail(out != NULL);
+
+	fprintf(out, "\n   == Dispatch: %s calibration table for '%s' "
+		"(%u sizes, %d to %d)\n", md->cached ? "cached" : "new", md->key,
+		md->num_samples, md->sizes[0], md->sizes[md->num_samples - 1]);
+	fprintf(out, "      Host     : %.3e s + %.3e s/op\n",
+		md->host.a, md->host.b);
+	fprintf(out, "      Transfer : %.3e s + %.3e s/byte\n",
+		md->xfer.a, md->xfer.b);
+	fprintf(out, "      Kernel   : %.3e s + %.3e s/op\n",
+		md->kernel.a, md->kernel.b);
+	fprintf(out, "      Overhead : %.3e s\n", md->overhead);
+}
+
+/**
+ * Destroy a dispatcher.
+ *
+ * @param[in] md Dispatcher to destroy.
+ * */
+void matmult_dispatch_destroy(MatmultDispatch* md) {
+
+	g_return_if_fail(md != NULL);
+
+	g_free(md->key);
+	g_slice_free(MatmultDispatch, md);
+}
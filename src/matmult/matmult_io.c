@@ -0,0 +1,444 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Memory-mapped matrix files for matmult.
+ *
+ * Matrices of `cl_int` are read from and written to NumPy `.npy` files
+ * (little-endian `int32`, C order, two dimensions) or headered raw
+ * binary files, which are mapped into memory instead of being read or
+ * parsed. Raw files start with ::MatmultRawHeader, followed by the
+ * matrix rows at the given data offset.
+ *
+ * Files created here put the matrix at a page boundary, so that their
+ * mapping can back a `CL_MEM_USE_HOST_PTR` device buffer. Input files
+ * are mapped copy-on-write, so the file is never modified even if the
+ * OpenCL implementation writes to the host pointer.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#include "matmult.h"
+
+#ifdef G_OS_UNIX
+	#define MATMULT_IO_MMAP
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+#endif
+
+/* Offset of matrix data in files created by this module. */
+#define MATMULT_IO_ALIGN 4096
+
+/* Magic string of .npy files. */
+#define MATMULT_IO_NPY_MAGIC "\x93NUMPY"
+
+/* Length of the magic string of .npy files. */
+#define MATMULT_IO_NPY_MAGIC_LEN 6
+
+/* Memory-mapped matrix file. */
+struct matmult_mfile {
+	/* Mapped file contents. */
+	void* map;
+	/* Size of the mapping in bytes. */
+	size_t map_size;
+	/* Offset of matrix data in the file. */
+	size_t offset;
+	/* Dimensions (cols, rows) of the matrix. */
+	int dims[2];
+};
+
+#ifdef MATMULT_IO_MMAP
+
+/* Parse the header of a .npy file with `size` bytes, returning the
+ * offset of matrix data, or 0 if the header is not valid for a matrix
+ * of `cl_int`. */
+static size_t matmult_io_npy_parse(const guchar* map, size_t size,
+	int* dims) {
+
+	size_t hlen, hstart;
+	gchar* header = NULL;
+	const gchar* p;
+	gint64 rows, cols;
+	gchar* end;
+	size_t offset = 0;
+
+	if ((size < 10) || (memcmp(map, MATMULT_IO_NPY_MAGIC,
+		MATMULT_IO_NPY_MAGIC_LEN) != 0)) return 0;
+
+	/* Version 1.0 has a 16-bit header length, later versions have a
+	 * 32-bit one. */
+	if (map[6] == 1) {
+		hlen = map[8] | (map[9] << 8);
+		hstart = 10;
+	} else if ((size >= 12) && ((map[6] == 2) || (map[6] == 3))) {
+		hlen = map[8] | (map[9] << 8) | ((size_t) map[10] << 16)
+			| ((size_t) map[11] << 24);
+		hstart = 12;
+	} else {
+		return 0;
+	}
+	if (hstart + hlen > size) return 0;
+	header = g_strndup((const gchar*) map + hstart, hlen);
+
+	/* Little-endian 32-bit integers in C order. */
+	if (strstr(header, "'<i4'") == NULL) goto finish;
+	p = strstr(header, "'fortran_order':");
+	if ((p == NULL) || (strncmp(g_strchug((gchar*) p + 16), "False", 5)
+		!= 0)) goto finish;
+
+	/* Shape is (rows, cols). */
+	p = strstr(header, "'shape':");
+	if (p == NULL) goto finish;
+	p = strchr(p, '(');
+	if (p == NULL) goto finish;
+	rows = g_ascii_strtoll(p + 1, &end, 10);
+	if ((end == p + 1) || (*end != ',')) goto finish;
+	p = end + 1;
+	cols = g_ascii_strtoll(p, &end, 10);
+	if ((end == p) || (rows < 1) || (rows > G_MAXINT) || (cols < 1)
+		|| (cols > G_MAXINT)) goto finish;
+	while (*end == ' ') end++;
+	if ((*end != ')') && !((*end == ',') && (end[1] == ')')))
+		goto finish;
+
+	dims[0] = (int) cols;
+	dims[1] = (int) rows;
+	offset = hstart + hlen;
+
+finish:
+	g_free(header);
+	return offset;
+}
+
+/* Write the header of a .npy file with data at ::MATMULT_IO_ALIGN. */
+static void matmult_io_npy_write(guchar* map, const int* dims) {
+
+	size_t hlen = MATMULT_IO_ALIGN - 10;
+	gchar* dict = g_strdup_printf("{'descr': '<i4', 'fortran_order': "
+		"False, 'shape': (%d, %d), }", dims[1], dims[0]);
+	size_t dlen = strlen(dict);
+
+	memcpy(map, MATMULT_IO_NPY_MAGIC, MATMULT_IO_NPY_MAGIC_LEN);
+	map[6] = 1;
+	map[7] = 0;
+	map[8] = hlen & 0xff;
+	map[9] = (hlen >> 8) & 0xff;
+
+	/* Dictionary, padded with spaces and terminated by a newline. */
+	memcpy(map + 10, dict, dlen);
+	memset(map + 10 + dlen, ' ', hlen - dlen - 1);
+	map[10 + hlen - 1] = '\n';
+	g_free(dict);
+}
+
+#endif
+
+/* Check if a file name has the .npy extension. */
+static gboolean matmult_io_is_npy(const char* filename) {
+	return g_str_has_suffix(filename, ".npy")
+		|| g_str_has_suffix(filename, ".NPY");
+}
+
+/**
+ * Map a matrix file for reading.
+ *
+ * The format is determined from the file contents.
+ *
+ * @param[in] filename Name of `.npy` or raw matrix file.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return A new mapped matrix file, or `NULL` if the file can't be
+ * mapped or doesn't contain a matrix of `cl_int`.
+ * */
+MatmultMFile* matmult_mfile_open(const char* filename, GError** err) {
+
+	MatmultMFile* mf = NULL;
+
+#ifdef MATMULT_IO_MMAP
+
+	GError* err_internal = NULL;
+	struct stat st;
+	int fd;
+
+	g_return_val_if_fail(filename != NULL, NULL);
+
+	fd = open(filename, O_RDONLY);
+	if_err_create_goto(err_internal, CCL_EX_ERROR, fd < 0, CCL_EX_FAIL,
+		error_handler, "Unable to open matrix file '%s': %s.", filename,
+		g_strerror(errno));
+
+	mf = g_slice_new0(MatmultMFile);
+	if_err_create_goto(err_internal, CCL_EX_ERROR,
+		(fstat(fd, &st) != 0) || (st.st_size == 0), CCL_EX_FAIL,
+		error_handler, "Matrix file '%s' is empty or unreadable.",
+		filename);
+	mf->map_size = (size_t) st.st_size;
+
+	/* Private writable mapping: pages are shared with the page cache
+	 * until written, and writes never reach the file. */
+	mf->map = mmap(NULL, mf->map_size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE, fd, 0);
+	close(fd);
+	fd = -1;
+	if (mf->map == MAP_FAILED) mf->map = NULL;
+	if_err_create_goto(err_internal, CCL_EX_ERROR, mf->map == NULL,
+		CCL_EX_FAIL, error_handler, "Unable to map matrix file '%s'.",
+		filename);
+
+	/* Parse header. */
+	if (mf->map_size >= MATMULT_IO_NPY_MAGIC_LEN
+		&& memcmp(mf->map, MATMULT_IO_NPY_MAGIC,
+			MATMULT_IO_NPY_MAGIC_LEN) == 0) {
+		mf->offset = matmult_io_npy_parse(mf->map, mf->map_size, mf->dims);
+		if_err_create_goto(err_internal, CCL_EX_ERROR,
+			(mf->offset == 0) || (G_BYTE_ORDER != G_LITTLE_ENDIAN),
+			CCL_EX_FAIL, error_handler, "File '%s' must contain a " \
+			"two-dimensional C-order array of little-endian int32 on a " \
+			"little-endian host.", filename);
+	} else {
+		MatmultRawHeader* hdr = (MatmultRawHeader*) mf->map;
+		if_err_create_goto(err_internal, CCL_EX_ERROR,
+			(mf->map_size < sizeof(MatmultRawHeader))
+				|| (memcmp(hdr->magic, MATMULT_RAW_MAGIC,
+					sizeof(hdr->magic)) != 0)
+				|| (GUINT32_FROM_LE(hdr->version) != 1)
+				|| (GUINT32_FROM_LE(hdr->offset)
+					< sizeof(MatmultRawHeader))
+				|| ((gint32) GUINT32_FROM_LE(hdr->cols) < 1)
+				|| ((gint32) GUINT32_FROM_LE(hdr->rows) < 1),
+			CCL_EX_FAIL, error_handler,
+			"File '%s' is neither a .npy nor a raw matrix file.",
+			filename);
+		mf->offset = GUINT32_FROM_LE(hdr->offset);
+		mf->dims[0] = (int) GUINT32_FROM_LE(hdr->cols);
+		mf->dims[1] = (int) GUINT32_FROM_LE(hdr->rows);
+	}
+
+	/* Data must be aligned for `cl_int` access. */
+	if_err_create_goto(err_internal, CCL_EX_ERROR,
+		mf->offset % sizeof(cl_int) != 0, CCL_EX_FAIL, error_handler,
+		"Matrix data in file '%s' is not aligned to %u bytes.", filename,
+		(unsigned) sizeof(cl_int));
+
+	/* Data must be complete. Compared by division, since the size given
+	 * by the dimensions may overflow. */
+	if_err_create_goto(err_internal, CCL_EX_ERROR,
+		(mf->offset > mf->map_size)
+			|| ((size_t) mf->dims[1]
+				> (mf->map_size - mf->offset) / sizeof(cl_int)
+					/ (size_t) mf->dims[0]),
+		CCL_EX_FAIL, error_handler,
+		"Matrix file '%s' is truncated.", filename);
+
+	/* Matrices are read from start to end by the host and by device
+	 * transfers. */
+	madvise(mf->map, mf->map_size, MADV_SEQUENTIAL);
+	madvise(mf->map, mf->map_size, MADV_WILLNEED);
+
+	return mf;
+
+error_handler:
+	if (fd >= 0) close(fd);
+	if (mf) matmult_mfile_close(mf);
+	g_propagate_error(err, err_internal);
+	return NULL;
+
+#else
+
+	g_set_error(err, CCL_EX_ERROR, CCL_EX_FAIL,
+		"Matrix files (%s) are not supported on this platform.",
+		filename);
+	return mf;
+
+#endif
+}
+
+/**
+ * Create and map a matrix file for writing.
+ *
+ * The file is a `.npy` file if its name ends with `.npy`, or a raw
+ * matrix file otherwise. Matrix data starts at a page boundary and is
+ * written to the file through the mapping.
+ *
+ * @param[in] filename Name of the file, which is replaced if it exists.
+ * @param[in] cols Number of columns of the matrix.
+ * @param[in] rows Number of rows of the matrix.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return A new mapped matrix file, or `NULL` if an error occurs.
+ * */
+MatmultMFile* matmult_mfile_create(const char* filename, int cols,
+	int rows, GError** err) {
+
+	MatmultMFile* mf = NULL;
+
+#ifdef MATMULT_IO_MMAP
+
+	GError* err_internal = NULL;
+	int fd;
+
+	g_return_val_if_fail(filename != NULL, NULL);
+	g_return_val_if_fail((cols > 0) && (rows > 0), NULL);
+
+	fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if_err_create_goto(err_internal, CCL_EX_ERROR, fd < 0, CCL_EX_FAIL,
+		error_handler, "Unable to create matrix file '%s': %s.",
+		filename, g_strerror(errno));
+
+	mf = g_slice_new0(MatmultMFile);
+	mf->dims[0] = cols;
+	mf->dims[1] = rows;
+	mf->offset = MATMULT_IO_ALIGN;
+	mf->map_size = mf->offset + (size_t) cols * rows * sizeof(cl_int);
+
+	if_err_create_goto(err_internal, CCL_EX_ERROR,
+		ftruncate(fd, (off_t) mf->map_size) != 0, CCL_EX_FAIL,
+		error_handler, "Unable to resize matrix file '%s': %s.",
+		filename, g_strerror(errno));
+	mf->map = mmap(NULL, mf->map_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED, fd, 0);
+	close(fd);
+	fd = -1;
+	if (mf->map == MAP_FAILED) mf->map = NULL;
+	if_err_create_goto(err_internal, CCL_EX_ERROR, mf->map == NULL,
+		CCL_EX_FAIL, error_handler, "Unable to map matrix file '%s'.",
+		filename);
+
+	/* Write header. */
+	if (matmult_io_is_npy(filename)) {
+		matmult_io_npy_write(mf->map, mf->dims);
+	} else {
+		MatmultRawHeader* hdr = (MatmultRawHeader*) mf->map;
+		memcpy(hdr->magic, MATMULT_RAW_MAGIC, sizeof(hdr->magic));
+		hdr->version = GUINT32_TO_LE(1);
+		hdr->offset = GUINT32_TO_LE((guint32) mf->offset);
+		hdr->cols = GUINT32_TO_LE((guint32) cols);
+		hdr->rows = GUINT32_TO_LE((guint32) rows);
+	}
+
+	return mf;
+
+error_handler:
+	if (fd >= 0) close(fd);
+	if (mf) matmult_mfile_close(mf);
+	g_propagate_error(err, err_internal);
+	return NULL;
+
+#else
+
+	(void) cols;
+	(void) rows;
+	(void) matmult_io_is_npy;
+	g_set_error(err, CCL_EX_ERROR, CCL_EX_FAIL,
+		"Matrix files (%s) are not supported on this platform.",
+		filename);
+	return mf;
+
+#endif
+}
+
+/**
+ * Get the matrix of a mapped matrix file.
+ *
+ * @param[in] mf Mapped matrix file.
+ * @return Matrix rows, valid until the file is closed.
+ * */
+int* matmult_mfile_data(MatmultMFile* mf) {
+	g_return_val_if_fail(mf != NULL, NULL);
+	return (int*) ((guchar*) mf->map + mf->offset);
+}
+
+/**
+ * Get the dimensions of the matrix of a mapped matrix file.
+ *
+ * @param[in] mf Mapped matrix file.
+ * @param[out] dims Dimensions (cols, rows) of the matrix.
+ * */
+void matmult_mfile_dims_get(MatmultMFile* mf, int* dims) {
+	g_return_if_fail(mf != NULL);
+	dims[0] = mf->dims[0];
+	dims[1] = mf->dims[1];
+}
+
+/**
+ * Create a read-only device buffer with the matrix of a mapped matrix
+ * file.
+ *
+ * The mapping itself backs the buffer (`CL_MEM_USE_HOST_PTR`) if the
+ * matrix is aligned to the device's base address alignment, so the
+ * implementation may use it without copying. Otherwise, the matrix is
+ * copied into the buffer.
+ *
+ * @param[in] mf Mapped matrix file, which must not be closed before the
+ * buffer is destroyed.
+ * @param[in] ctx Context wrapper.
+ * @param[in] dev Device wrapper.
+ * @param[out] use_host_ptr If not `NULL`, set to `TRUE` if the mapping
+ * backs the buffer.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return A new device buffer, to be destroyed with
+ * ccl_ex_footprint_buffer_destroy(), or `NULL` if an error occurs.
+ * */
+CCLBuffer* matmult_mfile_buffer_new(MatmultMFile* mf, CCLContext* ctx,
+	CCLDevice* dev, gboolean* use_host_ptr, GError** err) {
+
+	GError* err_internal = NULL;
+	cl_uint align_bits;
+	gboolean aligned;
+	int* data;
+
+	g_return_val_if_fail(mf != NULL, NULL);
+
+	align_bits = ccl_device_get_info_scalar(
+		dev, CL_DEVICE_MEM_BASE_ADDR_ALIGN, cl_uint, &err_internal);
+	if (err_internal) {
+		g_propagate_error(err, err_internal);
+		return NULL;
+	}
+
+	data = matmult_mfile_data(mf);
+	aligned = ((guintptr) data % MAX(align_bits / 8, 1)) == 0;
+	if (use_host_ptr) *use_host_ptr = aligned;
+
+	return ccl_ex_footprint_buffer_new(ctx, CL_MEM_READ_ONLY
+			| (aligned ? CL_MEM_USE_HOST_PTR : CL_MEM_COPY_HOST_PTR),
+		(size_t) mf->dims[0] * mf->dims[1] * sizeof(cl_int), data, err);
+}
+
+/**
+ * Unmap and close a matrix file. Matrices written to files created
+ * with matmult_mfile_create() are in the file after this call.
+ *
+ * @param[in] mf Mapped matrix file.
+ * */
+void matmult_mfile_close(MatmultMFile* mf) {
+
+	g_return_if_fail(mf != NULL);
+
+#ifdef MATMULT_IO_MMAP
+	if (mf->map) munmap(mf->map, mf->map_size);
+#endif
+	g_slice_free(MatmultMFile, mf);
+}
@@ -0,0 +1,196 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Thread scaling and binding study of the matmult host multiplication.
+ *
+ * Thread binding (`OMP_PROC_BIND`) and places (`OMP_PLACES`) are read
+ * by the OpenMP runtime when the program starts, so the study runs
+ * one worker process for each combination of binding policy and places.
+ * Each worker sweeps thread counts (powers of two up to the number of
+ * processors, and the number of processors itself) and schedule kinds,
+ * repeats each configuration, and reports, relative to one thread with
+ * the same binding and schedule:
+ *
+ * * speedup, @f$S_p=T_1/T_p@f$;
+ * * parallel efficiency, @f$E_p=S_p/p@f$;
+ * * Karp-Flatt experimentally determined serial fraction,
+ *   @f$e=(1/S_p-1/p)/(1-1/p)@f$.
+ *
+ * A serial fraction which grows with the thread count points to
+ * parallel overhead (e.g. memory bandwidth, scheduling or false
+ * sharing) rather than to inherently serial work.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#include "matmult.h"
+
+/* Binding policies and places swept by the study. Without binding,
+ * places are irrelevant. */
+static const char* const scaling_binds[] = { "false", "master", "close",
+	"spread" };
+static const char* const scaling_places[] = { "threads", "cores",
+	"sockets" };
+
+/**
+ * Run the thread scaling study, with one worker process for each
+ * combination of binding policy and places. Workers print their
+ * results to the standard output.
+ *
+ * @param[in] worker_argv Command line of a worker process, `NULL`
+ * terminated.
+ * @param[out] err Return location for a GError, or `NULL` if error
+ * reporting is to be ignored.
+ * @return `TRUE` if all workers ran successfully, `FALSE` otherwise.
+ * */
+gboolean matmult_scaling_run(gchar** worker_argv, GError** err) {
+
+	GError* err_internal = NULL;
+	gchar** envp = NULL;
+	gint wait_status;
+
+	g_return_val_if_fail(worker_argv != NULL, FALSE);
+
+#ifndef USE_OPENMP
+	if_err_create_goto(err_internal, CCL_EX_ERROR, TRUE, CCL_EX_FAIL,
+		error_handler, "Thread scaling study requires OpenMP.");
+#endif
+
+	for (guint b = 0; b < G_N_ELEMENTS(scaling_binds); ++b) {
+		for (guint p = 0; p < G_N_ELEMENTS(scaling_places); ++p) {
+
+			/* Places only matter with binding. */
+			if ((b == 0) && (p > 0)) break;
+
+			envp = g_get_environ();
+			envp = g_environ_setenv(envp, "OMP_PROC_BIND",
+				scaling_binds[b], TRUE);
+			if (b == 0)
+				envp = g_environ_unsetenv(envp, "OMP_PLACES");
+			else
+				envp = g_environ_setenv(envp, "OMP_PLACES",
+					scaling_places[p], TRUE);
+
+			/* Worker shares our standard output. */
+			fflush(stdout);
+			g_spawn_sync(NULL, worker_argv, envp, G_SPAWN_SEARCH_PATH,
+				NULL, NULL, NULL, NULL, &wait_status, &err_internal);
+			if_err_goto(err_internal, error_handler);
+			g_spawn_check_exit_status(wait_status, &err_internal);
+			if_err_goto(err_internal, error_handler);
+
+			g_strfreev(envp);
+			envp = NULL;
+		}
+	}
+
+	return TRUE;
+
+error_handler:
+	g_strfreev(envp);
+	g_propagate_error(err, err_internal);
+	return FALSE;
+}
+
+/**
+ * Thread scaling study worker: sweep thread counts and schedule kinds
+ * with the binding and places given in the environment.
+ *
+ * @param[in] ad Dimensions (cols, rows) of matrix A.
+ * @param[in] bd Dimensions (cols, rows) of matrix B (of @f$A^T@f$ if
+ * `aat` is true).
+ * @param[in] aat Multiply A by its transpose.
+ * @param[in] A Matrix A.
+ * @param[in] B Matrix B, ignored if `aat` is true.
+ * @param[in] reps Number of timed runs of each configuration, after one
+ * warm-up run.
+ * @param[in] out Where to print results.
+ * */
+void matmult_scaling_worker(const int* ad, const int* bd, gboolean aat,
+	const int* A, const int* B, int reps, FILE* out) {
+
+#ifdef USE_OPENMP
+
+	const struct { omp_sched_t kind; const char* name; } scheds[] = {
+		{ omp_sched_static, "static" },
+		{ omp_sched_dynamic, "dynamic" },
+		{ omp_sched_guided, "guided" } };
+	int num_procs = omp_get_num_procs();
+	int* C = matmult_matrix_new(bd[0], ad[1], NULL, NULL);
+	const char* places = g_getenv("OMP_PLACES");
+
+	fprintf(out, "\n   == Thread scaling: OMP_PROC_BIND=%s, OMP_PLACES=%s "
+		"(%d processors, best of %d runs)\n\n",
+		g_getenv("OMP_PROC_BIND"), places ? places : "(unset)",
+		num_procs, reps);
+	fprintf(out, "     %-8s %7s %12s %12s %9s %10s %10s\n", "Schedule",
+		"Threads", "Best (s)", "Mean (s)", "Speedup", "Efficiency",
+		"Karp-Flatt");
+
+	for (guint s = 0; s < G_N_ELEMENTS(scheds); ++s) {
+
+		double t1 = 0;
+
+		omp_set_schedule(scheds[s].kind, 0);
+
+		/* Powers of two, and the number of processors. */
+		for (int p = 1; p <= num_procs; p = (p * 2 > num_procs
+			&& p < num_procs) ? num_procs : p * 2) {
+
+			double t, t_best = -1, t_sum = 0, speedup;
+			gint64 t0;
+
+			omp_set_num_threads(p);
+			for (int r = 0; r <= reps; ++r) {
+				t0 = g_get_monotonic_time();
+				matmult_host(ad, bd, aat, TRUE, A, B, C);
+				t = (g_get_monotonic_time() - t0) * 1e-6;
+
+				/* First run is a warm-up. */
+				if (r == 0) continue;
+				t_sum += t;
+				if ((t_best < 0) || (t < t_best)) t_best = t;
+			}
+			if (p == 1) t1 = t_best;
+
+			speedup = t1 / t_best;
+			fprintf(out, "     %-8s %7d %12.4e %12.4e %9.2f %9.1f%%",
+				scheds[s].name, p, t_best, t_sum / reps, speedup,
+				100.0 * speedup / p);
+			if (p > 1)
+				fprintf(out, " %10.4f\n",
+					(1.0 / speedup - 1.0 / p) / (1.0 - 1.0 / p));
+			else
+				fprintf(out, " %10s\n", "-");
+		}
+	}
+	fflush(out);
+
+	matmult_matrix_free(C);
+
+#else
+
+	(void) ad; (void) bd; (void) aat; (void) A; (void) B; (void) reps;
+	fprintf(out, "Thread scaling study requires OpenMP.\n");
+
+#endif
+}
@@ -20,15 +20,73 @@
  * @file
  * Generate random numbers with OpenCL using the cf4ocl library.
  *
- * Compile with gcc or clang:
+ * Usage: rng_ccl [NUMRN [NUMITER [MAIN_CPUS:OUT_CPUS [NUMA [SAMPLE [CAPTURE [SOAK]]]]]]]
+ *
+ * The main (RNG) and output threads are pinned to the given CPU sets,
+ * e.g. `0-3:4-7`. If NUMA is 1, the host buffer is placed on the NUMA
+ * node of the output thread, which reads it and writes it to stdout.
+ *
+ * When compiled with profiling, SAMPLE selects which iterations are
+ * profiled: 1 (default) profiles all of them, N profiles every Nth
+ * iteration and -N a random sample of one in N iterations. Sampled
+ * profiling releases events after each iteration and runs unsampled
+ * iterations on queues without profiling, reporting the overhead of
+ * profiling itself.
+ *
+ * The device is the first GPU, unless the `CCL_EX_DEVICE` environment
+ * variable selects another one (an index, or one of `menu`, `first`,
+ * `gpu`, `cpu`, `accel` or `fastest`).
+ *
+ * If a CAPTURE file is given, the OpenCL command stream is captured to
+ * it, for replaying with `cmd_replay` (an empty name captures nothing).
+ *
+ * If SOAK is given, as `DURATION[:WINDOW]` (e.g. `12h:5m`; a duration
+ * of 0 runs until `Ctrl+C`), NUMITER is ignored and random numbers are
+ * produced for the given duration. Throughput, latency percentiles, RSS
+ * and events held by the main queues are logged to stderr every window,
+ * and windows which degrade with respect to the first one are flagged.
+ *
+ * If the `CCL_EX_PERFCTR` environment variable is set, hardware counters
+ * of the output thread's writes to stdout (IPC, cache, branch and dTLB
+ * miss rates) are shown with the profiling information.
+ *
+ * Compile with gcc or clang, together with the examples_common library:
  * $ gcc -pthread -Wall -std=c99 `pkg-config --cflags cf4ocl2` \
- *       rng_ccl.c -o rng_ccl `pkg-config --libs cf4ocl2`
+ *       rng_ccl.c -o rng_ccl -lexamples_common `pkg-config --libs cf4ocl2`
  */
 
 #include <cf4ocl2.h>
 #include <pthread.h>
 #include <assert.h>
-#include "cp_sem.h"
+#include "examples_hugemem.h"
+#include "examples_footprint.h"
+#include "examples_sampprof.h"
+#include "examples_capture.h"
+#include "examples_soak.h"
+#include "examples_perfctr.h"
+#include "cp_affinity.h"
+
+/* Thread hand-offs go through lock-free rings holding tokens, or through
+ * semaphores. */
+#ifdef WITH_SPSC_RING
+	#include "spsc_ring.h"
+	typedef spsc_ring_t handoff_t;
+	#define handoff_init(h, val) \
+		do { spsc_ring_init(h); \
+			for (unsigned int _i = 0; _i < (val); _i++) \
+				spsc_ring_push((h), NULL); \
+		} while(0)
+	#define handoff_destroy(h) spsc_ring_destroy(h)
+	#define handoff_wait(h) spsc_ring_pop(h)
+	#define handoff_post(h) spsc_ring_push((h), NULL)
+#else
+	#include "cp_sem.h"
+	typedef cp_sem_t handoff_t;
+	#define handoff_init(h, val) cp_sem_init((h), (val))
+	#define handoff_destroy(h) cp_sem_destroy(h)
+	#define handoff_wait(h) cp_sem_wait(h)
+	#define handoff_post(h) cp_sem_post(h)
+#endif
 
 /* Define command queue flags depending on whether the profiling compile-time
  * flag set is set or not. */
@@ -44,7 +102,9 @@
 /* Number of iterations producing random numbers. */
 #define NUMITER_DEFAULT 10000
 
-/* Error handling macro. */
+/* Error handling macro (reports the line, unlike the one in
+ * examples_common.h). */
+#undef HANDLE_ERROR
 #define HANDLE_ERROR(err) \
 	do { if ((err) != NULL) { \
 		fprintf(stderr, "\nError at line %d: %s\n", __LINE__, (err)->message); \
@@ -58,8 +118,12 @@
 const char* kernel_filenames[] = { KERNEL_INIT ".cl", KERNEL_RNG ".cl" };
 
 /* Thread semaphores. */
-cp_sem_t sem_rng;
-cp_sem_t sem_comm;
+handoff_t sem_rng;
+handoff_t sem_comm;
+
+/* CPU sets of main (RNG) and output threads. */
+cp_cpuset_t cpus_main;
+cp_cpuset_t cpus_out;
 
 /* Information shared between main thread and data transfer/output thread. */
 struct bufshare {
@@ -71,8 +135,20 @@ struct bufshare {
 	CCLBuffer * bufdev1;
 	CCLBuffer * bufdev2;
 
-	/* Command queue for data transfers. */
+	/* Command queues for data transfers, with and without profiling
+	 * (the latter only with sampled profiling). */
 	CCLQueue * cq;
+	CCLQueue * cq_noprof;
+
+	/* Sampled profiling, if any. */
+	CCLExSampProf * sp;
+
+	/* Command-stream capture, if any. */
+	CCLExCapture * cap;
+
+	/* Hardware counters of the output thread, if requested (created by
+	 * that thread, since counters are per thread). */
+	CCLExPerfCtr * pc;
 
 	/* Possible transfer error. */
 	CCLErr * err;
@@ -80,12 +156,23 @@ struct bufshare {
 	/* Number of random numbers in buffer. */
 	cl_uint numrn;
 
-	/* Number of iterations producing random numbers. */
+	/* Number of iterations producing random numbers (in soak mode, set
+	 * by the main thread when the run is over). */
 	unsigned int numiter;
 
 	/* Buffer size in bytes. */
 	size_t bufsize;
 
+	/* Is the host buffer placed on the output thread's NUMA node? */
+	int numa_place;
+
+	/* Must the output thread touch the host buffer first to place it? */
+	int numa_touch;
+
+	/* Must the output thread release the events of each iteration (soak
+	 * runs without sampled profiling)? */
+	int gc;
+
 };
 
 /* Write random numbers directly (as binary) to stdout. */
@@ -97,34 +184,75 @@ void * rng_out(void * arg) {
 	/* Buffer pointers. */
 	CCLBuffer * bufdev1, * bufdev2, * bufswp;
 
+	/* Command queue of current iteration. */
+	CCLQueue * cq;
+
+	/* Read event. */
+	CCLEvent * evt_read;
+
+	/* Buffer offset, for capture. */
+	size_t offset = 0;
+
 	/* Unwrap argument. */
 	struct bufshare * bufs = (struct bufshare *) arg;
 
+	/* Pin thread to its CPU set, if any. */
+	cp_affinity_set(&cpus_out);
+
+	/* If the host buffer could not be placed on a specific node, place it
+	 * on the node of this thread by touching it first. */
+	if (bufs->numa_touch)
+		cp_numa_touch(bufs->bufhost, bufs->bufsize);
+
+	/* Count hardware events of this thread, if requested. */
+	if (g_getenv(CCL_EX_PERFCTR_ENV) != NULL)
+		bufs->pc = ccl_ex_perfctr_new(FALSE);
+
 	/* Get initial buffers. */
 	bufdev1 = bufs->bufdev1;
 	bufdev2 = bufs->bufdev2;
 
 	/* Read random numbers and write them to stdout. */
-	for (i = 0; i < bufs->numiter; i++) {
+	for (i = 0;
+		i < (unsigned int) g_atomic_int_get((gint *) &bufs->numiter); i++) {
 
 		/* Wait for RNG kernel from previous iteration before proceding with
 		 * next read. */
-		cp_sem_wait(&sem_rng);
+		handoff_wait(&sem_rng);
+
+		/* Only profile sampled iterations. */
+		cq = bufs->cq;
+		if ((bufs->sp) && (!ccl_ex_sampprof_is_sampled(bufs->sp, i)))
+			cq = bufs->cq_noprof;
 
 		/* Read data from device buffer into host buffer. */
-		ccl_buffer_enqueue_read(bufdev1, bufs->cq, CL_TRUE, 0,
+		evt_read = ccl_buffer_enqueue_read(bufdev1, cq, CL_TRUE, 0,
 			bufs->bufsize, bufs->bufhost, NULL, &bufs->err);
 
+		/* Capture read before the main thread can proceed. */
+		if ((bufs->cap) && (!bufs->err))
+			ccl_ex_capture_read(bufs->cap, evt_read, cq, bufdev1, CL_TRUE,
+				&offset, &bufs->bufsize, NULL);
+
+		/* Release events of this iteration, keeping their profiling
+		 * information if sampled. */
+		if ((bufs->sp) && (!bufs->err))
+			ccl_ex_sampprof_collect(bufs->sp, cq, "Comms", i, &bufs->err);
+		else if (bufs->gc)
+			ccl_queue_gc(cq);
+
 		/* Signal that read for current iteration is over. */
-		cp_sem_post(&sem_comm);
+		handoff_post(&sem_comm);
 
 		/* If error occured in read, terminate thread and let main thread
 		 * handle error. */
 		if (bufs->err) return NULL;
 
 		/* Write raw random numbers to stdout. */
+		if (bufs->pc) ccl_ex_perfctr_start(bufs->pc, "fwrite");
 		fwrite(bufs->bufhost, sizeof(cl_ulong), (size_t) bufs->numrn, stdout);
 		fflush(stdout);
+		if (bufs->pc) ccl_ex_perfctr_stop(bufs->pc, "fwrite");
 
 		/* Swap buffers. */
 		bufswp = bufdev1;
@@ -151,7 +279,9 @@ int main(int argc, char **argv) {
 	unsigned int i;
 
 	/* Host buffer. */
-	struct bufshare bufs = { NULL, NULL, NULL, NULL, NULL, 0, 0, 0 };
+	struct bufshare bufs =
+		{ NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, 0, 0, 0,
+			0, 0, 0 };
 
 	/* Communications thread. */
 	pthread_t comms_th;
@@ -161,19 +291,30 @@ int main(int argc, char **argv) {
 	CCLDevice * dev = NULL;
 	CCLProgram * prg = NULL;
 	CCLKernel * kinit = NULL, *krng = NULL;
-	CCLQueue * cq_main = NULL;
+	CCLQueue * cq_main = NULL, * cq_noprof = NULL, * cq = NULL;
 	CCLBuffer * bufdev1 = NULL, * bufdev2 = NULL, * bufswp = NULL;
 	CCLEvent * evt_exec = NULL;
 
 	/* Profiler object. */
 	CCLProf* prof = NULL;
 
+	/* Soak mode, if any. */
+	CCLExSoak * soak = NULL;
+
+	/* Profiling sample period, and start of current iteration. */
+	int sample = 1;
+	gint64 t_iter;
+
 	/* Error management objects. */
 	CCLErr * err = NULL, * err_bld;
 
 	/* Device name. */
 	char* dev_name;
 
+	/* Device requirements, first GPU by default. */
+	CCLExDevReqs dev_reqs = { FALSE, FALSE, 0, CCL_EX_WORKLOAD_COMPUTE,
+		"gpu" };
+
 	/* Real and kernel work sizes. */
 	size_t rws = 0, gws1 = 0, gws2 = 0, lws1 = 0, lws2 = 0;
 
@@ -181,8 +322,8 @@ int main(int argc, char **argv) {
 	const char * bldlog;
 
 	/* Initialize semaphores. */
-	cp_sem_init(&sem_rng, 1);
-	cp_sem_init(&sem_comm, 1);
+	handoff_init(&sem_rng, 1);
+	handoff_init(&sem_comm, 1);
 
 	/* Did user specify a number of random numbers? */
 	if (argc >= 2) {
@@ -205,8 +346,57 @@ int main(int argc, char **argv) {
 		bufs.numiter = NUMITER_DEFAULT;
 	}
 
-	/* Setup OpenCL context with GPU device. */
-	ctx = ccl_context_new_gpu(&err);
+	/* Did user specify CPU sets for the main and output threads, as
+	 * "MAIN:OUT" (e.g. "0-3:4-7")? */
+	if (argc >= 4) {
+		if (cp_affinity_parse_pair(argv[3], &cpus_main, &cpus_out) != 0) {
+			fprintf(stderr, "Invalid CPU sets '%s'\n", argv[3]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	/* Did user ask to place the host buffer on the output thread's NUMA
+	 * node? */
+	if (argc >= 5) {
+		bufs.numa_place = atoi(argv[4]);
+	}
+
+	/* Did user ask to only profile a sample of the iterations? */
+	if (argc >= 6) {
+		sample = atoi(argv[5]);
+		if (sample == 0) {
+			fprintf(stderr, "Invalid profiling sample period.\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	/* Did user ask to capture the command stream (an empty file name
+	 * skips capture)? */
+	if ((argc >= 7) && (*argv[6] != '\0')) {
+		bufs.cap = ccl_ex_capture_new(argv[6], &err);
+		HANDLE_ERROR(err);
+	}
+
+	/* Did user ask for a soak run? If so, run until it's over. */
+	if (argc >= 8) {
+		soak = ccl_ex_soak_new(argv[7], "numbers", stderr, &err);
+		HANDLE_ERROR(err);
+		bufs.numiter = G_MAXUINT;
+		bufs.gc = 1;
+	}
+
+	/* Pin main thread to its CPU set, if any. */
+	cp_affinity_set(&cpus_main);
+
+	/* Report memory footprint at exit, for this problem size (stdout is
+	 * for random numbers). */
+	ccl_ex_footprint_report_at_exit(argv[0], stderr);
+	ccl_ex_footprint_param("numrn", bufs.numrn);
+	if (!soak) ccl_ex_footprint_param("numiter", bufs.numiter);
+
+	/* Setup OpenCL context with GPU device, or with the device given
+	 * in the environment. */
+	ctx = ccl_ex_context_new(NULL, &dev_reqs, &err);
 	HANDLE_ERROR(err);
 
 	/* Get device. */
@@ -223,6 +413,16 @@ int main(int argc, char **argv) {
 	bufs.cq = ccl_queue_new(ctx, dev, CQ_FLAGS, &err);
 	HANDLE_ERROR(err);
 
+	/* With sampled profiling, unsampled iterations run on queues without
+	 * profiling. */
+	if ((CQ_FLAGS) && (sample != 1)) {
+		bufs.sp = ccl_ex_sampprof_new(sample, g_random_int());
+		cq_noprof = ccl_queue_new(ctx, dev, 0, &err);
+		HANDLE_ERROR(err);
+		bufs.cq_noprof = ccl_queue_new(ctx, dev, 0, &err);
+		HANDLE_ERROR(err);
+	}
+
 	/* Create program. */
 	prg = ccl_program_new_from_source_files(ctx, 2, kernel_filenames, &err);
 	HANDLE_ERROR(err);
@@ -239,6 +439,10 @@ int main(int argc, char **argv) {
 	}
 	HANDLE_ERROR(err);
 
+	/* Capture program sources. */
+	if (bufs.cap)
+		ccl_ex_capture_program(bufs.cap, 2, kernel_filenames, NULL);
+
 	/* Get kernels. */
 	kinit = ccl_program_get_kernel(prg, KERNEL_INIT, &err);
 	HANDLE_ERROR(err);
@@ -251,14 +455,18 @@ int main(int argc, char **argv) {
 	ccl_kernel_suggest_worksizes(krng, dev, 1, &rws, &gws2, &lws2, &err);
 	HANDLE_ERROR(err);
 
-	/* Allocate memory for host buffer. */
-	bufs.bufhost = (cl_ulong*) malloc(bufs.bufsize);
+	/* Allocate memory for host buffer, huge page backed, on the output
+	 * thread's NUMA node if requested (if the node is unknown or the
+	 * buffer can't be placed, the output thread touches it first). */
+	bufs.bufhost = (cl_ulong*) ccl_ex_hugemem_alloc(bufs.bufsize);
+	bufs.numa_touch = bufs.numa_place && !cp_numa_bind(bufs.bufhost,
+		bufs.bufsize, cp_affinity_node(&cpus_out));
 
 	/* Create device buffers. */
-	bufdev1 = ccl_buffer_new(
+	bufdev1 = ccl_ex_footprint_buffer_new(
 		ctx, CL_MEM_READ_WRITE, bufs.bufsize, NULL, &err);
 	HANDLE_ERROR(err);
-	bufdev2 = ccl_buffer_new(
+	bufdev2 = ccl_ex_footprint_buffer_new(
 		ctx, CL_MEM_READ_WRITE, bufs.bufsize, NULL, &err);
 	HANDLE_ERROR(err);
 
@@ -273,8 +481,17 @@ int main(int argc, char **argv) {
 		(unsigned int) gws1, (unsigned int) lws1);
 	fprintf(stderr, " * Global/local work sizes (rng) : %u/%u\n",
 		(unsigned int) gws2, (unsigned int) lws2);
-	fprintf(stderr, " * Number of iterations          : %u\n",
-		(unsigned int) bufs.numiter);
+	if (soak)
+		fprintf(stderr, " * Number of iterations          : soak run\n");
+	else
+		fprintf(stderr, " * Number of iterations          : %u\n",
+			(unsigned int) bufs.numiter);
+	cp_affinity_print(stderr, " * Main thread CPUs              : ",
+		&cpus_main);
+	cp_affinity_print(stderr, " * Output thread CPUs            : ",
+		&cpus_out);
+	fprintf(stderr, " * Host buffer NUMA placement    : %s\n",
+		bufs.numa_place ? "output thread node" : "default");
 
 	/* Start profiling. */
 	prof = ccl_prof_new();
@@ -295,21 +512,46 @@ int main(int argc, char **argv) {
 	ccl_queue_finish(cq_main, &err);
 	HANDLE_ERROR(err);
 
+	/* Capture initialization. */
+	if (bufs.cap) {
+		ccl_ex_capture_arg_mem(bufs.cap, kinit, 0, bufdev1);
+		ccl_ex_capture_arg_priv(bufs.cap, kinit, 1,
+			&bufs.numrn, sizeof(cl_uint));
+		ccl_ex_capture_kernel(bufs.cap, evt_exec, cq_main, kinit, 1,
+			&gws1, &lws1, NULL);
+		ccl_ex_capture_finish(bufs.cap, cq_main);
+		ccl_ex_capture_arg_priv(bufs.cap, krng, 0,
+			&bufs.numrn, sizeof(cl_uint));
+	}
+
 	/* Invoke thread to output random numbers to stdout
 	 * (in raw, binary form). */
 	pthread_create(&comms_th, NULL, rng_out, &bufs);
 
+	/* Track events held by the main queues in soak mode (the output
+	 * thread uses its queues concurrently). */
+	if (soak) {
+		ccl_ex_soak_add_queue(soak, cq_main);
+		if (cq_noprof) ccl_ex_soak_add_queue(soak, cq_noprof);
+	}
+
 	/* Produce random numbers. */
 	for (i = 0; i < bufs.numiter - 1; i++) {
 
 		/* Wait for read from previous iteration. */
-		cp_sem_wait(&sem_comm);
+		handoff_wait(&sem_comm);
 
 		/* Handle possible errors in comms thread. */
 		HANDLE_ERROR(bufs.err);
 
+		/* Only profile sampled iterations. */
+		t_iter = g_get_monotonic_time();
+		cq = cq_main;
+		if ((bufs.sp) && (!ccl_ex_sampprof_is_sampled(bufs.sp, i)))
+			cq = cq_noprof;
+
 		/* Run random number generation kernel. */
-		evt_exec = ccl_kernel_set_args_and_enqueue_ndrange(krng, cq_main, 1,
+		evt_exec = ccl_kernel_set_args_and_enqueue_ndrange(krng, cq, 1,
 			NULL, (const size_t*) &gws2, (const size_t*) &lws2, NULL, &err,
 			ccl_arg_skip, bufdev1, bufdev2, /* Kernel arguments. */
 			NULL);
@@ -317,11 +559,39 @@ int main(int argc, char **argv) {
 		ccl_event_set_name(evt_exec, "RNG_KERNEL");
 
 		/* Wait for random number generation kernel to finish. */
-		ccl_queue_finish(cq_main, &err);
+		ccl_queue_finish(cq, &err);
 		HANDLE_ERROR(err);
 
+		/* In soak mode, when the run is over, tell the output thread
+		 * to stop after reading the result of this iteration (the
+		 * handoff below publishes the new number of iterations). */
+		if ((soak) && (!ccl_ex_soak_iter(soak,
+			(g_get_monotonic_time() - t_iter) * 1e-6, bufs.numrn)))
+			g_atomic_int_set((gint *) &bufs.numiter, i + 2);
+
+		/* Capture iteration before the output thread can proceed. */
+		if (bufs.cap) {
+			ccl_ex_capture_arg_mem(bufs.cap, krng, 1, bufdev1);
+			ccl_ex_capture_arg_mem(bufs.cap, krng, 2, bufdev2);
+			ccl_ex_capture_kernel(bufs.cap, evt_exec, cq, krng, 1,
+				&gws2, &lws2, NULL);
+			ccl_ex_capture_finish(bufs.cap, cq);
+		}
+
 		/* Signal that RNG kernel from previous iteration is over. */
-		cp_sem_post(&sem_rng);
+		handoff_post(&sem_rng);
+
+		/* Account for iteration time and release events of this
+		 * iteration, keeping their profiling information if sampled. */
+		if (bufs.sp) {
+			ccl_ex_sampprof_iter_time(bufs.sp, i,
+				(g_get_monotonic_time() - t_iter) * 1e-6);
+			ccl_ex_sampprof_collect(bufs.sp, cq, "Main", i, &err);
+			HANDLE_ERROR(err);
+		}
+
+		/* In soak mode, release events of this iteration. */
+		if (soak) ccl_ex_soak_gc(soak);
 
 		/* Swap buffers. */
 		bufswp = bufdev1;
@@ -336,20 +606,42 @@ int main(int argc, char **argv) {
 	/* Stop profiling. */
 	ccl_prof_stop(prof);
 
+	/* Host buffer was written by the output thread, sample memory
+	 * usage. */
+	ccl_ex_footprint_sample();
+
 #ifdef WITH_PROFILING
 
-	/* Add queues to the profiler object. */
-	ccl_prof_add_queue(prof, "Main", cq_main);
-	ccl_prof_add_queue(prof, "Comms", bufs.cq);
+	if (bufs.sp) {
 
-	/* Perform profiling calculations. */
-	ccl_prof_calc(prof, &err);
-	HANDLE_ERROR(err);
+		/* Show sampled profiling info, events were already
+		 * released. */
+		HANDLE_ERROR(bufs.err);
+		ccl_ex_sampprof_summary_print(bufs.sp, stderr);
+		fprintf(stderr, "\n");
+
+	} else if (soak) {
+
+		/* Events were released during the soak run. */
+		fprintf(stderr, " * Events were released during the soak run, use "
+			"a sample period for profiling info.\n");
+
+	} else {
 
-	/* Show profiling info. */
-	fprintf(stderr, "%s", ccl_prof_get_summary(prof,
-		CCL_PROF_AGG_SORT_TIME | CCL_PROF_SORT_DESC,
-		CCL_PROF_OVERLAP_SORT_DURATION | CCL_PROF_SORT_DESC));
+		/* Add queues to the profiler object. */
+		ccl_prof_add_queue(prof, "Main", cq_main);
+		ccl_prof_add_queue(prof, "Comms", bufs.cq);
+
+		/* Perform profiling calculations. */
+		ccl_prof_calc(prof, &err);
+		HANDLE_ERROR(err);
+
+		/* Show profiling info. */
+		fprintf(stderr, "%s", ccl_prof_get_summary(prof,
+			CCL_PROF_AGG_SORT_TIME | CCL_PROF_SORT_DESC,
+			CCL_PROF_OVERLAP_SORT_DURATION | CCL_PROF_SORT_DESC));
+
+	}
 #else
 
 	/* Show elapsed time. */
@@ -358,24 +650,55 @@ int main(int argc, char **argv) {
 
 #endif
 
-	/* Destroy profiler object. */
+	/* Show throughput, for comparing thread placements. */
+	fprintf(stderr, " * Throughput                        : %.2f MB/s\n",
+		bufs.numiter * (double) bufs.bufsize
+		/ (1024 * 1024 * ccl_prof_time_elapsed(prof)));
+
+	/* Show why writing to stdout takes the time it takes. */
+	if (bufs.pc) {
+		ccl_ex_perfctr_summary_print(bufs.pc, stderr);
+		fprintf(stderr, "\n");
+		ccl_ex_perfctr_destroy(bufs.pc);
+	}
+
+	/* Show how the host buffer is backed. */
+	ccl_ex_hugemem_stats_print(stderr);
+
+	/* Finish command-stream capture. */
+	if (bufs.cap) {
+		ccl_ex_capture_close(bufs.cap, &err);
+		HANDLE_ERROR(err);
+		fprintf(stderr, " * Command stream captured to '%s'\n", argv[6]);
+	}
+
+	/* Show soak run summary. */
+	if (soak) {
+		ccl_ex_soak_summary_print(soak, stderr);
+		ccl_ex_soak_destroy(soak);
+	}
+
+	/* Destroy profiler objects. */
 	ccl_prof_destroy(prof);
+	if (bufs.sp) ccl_ex_sampprof_destroy(bufs.sp);
 
 	/* Destroy cf4ocl wrappers - only the ones created with ccl_*_new()
 	 * functions. */
-	if (bufdev1) ccl_buffer_destroy(bufdev1);
-	if (bufdev2) ccl_buffer_destroy(bufdev2);
+	if (bufdev1) ccl_ex_footprint_buffer_destroy(bufdev1);
+	if (bufdev2) ccl_ex_footprint_buffer_destroy(bufdev2);
 	if (cq_main) ccl_queue_destroy(cq_main);
 	if (bufs.cq) ccl_queue_destroy(bufs.cq);
+	if (cq_noprof) ccl_queue_destroy(cq_noprof);
+	if (bufs.cq_noprof) ccl_queue_destroy(bufs.cq_noprof);
 	if (prg) ccl_program_destroy(prg);
 	if (ctx) ccl_context_destroy(ctx);
 
 	/* Free host resources */
-	if (bufs.bufhost) free(bufs.bufhost);
+	ccl_ex_hugemem_free(bufs.bufhost);
 
 	/* Destroy semaphores. */
-	cp_sem_destroy(&sem_comm);
-	cp_sem_destroy(&sem_rng);
+	handoff_destroy(&sem_comm);
+	handoff_destroy(&sem_rng);
 
 	/* Check that all cf4ocl wrapper objects are destroyed. */
 	assert(ccl_wrapper_memcheck());
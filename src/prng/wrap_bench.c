@@ -0,0 +1,518 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Microbenchmark of the overhead of _cf4ocl_ wrappers over raw OpenCL,
+ * at the level of the calls made in the hot paths of rng_ccl and
+ * rng_ocl.
+ *
+ * The same OpenCL objects (queue, kernel, buffers) are used through
+ * both APIs, in tight loops of:
+ *
+ * * Setting the three arguments of an empty kernel with the signature
+ *   of the RNG kernel. _cf4ocl_ only stores the arguments, which are
+ *   set with `clSetKernelArg()` when the kernel is enqueued, so this row
+ *   measures deferred work.
+ * * Enqueuing the empty kernel, keeping its event.
+ * * Setting arguments and enqueuing, as rng_ccl and rng_ocl do for each
+ *   batch of random numbers.
+ * * Enqueuing a marker, i.e. creating an event.
+ * * Blocking reads of a single value.
+ *
+ * Raw OpenCL events are kept and released after each measurement, as
+ * _cf4ocl_ keeps its event wrappers until the queue is garbage
+ * collected, so that both APIs do the same work in the timed loop. The
+ * reported values are the best average time per call over all
+ * repetitions, in nanoseconds.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ */
+
+#include "examples_common.h"
+#include "examples_footprint.h"
+
+/** Default number of calls per measurement. */
+#define ITERS 10000
+
+/** Default number of repetitions of each measurement. */
+#define REPS 5
+
+/** Work size of the empty kernel. */
+#define WS 64
+
+/** A description of the program. */
+#define PROG_DESCRIPTION "Microbenchmark of cf4ocl wrapper overhead " \
+	"versus raw OpenCL"
+
+/* Command queue flags. */
+#ifdef WITH_PROFILING
+	#define CQ_FLAGS CL_QUEUE_PROFILING_ENABLE
+#else
+	#define CQ_FLAGS 0
+#endif
+
+/* Empty kernel with the same arguments as the RNG kernel. */
+static const char* kernel_src =
+	"__kernel void rng_empty(const uint nseeds, __global ulong *in,\n"
+	"	__global ulong *out) { }\n";
+
+/* Command line arguments and respective default values. */
+static int iters = ITERS;
+static int reps = REPS;
+static gchar* device = NULL;
+static gboolean version;
+
+/* Valid command line options. */
+static GOptionEntry entries[] = {
+	{"iters",   'n', 0, G_OPTION_ARG_INT,  &iters,
+		"Number of calls per measurement (default is "
+		G_STRINGIFY(ITERS) ")",
+		"N"},
+	{"reps",    'r', 0, G_OPTION_ARG_INT,  &reps,
+		"Number of repetitions of each measurement (default is "
+		G_STRINGIFY(REPS) ")",
+		"N"},
+	{"device",  'd', 0, G_OPTION_ARG_STRING, &device,
+		"Device index, or one of menu, first, gpu, cpu, accel or "\
+		"fastest (if not given, use $CCL_EX_DEVICE or chose device "\
+		"from menu)",
+		"INDEX|SELECTOR"},
+	{"version",  0,  0, G_OPTION_ARG_NONE, &version,
+		"Output version information and exit",
+		NULL},
+	{ NULL, 0, 0, 0, NULL, NULL, NULL }
+};
+
+/**
+ * OpenCL objects used by the measurements, through both APIs.
+ * */
+typedef struct wrap_bench {
+
+	/** Wrappers. */
+	CCLQueue* cq;
+	CCLKernel* krnl;
+	CCLBuffer* buf1;
+	CCLBuffer* buf2;
+	/** Raw objects, unwrapped from the above. */
+	cl_command_queue q;
+	cl_kernel k;
+	cl_mem m1;
+	cl_mem m2;
+	/** OpenCL version of the platform, e.g. 120 for 1.2. */
+	cl_uint ocl_ver;
+	/** Kernel arguments and work sizes. */
+	cl_uint nseeds;
+	size_t gws;
+	size_t lws;
+	/** Raw events of one measurement. */
+	cl_event* evts;
+	/** Destination of reads. */
+	cl_ulong host_val;
+
+} WrapBench;
+
+/**
+ * An operation measured through both APIs. Each function returns the
+ * average time per call in nanoseconds, or a negative value on error.
+ * */
+typedef struct wrap_op {
+
+	/** Operation name. */
+	const char* name;
+	/** Measure with cf4ocl. */
+	double (*ccl)(WrapBench* wb, GError** err);
+	/** Measure with raw OpenCL. */
+	double (*ocl)(WrapBench* wb, GError** err);
+
+} WrapOp;
+
+/* Average time per call, in nanoseconds. */
+static double wb_ns(gint64 t0, gint64 t1) {
+	return (t1 - t0) * 1000.0 / iters;
+}
+
+/* Wait for cf4ocl commands of a measurement and release their events. */
+static gboolean wb_ccl_done(WrapBench* wb, GError** err) {
+	if (!ccl_queue_finish(wb->cq, err)) return FALSE;
+	ccl_queue_gc(wb->cq);
+	return TRUE;
+}
+
+/* Wait for raw commands of a measurement and release the first `n` of
+ * their events. */
+static gboolean wb_ocl_done(WrapBench* wb, int n, cl_int status,
+	GError** err) {
+
+	if (status == CL_SUCCESS) status = clFinish(wb->q);
+	for (int i = 0; i < n; ++i) clReleaseEvent(wb->evts[i]);
+	if (status != CL_SUCCESS) {
+		g_set_error(err, CCL_EX_ERROR, CCL_EX_FAIL,
+			"OpenCL error %d in raw measurement.", status);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* Set kernel arguments, cf4ocl. */
+static double wb_set_args_ccl(WrapBench* wb, GError** err) {
+
+	gint64 t0, t1;
+
+	t0 = g_get_monotonic_time();
+	for (int i = 0; i < iters; ++i)
+		ccl_kernel_set_args(wb->krnl, ccl_arg_priv(wb->nseeds, cl_uint),
+			wb->buf1, wb->buf2, NULL);
+	t1 = g_get_monotonic_time();
+
+	/* Arguments are only set when the kernel is enqueued. */
+	if (!ccl_kernel_enqueue_ndrange(wb->krnl, wb->cq, 1, NULL, &wb->gws,
+		&wb->lws, NULL, err)) return -1;
+	return wb_ccl_done(wb, err) ? wb_ns(t0, t1) : -1;
+}
+
+/* Set kernel arguments, raw OpenCL. */
+static double wb_set_args_ocl(WrapBench* wb, GError** err) {
+
+	cl_int status = CL_SUCCESS;
+	gint64 t0, t1;
+
+	t0 = g_get_monotonic_time();
+	for (int i = 0; (i < iters) && (status == CL_SUCCESS); ++i) {
+		status = clSetKernelArg(
+			wb->k, 0, sizeof(cl_uint), (const void*) &wb->nseeds);
+		if (status == CL_SUCCESS) status = clSetKernelArg(
+			wb->k, 1, sizeof(cl_mem), (const void*) &wb->m1);
+		if (status == CL_SUCCESS) status = clSetKernelArg(
+			wb->k, 2, sizeof(cl_mem), (const void*) &wb->m2);
+	}
+	t1 = g_get_monotonic_time();
+
+	return wb_ocl_done(wb, 0, status, err) ? wb_ns(t0, t1) : -1;
+}
+
+/* Enqueue empty kernel, cf4ocl. */
+static double wb_enqueue_ccl(WrapBench* wb, GError** err) {
+
+	gint64 t0, t1;
+	GError* err_internal = NULL;
+
+	t0 = g_get_monotonic_time();
+	for (int i = 0; (i < iters) && !err_internal; ++i)
+		ccl_kernel_enqueue_ndrange(wb->krnl, wb->cq, 1, NULL, &wb->gws,
+			&wb->lws, NULL, &err_internal);
+	t1 = g_get_monotonic_time();
+
+	if (err_internal) {
+		g_propagate_error(err, err_internal);
+		return -1;
+	}
+	return wb_ccl_done(wb, err) ? wb_ns(t0, t1) : -1;
+}
+
+/* Enqueue empty kernel, raw OpenCL. */
+static double wb_enqueue_ocl(WrapBench* wb, GError** err) {
+
+	cl_int status = CL_SUCCESS;
+	gint64 t0, t1;
+	int n = 0;
+
+	t0 = g_get_monotonic_time();
+	for (; (n < iters) && (status == CL_SUCCESS); ++n)
+		status = clEnqueueNDRangeKernel(wb->q, wb->k, 1, NULL, &wb->gws,
+			&wb->lws, 0, NULL, &wb->evts[n]);
+	t1 = g_get_monotonic_time();
+
+	if (status != CL_SUCCESS) n--;
+	return wb_ocl_done(wb, n, status, err) ? wb_ns(t0, t1) : -1;
+}
+
+/* Set kernel arguments and enqueue empty kernel, cf4ocl. */
+static double wb_set_enqueue_ccl(WrapBench* wb, GError** err) {
+
+	gint64 t0, t1;
+	GError* err_internal = NULL;
+
+	t0 = g_get_monotonic_time();
+	for (int i = 0; (i < iters) && !err_internal; ++i)
+		ccl_kernel_set_args_and_enqueue_ndrange(wb->krnl, wb->cq, 1, NULL,
+			&wb->gws, &wb->lws, NULL, &err_internal,
+			ccl_arg_priv(wb->nseeds, cl_uint), wb->buf1, wb->buf2, NULL);
+	t1 = g_get_monotonic_time();
+
+	if (err_internal) {
+		g_propagate_error(err, err_internal);
+		return -1;
+	}
+	return wb_ccl_done(wb, err) ? wb_ns(t0, t1) : -1;
+}
+
+/* Set kernel arguments and enqueue empty kernel, raw OpenCL. */
+static double wb_set_enqueue_ocl(WrapBench* wb, GError** err) {
+
+	cl_int status = CL_SUCCESS;
+	gint64 t0, t1;
+	int n = 0;
+
+	t0 = g_get_monotonic_time();
+	for (; (n < iters) && (status == CL_SUCCESS); ++n) {
+		status = clSetKernelArg(
+			wb->k, 0, sizeof(cl_uint), (const void*) &wb->nseeds);
+		if (status == CL_SUCCESS) status = clSetKernelArg(
+			wb->k, 1, sizeof(cl_mem), (const void*) &wb->m1);
+		if (status == CL_SUCCESS) status = clSetKernelArg(
+			wb->k, 2, sizeof(cl_mem), (const void*) &wb->m2);
+		if (status == CL_SUCCESS) status = clEnqueueNDRangeKernel(
+			wb->q, wb->k, 1, NULL, &wb->gws, &wb->lws, 0, NULL,
+			&wb->evts[n]);
+	}
+	t1 = g_get_monotonic_time();
+
+	if (status != CL_SUCCESS) n--;
+	return wb_ocl_done(wb, n, status, err) ? wb_ns(t0, t1) : -1;
+}
+
+/* Enqueue marker, cf4ocl. */
+static double wb_marker_ccl(WrapBench* wb, GError** err) {
+
+	gint64 t0, t1;
+	GError* err_internal = NULL;
+
+	t0 = g_get_monotonic_time();
+	for (int i = 0; (i < iters) && !err_internal; ++i)
+		ccl_enqueue_marker(wb->cq, NULL, &err_internal);
+	t1 = g_get_monotonic_time();
+
+	if (err_internal) {
+		g_propagate_error(err, err_internal);
+		return -1;
+	}
+	return wb_ccl_done(wb, err) ? wb_ns(t0, t1) : -1;
+}
+
+/* Enqueue marker, raw OpenCL. */
+static double wb_marker_ocl(WrapBench* wb, GError** err) {
+
+	cl_int status = CL_SUCCESS;
+	gint64 t0, t1;
+	int n = 0;
+
+	t0 = g_get_monotonic_time();
+	for (; (n < iters) && (status == CL_SUCCESS); ++n) {
+#ifdef CL_VERSION_1_2
+		if (wb->ocl_ver >= 120)
+			status = clEnqueueMarkerWithWaitList(
+				wb->q, 0, NULL, &wb->evts[n]);
+		else
+#endif
+			status = clEnqueueMarker(wb->q, &wb->evts[n]);
+	}
+	t1 = g_get_monotonic_time();
+
+	if (status != CL_SUCCESS) n--;
+	return wb_ocl_done(wb, n, status, err) ? wb_ns(t0, t1) : -1;
+}
+
+/* Blocking read of one value, cf4ocl. */
+static double wb_read_ccl(WrapBench* wb, GError** err) {
+
+	gint64 t0, t1;
+	GError* err_internal = NULL;
+
+	t0 = g_get_monotonic_time();
+	for (int i = 0; (i < iters) && !err_internal; ++i)
+		ccl_buffer_enqueue_read(wb->buf1, wb->cq, CL_TRUE, 0,
+			sizeof(cl_ulong), &wb->host_val, NULL, &err_internal);
+	t1 = g_get_monotonic_time();
+
+	if (err_internal) {
+		g_propagate_error(err, err_internal);
+		return -1;
+	}
+	return wb_ccl_done(wb, err) ? wb_ns(t0, t1) : -1;
+}
+
+/* Blocking read of one value, raw OpenCL. */
+static double wb_read_ocl(WrapBench* wb, GError** err) {
+
+	cl_int status = CL_SUCCESS;
+	gint64 t0, t1;
+	int n = 0;
+
+	t0 = g_get_monotonic_time();
+	for (; (n < iters) && (status == CL_SUCCESS); ++n)
+		status = clEnqueueReadBuffer(wb->q, wb->m1, CL_TRUE, 0,
+			sizeof(cl_ulong), &wb->host_val, 0, NULL, &wb->evts[n]);
+	t1 = g_get_monotonic_time();
+
+	if (status != CL_SUCCESS) n--;
+	return wb_ocl_done(wb, n, status, err) ? wb_ns(t0, t1) : -1;
+}
+
+/* Operations to measure. */
+static const WrapOp ops[] = {
+	{ "set args (3)",        wb_set_args_ccl,    wb_set_args_ocl    },
+	{ "enqueue kernel",      wb_enqueue_ccl,     wb_enqueue_ocl     },
+	{ "set args + enqueue",  wb_set_enqueue_ccl, wb_set_enqueue_ocl },
+	{ "marker (new event)",  wb_marker_ccl,      wb_marker_ocl      },
+	{ "blocking read (8 B)", wb_read_ccl,        wb_read_ocl        }
+};
+
+/**
+ * Wrapper overhead microbenchmark main function.
+ *
+ * @param[in] argc Number of command line arguments.
+ * @param[in] argv Command line arguments.
+ * @return #CCL_EX_SUCCESS if program returns with no error, or
+ * #CCL_EX_FAIL otherwise.
+ * */
+int main(int argc, char *argv[]) {
+
+	/* Function and program return status. */
+	int status;
+	/* Error management. */
+	GError *err = NULL;
+	/* Command line options context. */
+	GOptionContext* opt_ctx = NULL;
+	/* Device requirements. */
+	CCLExDevReqs dev_reqs = { FALSE, FALSE, 0, CCL_EX_WORKLOAD_MEMORY,
+		NULL };
+	/* Wrappers. */
+	CCLContext* ctx = NULL;
+	CCLDevice* dev = NULL;
+	CCLProgram* prg = NULL;
+	/* Objects used by the measurements. */
+	WrapBench wb = { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+		0, WS, WS, WS, NULL, 0 };
+	/* Device name. */
+	char* dev_name;
+
+	/* Parse command line options. */
+	opt_ctx = g_option_context_new (" - " PROG_DESCRIPTION);
+	g_option_context_add_main_entries(opt_ctx, entries, NULL);
+	g_option_context_parse(opt_ctx, &argc, &argv, &err);
+	if_err_goto(err, error_handler);
+	if_err_create_goto(err, CCL_EX_ERROR, (iters < 1) || (reps < 1),
+		CCL_EX_FAIL, error_handler,
+		"Number of calls and repetitions must be positive.");
+
+	/* If version was requested, output version and exit. */
+	if (version) {
+		ccl_ex_version_print("wrap_bench");
+		exit(0);
+	}
+
+	/* Create context, queue, buffers and empty kernel. */
+	ctx = ccl_ex_context_new(device, &dev_reqs, &err);
+	if_err_goto(err, error_handler);
+	dev = ccl_context_get_device(ctx, 0, &err);
+	if_err_goto(err, error_handler);
+	dev_name = ccl_device_get_info_array(dev, CL_DEVICE_NAME, char, &err);
+	if_err_goto(err, error_handler);
+	wb.ocl_ver = ccl_context_get_opencl_version(ctx, &err);
+	if_err_goto(err, error_handler);
+
+	wb.cq = ccl_queue_new(ctx, dev, CQ_FLAGS, &err);
+	if_err_goto(err, error_handler);
+	wb.buf1 = ccl_ex_footprint_buffer_new(ctx, CL_MEM_READ_WRITE,
+		WS * sizeof(cl_ulong), NULL, &err);
+	if_err_goto(err, error_handler);
+	wb.buf2 = ccl_ex_footprint_buffer_new(ctx, CL_MEM_READ_WRITE,
+		WS * sizeof(cl_ulong), NULL, &err);
+	if_err_goto(err, error_handler);
+
+	prg = ccl_program_new_from_source(ctx, kernel_src, &err);
+	if_err_goto(err, error_handler);
+	ccl_program_build(prg, NULL, &err);
+	if_err_goto(err, error_handler);
+	wb.krnl = ccl_program_get_kernel(prg, "rng_empty", &err);
+	if_err_goto(err, error_handler);
+
+	wb.q = ccl_queue_unwrap(wb.cq);
+	wb.k = ccl_kernel_unwrap(wb.krnl);
+	wb.m1 = ccl_buffer_unwrap(wb.buf1);
+	wb.m2 = ccl_buffer_unwrap(wb.buf2);
+	wb.evts = g_new(cl_event, iters);
+
+	g_printf("\n   ======================== cf4ocl wrapper overhead ========================\n\n");
+	g_printf("     Device                    : %s\n", dev_name);
+	g_printf("     Calls per measurement     : %d\n", iters);
+	g_printf("     Repetitions               : %d\n\n", reps);
+	g_printf("     %-20s %12s %12s %14s %8s\n", "Operation",
+		"cf4ocl (ns)", "OpenCL (ns)", "Overhead (ns)", "Ratio");
+	g_printf("     -------------------------------------------------------------------------\n");
+
+	/* Measure each operation, alternating APIs; the first repetition
+	 * warms up caches and the driver, and is not counted. */
+	for (guint i = 0; i < G_N_ELEMENTS(ops); ++i) {
+
+		double ccl_min = G_MAXDOUBLE, ocl_min = G_MAXDOUBLE;
+
+		for (int r = 0; r <= reps; ++r) {
+			double t_ccl, t_ocl;
+			t_ccl = ops[i].ccl(&wb, &err);
+			if_err_goto(err, error_handler);
+			t_ocl = ops[i].ocl(&wb, &err);
+			if_err_goto(err, error_handler);
+			if (r == 0) continue;
+			ccl_min = MIN(ccl_min, t_ccl);
+			ocl_min = MIN(ocl_min, t_ocl);
+		}
+
+		g_printf("     %-20s %12.1f %12.1f %14.1f %7.2fx\n", ops[i].name,
+			ccl_min, ocl_min, ccl_min - ocl_min,
+			ocl_min > 0 ? ccl_min / ocl_min : 0.0);
+	}
+	g_printf("\n     cf4ocl stores kernel arguments and sets them when the kernel is\n"
+		"     enqueued, so \"set args + enqueue\" is the comparable hot path.\n\n");
+
+	/* If we get here, everything went Ok. */
+	status = CCL_EX_SUCCESS;
+	g_assert(err == NULL);
+	goto clean_all;
+
+error_handler:
+	/* Handle error. */
+	g_assert(err != NULL);
+	g_fprintf(stderr, "Error: %s\n", err->message);
+	status = err->code;
+	g_error_free(err);
+
+clean_all:
+
+	/* Release wrappers and host memory. */
+	if (wb.evts) g_free(wb.evts);
+	if (wb.buf1) ccl_ex_footprint_buffer_destroy(wb.buf1);
+	if (wb.buf2) ccl_ex_footprint_buffer_destroy(wb.buf2);
+	if (prg) ccl_program_destroy(prg);
+	if (wb.cq) ccl_queue_destroy(wb.cq);
+	if (ctx) ccl_context_destroy(ctx);
+
+	/* Free command line options context and variables. */
+	if (opt_ctx) g_option_context_free(opt_ctx);
+	if (device) g_free(device);
+
+	/* Check all wrappers have been destroyed. */
+	g_assert(ccl_wrapper_memcheck());
+
+	/* Return status. */
+	return status;
+
+}
@@ -0,0 +1,646 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Replay of command streams captured by the examples (rng_ccl with a
+ * sixth argument, ca_mt with a ninth), see `examples_capture.h`.
+ *
+ * The program is rebuilt from the captured sources and the stream is
+ * re-executed in capture order against synthetic buffers and images of
+ * the captured sizes, with the captured queues, event dependencies and
+ * host synchronization points, but without any of the host work of the
+ * example. Transfers use a scratch host buffer and kernels see
+ * unspecified data. All queues have profiling enabled, and the
+ * profiling summary gives device-only timings, which can be compared
+ * across devices by replaying the same stream on each of them.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ */
+
+#include "examples_common.h"
+#include "examples_capture.h"
+#include <string.h>
+
+/** A description of the program. */
+#define PROG_DESCRIPTION "Replay of captured OpenCL command streams"
+
+/* Command line arguments and respective default values. */
+static int reps = 1;
+static gchar* device = NULL;
+static gboolean version;
+
+/* Valid command line options. */
+static GOptionEntry entries[] = {
+	{"reps",    'n', 0, G_OPTION_ARG_INT,  &reps,
+		"Number of times to replay the stream (default is 1)",
+		"N"},
+	{"device",  'd', 0, G_OPTION_ARG_STRING, &device,
+		"Device index, or one of menu, first, gpu, cpu, accel or "\
+		"fastest (if not given, use $CCL_EX_DEVICE or chose device "\
+		"from menu)",
+		"INDEX|SELECTOR"},
+	{"version",  0,  0, G_OPTION_ARG_NONE, &version,
+		"Output version information and exit",
+		NULL},
+	{ NULL, 0, 0, 0, NULL, NULL, NULL }
+};
+
+/**
+ * A captured buffer or image.
+ * */
+typedef struct replay_mem {
+	/** Is it an image? */
+	gboolean is_image;
+	/** Memory flags. */
+	cl_mem_flags flags;
+	/** Size in bytes (buffers). */
+	size_t size;
+	/** Format and dimensions (images). */
+	cl_image_format format;
+	size_t width;
+	size_t height;
+} ReplayMem;
+
+/**
+ * A captured command or kernel argument.
+ * */
+typedef struct replay_cmd {
+	/** Record kind: `A`, `K`, `R`, `W` or `S`. */
+	char kind;
+	/** Command identifier (not for arguments). */
+	guint id;
+	/** Queue (kernels, transfers and finishes). */
+	guint queue;
+	/** Kernel name (arguments and kernels). */
+	gchar* kernel;
+	/** Work sizes (kernels). */
+	cl_uint dims;
+	size_t gws[3];
+	size_t lws[3];
+	gboolean has_lws;
+	/** Memory object (transfers and memory arguments). */
+	guint mem;
+	/** Transfer details. */
+	cl_bool blocking;
+	size_t origin[3];
+	size_t region[3];
+	/** Argument index, kind (`m`, `p` or `l`), value and size. */
+	cl_uint index;
+	char arg_kind;
+	guchar* value;
+	size_t size;
+	/** Synchronization kind, `E` (events) or `Q` (queue). */
+	char sync;
+	/** Commands waited for. */
+	GArray* waits;
+} ReplayCmd;
+
+/**
+ * A captured command stream.
+ * */
+typedef struct replay_stream {
+	/** Program sources, concatenated. */
+	GString* source;
+	/** Build options, or `NULL`. */
+	gchar* options;
+	/** Queue properties. */
+	GArray* queues;
+	/** Buffers and images. */
+	GArray* mems;
+	/** Commands and kernel arguments, in capture order. */
+	GArray* cmds;
+	/** Number of command identifiers. */
+	guint num_ids;
+	/** Largest transfer in bytes. */
+	size_t max_bytes;
+} ReplayStream;
+
+/* Parse a comma-separated list of at most 3 sizes, or `-`. */
+static cl_uint replay_sizes(const char* field, size_t* sizes) {
+
+	gchar** vals;
+	cl_uint n = 0;
+
+	if (g_strcmp0(field, "-") == 0) return 0;
+	vals = g_strsplit(field, ",", 4);
+	for (n = 0; vals[n] && (n < 3); ++n)
+		sizes[n] = (size_t) g_ascii_strtoull(vals[n], NULL, 10);
+	g_strfreev(vals);
+	return n;
+}
+
+/* Parse a comma-separated list of earlier command identifiers, or
+ * `-`. */
+static GArray* replay_waits(const char* field, guint num_ids) {
+
+	GArray* waits = g_array_new(FALSE, FALSE, sizeof(guint));
+	gchar** vals;
+	guint id;
+
+	if (g_strcmp0(field, "-") == 0) return waits;
+	vals = g_strsplit(field, ",", -1);
+	for (guint i = 0; vals[i]; ++i) {
+		id = (guint) g_ascii_strtoull(vals[i], NULL, 10);
+		if (id >= num_ids) {
+			g_array_free(waits, TRUE);
+			waits = NULL;
+			break;
+		}
+		g_array_append_val(waits, id);
+	}
+	g_strfreev(vals);
+	return waits;
+}
+
+/* Free a command stream. */
+static void replay_stream_free(ReplayStream* rs) {
+
+	if (rs->cmds) {
+		for (guint i = 0; i < rs->cmds->len; ++i) {
+			ReplayCmd* c = &g_array_index(rs->cmds, ReplayCmd, i);
+			g_free(c->kernel);
+			g_free(c->value);
+			if (c->waits) g_array_free(c->waits, TRUE);
+		}
+		g_array_free(rs->cmds, TRUE);
+	}
+	if (rs->mems) g_array_free(rs->mems, TRUE);
+	if (rs->queues) g_array_free(rs->queues, TRUE);
+	if (rs->source) g_string_free(rs->source, TRUE);
+	g_free(rs->options);
+	g_slice_free(ReplayStream, rs);
+}
+
+/* Load a command stream written by the capture module. */
+static ReplayStream* replay_stream_load(const char* filename,
+	GError** err) {
+
+	ReplayStream* rs;
+	gchar* contents = NULL;
+	gchar** lines = NULL;
+	gchar** f = NULL;
+	GError* err_internal = NULL;
+
+	rs = g_slice_new0(ReplayStream);
+	rs->source = g_string_new(NULL);
+	rs->queues = g_array_new(FALSE, FALSE,
+		sizeof(cl_command_queue_properties));
+	rs->mems = g_array_new(FALSE, TRUE, sizeof(ReplayMem));
+	rs->cmds = g_array_new(FALSE, TRUE, sizeof(ReplayCmd));
+
+	g_file_get_contents(filename, &contents, NULL, &err_internal);
+	if_err_goto(err_internal, error_handler);
+
+	if_err_create_goto(err_internal, CCL_EX_ERROR,
+		!g_str_has_prefix(contents, CCL_EX_CAPTURE_MAGIC), CCL_EX_FAIL,
+		error_handler, "%s: not a captured command stream.", filename);
+
+	lines = g_strsplit(contents, "\n", -1);
+	for (guint l = 1; lines[l]; ++l) {
+
+		ReplayCmd c;
+		guint nf;
+		gboolean ok = TRUE;
+
+		if (*lines[l] == '\0') continue;
+		f = g_strsplit(lines[l], "\t", -1);
+		nf = g_strv_length(f);
+		memset(&c, 0, sizeof(ReplayCmd));
+		c.kind = f[0][0];
+
+		if ((c.kind == 'P') && (nf == 3)) {
+
+			/* Program source. */
+			gchar* src = g_strcompress(f[2]);
+			g_string_append_printf(rs->source, "%s\n", src);
+			g_free(src);
+			if ((rs->options == NULL) && (g_strcmp0(f[1], "-") != 0))
+				rs->options = g_strcompress(f[1]);
+
+		} else if ((c.kind == 'Q') && (nf == 3)) {
+
+			/* Queue, identifiers are assigned in order. */
+			cl_command_queue_properties props =
+				g_ascii_strtoull(f[2], NULL, 10);
+			ok = (g_ascii_strtoull(f[1], NULL, 10) == rs->queues->len);
+			g_array_append_val(rs->queues, props);
+
+		} else if (((c.kind == 'B') && (nf == 4))
+			|| ((c.kind == 'I') && (nf == 7))) {
+
+			/* Buffer or image, identifiers are assigned in order. */
+			ReplayMem m;
+			memset(&m, 0, sizeof(ReplayMem));
+			ok = (g_ascii_strtoull(f[1], NULL, 10) == rs->mems->len);
+			m.flags = g_ascii_strtoull(f[2], NULL, 10);
+			if (c.kind == 'B') {
+				m.size = g_ascii_strtoull(f[3], NULL, 10);
+			} else {
+				m.is_image = TRUE;
+				m.format.image_channel_order =
+					(cl_channel_order) g_ascii_strtoull(f[3], NULL, 10);
+				m.format.image_channel_data_type =
+					(cl_channel_type) g_ascii_strtoull(f[4], NULL, 10);
+				m.width = g_ascii_strtoull(f[5], NULL, 10);
+				m.height = g_ascii_strtoull(f[6], NULL, 10);
+			}
+			g_array_append_val(rs->mems, m);
+
+		} else if ((c.kind == 'A') && (nf == 5)) {
+
+			/* Kernel argument. */
+			c.kernel = g_strdup(f[1]);
+			c.index = (cl_uint) g_ascii_strtoull(f[2], NULL, 10);
+			c.arg_kind = f[3][0];
+			if (c.arg_kind == 'm') {
+				c.mem = (guint) g_ascii_strtoull(f[4], NULL, 10);
+				ok = (c.mem < rs->mems->len);
+			} else if (c.arg_kind == 'p') {
+				c.size = strlen(f[4]) / 2;
+				c.value = g_malloc(c.size);
+				for (size_t i = 0; i < c.size; ++i)
+					c.value[i] = (guchar)
+						((g_ascii_xdigit_value(f[4][2 * i]) << 4)
+						| g_ascii_xdigit_value(f[4][2 * i + 1]));
+			} else if (c.arg_kind == 'l') {
+				c.size = g_ascii_strtoull(f[4], NULL, 10);
+			} else {
+				ok = FALSE;
+			}
+			g_array_append_val(rs->cmds, c);
+
+		} else if ((c.kind == 'K') && (nf == 7)) {
+
+			/* Kernel launch. */
+			c.id = (guint) g_ascii_strtoull(f[1], NULL, 10);
+			c.queue = (guint) g_ascii_strtoull(f[2], NULL, 10);
+			c.kernel = g_strdup(f[3]);
+			c.dims = replay_sizes(f[4], c.gws);
+			c.has_lws = (replay_sizes(f[5], c.lws) == c.dims);
+			c.waits = replay_waits(f[6], rs->num_ids);
+			ok = (c.id == rs->num_ids) && (c.dims > 0)
+				&& (c.queue < rs->queues->len) && (c.waits != NULL);
+			rs->num_ids++;
+			g_array_append_val(rs->cmds, c);
+
+		} else if (((c.kind == 'R') || (c.kind == 'W')) && (nf == 9)) {
+
+			/* Read or write. */
+			size_t bytes;
+			c.id = (guint) g_ascii_strtoull(f[1], NULL, 10);
+			c.queue = (guint) g_ascii_strtoull(f[2], NULL, 10);
+			c.mem = (guint) g_ascii_strtoull(f[3], NULL, 10);
+			c.blocking = g_ascii_strtoull(f[4], NULL, 10) ? CL_TRUE : CL_FALSE;
+			replay_sizes(f[5], c.origin);
+			replay_sizes(f[6], c.region);
+			bytes = g_ascii_strtoull(f[7], NULL, 10);
+			rs->max_bytes = MAX(rs->max_bytes, bytes);
+			c.waits = replay_waits(f[8], rs->num_ids);
+			ok = (c.id == rs->num_ids) && (c.queue < rs->queues->len)
+				&& (c.mem < rs->mems->len) && (c.waits != NULL);
+			rs->num_ids++;
+			g_array_append_val(rs->cmds, c);
+
+		} else if ((c.kind == 'S') && (nf == 4)) {
+
+			/* Host synchronization. */
+			c.id = (guint) g_ascii_strtoull(f[1], NULL, 10);
+			c.sync = f[2][0];
+			if (c.sync == 'Q') {
+				c.queue = (guint) g_ascii_strtoull(f[3], NULL, 10);
+				ok = (c.queue < rs->queues->len);
+			} else {
+				c.waits = replay_waits(f[3], rs->num_ids);
+				ok = (c.sync == 'E') && (c.waits != NULL);
+			}
+			ok = ok && (c.id == rs->num_ids);
+			rs->num_ids++;
+			g_array_append_val(rs->cmds, c);
+
+		} else {
+			ok = FALSE;
+		}
+
+		g_strfreev(f);
+		f = NULL;
+		if_err_create_goto(err_internal, CCL_EX_ERROR, !ok, CCL_EX_FAIL,
+			error_handler, "%s:%u: invalid record.", filename, l + 1);
+	}
+
+	if_err_create_goto(err_internal, CCL_EX_ERROR, rs->source->len == 0,
+		CCL_EX_FAIL, error_handler, "%s: no program sources.", filename);
+
+	g_strfreev(lines);
+	g_free(contents);
+	return rs;
+
+error_handler:
+	/* If we got here there was an error, verify that it is so. */
+	g_assert(err_internal != NULL);
+	g_propagate_error(err, err_internal);
+	if (f) g_strfreev(f);
+	if (lines) g_strfreev(lines);
+	if (contents) g_free(contents);
+	replay_stream_free(rs);
+	return NULL;
+}
+
+/* Add the events of the given commands to a wait list. */
+static void replay_wait_list(CCLEventWaitList* ewl, GArray* waits,
+	CCLEvent** evts) {
+
+	for (guint i = 0; i < waits->len; ++i) {
+		CCLEvent* evt = evts[g_array_index(waits, guint, i)];
+		if (evt) ccl_event_wait_list_add(ewl, evt, NULL);
+	}
+}
+
+/* Replay a command stream once. */
+static gboolean replay_run(ReplayStream* rs, CCLProgram* prg,
+	CCLQueue** queues, void** mems, CCLEvent** evts, void* host,
+	GError** err) {
+
+	CCLEventWaitList ewl = NULL;
+	CCLKernel* krnl;
+	GError* err_internal = NULL;
+
+	memset(evts, 0, rs->num_ids * sizeof(CCLEvent*));
+
+	for (guint i = 0; i < rs->cmds->len; ++i) {
+
+		ReplayCmd* c = &g_array_index(rs->cmds, ReplayCmd, i);
+		ReplayMem* m = ((c->kind == 'R') || (c->kind == 'W'))
+			? &g_array_index(rs->mems, ReplayMem, c->mem) : NULL;
+
+		if (c->waits) replay_wait_list(&ewl, c->waits, evts);
+
+		switch (c->kind) {
+
+			case 'A':
+				krnl = ccl_program_get_kernel(prg, c->kernel, &err_internal);
+				if_err_goto(err_internal, error_handler);
+				if (c->arg_kind == 'm')
+					ccl_kernel_set_arg(krnl, c->index, mems[c->mem]);
+				else if (c->arg_kind == 'p')
+					ccl_kernel_set_arg(krnl, c->index,
+						ccl_arg_full(c->value, c->size));
+				else
+					ccl_kernel_set_arg(krnl, c->index,
+						ccl_arg_local(c->size, cl_uchar));
+				break;
+
+			case 'K':
+				krnl = ccl_program_get_kernel(prg, c->kernel, &err_internal);
+				if_err_goto(err_internal, error_handler);
+				evts[c->id] = ccl_kernel_enqueue_ndrange(krnl,
+					queues[c->queue], c->dims, NULL, c->gws,
+					c->has_lws ? c->lws : NULL, &ewl, &err_internal);
+				if_err_goto(err_internal, error_handler);
+				ccl_event_set_name(evts[c->id], c->kernel);
+				break;
+
+			case 'R':
+				if (m->is_image)
+					evts[c->id] = ccl_image_enqueue_read(mems[c->mem],
+						queues[c->queue], c->blocking, c->origin, c->region,
+						0, 0, host, &ewl, &err_internal);
+				else
+					evts[c->id] = ccl_buffer_enqueue_read(mems[c->mem],
+						queues[c->queue], c->blocking, c->origin[0],
+						c->region[0], host, &ewl, &err_internal);
+				if_err_goto(err_internal, error_handler);
+				break;
+
+			case 'W':
+				if (m->is_image)
+					evts[c->id] = ccl_image_enqueue_write(mems[c->mem],
+						queues[c->queue], c->blocking, c->origin, c->region,
+						0, 0, host, &ewl, &err_internal);
+				else
+					evts[c->id] = ccl_buffer_enqueue_write(mems[c->mem],
+						queues[c->queue], c->blocking, c->origin[0],
+						c->region[0], host, &ewl, &err_internal);
+				if_err_goto(err_internal, error_handler);
+				break;
+
+			case 'S':
+				if (c->sync == 'Q')
+					ccl_queue_finish(queues[c->queue], &err_internal);
+				else if (ewl != NULL)
+					ccl_event_wait(&ewl, &err_internal);
+				if_err_goto(err_internal, error_handler);
+				break;
+		}
+	}
+
+	/* Wait for all queues. */
+	for (guint q = 0; q < rs->queues->len; ++q) {
+		ccl_queue_finish(queues[q], &err_internal);
+		if_err_goto(err_internal, error_handler);
+	}
+
+	return TRUE;
+
+error_handler:
+	/* If we got here there was an error, verify that it is so. */
+	g_assert(err_internal != NULL);
+	g_propagate_error(err, err_internal);
+	if (ewl) ccl_event_wait_list_clear(&ewl);
+	return FALSE;
+}
+
+/**
+ * Command stream replay main function.
+ *
+ * @param[in] argc Number of command line arguments.
+ * @param[in] argv Command line arguments.
+ * @return #CCL_EX_SUCCESS if program returns with no error, or
+ * #CCL_EX_FAIL otherwise.
+ * */
+int main(int argc, char *argv[]) {
+
+	/* Function and program return status. */
+	int status;
+	/* Error management. */
+	GError *err = NULL;
+	/* Command line options context. */
+	GOptionContext* opt_ctx = NULL;
+	/* Captured command stream. */
+	ReplayStream* rs = NULL;
+	/* Device requirements. */
+	CCLExDevReqs dev_reqs = { FALSE, FALSE, 0, CCL_EX_WORKLOAD_COMPUTE,
+		NULL };
+	/* cf4ocl wrappers. */
+	CCLContext* ctx = NULL;
+	CCLDevice* dev = NULL;
+	CCLProgram* prg = NULL;
+	CCLQueue** queues = NULL;
+	void** mems = NULL;
+	CCLEvent** evts = NULL;
+	/* Profiler object. */
+	CCLProf* prof = NULL;
+	/* Device name. */
+	char* dev_name;
+	/* Scratch host memory for transfers. */
+	void* host = NULL;
+	/* Duration of each replay. */
+	gint64 t0;
+
+	/* Parse command line options. */
+	opt_ctx = g_option_context_new ("FILE - " PROG_DESCRIPTION);
+	g_option_context_add_main_entries(opt_ctx, entries, NULL);
+	g_option_context_parse(opt_ctx, &argc, &argv, &err);
+	if_err_goto(err, error_handler);
+
+	/* If version was requested, output version and exit. */
+	if (version) {
+		ccl_ex_version_print("cmd_replay");
+		exit(0);
+	}
+
+	if_err_create_goto(err, CCL_EX_ERROR, (argc != 2) || (reps < 1),
+		CCL_EX_FAIL, error_handler,
+		"A capture file and a positive number of replays must be given.");
+
+	/* Load command stream. */
+	rs = replay_stream_load(argv[1], &err);
+	if_err_goto(err, error_handler);
+
+	/* Create context and build program. */
+	ctx = ccl_ex_context_new(device, &dev_reqs, &err);
+	if_err_goto(err, error_handler);
+	dev = ccl_context_get_device(ctx, 0, &err);
+	if_err_goto(err, error_handler);
+	dev_name = ccl_device_get_info_array(dev, CL_DEVICE_NAME, char, &err);
+	if_err_goto(err, error_handler);
+
+	prg = ccl_program_new_from_source(ctx, rs->source->str, &err);
+	if_err_goto(err, error_handler);
+	ccl_program_build(prg, rs->options, &err);
+	if_err_goto(err, error_handler);
+
+	/* Create queues, always with profiling. */
+	queues = g_new0(CCLQueue*, rs->queues->len);
+	for (guint q = 0; q < rs->queues->len; ++q) {
+		queues[q] = ccl_queue_new(ctx, dev, CL_QUEUE_PROFILING_ENABLE
+			| g_array_index(rs->queues, cl_command_queue_properties, q),
+			&err);
+		if_err_goto(err, error_handler);
+	}
+
+	/* Create synthetic buffers and images, without host pointers. */
+	mems = g_new0(void*, rs->mems->len);
+	for (guint i = 0; i < rs->mems->len; ++i) {
+		ReplayMem* m = &g_array_index(rs->mems, ReplayMem, i);
+		cl_mem_flags flags =
+			m->flags & ~(CL_MEM_USE_HOST_PTR | CL_MEM_COPY_HOST_PTR);
+		if (m->is_image)
+			mems[i] = ccl_image_new(ctx, flags, &m->format, NULL, &err,
+				"image_type", (cl_mem_object_type) CL_MEM_OBJECT_IMAGE2D,
+				"image_width", m->width,
+				"image_height", m->height,
+				NULL);
+		else
+			mems[i] = ccl_buffer_new(ctx, flags, m->size, NULL, &err);
+		if_err_goto(err, error_handler);
+	}
+
+	evts = g_new0(CCLEvent*, MAX(rs->num_ids, 1));
+	host = g_malloc0(MAX(rs->max_bytes, 1));
+
+	g_printf("\n   ========================== Command stream replay ========================\n\n");
+	g_printf("     Capture file      : %s\n", argv[1]);
+	g_printf("     Device            : %s\n", dev_name);
+	g_printf("     Queues / memobjs  : %u / %u\n",
+		rs->queues->len, rs->mems->len);
+	g_printf("     Commands          : %u (%d replays)\n\n",
+		rs->num_ids, reps);
+
+	/* Replay stream. */
+	prof = ccl_prof_new();
+	ccl_prof_start(prof);
+	for (int r = 0; r < reps; ++r) {
+		t0 = g_get_monotonic_time();
+		replay_run(rs, prg, queues, mems, evts, host, &err);
+		if_err_goto(err, error_handler);
+		g_printf("     Replay %-4d       : %es\n", r + 1,
+			(g_get_monotonic_time() - t0) * 1e-6);
+	}
+	ccl_prof_stop(prof);
+
+	/* Device-only timings. */
+	for (guint q = 0; q < rs->queues->len; ++q) {
+		gchar* qname = g_strdup_printf("Q%u", q);
+		ccl_prof_add_queue(prof, qname, queues[q]);
+		g_free(qname);
+	}
+	ccl_prof_calc(prof, &err);
+	if_err_goto(err, error_handler);
+	ccl_prof_print_summary(prof);
+
+	/* If we get here, everything went Ok. */
+	status = CCL_EX_SUCCESS;
+	g_assert(err == NULL);
+	goto clean_all;
+
+error_handler:
+	/* Handle error. */
+	g_assert(err != NULL);
+	g_fprintf(stderr, "Error: %s\n", err->message);
+	status = err->code;
+	g_error_free(err);
+
+clean_all:
+
+	/* Release wrappers and host memory. */
+	if (prof) ccl_prof_destroy(prof);
+	if (mems) {
+		for (guint i = 0; i < rs->mems->len; ++i) {
+			if (mems[i] == NULL) continue;
+			if (g_array_index(rs->mems, ReplayMem, i).is_image)
+				ccl_image_destroy(mems[i]);
+			else
+				ccl_buffer_destroy(mems[i]);
+		}
+		g_free(mems);
+	}
+	if (queues) {
+		for (guint q = 0; q < rs->queues->len; ++q)
+			if (queues[q]) ccl_queue_destroy(queues[q]);
+		g_free(queues);
+	}
+	g_free(evts);
+	g_free(host);
+	if (prg) ccl_program_destroy(prg);
+	if (ctx) ccl_context_destroy(ctx);
+	if (rs) replay_stream_free(rs);
+
+	/* Free command line options context and variables. */
+	if (opt_ctx) g_option_context_free(opt_ctx);
+	if (device) g_free(device);
+
+	/* Check all wrappers have been destroyed. */
+	g_assert(ccl_wrapper_memcheck());
+
+	/* Return status. */
+	return status;
+
+}
@@ -0,0 +1,202 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Header library for a lock-free single-producer/single-consumer ring
+ * of pointers. Producer and consumer indexes live in separate cache
+ * lines. A side which cannot proceed spins for a while and then sleeps
+ * on a futex (Linux, when compiled with `_GNU_SOURCE` or
+ * `_DEFAULT_SOURCE`) or yields the processor (elsewhere). The other
+ * side only makes a wake-up system call if a sleeper is flagged.
+ *
+ * Requires GCC or Clang (`__atomic` builtins). Rings should be declared
+ * statically or on the stack, so that cache line alignment holds.
+ */
+
+#ifndef _SPSC_RING_H_
+#define _SPSC_RING_H_
+
+#include <stddef.h>
+#include <sched.h>
+
+#if defined(__linux__) && (defined(_GNU_SOURCE) || defined(_DEFAULT_SOURCE))
+	#define SPSC_RING_FUTEX
+	#include <unistd.h>
+	#include <sys/syscall.h>
+	#include <linux/futex.h>
+#endif
+
+/** Cache line size assumed for padding. */
+#define SPSC_RING_CACHE_LINE 64
+
+/** Ring capacity (must be a power of two). */
+#define SPSC_RING_CAPACITY 64
+
+/** Maximum and minimum number of spins before sleeping. The spin limit
+ * of each side adapts between these: it doubles when spinning succeeds
+ * and halves when the side has to sleep anyway. */
+#define SPSC_RING_SPINS_MAX 16384
+#define SPSC_RING_SPINS_MIN 16
+
+/** Processor hint for spin loops. */
+#if defined(__x86_64__) || defined(__i386__)
+	#define SPSC_RING_RELAX() __builtin_ia32_pause()
+#else
+	#define SPSC_RING_RELAX() __atomic_signal_fence(__ATOMIC_SEQ_CST)
+#endif
+
+/**
+ * The ring object.
+ * */
+typedef struct {
+
+	/* Consumer side: read index, "consumer is sleeping" flag and spin
+	 * limit. */
+	unsigned int head __attribute__((aligned(SPSC_RING_CACHE_LINE)));
+	int cons_sleep;
+	int cons_spins;
+
+	/* Producer side: write index, "producer is sleeping" flag and spin
+	 * limit. */
+	unsigned int tail __attribute__((aligned(SPSC_RING_CACHE_LINE)));
+	int prod_sleep;
+	int prod_spins;
+
+	/* Slots. */
+	void * slots[SPSC_RING_CAPACITY]
+		__attribute__((aligned(SPSC_RING_CACHE_LINE)));
+
+} spsc_ring_t;
+
+/* Sleep while `*addr == val`. */
+static inline void spsc_ring_sleep(unsigned int * addr, unsigned int val) {
+#ifdef SPSC_RING_FUTEX
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+#else
+	(void) addr; (void) val;
+	sched_yield();
+#endif
+}
+
+/* Wake up a thread sleeping on `addr`. */
+static inline void spsc_ring_wake(unsigned int * addr) {
+#ifdef SPSC_RING_FUTEX
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#else
+	(void) addr;
+#endif
+}
+
+/* Wait until `*idx` differs from `val`, spinning first and then
+ * sleeping with `*sleep_flag` set. Returns the new value of `*idx`. */
+static inline unsigned int spsc_ring_wait(unsigned int * idx,
+	unsigned int val, int * sleep_flag, int * spins) {
+
+	unsigned int cur;
+	int i;
+
+	/* Spin. */
+	for (i = 0; i < *spins; i++) {
+		cur = __atomic_load_n(idx, __ATOMIC_ACQUIRE);
+		if (cur != val) {
+			if (*spins < SPSC_RING_SPINS_MAX) *spins *= 2;
+			return cur;
+		}
+		SPSC_RING_RELAX();
+	}
+	if (*spins > SPSC_RING_SPINS_MIN) *spins /= 2;
+
+	/* Sleep. The flag store and index load are sequentially consistent
+	 * so that they can't be reordered with the other side's index store
+	 * and flag load. */
+	for (;;) {
+		__atomic_store_n(sleep_flag, 1, __ATOMIC_SEQ_CST);
+		cur = __atomic_load_n(idx, __ATOMIC_SEQ_CST);
+		if (cur != val) break;
+		spsc_ring_sleep(idx, val);
+	}
+	__atomic_store_n(sleep_flag, 0, __ATOMIC_RELAXED);
+	return cur;
+}
+
+/* Publish a new value of `*idx`, waking up the other side if it sleeps. */
+static inline void spsc_ring_publish(unsigned int * idx, unsigned int val,
+	int * sleep_flag) {
+
+	__atomic_store_n(idx, val, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(sleep_flag, __ATOMIC_SEQ_CST))
+		spsc_ring_wake(idx);
+}
+
+/**
+ * Initialize ring.
+ * */
+static inline void spsc_ring_init(spsc_ring_t * r) {
+	r->head = 0;
+	r->tail = 0;
+	r->cons_sleep = 0;
+	r->prod_sleep = 0;
+	r->cons_spins = SPSC_RING_SPINS_MAX;
+	r->prod_spins = SPSC_RING_SPINS_MAX;
+}
+
+/**
+ * Destroy ring (nothing to release, for symmetry with cp_sem.h).
+ * */
+static inline void spsc_ring_destroy(spsc_ring_t * r) {
+	(void) r;
+}
+
+/**
+ * Push item into ring (producer only), waiting if ring is full.
+ * */
+static inline void spsc_ring_push(spsc_ring_t * r, void * item) {
+
+	unsigned int tail = r->tail;
+	unsigned int head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+	/* Wait for a free slot. */
+	while (tail - head >= SPSC_RING_CAPACITY)
+		head = spsc_ring_wait(
+			&r->head, head, &r->prod_sleep, &r->prod_spins);
+
+	r->slots[tail & (SPSC_RING_CAPACITY - 1)] = item;
+	spsc_ring_publish(&r->tail, tail + 1, &r->cons_sleep);
+}
+
+/**
+ * Pop item from ring (consumer only), waiting if ring is empty.
+ * */
+static inline void * spsc_ring_pop(spsc_ring_t * r) {
+
+	unsigned int head = r->head;
+	unsigned int tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+	void * item;
+
+	/* Wait for an item. */
+	while (tail == head)
+		tail = spsc_ring_wait(
+			&r->tail, tail, &r->cons_sleep, &r->cons_spins);
+
+	item = r->slots[head & (SPSC_RING_CAPACITY - 1)];
+	spsc_ring_publish(&r->head, head + 1, &r->prod_sleep);
+	return item;
+}
+
+#endif
@@ -0,0 +1,201 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Tests for the command line pair parser, the selection of 64-bit
+ * kernel indexes and soak mode.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#include <string.h>
+#include "examples_common.h"
+#include "examples_soak.h"
+
+/* Parsed pairs. */
+static int int_pair[2];
+static size_t size_pair[2];
+
+/* Parse a pair into an int array. */
+static gboolean parse_int(const gchar *option_name, const gchar *value,
+	gpointer data, GError **err) {
+	ccl_ex_parse_pairs(value, int_pair, option_name, data, err);
+}
+
+/* Parse a pair into a size_t array. */
+static gboolean parse_size(const gchar *option_name, const gchar *value,
+	gpointer data, GError **err) {
+	ccl_ex_parse_pairs(value, size_pair, option_name, data, err);
+}
+
+/* Parse a pair with the given parser, checking success and error. */
+static gboolean parse(GOptionArgFunc parser, const gchar* value) {
+
+	GError* err = NULL;
+	gboolean ok;
+
+	ok = parser("--test", value, NULL, &err);
+	g_assert(ok == (err == NULL));
+	g_clear_error(&err);
+	return ok;
+}
+
+/* Test parsing pairs into int arrays. */
+static void parse_int_test() {
+
+	g_assert(parse(parse_int, "3,4"));
+	g_assert_cmpint(int_pair[0], ==, 3);
+	g_assert_cmpint(int_pair[1], ==, 4);
+
+	g_assert(parse(parse_int, "-1,4"));
+	g_assert_cmpint(int_pair[0], ==, -1);
+
+	g_assert(parse(parse_int, "2147483647,-2147483648"));
+	g_assert_cmpint(int_pair[0], ==, G_MAXINT32);
+	g_assert_cmpint(int_pair[1], ==, G_MININT32);
+
+	/* Beyond the 32-bit limits. */
+	g_assert(!parse(parse_int, "2147483648,1"));
+	g_assert(!parse(parse_int, "1,-2147483649"));
+
+	/* Malformed. */
+	g_assert(!parse(parse_int, "3"));
+	g_assert(!parse(parse_int, "a,b"));
+}
+
+/* Test parsing pairs into size_t arrays. */
+static void parse_size_test() {
+
+	g_assert(parse(parse_size, "0,4"));
+	g_assert_cmpuint(size_pair[0], ==, 0);
+	g_assert_cmpuint(size_pair[1], ==, 4);
+
+	/* Negative values are rejected. */
+	g_assert(!parse(parse_size, "-1,4"));
+	g_assert(!parse(parse_size, "4,-1"));
+	g_assert(!parse(parse_size, "-4294967296,4"));
+
+	/* Beyond the 32-bit limits, if size_t allows it. */
+	if (sizeof(size_t) > 4) {
+		g_assert(parse(parse_size, "4294967296,65536"));
+		g_assert_cmpuint(size_pair[0], ==, G_GUINT64_CONSTANT(4294967296));
+		g_assert_cmpuint(size_pair[1], ==, 65536);
+	} else {
+		g_assert(!parse(parse_size, "4294967296,65536"));
+	}
+}
+
+/* Test selection of 64-bit kernel indexes. */
+static void idx64_test() {
+
+	gchar* opts;
+
+	/* Small buffers and buffers at the limit use 32-bit indexes. */
+	opts = ccl_ex_compiler_opts_get(NULL, 1024);
+	g_assert_cmpstr(opts, ==, "");
+	g_free(opts);
+
+	opts = ccl_ex_compiler_opts_get("-D FOO", 1024);
+	g_assert_cmpstr(opts, ==, "-D FOO");
+	g_free(opts);
+
+	if (sizeof(size_t) > 4) {
+
+		opts = ccl_ex_compiler_opts_get(NULL,
+			(size_t) CCL_EX_IDX32_MAX_BYTES);
+		g_assert(strstr(opts, "IDX64") == NULL);
+		g_free(opts);
+
+		/* Larger buffers use 64-bit indexes. */
+		opts = ccl_ex_compiler_opts_get(NULL,
+			(size_t) CCL_EX_IDX32_MAX_BYTES + 1);
+		g_assert(strstr(opts, "-D IDX64") != NULL);
+		g_free(opts);
+
+		opts = ccl_ex_compiler_opts_get("-D FOO",
+			(size_t) CCL_EX_IDX32_MAX_BYTES * 2);
+		g_assert(strstr(opts, "-D FOO") != NULL);
+		g_assert(strstr(opts, "-D IDX64") != NULL);
+		g_free(opts);
+	}
+}
+
+/* Test that a clean soak run, with steady latency and no growth, is
+ * neither flagged as degraded nor as growing. */
+static void soak_flat_test() {
+
+	GError* err = NULL;
+	CCLExSoak* soak;
+	FILE* out = tmpfile();
+	char log[8192];
+	size_t len;
+	guint64 i = 0;
+	gboolean more = TRUE;
+
+	g_assert(out != NULL);
+
+	/* Several short windows, to go beyond CCL_EX_SOAK_GROWTH. */
+	soak = ccl_ex_soak_new("0.5:0.05", "units", out, &err);
+	g_assert_no_error(err);
+
+	/* Iterations with the same latency pattern in every window, whose
+	 * events (none here) are released as in the examples. */
+	while (more) {
+		g_usleep(1000);
+		i++;
+		more = ccl_ex_soak_iter(soak, 1e-3 * (1 + 0.01 * (i % 3)), 1);
+		ccl_ex_soak_gc(soak);
+	}
+
+	g_assert_cmpuint(ccl_ex_soak_iters(soak), ==, i);
+	ccl_ex_soak_summary_print(soak, out);
+	ccl_ex_soak_destroy(soak);
+
+	/* Read back the log and the summary. */
+	rewind(out);
+	len = fread(log, 1, sizeof(log) - 1, out);
+	log[len] = '\0';
+	fclose(out);
+
+	g_assert(strstr(log, "DEGRADED") == NULL);
+	g_assert(strstr(log, "GROWING") == NULL);
+	g_assert(strstr(log, "Degraded windows       : 0\n") != NULL);
+	g_assert(strstr(log, "Growing windows        : 0\n") != NULL);
+}
+
+/**
+ * Main function.
+ *
+ * @param[in] argc Number of command line arguments.
+ * @param[in] argv Vector of command line arguments.
+ * @return Result of running the tests.
+ * */
+int main(int argc, char** argv) {
+
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/common/parse-pairs/int", parse_int_test);
+	g_test_add_func("/common/parse-pairs/size", parse_size_test);
+	g_test_add_func("/common/idx64", idx64_test);
+	g_test_add_func("/common/soak/flat", soak_flat_test);
+
+	return g_test_run();
+}
@@ -0,0 +1,309 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Tests for matrix sizes and indexes just beyond the 32-bit limits:
+ * matrix files whose data exceeds 4 GiB, the selection of 64-bit kernel
+ * indexes for such matrices, and the 64-bit index variant of the
+ * multiplication kernel, checked against the host. The kernel test is
+ * skipped if no OpenCL device is available.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#include <glib/gstdio.h>
+#include "matmult.h"
+
+#ifdef G_OS_UNIX
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+/* Matrix whose data is just beyond 4 GiB, 32768 x 32769 ints. */
+#define BIG_COLS 32768
+#define BIG_ROWS 32769
+
+/* Executable name, for locating the kernels. */
+static char* exec_name;
+
+/* Write a raw matrix file with the given header dimensions and `n`
+ * elements of data. */
+static gchar* raw_file_write(const gchar* dir, guint32 cols,
+	guint32 rows, const cl_int* data, size_t n) {
+
+	MatmultRawHeader hdr;
+	gchar* filename = g_build_filename(dir, "raw.mat", NULL);
+	gchar* contents = g_malloc(sizeof(hdr) + n * sizeof(cl_int));
+	GError* err = NULL;
+
+	memcpy(hdr.magic, MATMULT_RAW_MAGIC, sizeof(hdr.magic));
+	hdr.version = GUINT32_TO_LE(1);
+	hdr.offset = GUINT32_TO_LE(sizeof(hdr));
+	hdr.cols = GUINT32_TO_LE(cols);
+	hdr.rows = GUINT32_TO_LE(rows);
+	memcpy(contents, &hdr, sizeof(hdr));
+	memcpy(contents + sizeof(hdr), data, n * sizeof(cl_int));
+
+	g_file_set_contents(filename, contents, sizeof(hdr) + n * sizeof(cl_int),
+		&err);
+	g_assert_no_error(err);
+	g_free(contents);
+	return filename;
+}
+
+/* Test that files with dimensions whose size exceeds 2^32 bytes are
+ * not taken as complete because the size overflows. */
+static void mfile_truncated_test() {
+
+	cl_int data[4] = { 1, -2, 3, G_MAXINT32 };
+	gchar* dir;
+	gchar* filename;
+	MatmultMFile* mf;
+	GError* err = NULL;
+	int dims[2];
+
+	dir = g_dir_make_tmp("test_matmult_XXXXXX", &err);
+	g_assert_no_error(err);
+
+	/* Complete 2 x 2 matrix. */
+	filename = raw_file_write(dir, 2, 2, data, 4);
+	mf = matmult_mfile_open(filename, &err);
+	g_assert_no_error(err);
+	matmult_mfile_dims_get(mf, dims);
+	g_assert_cmpint(dims[0], ==, 2);
+	g_assert_cmpint(dims[1], ==, 2);
+	g_assert(memcmp(matmult_mfile_data(mf), data, sizeof(data)) == 0);
+	matmult_mfile_close(mf);
+	g_unlink(filename);
+	g_free(filename);
+
+	/* 65536 x 65537 ints, whose size in 32 bits would be 256 KiB,
+	 * with only 4 elements. */
+	filename = raw_file_write(dir, 65536, 65537, data, 4);
+	mf = matmult_mfile_open(filename, &err);
+	g_assert(mf == NULL);
+	g_assert_error(err, CCL_EX_ERROR, CCL_EX_FAIL);
+	g_assert(strstr(err->message, "truncated") != NULL);
+	g_clear_error(&err);
+	g_unlink(filename);
+	g_free(filename);
+
+	g_rmdir(dir);
+	g_free(dir);
+}
+
+/* Test creating a sparse matrix file whose data is just beyond 4 GiB,
+ * writing elements whose byte offsets exceed 2^32, and that 64-bit
+ * kernel indexes are selected for it but not for a matrix of exactly
+ * 4 GiB. */
+static void mfile_sparse_test() {
+
+#ifdef G_OS_UNIX
+
+	gchar* dir;
+	gchar* filename;
+	MatmultMFile* mf;
+	GError* err = NULL;
+	GStatBuf st;
+	gchar* opts;
+	size_t last = (size_t) BIG_COLS * (BIG_ROWS - 1) + (BIG_COLS - 1);
+	size_t bytes = (size_t) BIG_COLS * BIG_ROWS * sizeof(cl_int);
+	cl_int val = 0;
+	int fd;
+
+	if (sizeof(size_t) <= 4) {
+		g_test_message("size_t is 32-bit, skipping.");
+		return;
+	}
+	g_assert_cmpuint(bytes, ==, G_GUINT64_CONSTANT(4295098368));
+	g_assert_cmpuint(last * sizeof(cl_int), >, G_MAXUINT32);
+
+	/* Kernel index width. */
+	opts = ccl_ex_compiler_opts_get(NULL,
+		(size_t) BIG_COLS * BIG_COLS * sizeof(cl_int));
+	g_assert(strstr(opts, "IDX64") == NULL);
+	g_free(opts);
+	opts = ccl_ex_compiler_opts_get(NULL, bytes);
+	g_assert(strstr(opts, "-D IDX64") != NULL);
+	g_free(opts);
+
+	dir = g_dir_make_tmp("test_matmult_XXXXXX", &err);
+	g_assert_no_error(err);
+	filename = g_build_filename(dir, "sparse.mat", NULL);
+
+	/* Only the pages which are written are allocated. */
+	mf = matmult_mfile_create(filename, BIG_COLS, BIG_ROWS, &err);
+	if (!mf) {
+		g_test_message("%s Skipping.", err->message);
+		g_clear_error(&err);
+	} else {
+		matmult_mfile_data(mf)[0] = 7;
+		matmult_mfile_data(mf)[last] = 42;
+		matmult_mfile_close(mf);
+
+		/* Check the file size and the last element. */
+		g_assert(g_stat(filename, &st) == 0);
+		g_assert_cmpuint((size_t) st.st_size, >, bytes);
+		fd = open(filename, O_RDONLY);
+		g_assert(fd >= 0);
+		g_assert((size_t) pread(fd, &val, sizeof(cl_int),
+			(off_t) (st.st_size - bytes + last * sizeof(cl_int)))
+				== sizeof(cl_int));
+		close(fd);
+		g_assert_cmpint(val, ==, 42);
+	}
+
+	g_unlink(filename);
+	g_free(filename);
+	g_rmdir(dir);
+	g_free(dir);
+
+#else
+
+	g_test_message("Matrix files aren't mapped, skipping.");
+
+#endif
+}
+
+/* Test the index math of the 64-bit index variant of kernel 0 on
+ * small, mostly zero, matrices against the host. */
+static void idx64_kernel_test() {
+
+	CCLExDevReqs reqs = { FALSE, FALSE, 0, CCL_EX_WORKLOAD_COMPUTE,
+		"first" };
+	CCLContext* ctx = NULL;
+	CCLQueue* cq = NULL;
+	CCLProgram* prg = NULL;
+	CCLKernel* krnl;
+	CCLDevice* dev;
+	CCLBuffer* bufs[3] = { NULL, NULL, NULL };
+	gchar* paths[2];
+	gchar* opts;
+	GError* err = NULL;
+	GRand* rng;
+	int ad[2] = { 53, 37 }, bd[2] = { 29, 53 };
+	cl_int *A, *B, *C, *C_dev;
+	size_t gws[2] = { bd[0], ad[1] };
+
+	ctx = ccl_ex_context_new(NULL, &reqs, &err);
+	if (!ctx) {
+		g_test_message("No OpenCL device available, skipping.");
+		g_clear_error(&err);
+		return;
+	}
+	dev = ccl_context_get_device(ctx, 0, &err);
+	g_assert_no_error(err);
+	cq = ccl_queue_new(ctx, dev, 0, &err);
+	g_assert_no_error(err);
+
+	/* Build with the options given to matrices beyond 4 GiB. */
+	paths[0] = ccl_ex_kernelpath_get(CCL_EX_INSTR_KERNEL_FILE, exec_name);
+	paths[1] = ccl_ex_kernelpath_get("matmult.cl", exec_name);
+	prg = ccl_program_new_from_source_files(ctx, 2,
+		(const char**) paths, &err);
+	g_assert_no_error(err);
+	opts = ccl_ex_compiler_opts_get(NULL,
+		(size_t) CCL_EX_IDX32_MAX_BYTES + 1);
+	ccl_program_build(prg, opts, &err);
+	g_assert_no_error(err);
+	krnl = ccl_program_get_kernel(prg, "matmult0", &err);
+	g_assert_no_error(err);
+
+	/* Mostly zero matrices, with a few extreme values. */
+	rng = g_rand_new_with_seed(0);
+	A = g_new(cl_int, (size_t) ad[0] * ad[1]);
+	B = g_new(cl_int, (size_t) bd[0] * bd[1]);
+	C = g_new(cl_int, (size_t) bd[0] * ad[1]);
+	C_dev = g_new(cl_int, (size_t) bd[0] * ad[1]);
+	for (size_t i = 0; i < (size_t) ad[0] * ad[1]; ++i)
+		A[i] = (g_rand_int_range(rng, 0, 8) == 0)
+			? g_rand_int_range(rng, -100, 100) : 0;
+	for (size_t i = 0; i < (size_t) bd[0] * bd[1]; ++i)
+		B[i] = (g_rand_int_range(rng, 0, 8) == 0)
+			? ((i % 7 == 0) ? G_MAXINT32 : g_rand_int_range(rng, -100, 100))
+			: 0;
+	g_rand_free(rng);
+
+	/* Host reference, wrapping around modulo 2^32 as the kernel. */
+	for (int row = 0; row < ad[1]; ++row) {
+		for (int col = 0; col < bd[0]; ++col) {
+			guint32 sum = 0;
+			for (int i = 0; i < ad[0]; ++i)
+				sum += (guint32) A[(size_t) row * ad[0] + i]
+					* (guint32) B[(size_t) i * bd[0] + col];
+			C[(size_t) row * bd[0] + col] = (int) sum;
+		}
+	}
+
+	bufs[0] = ccl_buffer_new(ctx, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+		(size_t) ad[0] * ad[1] * sizeof(cl_int), A, &err);
+	g_assert_no_error(err);
+	bufs[1] = ccl_buffer_new(ctx, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+		(size_t) bd[0] * bd[1] * sizeof(cl_int), B, &err);
+	g_assert_no_error(err);
+	bufs[2] = ccl_buffer_new(ctx, CL_MEM_WRITE_ONLY,
+		(size_t) bd[0] * ad[1] * sizeof(cl_int), NULL, &err);
+	g_assert_no_error(err);
+
+	ccl_kernel_set_args_and_enqueue_ndrange(krnl, cq, 2, NULL, gws, NULL,
+		NULL, &err, bufs[0], bufs[1], bufs[2],
+		ccl_arg_full(ad, sizeof(cl_int2)), ccl_arg_full(bd, sizeof(cl_int2)),
+		NULL);
+	g_assert_no_error(err);
+	ccl_buffer_enqueue_read(bufs[2], cq, CL_TRUE, 0,
+		(size_t) bd[0] * ad[1] * sizeof(cl_int), C_dev, NULL, &err);
+	g_assert_no_error(err);
+
+	for (size_t i = 0; i < (size_t) bd[0] * ad[1]; ++i)
+		g_assert_cmpint(C_dev[i], ==, C[i]);
+
+	g_free(A);
+	g_free(B);
+	g_free(C);
+	g_free(C_dev);
+	for (guint k = 0; k < 3; ++k)
+		ccl_buffer_destroy(bufs[k]);
+	g_free(opts);
+	g_free(paths[0]);
+	g_free(paths[1]);
+	ccl_program_destroy(prg);
+	ccl_queue_destroy(cq);
+	ccl_context_destroy(ctx);
+}
+
+/**
+ * Main function.
+ *
+ * @param[in] argc Number of command line arguments.
+ * @param[in] argv Vector of command line arguments.
+ * @return Result of running the tests.
+ * */
+int main(int argc, char** argv) {
+
+	g_test_init(&argc, &argv, NULL);
+	exec_name = argv[0];
+
+	g_test_add_func("/matmult/mfile/truncated", mfile_truncated_test);
+	g_test_add_func("/matmult/mfile/sparse", mfile_sparse_test);
+	g_test_add_func("/matmult/idx64/kernel", idx64_kernel_test);
+
+	return g_test_run();
+}
@@ -0,0 +1,236 @@
+/*
+ * This file is part of cf4ocl-examples.
+ * Copyright (C) 2016 Nuno Fachada
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * */
+
+/**
+ * @file
+ * Tests for the device scan and compaction primitives, checked against
+ * the host. Tests are skipped if no OpenCL device is available.
+ *
+ * @author Nuno Fachada
+ * @date 2016
+ * @copyright [GNU General Public License version 3 (GPLv3)](http://www.gnu.org/licenses/gpl.html)
+ * */
+
+#include <string.h>
+#include "examples_common.h"
+#include "examples_reduce.h"
+
+/* Number of elements, enough for scanning block totals recursively. */
+#define NUM_ELEMS 100003
+
+/* Executable name, for locating the reduction kernels. */
+static char* exec_name;
+
+/* Device, queue and reduction primitives used by the tests. */
+typedef struct {
+	CCLContext* ctx;
+	CCLQueue* cq;
+	CCLExReduce* r;
+	cl_int* in;
+	cl_int* flags;
+	cl_int* out;
+	CCLBuffer* in_dev;
+	CCLBuffer* flags_dev;
+	CCLBuffer* out_dev;
+} ReduceFixture;
+
+/* Create a context with the first device, and random inputs where
+ * positive elements are flagged. */
+static void reduce_setup(ReduceFixture* rf, gconstpointer data) {
+
+	CCLExDevReqs reqs = { FALSE, FALSE, 0, CCL_EX_WORKLOAD_MEMORY,
+		"first" };
+	CCLDevice* dev;
+	GRand* rng;
+	GError* err = NULL;
+	size_t size = NUM_ELEMS * sizeof(cl_int);
+
+	(void) data;
+	memset(rf, 0, sizeof(ReduceFixture));
+
+	rf->ctx = ccl_ex_context_new(NULL, &reqs, &err);
+	if (!rf->ctx) {
+		g_clear_error(&err);
+		return;
+	}
+	dev = ccl_context_get_device(rf->ctx, 0, &err);
+	g_assert_no_error(err);
+	rf->cq = ccl_queue_new(rf->ctx, dev, 0, &err);
+	g_assert_no_error(err);
+	rf->r = ccl_ex_reduce_new(rf->ctx, exec_name, &err);
+	g_assert_no_error(err);
+
+	rng = g_rand_new_with_seed(0);
+	rf->in = g_new(cl_int, NUM_ELEMS);
+	rf->flags = g_new(cl_int, NUM_ELEMS);
+	rf->out = g_new(cl_int, NUM_ELEMS);
+	for (size_t i = 0; i < NUM_ELEMS; ++i) {
+		/* Include extreme values, whose sums wrap around. */
+		rf->in[i] = (i % 1000 == 0) ? G_MAXINT32
+			: (cl_int) g_rand_int_range(rng, -1000, 1000);
+		rf->flags[i] = (rf->in[i] > 0) ? 1 : 0;
+	}
+	g_rand_free(rng);
+
+	rf->in_dev = ccl_buffer_new(rf->ctx,
+		CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, size, rf->in, &err);
+	g_assert_no_error(err);
+	rf->flags_dev = ccl_buffer_new(rf->ctx,
+		CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, size, rf->flags, &err);
+	g_assert_no_error(err);
+	rf->out_dev = ccl_buffer_new(rf->ctx, CL_MEM_READ_WRITE, size, NULL,
+		&err);
+	g_assert_no_error(err);
+}
+
+/* Release fixture. */
+static void reduce_teardown(ReduceFixture* rf, gconstpointer data) {
+
+	(void) data;
+	if (rf->in_dev) ccl_buffer_destroy(rf->in_dev);
+	if (rf->flags_dev) ccl_buffer_destroy(rf->flags_dev);
+	if (rf->out_dev) ccl_buffer_destroy(rf->out_dev);
+	g_free(rf->in);
+	g_free(rf->flags);
+	g_free(rf->out);
+	if (rf->r) ccl_ex_reduce_destroy(rf->r);
+	if (rf->cq) ccl_queue_destroy(rf->cq);
+	if (rf->ctx) ccl_context_destroy(rf->ctx);
+}
+
+/* Read back n elements of the output buffer. */
+static void reduce_read(ReduceFixture* rf, size_t n) {
+
+	GError* err = NULL;
+
+	ccl_buffer_enqueue_read(rf->out_dev, rf->cq, CL_TRUE, 0,
+		n * sizeof(cl_int), rf->out, NULL, &err);
+	g_assert_no_error(err);
+}
+
+/* Check inclusive and exclusive scans, which wrap around modulo 2^32,
+ * against the host. */
+static void scan_test(ReduceFixture* rf, gconstpointer data) {
+
+	GError* err = NULL;
+
+	(void) data;
+	if (!rf->ctx) {
+		g_test_message("No OpenCL device available, skipping.");
+		return;
+	}
+
+	for (int inclusive = 0; inclusive <= 1; ++inclusive) {
+
+		guint32 sum = 0;
+
+		ccl_ex_reduce_scan_int(rf->r, rf->cq, rf->in_dev, rf->out_dev,
+			NUM_ELEMS, inclusive, &err);
+		g_assert_no_error(err);
+		reduce_read(rf, NUM_ELEMS);
+
+		for (size_t i = 0; i < NUM_ELEMS; ++i) {
+			if (inclusive) sum += (guint32) rf->in[i];
+			g_assert_cmpint(rf->out[i], ==, (cl_int) sum);
+			if (!inclusive) sum += (guint32) rf->in[i];
+		}
+	}
+}
+
+/* Check compaction of values and of indexes against the host. */
+static void compact_test(ReduceFixture* rf, gconstpointer data) {
+
+	GError* err = NULL;
+	size_t n_out, j;
+
+	(void) data;
+	if (!rf->ctx) {
+		g_test_message("No OpenCL device available, skipping.");
+		return;
+	}
+
+	/* Values. */
+	ccl_ex_reduce_compact_int(rf->r, rf->cq, rf->in_dev, rf->flags_dev,
+		rf->out_dev, NUM_ELEMS, &n_out, &err);
+	g_assert_no_error(err);
+	reduce_read(rf, n_out);
+	j = 0;
+	for (size_t i = 0; i < NUM_ELEMS; ++i) {
+		if (!rf->flags[i]) continue;
+		g_assert_cmpuint(j, <, n_out);
+		g_assert_cmpint(rf->out[j], ==, rf->in[i]);
+		++j;
+	}
+	g_assert_cmpuint(j, ==, n_out);
+
+	/* Indexes. */
+	ccl_ex_reduce_compact_int(rf->r, rf->cq, NULL, rf->flags_dev,
+		rf->out_dev, NUM_ELEMS, &n_out, &err);
+	g_assert_no_error(err);
+	reduce_read(rf, n_out);
+	j = 0;
+	for (size_t i = 0; i < NUM_ELEMS; ++i) {
+		if (!rf->flags[i]) continue;
+		g_assert_cmpuint(j, <, n_out);
+		g_assert_cmpint(rf->out[j], ==, (cl_int) i);
+		++j;
+	}
+	g_assert_cmpuint(j, ==, n_out);
+}
+
+/* Check flagging of differing elements against the host. */
+static void flag_ne_test(ReduceFixture* rf, gconstpointer data) {
+
+	GError* err = NULL;
+
+	(void) data;
+	if (!rf->ctx) {
+		g_test_message("No OpenCL device available, skipping.");
+		return;
+	}
+
+	ccl_ex_reduce_flag_ne_int(rf->r, rf->cq, rf->in_dev, rf->flags_dev,
+		rf->out_dev, NUM_ELEMS, &err);
+	g_assert_no_error(err);
+	reduce_read(rf, NUM_ELEMS);
+
+	for (size_t i = 0; i < NUM_ELEMS; ++i)
+		g_assert_cmpint(rf->out[i], ==, rf->in[i] != rf->flags[i]);
+}
+
+/**
+ * Main function.
+ *
+ * @param[in] argc Number of command line arguments.
+ * @param[in] argv Vector of command line arguments.
+ * @return Result of running the tests.
+ * */
+int main(int argc, char** argv) {
+
+	g_test_init(&argc, &argv, NULL);
+	exec_name = argv[0];
+
+	g_test_add("/reduce/scan", ReduceFixture, NULL, reduce_setup,
+		scan_test, reduce_teardown);
+	g_test_add("/reduce/compact", ReduceFixture, NULL, reduce_setup,
+		compact_test, reduce_teardown);
+	g_test_add("/reduce/flag-ne", ReduceFixture, NULL, reduce_setup,
+		flag_ne_test, reduce_teardown);
+
+	return g_test_run();
+}